@@ -5,6 +5,10 @@
  */
 
 
+struct mbuf;
+
 int base64_encode(const uint8_t *in, size_t ilen, char *out, size_t *olen);
 int base64_print(struct re_printf *pf, const uint8_t *ptr, size_t len);
 int base64_decode(const char *in, size_t ilen, uint8_t *out, size_t *olen);
+int base64_encode_mbuf(struct mbuf *mb, const uint8_t *in, size_t ilen);
+int base64_decode_mbuf(struct mbuf *mb, const char *in, size_t ilen);
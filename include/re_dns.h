@@ -189,9 +189,24 @@ struct dnsrr *dns_rrlist_find(struct list *rrl, const char *name,
 			      uint16_t type, uint16_t dnsclass, bool recurse);
 
 
+/* DNS Message */
+struct dns_msg;
+
+int  dns_msg_decode(struct dns_msg **msgp, struct mbuf *mb);
+const struct dnshdr *dns_msg_hdr(const struct dns_msg *msg);
+int  dns_msg_question(const struct dns_msg *msg, const char **namep,
+		      uint16_t *typep, uint16_t *dnsclassp);
+uint32_t dns_msg_count(const struct dns_msg *msg, unsigned sect);
+int  dns_msg_rr(const struct dns_msg *msg, unsigned sect, uint32_t i,
+		struct dnsrr *rr);
+int  dns_msg_rrlist(struct list *rrl, struct dns_msg *msg, unsigned sect,
+		    uint32_t max);
+
+
 /* DNS Client */
 struct sa;
 struct dnsc;
+struct dnsc_cache;
 struct dns_query;
 
 /** DNS Client configuration */
@@ -201,6 +216,21 @@ struct dnsc_conf {
 	uint32_t conn_timeout;  /* in [ms] */
 	uint32_t idle_timeout;  /* in [ms] */
 	uint32_t cache_ttl_max; /* in [s] 0 for disabled */
+	uint32_t cache_size;    /* max. entries, 0 for default */
+	bool race;              /* send first query to two servers */
+};
+
+/** DNS Client statistics */
+struct dnsc_stats {
+	uint64_t queries;         /**< Queries from the application */
+	uint64_t wire;            /**< Queries sent to the DNS servers */
+	uint64_t coalesced;       /**< Queries joining an outstanding one */
+	uint64_t cache_hits;      /**< Queries answered from the cache */
+	uint64_t cache_misses;    /**< Cache lookups without an entry */
+	uint64_t cache_negative;  /**< NXDOMAIN/NODATA answers cached */
+	uint64_t cache_evictions; /**< Entries evicted as least recent */
+	uint64_t prefetches;      /**< Hot entries refreshed ahead of expiry */
+	uint64_t races;           /**< Queries raced to two nameservers */
 };
 
 int  dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
@@ -220,6 +250,13 @@ int  dnsc_notify(struct dns_query **qp, struct dnsc *dnsc, const char *name,
 		 dns_query_h *qh, void *arg);
 void dnsc_cache_flush(struct dnsc *dnsc);
 void dnsc_cache_max(struct dnsc *dnsc, uint32_t max);
+int  dnsc_stats_get(const struct dnsc *dnsc, struct dnsc_stats *stats);
+void dnsc_cache_attach(struct dnsc *dnsc, struct dnsc_cache *cache);
+
+
+/* Shared DNS Cache */
+int  dnsc_cache_alloc(struct dnsc_cache **cachep, uint32_t size);
+void dnsc_cache_clear(struct dnsc_cache *cache);
 
 
 /* DNS System functions */
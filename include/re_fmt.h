@@ -100,7 +100,14 @@ int re_sdprintf(char **strp, const char *fmt, ...);
 
 
 /* Regular expressions */
+struct re_regex;
+
 int re_regex(const char *ptr, size_t len, const char *expr, ...);
+int re_regex_compile(struct re_regex **rxp, const char *expr);
+int re_regex_match(const struct re_regex *rx, const char *ptr, size_t len,
+		   ...);
+int re_regex_cached(const char *ptr, size_t len, const char *expr, ...);
+void re_regex_cache_flush(void);
 
 
 /* Character functions */
@@ -7,9 +7,32 @@
 
 struct hash;
 struct pl;
+struct re_printf;
+
+
+/**
+ * Defines the hash key handler of a dynamic hashmap table
+ *
+ * @param le  List element
+ *
+ * @return Hash key the element was added with
+ */
+typedef uint32_t (hash_key_h)(const struct le *le);
+
+/** Hashmap table statistics */
+struct hash_stats {
+	uint32_t bsize;      /**< Bucket size                       */
+	uint32_t count;      /**< Number of elements                */
+	uint32_t used;       /**< Number of non-empty buckets       */
+	uint32_t chain_max;  /**< Length of the longest bucket list */
+	uint32_t resizes;    /**< Number of resizes                 */
+	bool dynamic;        /**< True if the table resizes itself  */
+};
 
 
 int  hash_alloc(struct hash **hp, uint32_t bsize);
+int  hash_alloc_dynamic(struct hash **hp, uint32_t bsize_min,
+			hash_key_h *keyh);
 void hash_append(struct hash *h, uint32_t key, struct le *le, void *data);
 void hash_unlink(struct le *le);
 struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
@@ -21,6 +44,8 @@ uint32_t hash_bsize(const struct hash *h);
 void hash_flush(struct hash *h);
 void hash_clear(struct hash *h);
 uint32_t hash_valid_size(uint32_t size);
+int  hash_stats(const struct hash *h, struct hash_stats *stats);
+int  hash_debug(struct re_printf *pf, const struct hash *h);
 
 
 /* Hash functions */
@@ -32,3 +57,9 @@ uint32_t hash_joaat_pl(const struct pl *pl);
 uint32_t hash_joaat_pl_ci(const struct pl *pl);
 uint32_t hash_fast(const char *k, size_t len);
 uint32_t hash_fast_str(const char *str);
+uint32_t hash_wy(const uint8_t *key, size_t len);
+uint32_t hash_wy_ci(const char *str, size_t len);
+uint32_t hash_wy_str(const char *str);
+uint32_t hash_wy_str_ci(const char *str);
+uint32_t hash_wy_pl(const struct pl *pl);
+uint32_t hash_wy_pl_ci(const struct pl *pl);
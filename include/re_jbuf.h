@@ -5,6 +5,7 @@
  */
 struct jbuf;
 struct rtp_header;
+struct gnack;
 
 /** Jitter buffer statistics */
 struct jbuf_stat {
@@ -28,11 +29,33 @@ enum jbuf_type {
 };
 
 
+/** Jitter buffer video payload format */
+enum jbuf_video {
+	JBUF_VIDEO_OFF = 0,   /**< Packets, no video frames               */
+	JBUF_VIDEO_GENERIC,   /**< Video frames, no keyframe detection    */
+	JBUF_VIDEO_H264,      /**< H.264 video frames (RFC 6184)          */
+	JBUF_VIDEO_H265,      /**< H.265 video frames (RFC 7798)          */
+	JBUF_VIDEO_AV1,       /**< AV1 video frames                       */
+};
+
+/** Video frame in the jitter buffer */
+struct jbuf_frame {
+	uint32_t ts;       /**< RTP timestamp                             */
+	uint16_t seq;      /**< Sequence number of the first packet       */
+	uint16_t n;        /**< Number of packets                         */
+	bool keyframe;     /**< Frame contains a keyframe                 */
+	bool skipped;      /**< Incomplete frames were dropped before it  */
+};
+
+
 int  jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max);
 int  jbuf_set_type(struct jbuf *jb, enum jbuf_type jbtype);
+int  jbuf_set_video(struct jbuf *jb, enum jbuf_video video);
 int  jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem);
 int  jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem);
 int  jbuf_drain(struct jbuf *jb, struct rtp_header *hdr, void **mem);
+int  jbuf_frame(struct jbuf *jb, struct jbuf_frame *frame);
+int  jbuf_nack(struct jbuf *jb, struct gnack *gnackv, uint32_t *n);
 void jbuf_flush(struct jbuf *jb);
 int  jbuf_stats(const struct jbuf *jb, struct jbuf_stat *jstat);
 int  jbuf_debug(struct re_printf *pf, const struct jbuf *jb);
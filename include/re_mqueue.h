@@ -10,3 +10,4 @@ typedef void (mqueue_h)(int id, void *data, void *arg);
 
 int mqueue_alloc(struct mqueue **mqp, mqueue_h *h, void *arg);
 int mqueue_push(struct mqueue *mq, int id, void *data);
+void mqueue_drain(struct mqueue *mq);
@@ -29,6 +29,7 @@ struct rtp_header {
 		uint16_t type;  /**< Defined by profile     */
 		uint16_t len;   /**< Number of 32-bit words */
 	} x;
+	uint64_t arrival;   /**< Arrival time in [us]   */
 };
 
 /** RTCP Packet Types */
@@ -202,14 +203,23 @@ struct rtcp_stats {
 	uint32_t rtt;           /**< Current Round-Trip Time in [us] */
 };
 
+/** RTP header extension element (RFC 8285) */
+struct rtp_ext {
+	uint8_t id;          /**< Extension identifier   */
+	uint8_t len;         /**< Number of data bytes   */
+	uint8_t data[16];    /**< Extension data         */
+};
+
 struct sa;
 struct re_printf;
 struct rtp_sock;
+struct rtcp_twcc;
 
 typedef void (rtp_recv_h)(const struct sa *src, const struct rtp_header *hdr,
 			  struct mbuf *mb, void *arg);
 typedef void (rtcp_recv_h)(const struct sa *src, struct rtcp_msg *msg,
 			   void *arg);
+typedef bool (rtcp_twcc_h)(uint16_t seq, bool recv, int64_t t, void *arg);
 
 /* RTP api */
 int   rtp_alloc(struct rtp_sock **rsp);
@@ -230,6 +240,16 @@ uint32_t rtp_sess_ssrc(const struct rtp_sock *rs);
 const struct sa *rtp_local(const struct rtp_sock *rs);
 int rtp_clear(struct rtp_sock *rs);
 
+/* RTP header extensions */
+int   rtp_ext_encode(struct mbuf *mb, const struct rtp_ext *extv,
+		     size_t extc);
+int   rtp_ext_find(struct rtp_ext *ext, uint8_t id,
+		   const struct rtp_header *hdr, const struct mbuf *mb);
+void  rtp_ext_set_twseq(struct rtp_ext *ext, uint8_t id, uint16_t seq);
+void  rtp_ext_set_abs_time(struct rtp_ext *ext, uint8_t id, uint64_t us);
+uint16_t rtp_ext_twseq(const struct rtp_ext *ext);
+uint32_t rtp_ext_abs_time(const struct rtp_ext *ext);
+
 /* RTCP session api */
 void  rtcp_start(struct rtp_sock *rs, const char *cname,
 		 const struct sa *peer);
@@ -245,6 +265,8 @@ int   rtcp_send_nack(struct rtp_sock *rs, uint16_t fsn, uint16_t blp);
 int   rtcp_send_pli(struct rtp_sock *rs, uint32_t fb_ssrc);
 int   rtcp_send_fir_rfc5104(struct rtp_sock *rs, uint32_t ssrc,
 			    uint8_t fir_seqn);
+int   rtcp_send_twcc(struct rtp_sock *rs, uint32_t ssrc_media,
+		     struct rtcp_twcc *twcc);
 int   rtcp_debug(struct re_printf *pf, const struct rtp_sock *rs);
 void *rtcp_sock(const struct rtp_sock *rs);
 int   rtcp_stats(struct rtp_sock *rs, uint32_t ssrc, struct rtcp_stats *stats);
@@ -258,6 +280,13 @@ const char *rtcp_type_name(enum rtcp_type type);
 const char *rtcp_sdes_name(enum rtcp_sdes_type sdes);
 bool rtp_is_rtcp_packet(const struct mbuf *mb);
 
+/* RTCP Transport-wide congestion control feedback */
+int   rtcp_twcc_alloc(struct rtcp_twcc **twccp, uint16_t size);
+int   rtcp_twcc_add(struct rtcp_twcc *twcc, uint16_t seq, uint64_t arrival);
+uint16_t rtcp_twcc_count(const struct rtcp_twcc *twcc);
+int   rtcp_twcc_encode(struct mbuf *mb, struct rtcp_twcc *twcc);
+int   rtcp_twcc_apply(const struct twcc *msg, rtcp_twcc_h *h, void *arg);
+
 
 static inline bool rtp_pt_is_rtcp(uint8_t pt)
 {
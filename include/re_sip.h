@@ -222,10 +222,12 @@ struct sip_msg {
 	struct pl expires;     /**< Cached Expires header                */
 	struct pl clen;        /**< Cached Content-Length header         */
 	struct hash *hdrht;    /**< Hash-table with all SIP headers      */
+	struct sip_hdrs *hdrs; /**< Flat storage of all SIP headers      */
 	struct mbuf *mb;       /**< Buffer containing the SIP message    */
 	void *sock;            /**< Transport socket                     */
 	uint64_t tag;          /**< Opaque tag                           */
 	enum sip_transp tp;    /**< SIP Transport                        */
+	uint8_t lazy;          /**< Fields pending a lazy decode         */
 	bool req;              /**< True if Request, False if Response  */
 };
 
@@ -289,6 +291,49 @@ int  sip_debug(struct re_printf *pf, const struct sip *sip);
 int  sip_send(struct sip *sip, void *sock, enum sip_transp tp,
 	      const struct sa *dst, struct mbuf *mb);
 void sip_set_trace_handler(struct sip *sip, sip_trace_h *traceh);
+void sip_set_lazy_decode(struct sip *sip, bool enable);
+
+
+/* trace ring */
+struct sip_trace_ring;
+
+/** Defines a SIP message captured by a SIP Message Trace Ring */
+struct sip_trace_rec {
+	bool tx;               /**< Sent or received                  */
+	enum sip_transp tp;    /**< SIP transport                     */
+	struct sa src;         /**< Source address                    */
+	struct sa dst;         /**< Destination address               */
+	uint64_t ts;           /**< Capture time as Unix time in [us] */
+	const uint8_t *pkt;    /**< Raw SIP message                   */
+	size_t len;            /**< Length of the SIP message         */
+};
+
+typedef void(sip_trace_rec_h)(const struct sip_trace_rec *rec, void *arg);
+
+int    sip_trace_ring_alloc(struct sip_trace_ring **ringp, size_t size);
+void   sip_set_trace_ring(struct sip *sip, struct sip_trace_ring *ring);
+size_t sip_trace_ring_drain(struct sip_trace_ring *ring, sip_trace_rec_h *h,
+			    void *arg);
+size_t sip_trace_ring_dropped(struct sip_trace_ring *ring);
+int    sip_trace_pcap_hdr(struct mbuf *mb);
+int    sip_trace_pcap_encode(struct mbuf *mb,
+			     const struct sip_trace_rec *rec);
+int    sip_trace_hep_encode(struct mbuf *mb, const struct sip_trace_rec *rec,
+			    uint32_t capt_id);
+
+
+/* sharding */
+struct sip_shard;
+
+typedef int(sip_shard_init_h)(struct sip **sipp, unsigned idx, void *arg);
+typedef void(sip_shard_close_h)(struct sip *sip, unsigned idx, void *arg);
+
+int    sip_shard_alloc(struct sip_shard **shp, const struct sa *laddr,
+		       unsigned n, sip_shard_init_h *inith,
+		       sip_shard_close_h *closeh, void *arg);
+int    sip_shard_callid(char **callidp, const struct sip_shard *sh,
+			unsigned idx);
+size_t sip_shard_dropped(struct sip_shard *sh);
 
 
 /* transport */
@@ -331,6 +376,24 @@ bool sip_request_loops(struct sip_loopstate *ls, uint16_t scode);
 void sip_loopstate_reset(struct sip_loopstate *ls);
 
 
+/* request template */
+struct sip_tmpl;
+
+int  sip_tmpl_alloc(struct sip_tmpl **tmplp, struct sip *sip,
+		    struct sip_dialog *dlg, const char *met,
+		    const char *fmt, ...);
+int  sip_tmpl_drequest(struct sip_request **reqp, struct sip_tmpl *tmpl,
+		       bool stateful, uint32_t cseq, struct sip_auth *auth,
+		       const char *ctype, const struct mbuf *body,
+		       sip_send_h *sendh, sip_resp_h *resph, void *arg);
+
+
+/* stateless forwarding */
+int  sip_fwd_request(struct sip *sip, const struct sip_msg *msg,
+		     enum sip_transp tp, const struct sa *dst);
+int  sip_fwd_response(struct sip *sip, const struct sip_msg *msg);
+
+
 /* reply */
 int  sip_strans_alloc(struct sip_strans **stp, struct sip *sip,
 		      const struct sip_msg *msg, sip_cancel_h *cancelh,
@@ -391,6 +454,12 @@ bool sip_dialog_cmp_half(const struct sip_dialog *dlg,
 
 /* msg */
 int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb);
+int sip_msg_decode_lazy(struct sip_msg **msgp, struct mbuf *mb);
+const struct uri *sip_msg_uri(const struct sip_msg *msg);
+const struct sip_taddr *sip_msg_to(const struct sip_msg *msg);
+const struct sip_taddr *sip_msg_from(const struct sip_msg *msg);
+const struct sip_rack *sip_msg_rack(const struct sip_msg *msg);
+const struct msg_ctype *sip_msg_ctype(const struct sip_msg *msg);
 const struct sip_hdr *sip_msg_hdr(const struct sip_msg *msg,
 				  enum sip_hdrid id);
 const struct sip_hdr *sip_msg_hdr_apply(const struct sip_msg *msg,
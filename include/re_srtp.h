@@ -22,6 +22,9 @@ struct srtp;
 
 int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	       const uint8_t *key, size_t key_bytes, int flags);
+int srtp_alloc_keysalt(struct srtp **srtpp, enum srtp_suite suite,
+		       const uint8_t *key, size_t key_bytes,
+		       const uint8_t *salt, size_t salt_bytes, int flags);
 int srtp_encrypt(struct srtp *srtp, struct mbuf *mb);
 int srtp_decrypt(struct srtp *srtp, struct mbuf *mb);
 int srtcp_encrypt(struct srtp *srtp, struct mbuf *mb);
@@ -168,6 +168,7 @@ extern const char *stun_software;
 struct stun;
 struct stun_msg;
 struct stun_ctrans;
+struct hmac;
 
 typedef void(stun_resp_h)(int err, uint16_t scode, const char *reason,
 			  const struct stun_msg *msg, void *arg);
@@ -188,13 +189,28 @@ int  stun_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 		  void *sock, const struct sa *dst, size_t presz,
 		  uint16_t method, const uint8_t *key, size_t keylen, bool fp,
 		  stun_resp_h *resph, void *arg, uint32_t attrc, ...);
+int  stun_request_hmac(struct stun_ctrans **ctp, struct stun *stun,
+		       int proto, void *sock, const struct sa *dst,
+		       size_t presz, uint16_t method, struct hmac *hmac,
+		       const uint8_t *key, size_t keylen, bool fp,
+		       stun_resp_h *resph, void *arg, uint32_t attrc, ...);
 int  stun_reply(int proto, void *sock, const struct sa *dst, size_t presz,
 		const struct stun_msg *req, const uint8_t *key,
 		size_t keylen, bool fp, uint32_t attrc, ...);
+int  stun_reply_hmac(int proto, void *sock, const struct sa *dst,
+		     size_t presz, const struct stun_msg *req,
+		     struct hmac *hmac, bool fp, uint32_t attrc, ...);
+int  stun_binding_reply(int proto, void *sock, const struct sa *dst,
+			size_t presz, const struct mbuf *req,
+			const char *software);
 int  stun_ereply(int proto, void *sock, const struct sa *dst, size_t presz,
 		 const struct stun_msg *req, uint16_t scode,
 		 const char *reason, const uint8_t *key, size_t keylen,
 		 bool fp, uint32_t attrc, ...);
+int  stun_ereply_hmac(int proto, void *sock, const struct sa *dst,
+		      size_t presz, const struct stun_msg *req,
+		      uint16_t scode, const char *reason, struct hmac *hmac,
+		      bool fp, uint32_t attrc, ...);
 int  stun_indication(int proto, void *sock, const struct sa *dst, size_t presz,
 		     uint16_t method, const uint8_t *key, size_t keylen,
 		     bool fp, uint32_t attrc, ...);
@@ -203,12 +219,17 @@ int  stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t cls,
 		      const uint8_t *tid, const struct stun_errcode *ec,
 		      const uint8_t *key, size_t keylen, bool fp,
 		      uint8_t padding, uint32_t attrc, va_list ap);
+int  stun_msg_vencode_hmac(struct mbuf *mb, uint16_t method, uint8_t cls,
+			   const uint8_t *tid, const struct stun_errcode *ec,
+			   struct hmac *hmac, bool fp, uint8_t padding,
+			   uint32_t attrc, va_list ap);
 int  stun_msg_encode(struct mbuf *mb, uint16_t method, uint8_t cls,
 		     const uint8_t *tid, const struct stun_errcode *ec,
 		     const uint8_t *key, size_t keylen, bool fp,
 		     uint8_t padding, uint32_t attrc, ...);
 int  stun_msg_decode(struct stun_msg **msgpp, struct mbuf *mb,
 		     struct stun_unknown_attr *ua);
+bool stun_msg_probe(const struct mbuf *mb);
 uint16_t stun_msg_type(const struct stun_msg *msg);
 uint16_t stun_msg_class(const struct stun_msg *msg);
 uint16_t stun_msg_method(const struct stun_msg *msg);
@@ -219,6 +240,7 @@ struct stun_attr *stun_msg_attr_apply(const struct stun_msg *msg,
 				      stun_attr_h *h, void *arg);
 int  stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		     size_t keylen);
+int  stun_msg_chk_mi_hmac(const struct stun_msg *msg, struct hmac *hmac);
 int  stun_msg_chk_fingerprint(const struct stun_msg *msg);
 void stun_msg_dump(const struct stun_msg *msg);
 
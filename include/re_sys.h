@@ -56,6 +56,26 @@ uint64_t sys_htonll(uint64_t v);
 uint64_t sys_ntohll(uint64_t v);
 
 
+/* CPU features */
+
+/** Instruction set extensions detected at runtime */
+enum cpu_feature {
+	CPU_SSE2      = 1<<0,  /**< x86 SSE2                      */
+	CPU_SSSE3     = 1<<1,  /**< x86 SSSE3                     */
+	CPU_SSE41     = 1<<2,  /**< x86 SSE4.1                    */
+	CPU_AVX2      = 1<<3,  /**< x86 AVX2                      */
+	CPU_AES       = 1<<4,  /**< x86 AES-NI                    */
+	CPU_PCLMUL    = 1<<5,  /**< x86 Carry-less multiplication */
+	CPU_NEON      = 1<<8,  /**< Armv8 Advanced SIMD           */
+	CPU_ARM_AES   = 1<<9,  /**< Armv8 AES instructions        */
+	CPU_ARM_PMULL = 1<<10, /**< Armv8 Polynomial multiply     */
+	CPU_ARM_CRC32 = 1<<11, /**< Armv8 CRC32 instructions      */
+};
+
+uint32_t sys_cpu_features(void);
+bool     sys_cpu_has(uint32_t mask);
+
+
 /* Random */
 uint16_t rand_u16(void);
 uint32_t rand_u32(void);
@@ -126,6 +126,9 @@ const struct sa *dtls_peer(const struct tls_conn *tc);
 void dtls_set_peer(struct tls_conn *tc, const struct sa *peer);
 void dtls_recv_packet(struct dtls_sock *sock, const struct sa *src,
 		      struct mbuf *mb);
+int dtls_srtp_alloc(struct srtp **txp, struct srtp **rxp,
+		    enum srtp_suite *suite, const struct tls_conn *tc,
+		    int flags);
 
 
 #ifdef USE_OPENSSL
@@ -0,0 +1,26 @@
+/**
+ * @file aes.h  AES (Advanced Encryption Standard) -- internal
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+
+/*
+ * Native AES-NI/PCLMUL backend
+ *
+ * Used by the AES backends for the CTR and GCM modes when the CPU
+ * supports it, bypassing the generic cipher dispatch.
+ */
+
+struct aesni;
+
+int  aesni_alloc(struct aesni **aesp, enum aes_mode mode,
+		 const uint8_t *key, size_t key_bits);
+void aesni_set_iv(struct aesni *aes, const uint8_t *iv);
+int  aesni_encr(struct aesni *aes, uint8_t *out, const uint8_t *in,
+		size_t len);
+int  aesni_decr(struct aesni *aes, uint8_t *out, const uint8_t *in,
+		size_t len);
+int  aesni_get_authtag(struct aesni *aes, uint8_t *tag, size_t taglen);
+int  aesni_authenticate(struct aesni *aes, const uint8_t *tag,
+			size_t taglen);
@@ -0,0 +1,817 @@
+/**
+ * @file aesni.c  AES-CTR and AES-GCM using AES-NI and PCLMULQDQ
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_sys.h>
+#include <re_aes.h>
+#include "aes.h"
+
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+	((defined(__i386__) || defined(_M_IX86)) && defined(__SSE2__))
+#define HAVE_AESNI 1
+#endif
+
+
+#ifdef HAVE_AESNI
+
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#include <smmintrin.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AESNI_TARGET __attribute__((target("aes,pclmul,ssse3,sse4.1")))
+#else
+#define AESNI_TARGET
+#endif
+
+
+enum {
+	MAX_ROUNDS = 14,
+	GCM_IVLEN  = 12,
+};
+
+
+struct aesni {
+	uint8_t rk[MAX_ROUNDS+1][AES_BLOCK_SIZE]; /**< Round keys         */
+	unsigned rounds;             /**< Number of rounds                */
+	enum aes_mode mode;          /**< CTR or GCM                      */
+
+	uint8_t ctr[AES_BLOCK_SIZE]; /**< Next counter block              */
+	uint8_t ks[AES_BLOCK_SIZE];  /**< Current keystream block         */
+	size_t ks_pos;               /**< Used bytes of keystream block   */
+
+	/* GCM only */
+	uint8_t h[4][AES_BLOCK_SIZE];/**< H^1..H^4 (byte-reflected)       */
+	uint8_t ek0[AES_BLOCK_SIZE]; /**< E(K, J0)                        */
+	uint8_t x[AES_BLOCK_SIZE];   /**< GHASH state (byte-reflected)    */
+	uint8_t part[AES_BLOCK_SIZE];/**< Partial GHASH input block       */
+	size_t part_len;             /**< Bytes in partial block          */
+	uint64_t aad_len;            /**< Total AAD length in bytes       */
+	uint64_t txt_len;            /**< Total text length in bytes      */
+};
+
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0]<<24 | (uint32_t)p[1]<<16 |
+		(uint32_t)p[2]<<8 | (uint32_t)p[3];
+}
+
+
+static inline void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+
+static inline void put_be64(uint8_t *p, uint64_t v)
+{
+	put_be32(p, (uint32_t)(v >> 32));
+	put_be32(p + 4, (uint32_t)v);
+}
+
+
+/* CTR mode increments the whole block, GCM only the last 32 bits */
+static inline void ctr_inc(struct aesni *aes)
+{
+	int i;
+
+	if (aes->mode == AES_MODE_GCM) {
+		put_be32(&aes->ctr[12], get_be32(&aes->ctr[12]) + 1);
+		return;
+	}
+
+	for (i = AES_BLOCK_SIZE - 1; i >= 0; i--) {
+		if (++aes->ctr[i])
+			break;
+	}
+}
+
+
+AESNI_TARGET
+static __m128i expand_assist(__m128i key, __m128i kg)
+{
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+
+	return _mm_xor_si128(key, kg);
+}
+
+
+#define EXPAND128(i, rcon)						\
+	k = expand_assist(k, _mm_shuffle_epi32(				\
+		_mm_aeskeygenassist_si128(k, rcon), 0xff));		\
+	_mm_storeu_si128((__m128i *)(void *)aes->rk[i], k)
+
+
+AESNI_TARGET
+static void expand_key128(struct aesni *aes, const uint8_t *key)
+{
+	__m128i k = _mm_loadu_si128((const __m128i *)(const void *)key);
+
+	_mm_storeu_si128((__m128i *)(void *)aes->rk[0], k);
+
+	EXPAND128(1, 0x01);
+	EXPAND128(2, 0x02);
+	EXPAND128(3, 0x04);
+	EXPAND128(4, 0x08);
+	EXPAND128(5, 0x10);
+	EXPAND128(6, 0x20);
+	EXPAND128(7, 0x40);
+	EXPAND128(8, 0x80);
+	EXPAND128(9, 0x1b);
+	EXPAND128(10, 0x36);
+}
+
+
+#define EXPAND256(i, rcon)						\
+	k1 = expand_assist(k1, _mm_shuffle_epi32(			\
+		_mm_aeskeygenassist_si128(k2, rcon), 0xff));		\
+	_mm_storeu_si128((__m128i *)(void *)aes->rk[i], k1);		\
+	if (i + 1 <= MAX_ROUNDS) {					\
+		k2 = expand_assist(k2, _mm_shuffle_epi32(		\
+			_mm_aeskeygenassist_si128(k1, 0x00), 0xaa));	\
+		_mm_storeu_si128((__m128i *)(void *)aes->rk[i+1], k2);	\
+	}
+
+
+AESNI_TARGET
+static void expand_key256(struct aesni *aes, const uint8_t *key)
+{
+	__m128i k1 = _mm_loadu_si128((const __m128i *)(const void *)key);
+	__m128i k2 = _mm_loadu_si128((const __m128i *)(const void *)
+				     (key + 16));
+
+	_mm_storeu_si128((__m128i *)(void *)aes->rk[0], k1);
+	_mm_storeu_si128((__m128i *)(void *)aes->rk[1], k2);
+
+	EXPAND256(2, 0x01);
+	EXPAND256(4, 0x02);
+	EXPAND256(6, 0x04);
+	EXPAND256(8, 0x08);
+	EXPAND256(10, 0x10);
+	EXPAND256(12, 0x20);
+	EXPAND256(14, 0x40);
+}
+
+
+AESNI_TARGET
+static inline void load_keys(__m128i *rk, const struct aesni *aes)
+{
+	unsigned i;
+
+	for (i=0; i<=aes->rounds; i++)
+		rk[i] = _mm_loadu_si128((const __m128i *)(const void *)
+					aes->rk[i]);
+}
+
+
+AESNI_TARGET
+static inline __m128i encrypt_block(const __m128i *rk, unsigned rounds,
+				    __m128i b)
+{
+	unsigned i;
+
+	b = _mm_xor_si128(b, rk[0]);
+	for (i=1; i<rounds; i++)
+		b = _mm_aesenc_si128(b, rk[i]);
+
+	return _mm_aesenclast_si128(b, rk[rounds]);
+}
+
+
+AESNI_TARGET
+static inline __m128i bswap128(__m128i v)
+{
+	const __m128i mask = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					  8, 9, 10, 11, 12, 13, 14, 15);
+
+	return _mm_shuffle_epi8(v, mask);
+}
+
+
+/*
+ * GF(2^128) multiplication of byte-reflected operands, see the Intel
+ * white paper "Carry-Less Multiplication Instruction and its Usage for
+ * Computing the GCM Mode" (algorithm 5). The product is split from the
+ * reduction so that several products can share one reduction.
+ */
+AESNI_TARGET
+static inline void gf_clmul(__m128i a, __m128i b, __m128i *lo, __m128i *hi)
+{
+	__m128i t3, t4, t5, t6;
+
+	t3 = _mm_clmulepi64_si128(a, b, 0x00);
+	t4 = _mm_clmulepi64_si128(a, b, 0x10);
+	t5 = _mm_clmulepi64_si128(a, b, 0x01);
+	t6 = _mm_clmulepi64_si128(a, b, 0x11);
+
+	t4 = _mm_xor_si128(t4, t5);
+	t5 = _mm_slli_si128(t4, 8);
+	t4 = _mm_srli_si128(t4, 8);
+
+	*lo = _mm_xor_si128(*lo, _mm_xor_si128(t3, t5));
+	*hi = _mm_xor_si128(*hi, _mm_xor_si128(t6, t4));
+}
+
+
+AESNI_TARGET
+static inline __m128i gf_reduce(__m128i t3, __m128i t6)
+{
+	__m128i t2, t4, t5, t7, t8, t9;
+
+	/* shift the 256-bit product left by one bit */
+	t7 = _mm_srli_epi32(t3, 31);
+	t8 = _mm_srli_epi32(t6, 31);
+	t3 = _mm_slli_epi32(t3, 1);
+	t6 = _mm_slli_epi32(t6, 1);
+	t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	t3 = _mm_or_si128(t3, t7);
+	t6 = _mm_or_si128(t6, t8);
+	t6 = _mm_or_si128(t6, t9);
+
+	/* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+	t7 = _mm_slli_epi32(t3, 31);
+	t8 = _mm_slli_epi32(t3, 30);
+	t9 = _mm_slli_epi32(t3, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	t3 = _mm_xor_si128(t3, t7);
+
+	t2 = _mm_srli_epi32(t3, 1);
+	t4 = _mm_srli_epi32(t3, 2);
+	t5 = _mm_srli_epi32(t3, 7);
+	t2 = _mm_xor_si128(t2, t4);
+	t2 = _mm_xor_si128(t2, t5);
+	t2 = _mm_xor_si128(t2, t8);
+	t3 = _mm_xor_si128(t3, t2);
+
+	return _mm_xor_si128(t6, t3);
+}
+
+
+AESNI_TARGET
+static __m128i gfmul(__m128i a, __m128i b)
+{
+	__m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+	gf_clmul(a, b, &lo, &hi);
+
+	return gf_reduce(lo, hi);
+}
+
+
+/*
+ * Absorb whole 16-byte blocks into the GHASH state. Four blocks at a
+ * time are multiplied with H^4..H^1 and reduced once.
+ */
+AESNI_TARGET
+static void ghash_blocks(struct aesni *aes, const uint8_t *p, size_t n)
+{
+	__m128i h[4];
+	__m128i x = _mm_loadu_si128((const __m128i *)(void *)aes->x);
+	unsigned i;
+
+	for (i=0; i<4; i++)
+		h[i] = _mm_loadu_si128((const __m128i *)(void *)aes->h[i]);
+
+	while (n >= 4) {
+		__m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+		for (i=0; i<4; i++) {
+			__m128i b = bswap128(_mm_loadu_si128(
+				(const __m128i *)(const void *)
+				(p + i*AES_BLOCK_SIZE)));
+
+			if (i == 0)
+				b = _mm_xor_si128(b, x);
+
+			gf_clmul(b, h[3-i], &lo, &hi);
+		}
+
+		x  = gf_reduce(lo, hi);
+		p += 4*AES_BLOCK_SIZE;
+		n -= 4;
+	}
+
+	while (n--) {
+		__m128i b = _mm_loadu_si128((const __m128i *)(const void *)p);
+
+		x = gfmul(_mm_xor_si128(x, bswap128(b)), h[0]);
+		p += AES_BLOCK_SIZE;
+	}
+
+	_mm_storeu_si128((__m128i *)(void *)aes->x, x);
+}
+
+
+static void ghash_update(struct aesni *aes, const uint8_t *p, size_t len)
+{
+	if (aes->part_len) {
+		size_t n = min(len, AES_BLOCK_SIZE - aes->part_len);
+
+		memcpy(&aes->part[aes->part_len], p, n);
+		aes->part_len += n;
+		p   += n;
+		len -= n;
+
+		if (aes->part_len < AES_BLOCK_SIZE)
+			return;
+
+		ghash_blocks(aes, aes->part, 1);
+		aes->part_len = 0;
+	}
+
+	if (len >= AES_BLOCK_SIZE) {
+		size_t n = len / AES_BLOCK_SIZE;
+
+		ghash_blocks(aes, p, n);
+		p   += n * AES_BLOCK_SIZE;
+		len -= n * AES_BLOCK_SIZE;
+	}
+
+	if (len) {
+		memcpy(aes->part, p, len);
+		aes->part_len = len;
+	}
+}
+
+
+/* Zero-pad and absorb a pending partial block */
+static void ghash_flush(struct aesni *aes)
+{
+	if (!aes->part_len)
+		return;
+
+	memset(&aes->part[aes->part_len], 0, AES_BLOCK_SIZE - aes->part_len);
+	ghash_blocks(aes, aes->part, 1);
+	aes->part_len = 0;
+}
+
+
+/*
+ * Get the next counter block. The fast path increments the low 32 bits
+ * of the byte-swapped counter in a register, and is only used when
+ * there is no carry into the upper 96 bits.
+ */
+AESNI_TARGET
+static inline __m128i ctr_next(struct aesni *aes, __m128i *c, bool fast)
+{
+	__m128i b;
+
+	if (fast) {
+		b  = bswap128(*c);
+		*c = _mm_add_epi32(*c, _mm_set_epi32(0, 0, 0, 1));
+		return b;
+	}
+
+	b = _mm_loadu_si128((const __m128i *)(void *)aes->ctr);
+	ctr_inc(aes);
+
+	return b;
+}
+
+
+AESNI_TARGET
+static void ctr_xor(struct aesni *aes, uint8_t *out, const uint8_t *in,
+		    size_t len)
+{
+	__m128i rk[MAX_ROUNDS+1];
+	__m128i c;
+	size_t i, nblocks;
+	bool fast;
+
+	/* use up the remaining keystream from the previous call */
+	while (len && aes->ks_pos < AES_BLOCK_SIZE) {
+		*out++ = *in++ ^ aes->ks[aes->ks_pos++];
+		--len;
+	}
+
+	if (!len)
+		return;
+
+	load_keys(rk, aes);
+
+	nblocks = (len + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+	fast = aes->mode == AES_MODE_GCM ||
+		get_be32(&aes->ctr[12]) <= (uint64_t)UINT32_MAX - nblocks;
+	c = bswap128(_mm_loadu_si128((const __m128i *)(void *)aes->ctr));
+
+	/* four blocks in parallel to hide the AESENC latency */
+	while (len >= 4*AES_BLOCK_SIZE) {
+		__m128i b[4];
+
+		for (i=0; i<4; i++)
+			b[i] = _mm_xor_si128(ctr_next(aes, &c, fast), rk[0]);
+
+		for (i=1; i<aes->rounds; i++) {
+			b[0] = _mm_aesenc_si128(b[0], rk[i]);
+			b[1] = _mm_aesenc_si128(b[1], rk[i]);
+			b[2] = _mm_aesenc_si128(b[2], rk[i]);
+			b[3] = _mm_aesenc_si128(b[3], rk[i]);
+		}
+
+		for (i=0; i<4; i++) {
+			__m128i d;
+
+			b[i] = _mm_aesenclast_si128(b[i], rk[aes->rounds]);
+			d = _mm_loadu_si128((const __m128i *)(const void *)
+					    (in + i*AES_BLOCK_SIZE));
+			_mm_storeu_si128((__m128i *)(void *)
+					 (out + i*AES_BLOCK_SIZE),
+					 _mm_xor_si128(d, b[i]));
+		}
+
+		in  += 4*AES_BLOCK_SIZE;
+		out += 4*AES_BLOCK_SIZE;
+		len -= 4*AES_BLOCK_SIZE;
+	}
+
+	while (len) {
+		__m128i b;
+
+		b = encrypt_block(rk, aes->rounds, ctr_next(aes, &c, fast));
+
+		if (len >= AES_BLOCK_SIZE) {
+			__m128i d = _mm_loadu_si128((const __m128i *)
+						    (const void *)in);
+
+			_mm_storeu_si128((__m128i *)(void *)out,
+					 _mm_xor_si128(d, b));
+			in  += AES_BLOCK_SIZE;
+			out += AES_BLOCK_SIZE;
+			len -= AES_BLOCK_SIZE;
+			continue;
+		}
+
+		_mm_storeu_si128((__m128i *)(void *)aes->ks, b);
+		for (i=0; i<len; i++)
+			out[i] = in[i] ^ aes->ks[i];
+
+		aes->ks_pos = len;
+		break;
+	}
+
+	if (fast)
+		_mm_storeu_si128((__m128i *)(void *)aes->ctr, bswap128(c));
+}
+
+
+AESNI_TARGET
+static void encrypt_one(const struct aesni *aes, uint8_t *out,
+			const uint8_t *in)
+{
+	__m128i rk[MAX_ROUNDS+1];
+	__m128i b = _mm_loadu_si128((const __m128i *)(const void *)in);
+
+	load_keys(rk, aes);
+	_mm_storeu_si128((__m128i *)(void *)out,
+			 encrypt_block(rk, aes->rounds, b));
+}
+
+
+AESNI_TARGET
+static void gcm_init_h(struct aesni *aes)
+{
+	const uint8_t zero[AES_BLOCK_SIZE] = {0};
+	uint8_t h[AES_BLOCK_SIZE];
+	__m128i h1, hn;
+	unsigned i;
+
+	encrypt_one(aes, h, zero);
+
+	h1 = bswap128(_mm_loadu_si128((const __m128i *)(void *)h));
+	hn = h1;
+	_mm_storeu_si128((__m128i *)(void *)aes->h[0], h1);
+
+	for (i=1; i<4; i++) {
+		hn = gfmul(hn, h1);
+		_mm_storeu_si128((__m128i *)(void *)aes->h[i], hn);
+	}
+}
+
+
+AESNI_TARGET
+static void gcm_tag(struct aesni *aes, uint8_t *tag)
+{
+	uint8_t lens[AES_BLOCK_SIZE];
+	__m128i x, t;
+
+	ghash_flush(aes);
+
+	put_be64(lens,     aes->aad_len * 8);
+	put_be64(lens + 8, aes->txt_len * 8);
+	ghash_blocks(aes, lens, 1);
+
+	x = bswap128(_mm_loadu_si128((const __m128i *)(void *)aes->x));
+	t = _mm_loadu_si128((const __m128i *)(void *)aes->ek0);
+
+	_mm_storeu_si128((__m128i *)(void *)tag, _mm_xor_si128(x, t));
+}
+
+
+static void destructor(void *arg)
+{
+	struct aesni *aes = arg;
+
+	memset(aes, 0, sizeof(*aes));
+}
+
+
+/**
+ * Allocate a native AES context
+ *
+ * @param aesp     Pointer to allocated AES context
+ * @param mode     AES mode
+ * @param key      Encryption key
+ * @param key_bits Key size in bits (128 or 256)
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @retval ENOTSUP if the CPU or the key size is not supported
+ */
+int aesni_alloc(struct aesni **aesp, enum aes_mode mode,
+		const uint8_t *key, size_t key_bits)
+{
+	struct aesni *aes;
+
+	if (!aesp || !key)
+		return EINVAL;
+
+	if (!sys_cpu_has(CPU_AES | CPU_PCLMUL | CPU_SSSE3 | CPU_SSE41))
+		return ENOTSUP;
+
+	if (mode != AES_MODE_CTR && mode != AES_MODE_GCM)
+		return ENOTSUP;
+
+	if (key_bits != 128 && key_bits != 256)
+		return ENOTSUP;
+
+	aes = mem_zalloc(sizeof(*aes), destructor);
+	if (!aes)
+		return ENOMEM;
+
+	aes->mode = mode;
+
+	if (key_bits == 128) {
+		aes->rounds = 10;
+		expand_key128(aes, key);
+	}
+	else {
+		aes->rounds = 14;
+		expand_key256(aes, key);
+	}
+
+	if (mode == AES_MODE_GCM)
+		gcm_init_h(aes);
+
+	aes->ks_pos = AES_BLOCK_SIZE;
+
+	*aesp = aes;
+
+	return 0;
+}
+
+
+/**
+ * Set the IV and reset the cipher state
+ *
+ * @param aes AES context
+ * @param iv  Initial counter block (CTR) or 96-bit IV (GCM)
+ */
+void aesni_set_iv(struct aesni *aes, const uint8_t *iv)
+{
+	if (!aes || !iv)
+		return;
+
+	aes->ks_pos = AES_BLOCK_SIZE;
+
+	if (aes->mode == AES_MODE_CTR) {
+		memcpy(aes->ctr, iv, AES_BLOCK_SIZE);
+		return;
+	}
+
+	/* J0 = IV || 0^31 || 1 */
+	memcpy(aes->ctr, iv, GCM_IVLEN);
+	put_be32(&aes->ctr[GCM_IVLEN], 1);
+
+	encrypt_one(aes, aes->ek0, aes->ctr);
+	ctr_inc(aes);
+
+	memset(aes->x, 0, sizeof(aes->x));
+	aes->part_len = 0;
+	aes->aad_len  = 0;
+	aes->txt_len  = 0;
+}
+
+
+/**
+ * Encrypt data. In GCM mode, a NULL output buffer adds the input
+ * as Additional Authenticated Data.
+ *
+ * @param aes AES context
+ * @param out Output buffer
+ * @param in  Input buffer
+ * @param len Number of bytes
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aesni_encr(struct aesni *aes, uint8_t *out, const uint8_t *in,
+	       size_t len)
+{
+	if (!aes || !in)
+		return EINVAL;
+
+	if (aes->mode == AES_MODE_CTR) {
+		if (!out)
+			return EINVAL;
+
+		ctr_xor(aes, out, in, len);
+		return 0;
+	}
+
+	if (!out) {
+		if (aes->txt_len)
+			return EPROTO;
+
+		ghash_update(aes, in, len);
+		aes->aad_len += len;
+		return 0;
+	}
+
+	if (!aes->txt_len)
+		ghash_flush(aes);
+
+	ctr_xor(aes, out, in, len);
+	ghash_update(aes, out, len);
+	aes->txt_len += len;
+
+	return 0;
+}
+
+
+/**
+ * Decrypt data. In GCM mode, a NULL output buffer adds the input
+ * as Additional Authenticated Data.
+ *
+ * @param aes AES context
+ * @param out Output buffer
+ * @param in  Input buffer
+ * @param len Number of bytes
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aesni_decr(struct aesni *aes, uint8_t *out, const uint8_t *in,
+	       size_t len)
+{
+	if (!aes || !in)
+		return EINVAL;
+
+	if (aes->mode == AES_MODE_CTR || !out)
+		return aesni_encr(aes, out, in, len);
+
+	if (!aes->txt_len)
+		ghash_flush(aes);
+
+	/* hash the ciphertext before it is overwritten in-place */
+	ghash_update(aes, in, len);
+	ctr_xor(aes, out, in, len);
+	aes->txt_len += len;
+
+	return 0;
+}
+
+
+/**
+ * Get the GCM authentication tag
+ *
+ * @param aes    AES context
+ * @param tag    Authentication tag
+ * @param taglen Length of Authentication tag
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aesni_get_authtag(struct aesni *aes, uint8_t *tag, size_t taglen)
+{
+	uint8_t t[AES_BLOCK_SIZE];
+
+	if (!aes || !tag || !taglen || taglen > sizeof(t))
+		return EINVAL;
+
+	if (aes->mode != AES_MODE_GCM)
+		return ENOTSUP;
+
+	gcm_tag(aes, t);
+	memcpy(tag, t, taglen);
+
+	return 0;
+}
+
+
+/**
+ * Verify the GCM authentication tag
+ *
+ * @param aes    AES context
+ * @param tag    Authentication tag
+ * @param taglen Length of Authentication tag
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @retval EAUTH if authentication failed
+ */
+int aesni_authenticate(struct aesni *aes, const uint8_t *tag, size_t taglen)
+{
+	uint8_t t[AES_BLOCK_SIZE];
+
+	if (!aes || !tag || !taglen || taglen > sizeof(t))
+		return EINVAL;
+
+	if (aes->mode != AES_MODE_GCM)
+		return ENOTSUP;
+
+	gcm_tag(aes, t);
+
+	return mem_seccmp(t, tag, taglen) ? EAUTH : 0;
+}
+
+
+#else
+
+
+int aesni_alloc(struct aesni **aesp, enum aes_mode mode,
+		const uint8_t *key, size_t key_bits)
+{
+	(void)aesp;
+	(void)mode;
+	(void)key;
+	(void)key_bits;
+
+	return ENOTSUP;
+}
+
+
+void aesni_set_iv(struct aesni *aes, const uint8_t *iv)
+{
+	(void)aes;
+	(void)iv;
+}
+
+
+int aesni_encr(struct aesni *aes, uint8_t *out, const uint8_t *in,
+	       size_t len)
+{
+	(void)aes;
+	(void)out;
+	(void)in;
+	(void)len;
+
+	return ENOSYS;
+}
+
+
+int aesni_decr(struct aesni *aes, uint8_t *out, const uint8_t *in,
+	       size_t len)
+{
+	(void)aes;
+	(void)out;
+	(void)in;
+	(void)len;
+
+	return ENOSYS;
+}
+
+
+int aesni_get_authtag(struct aesni *aes, uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+
+	return ENOSYS;
+}
+
+
+int aesni_authenticate(struct aesni *aes, const uint8_t *tag, size_t taglen)
+{
+	(void)aes;
+	(void)tag;
+	(void)taglen;
+
+	return ENOSYS;
+}
+
+
+#endif
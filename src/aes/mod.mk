@@ -4,6 +4,8 @@
 # Copyright (C) 2010 Creytiv.com
 #
 
+SRCS	+= aes/aesni.c
+
 ifneq ($(USE_OPENSSL_AES),)
 SRCS	+= aes/openssl/aes.c
 else ifneq ($(USE_APPLE_COMMONCRYPTO),)
@@ -11,10 +11,12 @@
 #include <re_fmt.h>
 #include <re_mem.h>
 #include <re_aes.h>
+#include "../aes.h"
 
 
 struct aes {
 	EVP_CIPHER_CTX *ctx;
+	struct aesni *ni;
 	enum aes_mode mode;
 	bool encr;
 };
@@ -71,6 +73,8 @@ static void destructor(void *arg)
 {
 	struct aes *st = arg;
 
+	mem_deref(st->ni);
+
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
 	if (st->ctx)
 		EVP_CIPHER_CTX_free(st->ctx);
@@ -104,6 +108,12 @@ int aes_alloc(struct aes **aesp, enum aes_mode mode,
 	st->mode = mode;
 	st->encr = true;
 
+	/* Prefer the native backend, bypassing the EVP dispatch */
+	if (0 == aesni_alloc(&st->ni, mode, key, key_bits)) {
+		aesni_set_iv(st->ni, iv);
+		goto out;
+	}
+
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
 	st->ctx = EVP_CIPHER_CTX_new();
 	if (!st->ctx) {
@@ -145,6 +155,11 @@ void aes_set_iv(struct aes *aes, const uint8_t *iv)
 	if (!aes || !iv)
 		return;
 
+	if (aes->ni) {
+		aesni_set_iv(aes->ni, iv);
+		return;
+	}
+
 	r = EVP_CipherInit_ex(aes->ctx, NULL, NULL, NULL, iv, -1);
 	if (!r)
 		ERR_clear_error();
@@ -158,6 +173,9 @@ int aes_encr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
 	if (!aes || !in)
 		return EINVAL;
 
+	if (aes->ni)
+		return aesni_encr(aes->ni, out, in, len);
+
 	if (!set_crypt_dir(aes, true))
 		return EPROTO;
 
@@ -177,6 +195,9 @@ int aes_decr(struct aes *aes, uint8_t *out, const uint8_t *in, size_t len)
 	if (!aes || !in)
 		return EINVAL;
 
+	if (aes->ni)
+		return aesni_decr(aes->ni, out, in, len);
+
 	if (!set_crypt_dir(aes, false))
 		return EPROTO;
 
@@ -205,6 +226,9 @@ int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
 	if (!aes || !tag || !taglen)
 		return EINVAL;
 
+	if (aes->ni)
+		return aesni_get_authtag(aes->ni, tag, taglen);
+
 	switch (aes->mode) {
 
 	case AES_MODE_GCM:
@@ -245,6 +269,9 @@ int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
 	if (!aes || !tag || !taglen)
 		return EINVAL;
 
+	if (aes->ni)
+		return aesni_authenticate(aes->ni, tag, taglen);
+
 	switch (aes->mode) {
 
 	case AES_MODE_GCM:
@@ -1,67 +1,97 @@
 /**
  * @file aes/stub.c  AES stub
  *
+ * Only the native backend is available, if supported by the CPU.
+ *
  * Copyright (C) 2010 Creytiv.com
  */
 #include <re_types.h>
+#include <re_mem.h>
 #include <re_aes.h>
+#include "aes.h"
+
+
+struct aes {
+	struct aesni *ni;
+};
+
+
+static void destructor(void *arg)
+{
+	struct aes *st = arg;
+
+	mem_deref(st->ni);
+}
 
 
 int aes_alloc(struct aes **stp, enum aes_mode mode,
 	      const uint8_t *key, size_t key_bits,
 	      const uint8_t iv[AES_BLOCK_SIZE])
 {
-	(void)stp;
-	(void)mode;
-	(void)key;
-	(void)key_bits;
-	(void)iv;
-	return ENOSYS;
+	struct aes *st;
+	int err;
+
+	if (!stp || !key)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = aesni_alloc(&st->ni, mode, key, key_bits);
+	if (err) {
+		mem_deref(st);
+		return err == ENOTSUP ? ENOSYS : err;
+	}
+
+	aesni_set_iv(st->ni, iv);
+
+	*stp = st;
+
+	return 0;
 }
 
 
 void aes_set_iv(struct aes *st, const uint8_t iv[AES_BLOCK_SIZE])
 {
-	(void)st;
-	(void)iv;
+	if (!st)
+		return;
+
+	aesni_set_iv(st->ni, iv);
 }
 
 
 int aes_encr(struct aes *st, uint8_t *out, const uint8_t *in, size_t len)
 {
-	(void)st;
-	(void)out;
-	(void)in;
-	(void)len;
-	return ENOSYS;
+	if (!st)
+		return EINVAL;
+
+	return aesni_encr(st->ni, out, in, len);
 }
 
 
 int aes_decr(struct aes *st, uint8_t *out, const uint8_t *in, size_t len)
 {
-	(void)st;
-	(void)out;
-	(void)in;
-	(void)len;
-	return ENOSYS;
+	if (!st)
+		return EINVAL;
+
+	return aesni_decr(st->ni, out, in, len);
 }
 
 
 int aes_get_authtag(struct aes *aes, uint8_t *tag, size_t taglen)
 {
-	(void)aes;
-	(void)tag;
-	(void)taglen;
+	if (!aes)
+		return EINVAL;
 
-	return ENOSYS;
+	return aesni_get_authtag(aes->ni, tag, taglen);
 }
 
 
 int aes_authenticate(struct aes *aes, const uint8_t *tag, size_t taglen)
 {
-	(void)aes;
-	(void)tag;
-	(void)taglen;
+	if (!aes)
+		return EINVAL;
 
-	return ENOSYS;
+	return aesni_authenticate(aes->ni, tag, taglen);
 }
@@ -3,17 +3,419 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
+#include <re_mbuf.h>
+#include <re_sys.h>
 #include <re_base64.h>
 
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_B64_X86 1
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#define AVX2_TARGET  __attribute__((target("avx2")))
+#elif defined(_M_X64)
+#include <immintrin.h>
+#define HAVE_B64_X86 1
+#define SSSE3_TARGET
+#define AVX2_TARGET
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_B64_NEON 1
+#endif
+
+
 static const char b64_table[65] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 	"abcdefghijklmnopqrstuvwxyz"
 	"0123456789+/";
 
 
+/*
+ * Vectorized codecs, after W. Mula and D. Lemire, "Faster Base64
+ * Encoding and Decoding Using AVX2 Instructions" (2018).
+ *
+ * Each function processes whole blocks and returns the number of input
+ * bytes consumed; the scalar code handles the tail and the padding.
+ * The decoders stop at the first block containing anything other than
+ * the 64 alphabet characters, so that padding and invalid input keep
+ * the scalar semantics.
+ */
+
+#ifdef HAVE_B64_X86
+
+SSSE3_TARGET
+static inline __m128i enc_reshuffle(__m128i in)
+{
+	__m128i t0, t1, t2, t3;
+
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+					       4, 5, 3, 4, 1, 2, 0, 1));
+
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+	return _mm_or_si128(t1, t3);
+}
+
+
+SSSE3_TARGET
+static inline __m128i enc_translate(__m128i in)
+{
+	const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+					  -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i ix = _mm_subs_epu8(in, _mm_set1_epi8(51));
+
+	ix = _mm_sub_epi8(ix, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+
+	return _mm_add_epi8(in, _mm_shuffle_epi8(lut, ix));
+}
+
+
+SSSE3_TARGET
+static size_t enc_ssse3(const uint8_t *in, size_t ilen, char *out)
+{
+	size_t n = 0;
+
+	/* 12 bytes in, 16 chars out, but the load reads 16 bytes */
+	while (ilen - n >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(const void *)
+					    (in + n));
+
+		v = enc_translate(enc_reshuffle(v));
+		_mm_storeu_si128((__m128i *)(void *)out, v);
+
+		n   += 12;
+		out += 16;
+	}
+
+	return n;
+}
+
+
+AVX2_TARGET
+static size_t enc_avx2(const uint8_t *in, size_t ilen, char *out)
+{
+	const __m256i shuf = _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	const __m256i lut = _mm256_setr_epi8(
+		65, 71, -4, -4, -4, -4, -4, -4,
+		-4, -4, -4, -4, -19, -16, 0, 0,
+		65, 71, -4, -4, -4, -4, -4, -4,
+		-4, -4, -4, -4, -19, -16, 0, 0);
+	size_t n = 0;
+
+	/* 24 bytes in, 32 chars out, the second load reads up to +28 */
+	while (ilen - n >= 28) {
+		__m256i v, t0, t1, t2, t3, ix;
+
+		v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((const __m128i *)(const void *)
+					(in + n))),
+			_mm_loadu_si128((const __m128i *)(const void *)
+					(in + n + 12)), 1);
+
+		v  = _mm256_shuffle_epi8(v, shuf);
+		t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+		t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		v  = _mm256_or_si256(t1, t3);
+
+		ix = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+		ix = _mm256_sub_epi8(ix, _mm256_cmpgt_epi8(
+					     v, _mm256_set1_epi8(25)));
+		v  = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut, ix));
+
+		_mm256_storeu_si256((__m256i *)(void *)out, v);
+
+		n   += 24;
+		out += 32;
+	}
+
+	return n;
+}
+
+
+SSSE3_TARGET
+static size_t dec_ssse3(const char *in, size_t ilen, uint8_t *out)
+{
+	const __m128i lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+					   14, 13, 12, -1, -1, -1, -1);
+	size_t n = 0;
+
+	/* 16 chars in, 12 bytes out, but the store writes 16 bytes */
+	while (ilen - n >= 24) {
+		__m128i v, hi_nib, lo_nib, hi, lo, roll;
+
+		v = _mm_loadu_si128((const __m128i *)(const void *)(in + n));
+
+		hi_nib = _mm_and_si128(_mm_srli_epi32(v, 4), mask_2f);
+		lo_nib = _mm_and_si128(v, mask_2f);
+		hi = _mm_shuffle_epi8(lut_hi, hi_nib);
+		lo = _mm_shuffle_epi8(lut_lo, lo_nib);
+
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+						     _mm_setzero_si128())))
+			break;
+
+		roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(
+				_mm_cmpeq_epi8(v, mask_2f), hi_nib));
+		v = _mm_add_epi8(v, roll);
+
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		v = _mm_shuffle_epi8(v, pack);
+
+		_mm_storeu_si128((__m128i *)(void *)out, v);
+
+		n   += 16;
+		out += 12;
+	}
+
+	return n;
+}
+
+
+AVX2_TARGET
+static size_t dec_avx2(const char *in, size_t ilen, uint8_t *out)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+	size_t n = 0;
+
+	/* 32 chars in, 24 bytes out, but the store writes 32 bytes */
+	while (ilen - n >= 48) {
+		__m256i v, hi_nib, lo_nib, hi, lo, roll;
+
+		v = _mm256_loadu_si256((const __m256i *)(const void *)
+				       (in + n));
+
+		hi_nib = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+		lo_nib = _mm256_and_si256(v, mask_2f);
+		hi = _mm256_shuffle_epi8(lut_hi, hi_nib);
+		lo = _mm256_shuffle_epi8(lut_lo, lo_nib);
+
+		if (!_mm256_testz_si256(lo, hi))
+			break;
+
+		roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(
+				_mm256_cmpeq_epi8(v, mask_2f), hi_nib));
+		v = _mm256_add_epi8(v, roll);
+
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+		v = _mm256_permutevar8x32_epi32(v, perm);
+
+		_mm256_storeu_si256((__m256i *)(void *)out, v);
+
+		n   += 32;
+		out += 24;
+	}
+
+	return n;
+}
+
+
+static size_t enc_simd(const uint8_t *in, size_t ilen, char *out)
+{
+	size_t n = 0;
+
+	if (ilen < 16)
+		return 0;
+
+	if (sys_cpu_has(CPU_AVX2))
+		n = enc_avx2(in, ilen, out);
+
+	if (sys_cpu_has(CPU_SSSE3))
+		n += enc_ssse3(in + n, ilen - n, out + n/3*4);
+
+	return n;
+}
+
+
+static size_t dec_simd(const char *in, size_t ilen, uint8_t *out)
+{
+	size_t n = 0, m;
+
+	if (ilen < 24)
+		return 0;
+
+	if (sys_cpu_has(CPU_AVX2)) {
+		n = dec_avx2(in, ilen, out);
+		if (n + 48 <= ilen)
+			return n;  /* stopped at invalid input */
+	}
+
+	if (sys_cpu_has(CPU_SSSE3)) {
+		m  = dec_ssse3(in + n, ilen - n, out + n/4*3);
+		n += m;
+	}
+
+	return n;
+}
+
+#elif defined(HAVE_B64_NEON)
+
+static size_t enc_simd(const uint8_t *in, size_t ilen, char *out)
+{
+	const uint8_t *t = (const uint8_t *)b64_table;
+	const uint8x16_t mask = vdupq_n_u8(0x3f);
+	uint8x16x4_t tbl;
+	size_t n = 0;
+
+	tbl.val[0] = vld1q_u8(t);
+	tbl.val[1] = vld1q_u8(t + 16);
+	tbl.val[2] = vld1q_u8(t + 32);
+	tbl.val[3] = vld1q_u8(t + 48);
+
+	/* 48 bytes in, 64 chars out */
+	while (ilen - n >= 48) {
+		uint8x16x3_t v = vld3q_u8(in + n);
+		uint8x16x4_t ix;
+
+		ix.val[0] = vshrq_n_u8(v.val[0], 2);
+		ix.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[0], 4),
+					      vshrq_n_u8(v.val[1], 4)), mask);
+		ix.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[1], 2),
+					      vshrq_n_u8(v.val[2], 6)), mask);
+		ix.val[3] = vandq_u8(v.val[2], mask);
+
+		ix.val[0] = vqtbl4q_u8(tbl, ix.val[0]);
+		ix.val[1] = vqtbl4q_u8(tbl, ix.val[1]);
+		ix.val[2] = vqtbl4q_u8(tbl, ix.val[2]);
+		ix.val[3] = vqtbl4q_u8(tbl, ix.val[3]);
+
+		vst4q_u8((uint8_t *)out, ix);
+
+		n   += 48;
+		out += 64;
+	}
+
+	return n;
+}
+
+
+/* Decode lookup for 0x00-0x7f, invalid characters map to 0xff */
+static const uint8_t b64_dec_neon[128] = {
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255,  62, 255, 255, 255,  63,  52,  53,  54,  55,
+	 56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255, 255,
+	  0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,
+	 13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,
+	255, 255, 255, 255, 255, 255,  26,  27,  28,  29,  30,  31,  32,
+	 33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,
+	 46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255
+};
+
+
+static size_t dec_simd(const char *in, size_t ilen, uint8_t *out)
+{
+	uint8x16x4_t lo, hi;
+	const uint8x16_t c64 = vdupq_n_u8(64);
+	size_t n = 0;
+	int i;
+
+	for (i=0; i<4; i++) {
+		lo.val[i] = vld1q_u8(&b64_dec_neon[16*i]);
+		hi.val[i] = vld1q_u8(&b64_dec_neon[64 + 16*i]);
+	}
+
+	/* 64 chars in, 48 bytes out */
+	while (ilen - n >= 64) {
+		uint8x16x4_t v = vld4q_u8((const uint8_t *)in + n);
+		uint8x16x3_t o;
+		uint8x16_t err = vdupq_n_u8(0);
+
+		for (i=0; i<4; i++) {
+			uint8x16_t d;
+
+			/* indices >= 128 yield 0 in both lookups */
+			d = vqtbl4q_u8(lo, v.val[i]);
+			d = vorrq_u8(d, vqtbl4q_u8(hi, vsubq_u8(v.val[i],
+								 c64)));
+			d = vorrq_u8(d, vcgeq_u8(v.val[i],
+						 vdupq_n_u8(128)));
+			err = vorrq_u8(err, d);
+			v.val[i] = d;
+		}
+
+		if (vmaxvq_u8(err) >= 64)
+			break;
+
+		o.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2),
+				    vshrq_n_u8(v.val[1], 4));
+		o.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4),
+				    vshrq_n_u8(v.val[2], 2));
+		o.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+
+		vst3q_u8(out, o);
+
+		n   += 64;
+		out += 48;
+	}
+
+	return n;
+}
+
+#else
+
+static size_t enc_simd(const uint8_t *in, size_t ilen, char *out)
+{
+	(void)in;
+	(void)ilen;
+	(void)out;
+
+	return 0;
+}
+
+
+static size_t dec_simd(const char *in, size_t ilen, uint8_t *out)
+{
+	(void)in;
+	(void)ilen;
+	(void)out;
+
+	return 0;
+}
+
+#endif
+
+
 /**
  * Base-64 encode a buffer
  *
@@ -28,6 +430,7 @@ int base64_encode(const uint8_t *in, size_t ilen, char *out, size_t *olen)
 {
 	const uint8_t *in_end = in + ilen;
 	const char *o = out;
+	size_t n;
 
 	if (!in || !out || !olen)
 		return EINVAL;
@@ -35,6 +438,10 @@ int base64_encode(const uint8_t *in, size_t ilen, char *out, size_t *olen)
 	if (*olen < 4 * ((ilen+2)/3))
 		return EOVERFLOW;
 
+	n = enc_simd(in, ilen, out);
+	in  += n;
+	out += n/3*4;
+
 	for (; in < in_end; ) {
 		uint32_t v;
 		int pad = 0;
@@ -128,6 +535,7 @@ int base64_decode(const char *in, size_t ilen, uint8_t *out, size_t *olen)
 {
 	const char *in_end = in + ilen;
 	const uint8_t *o = out;
+	size_t n;
 
 	if (!in || !out || !olen)
 		return EINVAL;
@@ -135,6 +543,10 @@ int base64_decode(const char *in, size_t ilen, uint8_t *out, size_t *olen)
 	if (*olen < 3 * (ilen/4))
 		return EOVERFLOW;
 
+	n = dec_simd(in, ilen, out);
+	in  += n;
+	out += n/4*3;
+
 	for (;in+3 < in_end; ) {
 		uint32_t v;
 
@@ -154,3 +566,71 @@ int base64_decode(const char *in, size_t ilen, uint8_t *out, size_t *olen)
 
 	return 0;
 }
+
+
+/**
+ * Base-64 encode a buffer and write it to a memory buffer
+ *
+ * @param mb   Memory buffer
+ * @param in   Input buffer
+ * @param ilen Length of input buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int base64_encode_mbuf(struct mbuf *mb, const uint8_t *in, size_t ilen)
+{
+	size_t olen = 4 * ((ilen+2)/3);
+	int err;
+
+	if (!mb || !in)
+		return EINVAL;
+
+	if (mb->pos + olen > mb->size) {
+		err = mbuf_resize(mb, MAX(mb->pos + olen, mb->size * 2));
+		if (err)
+			return err;
+	}
+
+	err = base64_encode(in, ilen, (char *)mbuf_buf(mb), &olen);
+	if (err)
+		return err;
+
+	mb->pos += olen;
+	mb->end  = MAX(mb->end, mb->pos);
+
+	return 0;
+}
+
+
+/**
+ * Decode a Base-64 encoded string and write it to a memory buffer
+ *
+ * @param mb   Memory buffer
+ * @param in   Input buffer
+ * @param ilen Length of input buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int base64_decode_mbuf(struct mbuf *mb, const char *in, size_t ilen)
+{
+	size_t olen = 3 * (ilen/4);
+	int err;
+
+	if (!mb || !in)
+		return EINVAL;
+
+	if (mb->pos + olen > mb->size) {
+		err = mbuf_resize(mb, MAX(mb->pos + olen, mb->size * 2));
+		if (err)
+			return err;
+	}
+
+	err = base64_decode(in, ilen, mbuf_buf(mb), &olen);
+	if (err)
+		return err;
+
+	mb->pos += olen;
+	mb->end  = MAX(mb->end, mb->pos);
+
+	return 0;
+}
@@ -0,0 +1,316 @@
+/**
+ * @file dns/cache.c  Shared DNS Cache
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_hash.h>
+#include <re_tmr.h>
+#include <re_thread.h>
+#include <re_dns.h>
+#include "dns.h"
+
+
+/*
+ * The shared cache holds the received DNS messages, which are immutable
+ * and decoded by the DNS client of each lookup. The entries are spread
+ * over shards with a lock each, so that lookups from different threads
+ * seldom contend. Each shard is bounded and evicts the least recently
+ * used entry; expired entries are removed by lookups and inserts.
+ */
+
+
+enum {
+	SHARDS = 16,
+	SHARD_HASH_SIZE = 64,
+	SWEEP_MAX = 4,
+	PREFETCH_HITS = 2,
+};
+
+
+struct centry {
+	struct le le;
+	struct le le_lru;
+	char *name;
+	struct mbuf *mb;       /* DNS message */
+	uint64_t expires;
+	uint32_t ttl;
+	uint32_t hits;
+	uint16_t type;
+	uint16_t dnsclass;
+	bool refresh;
+};
+
+
+struct cshard {
+	mtx_t *mtx;
+	struct hash *ht;
+	struct list lru;       /* least recently used first */
+	uint32_t n;
+};
+
+
+/** Defines a shared DNS Cache */
+struct dnsc_cache {
+	struct cshard shv[SHARDS];
+	uint32_t size;         /* per shard */
+};
+
+
+static void centry_destructor(void *arg)
+{
+	struct centry *e = arg;
+
+	hash_unlink(&e->le);
+	list_unlink(&e->le_lru);
+	mem_deref(e->name);
+	mem_deref(e->mb);
+}
+
+
+static void shard_flush(struct cshard *sh)
+{
+	struct le *le;
+
+	while ((le = sh->lru.head)) {
+		mem_deref(le->data);
+		--sh->n;
+	}
+}
+
+
+static void destructor(void *arg)
+{
+	struct dnsc_cache *cache = arg;
+	unsigned i;
+
+	for (i=0; i<SHARDS; i++) {
+
+		struct cshard *sh = &cache->shv[i];
+
+		shard_flush(sh);
+		mem_deref(sh->ht);
+		mem_deref(sh->mtx);
+	}
+}
+
+
+static struct cshard *shard_get(struct dnsc_cache *cache, uint32_t key)
+{
+	return &cache->shv[(key >> 16) % SHARDS];
+}
+
+
+static void entry_remove(struct cshard *sh, struct centry *e)
+{
+	mem_deref(e);
+	--sh->n;
+}
+
+
+static struct centry *entry_find(struct cshard *sh, uint32_t key,
+				 const char *name, uint16_t type,
+				 uint16_t dnsclass)
+{
+	struct le *le;
+
+	for (le = hash_list(sh->ht, key)->head; le; le = le->next) {
+
+		struct centry *e = le->data;
+
+		if (e->type != type || e->dnsclass != dnsclass)
+			continue;
+
+		if (!str_casecmp(e->name, name))
+			return e;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Allocate a shared DNS Cache
+ *
+ * The cache can be attached to DNS clients on different threads, see
+ * dnsc_cache_attach().
+ *
+ * @param cachep Pointer to allocated shared DNS Cache
+ * @param size   Maximum number of entries
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dnsc_cache_alloc(struct dnsc_cache **cachep, uint32_t size)
+{
+	struct dnsc_cache *cache;
+	unsigned i;
+	int err = 0;
+
+	if (!cachep || !size)
+		return EINVAL;
+
+	cache = mem_zalloc(sizeof(*cache), destructor);
+	if (!cache)
+		return ENOMEM;
+
+	cache->size = max(size / SHARDS, 1u);
+
+	for (i=0; i<SHARDS; i++) {
+
+		struct cshard *sh = &cache->shv[i];
+
+		err = mutex_alloc(&sh->mtx);
+		if (err)
+			goto out;
+
+		err = hash_alloc(&sh->ht, SHARD_HASH_SIZE);
+		if (err)
+			goto out;
+
+		list_init(&sh->lru);
+	}
+
+ out:
+	if (err)
+		mem_deref(cache);
+	else
+		*cachep = cache;
+
+	return err;
+}
+
+
+/**
+ * Flush a shared DNS Cache
+ *
+ * @param cache Shared DNS Cache
+ */
+void dnsc_cache_clear(struct dnsc_cache *cache)
+{
+	unsigned i;
+
+	if (!cache)
+		return;
+
+	for (i=0; i<SHARDS; i++) {
+
+		struct cshard *sh = &cache->shv[i];
+
+		mtx_lock(sh->mtx);
+		shard_flush(sh);
+		mtx_unlock(sh->mtx);
+	}
+}
+
+
+/*
+ * Looks up a cached DNS message, and returns a reference to it. The
+ * caller is asked to refresh a hot entry close to expiry, once.
+ */
+struct mbuf *dns_cache_lookup(struct dnsc_cache *cache, bool *refreshp,
+			      const char *name, uint16_t type,
+			      uint16_t dnsclass)
+{
+	uint32_t key = hash_wy_str_ci(name);
+	struct cshard *sh = shard_get(cache, key);
+	struct mbuf *mb = NULL;
+	uint64_t now = tmr_jiffies();
+	struct centry *e;
+
+	mtx_lock(sh->mtx);
+
+	e = entry_find(sh, key, name, type, dnsclass);
+	if (!e)
+		goto out;
+
+	if (e->expires <= now) {
+		entry_remove(sh, e);
+		goto out;
+	}
+
+	/* most recently used last */
+	list_unlink(&e->le_lru);
+	list_append(&sh->lru, &e->le_lru, e);
+	++e->hits;
+
+	if (refreshp && !e->refresh && e->hits >= PREFETCH_HITS &&
+	    (e->expires - now) * 10 <= e->ttl) {
+		e->refresh = true;
+		*refreshp = true;
+	}
+
+	mb = mem_ref(e->mb);
+
+ out:
+	mtx_unlock(sh->mtx);
+
+	return mb;
+}
+
+
+/*
+ * Inserts a DNS message, replacing any entry for the same question.
+ * Returns the number of evicted entries.
+ */
+uint32_t dns_cache_insert(struct dnsc_cache *cache, const char *name,
+			  uint16_t type, uint16_t dnsclass,
+			  const uint8_t *msg, size_t len, uint32_t ttl)
+{
+	uint32_t key = hash_wy_str_ci(name);
+	struct cshard *sh = shard_get(cache, key);
+	uint64_t now = tmr_jiffies();
+	uint32_t evicted = 0;
+	struct centry *e, *old;
+	unsigned i;
+
+	e = mem_zalloc(sizeof(*e), centry_destructor);
+	if (!e)
+		return 0;
+
+	e->mb = mbuf_alloc(len);
+	if (!e->mb || mbuf_write_mem(e->mb, msg, len) ||
+	    str_dup(&e->name, name)) {
+		mem_deref(e);
+		return 0;
+	}
+
+	e->type     = type;
+	e->dnsclass = dnsclass;
+	e->ttl      = ttl;
+	e->expires  = now + ttl;
+
+	mtx_lock(sh->mtx);
+
+	old = entry_find(sh, key, name, type, dnsclass);
+	if (old)
+		entry_remove(sh, old);
+
+	/* the least recently used entries are the likely expired ones */
+	for (i=0; i<SWEEP_MAX && sh->lru.head; i++) {
+
+		struct centry *lru = sh->lru.head->data;
+
+		if (lru->expires > now)
+			break;
+
+		entry_remove(sh, lru);
+	}
+
+	while (sh->n >= cache->size) {
+		entry_remove(sh, sh->lru.head->data);
+		++evicted;
+	}
+
+	hash_append(sh->ht, key, &e->le, e);
+	list_append(&sh->lru, &e->le_lru, e);
+	++sh->n;
+
+	mtx_unlock(sh->mtx);
+
+	return evicted;
+}
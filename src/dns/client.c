@@ -17,6 +17,7 @@
 #include <re_tcp.h>
 #include <re_sys.h>
 #include <re_dns.h>
+#include "dns.h"
 
 
 #define DEBUG_MODULE "dnsc"
@@ -33,6 +34,27 @@ enum {
 	SRVC_MAX = 32,
 	RR_MAX = 32,
 	CACHE_TTL_MAX = 1800,
+	CACHE_SIZE = 1024,
+	CACHE_SWEEP = 1000,
+	PREFETCH_HITS = 2,
+	NS_RTO_MIN = 100,           /* [ms] */
+	NS_RTO_MAX = 500,           /* [ms] */
+	NS_SRTT_FAIL = 1000000,     /* [us] */
+	NS_SRTT_MAX = 5000000,      /* [us] */
+	NS_FAIL_MAX = 3,
+	NS_QUARANTINE = 30 * 1000,  /* [ms] */
+	NS_STAT_AGE = 600 * 1000,   /* [ms] */
+};
+
+
+/* Nameserver health */
+struct nsstat {
+	uint64_t updated;      /* [ms] */
+	uint64_t pending;      /* unanswered since, in [ms] */
+	uint64_t quarantine;   /* until, in [ms] */
+	uint32_t srtt;         /* smoothed RTT in [us], 0 if unknown */
+	uint32_t rttvar;       /* [us] */
+	uint32_t fails;        /* consecutive failures */
 };
 
 
@@ -53,9 +75,11 @@ struct dns_query {
 	struct le le;
 	struct le le_hdl;
 	struct le le_tc;
+	struct le le_co;
+	struct list coql;      /* coalesced queries, if lead */
 	struct dnshdr hdr;
 	struct tmr tmr;
-	struct tmr tmr_ttl;
+	struct le le_lru;      /* cache LRU, if cached */
 	struct mbuf mb;
 	struct list rrlv[3];
 	char *name;
@@ -65,10 +89,19 @@ struct dns_query {
 	struct dnsc *dnsc;     /* parent  */
 	struct dns_query **qp; /* app ref */
 	uint32_t ntx;
+	uint32_t txmask;       /* nameservers tried */
+	uint32_t lastmask;     /* last transmission, not replied yet */
+	uint32_t sentmask;     /* nameservers sent the query */
+	uint32_t retxmask;     /* nameservers sent the query again */
+	uint64_t txts;         /* last transmission in [us] */
+	uint64_t expires;      /* cache expiry in [ms] */
+	uint32_t ttl;          /* cache TTL in [ms]    */
+	uint32_t hits;         /* cache hits           */
 	uint16_t id;
 	uint16_t type;
 	uint16_t dnsclass;
 	uint8_t opcode;
+	bool lead;
 	dns_query_h *qh;
 	void *arg;
 };
@@ -89,11 +122,17 @@ struct dnsc {
 	struct list hdl_cache;
 	struct hash *ht_query;
 	struct hash *ht_query_cache;
+	struct list cache_lru;     /* least recently used first */
+	struct dnsc_cache *shared;
+	uint32_t cachec;
+	struct tmr tmr_sweep;
 	struct hash *ht_tcpconn;
 	struct udp_sock *us;
 	struct udp_sock *us6;
 	struct sa srvv[SRVC_MAX];
+	struct nsstat nsv[SRVC_MAX];
 	uint32_t srvc;
+	struct dnsc_stats stats;
 };
 
 
@@ -103,6 +142,8 @@ static const struct dnsc_conf default_conf = {
 	CONN_TIMEOUT,
 	IDLE_TIMEOUT,
 	CACHE_TTL_MAX,
+	CACHE_SIZE,
+	false,
 };
 
 
@@ -142,10 +183,16 @@ static void query_destructor(void *data)
 	uint32_t i;
 
 	query_abort(q);
-	tmr_cancel(&q->tmr_ttl);
+
+	if (q->le_lru.list) {
+		list_unlink(&q->le_lru);
+		--q->dnsc->cachec;
+	}
+
 	mbuf_reset(&q->mb);
 	mem_deref(q->name);
 	list_unlink(&q->le_hdl);
+	list_unlink(&q->le_co);
 
 	for (i=0; i<ARRAY_SIZE(q->rrlv); i++)
 		(void)list_apply(&q->rrlv[i], true, rr_unlink_handler, NULL);
@@ -165,6 +212,16 @@ static void query_handler(struct dns_query *q, int err, struct list *ansl,
 		q->qh = NULL;
 	}
 
+	/* the coalesced queries get the same answer */
+	while (q->coql.head) {
+		struct dns_query *cq = q->coql.head->data;
+
+		list_unlink(&cq->le_co);
+		cq->hdr = q->hdr;
+		query_handler(cq, err, ansl, authl, addl);
+		mem_deref(cq);
+	}
+
 	/* in case we have more (than one) q refs */
 	query_abort(q);
 }
@@ -206,22 +263,372 @@ static bool query_cmp_handler(struct le *le, void *arg)
 }
 
 
-static void ttl_timeout_handler(void *arg)
+static bool query_lead_cmp_handler(struct le *le, void *arg)
 {
-	struct dns_query *q = arg;
+	const struct dns_query *q = le->data;
+	const struct dns_query *cq = arg;
 
-	DEBUG_INFO("ttl cache delete (id: %d): %s.\t%s\t%s\n", q->id, q->name,
-		   dns_rr_classname(q->dnsclass), dns_rr_typename(q->type));
+	if (!q->lead)
+		return false;
 
-	mem_deref(q);
+	if (q->hdr.rd != cq->hdr.rd)
+		return false;
+
+	if (q->type != cq->type || q->dnsclass != cq->dnsclass)
+		return false;
+
+	return !str_casecmp(q->name, cq->name);
+}
+
+
+/*
+ * The health of the client's own nameservers is tracked, and each
+ * UDP transmission goes to the fastest nameserver not yet tried by the
+ * query. A nameserver which timed out ranks behind the responsive ones,
+ * and is quarantined after repeated failures. The health of nameservers
+ * which were not used for a while is forgotten, for them to be probed
+ * again.
+ */
+static bool ns_tracked(const struct dns_query *q)
+{
+	return q->srvv == q->dnsc->srvv && q->srvc == &q->dnsc->srvc;
+}
+
+
+static void ns_fail(struct dnsc *dnsc, uint32_t idx, uint64_t now)
+{
+	struct nsstat *ns = &dnsc->nsv[idx];
+
+	ns->srtt    = ns->srtt ? min(ns->srtt * 2, (uint32_t)NS_SRTT_MAX)
+			       : NS_SRTT_FAIL;
+	ns->pending = 0;
+	ns->updated = now;
+
+	if (++ns->fails >= NS_FAIL_MAX) {
+		DEBUG_NOTICE("nameserver %J quarantined\n",
+			     &dnsc->srvv[idx]);
+		ns->quarantine = now + NS_QUARANTINE;
+		ns->fails = 0;
+	}
+}
+
+
+static struct nsstat *ns_stat(struct dnsc *dnsc, uint32_t idx, uint64_t now)
+{
+	struct nsstat *ns = &dnsc->nsv[idx];
+
+	if (ns->updated && now > ns->updated + NS_STAT_AGE)
+		memset(ns, 0, sizeof(*ns));
+
+	/* a transmission which was not answered in time is a failure,
+	   also if another nameserver answered the query meanwhile */
+	if (ns->pending && now >= ns->pending + NS_RTO_MAX)
+		ns_fail(dnsc, idx, now);
+
+	return ns;
+}
+
+
+static bool ns_better(struct dnsc *dnsc, uint32_t a, uint32_t b,
+		      uint64_t now)
+{
+	const struct nsstat *nsa = ns_stat(dnsc, a, now);
+	const struct nsstat *nsb = ns_stat(dnsc, b, now);
+	bool qa = nsa->quarantine > now;
+	bool qb = nsb->quarantine > now;
+
+	if (qa != qb)
+		return qb;
+
+	if (qa)
+		return nsa->quarantine < nsb->quarantine;
+
+	return nsa->srtt < nsb->srtt;
+}
+
+
+/* Returns the best nameserver not in the mask, or -1 */
+static int ns_best(struct dnsc *dnsc, uint32_t mask)
+{
+	uint64_t now = tmr_jiffies();
+	int best = -1;
+	uint32_t i;
+
+	for (i=0; i<dnsc->srvc; i++) {
+
+		if (mask & (1u << i))
+			continue;
+
+		if (best < 0 || ns_better(dnsc, i, best, now))
+			best = i;
+	}
+
+	return best;
+}
+
+
+static int ns_index(const struct dnsc *dnsc, const struct sa *src)
+{
+	uint32_t i;
+
+	for (i=0; i<dnsc->srvc; i++) {
+		if (sa_cmp(&dnsc->srvv[i], src, SA_ALL))
+			return i;
+	}
+
+	return -1;
+}
+
+
+static void ns_sent(struct dnsc *dnsc, uint32_t idx)
+{
+	struct nsstat *ns = &dnsc->nsv[idx];
+
+	if (!ns->pending)
+		ns->pending = tmr_jiffies();
+}
+
+
+/* Any reply from a nameserver shows that it is alive */
+static void ns_alive(struct dnsc *dnsc, const struct sa *src)
+{
+	struct nsstat *ns;
+	int idx;
+
+	if (!src)
+		return;
+
+	idx = ns_index(dnsc, src);
+	if (idx < 0)
+		return;
+
+	ns = &dnsc->nsv[idx];
+
+	ns->pending    = 0;
+	ns->fails      = 0;
+	ns->quarantine = 0;
+	ns->updated    = tmr_jiffies();
+}
+
+
+static void ns_reply(struct dns_query *q, const struct sa *src, bool fail)
+{
+	struct dnsc *dnsc = q->dnsc;
+	uint64_t now = tmr_jiffies();
+	struct nsstat *ns;
+	uint32_t rtt;
+	bool last;
+	int idx;
+
+	if (!src || !ns_tracked(q))
+		return;
+
+	idx = ns_index(dnsc, src);
+	if (idx < 0)
+		return;
+
+	last = q->lastmask & (1u << idx);
+	q->lastmask &= ~(1u << idx);
+
+	if (fail) {
+		ns_fail(dnsc, idx, now);
+		return;
+	}
+
+	ns = &dnsc->nsv[idx];
+
+	ns->pending    = 0;
+	ns->fails      = 0;
+	ns->quarantine = 0;
+	ns->updated    = now;
+
+	/* the RTT is ambiguous for a retransmitted query (Karn) */
+	if (!last || q->retxmask & (1u << idx))
+		return;
+
+	rtt = (uint32_t)min(tmr_jiffies_usec() - q->txts,
+			    (uint64_t)NS_SRTT_MAX);
+
+	/* RFC 6298 */
+	if (!ns->srtt || ns->srtt >= NS_SRTT_FAIL) {
+		ns->srtt   = rtt;
+		ns->rttvar = rtt / 2;
+	}
+	else {
+		uint32_t d = ns->srtt > rtt ? ns->srtt - rtt : rtt - ns->srtt;
+
+		ns->rttvar = (3 * ns->rttvar + d) / 4;
+		ns->srtt   = (7 * ns->srtt + rtt) / 8;
+	}
+}
+
+
+/* The retransmission timeout of the nameservers of the last
+ * transmission, in [ms] */
+static uint32_t ns_rto(struct dns_query *q)
+{
+	uint64_t now = tmr_jiffies();
+	uint32_t rto = 0;
+	uint32_t i;
+
+	if (!ns_tracked(q))
+		return NS_RTO_MAX;
+
+	for (i=0; i<q->dnsc->srvc; i++) {
+
+		const struct nsstat *ns;
+
+		if (!(q->lastmask & (1u << i)))
+			continue;
+
+		ns = ns_stat(q->dnsc, i, now);
+		if (!ns->srtt || ns->srtt >= NS_SRTT_FAIL)
+			return NS_RTO_MAX;
+
+		rto = max(rto, (ns->srtt + 4 * ns->rttvar) / 1000);
+	}
+
+	return min(max(rto, (uint32_t)NS_RTO_MIN), (uint32_t)NS_RTO_MAX);
+}
+
+
+static uint32_t ttl_msec(int64_t ttl)
+{
+	/* Fallback to 100ms for faster unit tests */
+	return ttl > 1 ? (uint32_t)ttl * 1000 : 100;
+}
+
+
+static void cache_sweep_handler(void *arg)
+{
+	struct dnsc *dnsc = arg;
+	uint64_t now = tmr_jiffies();
+	struct le *le = dnsc->cache_lru.head;
+
+	while (le) {
+		struct dns_query *q = le->data;
+
+		le = le->next;
+
+		if (q->expires <= now) {
+			DEBUG_INFO("ttl cache delete (id: %d): %s.\t%s\t%s\n",
+				   q->id, q->name,
+				   dns_rr_classname(q->dnsclass),
+				   dns_rr_typename(q->type));
+			mem_deref(q);
+		}
+	}
+
+	if (dnsc->cachec)
+		tmr_start(&dnsc->tmr_sweep, CACHE_SWEEP, cache_sweep_handler,
+			  dnsc);
+}
+
+
+/*
+ * The cache is bounded by the number of entries and evicts the least
+ * recently used one. Expired entries are removed by a single sweep
+ * timer, and lookups ignore entries which expired since the last sweep.
+ */
+static void cache_insert(struct dnsc *dnsc, struct dns_query *q,
+			 int64_t ttl)
+{
+	struct dnsquery dq;
+	uint32_t size = dnsc->conf.cache_size ? dnsc->conf.cache_size
+					      : CACHE_SIZE;
+
+	dq.hdr      = q->hdr;
+	dq.type     = q->type;
+	dq.dnsclass = q->dnsclass;
+	dq.name     = q->name;
+	dq.cache    = true;
+
+	/* replaces an entry refreshed ahead of expiry */
+	mem_deref(list_ledata(hash_lookup(dnsc->ht_query_cache,
+					  hash_wy_str_ci(q->name),
+					  query_cmp_handler, &dq)));
+
+	while (dnsc->cachec >= size) {
+		++dnsc->stats.cache_evictions;
+		mem_deref(list_ledata(dnsc->cache_lru.head));
+	}
+
+	q->ttl     = ttl_msec(ttl);
+	q->expires = tmr_jiffies() + q->ttl;
+	q->hits    = 0;
+
+	/* the wire query is not needed any more */
+	mbuf_reset(&q->mb);
+
+	hash_append(dnsc->ht_query_cache, hash_wy_str_ci(q->name), &q->le,
+		    q);
+	list_append(&dnsc->cache_lru, &q->le_lru, q);
+	++dnsc->cachec;
+
+	DEBUG_INFO("cache %s. (id: %d) %d secs\n", q->name, q->id, ttl);
+
+	if (!tmr_isrunning(&dnsc->tmr_sweep))
+		tmr_start(&dnsc->tmr_sweep, CACHE_SWEEP, cache_sweep_handler,
+			  dnsc);
 }
 
 
-static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
+static int rrlv_decode(struct list *rrlv, struct dns_msg *msg)
+{
+	int err = 0;
+
+	for (unsigned i = 0; i < 3; i++) {
+
+		if (dns_msg_count(msg, i) > RR_MAX)
+			DEBUG_WARNING("limit rr records %d\n", RR_MAX);
+
+		err |= dns_msg_rrlist(&rrlv[i], msg, i, RR_MAX);
+	}
+
+#if DEBUG_LEVEL > 5
+	for (unsigned i = 0; i < 3; i++) {
+		struct le *le;
+
+		LIST_FOREACH(&rrlv[i], le) {
+			DEBUG_INFO("%H\n", dns_rr_print, le->data);
+		}
+	}
+#endif
+
+	return err;
+}
+
+
+/* The lowest TTL of the records, which are not allocated for this */
+static void msg_ttl(const struct dns_msg *msg, int64_t *ttlp)
+{
+	for (unsigned i = 0; i < 3; i++) {
+
+		uint32_t n = min(dns_msg_count(msg, i), (uint32_t)RR_MAX);
+
+		for (uint32_t j = 0; j < n; j++) {
+
+			struct dnsrr rr;
+
+			(void)dns_msg_rr(msg, i, j, &rr);
+
+			if (rr.ttl < *ttlp)
+				*ttlp = rr.ttl;
+		}
+	}
+}
+
+
+static int reply_recv(struct dnsc *dnsc, const struct sa *src,
+		      struct mbuf *mb)
 {
 	struct dns_query *q = NULL;
-	uint32_t nv[3];
+	struct dns_msg *msg = NULL;
+	const char *name;
 	struct dnsquery dq;
+	struct dnsrr soa;
+	size_t start;
+	bool cache;
 	int err = 0;
 	int64_t ttl;
 
@@ -229,72 +636,75 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 		return EINVAL;
 
 	ttl = dnsc->conf.cache_ttl_max;
-	dq.name = NULL;
+	start = mb->pos;
 	dq.cache = false;
 
-	if (dns_hdr_decode(mb, &dq.hdr) || !dq.hdr.qr) {
-		err = EBADMSG;
-		goto out;
-	}
-
-	err = dns_dname_decode(mb, &dq.name, 0);
+	/* one allocation, the records are allocated only when needed */
+	err = dns_msg_decode(&msg, mb);
 	if (err)
 		goto out;
 
-	if (mbuf_get_left(mb) < 4) {
+	dq.hdr = *dns_msg_hdr(msg);
+	if (!dq.hdr.qr) {
 		err = EBADMSG;
 		goto out;
 	}
 
-	dq.type     = ntohs(mbuf_read_u16(mb));
-	dq.dnsclass = ntohs(mbuf_read_u16(mb));
+	err = dns_msg_question(msg, &name, &dq.type, &dq.dnsclass);
+	if (err)
+		goto out;
+
+	dq.name = (char *)name;
 
-	q = list_ledata(hash_lookup(dnsc->ht_query, hash_joaat_str_ci(dq.name),
+	q = list_ledata(hash_lookup(dnsc->ht_query, hash_wy_str_ci(dq.name),
 				    query_cmp_handler, &dq));
 	if (!q) {
+		/* e.g. the slower nameserver of a race */
+		ns_alive(dnsc, src);
 		err = ENOENT;
 		goto out;
 	}
 
-	/* try next server */
-	if (dq.hdr.rcode == DNS_RCODE_SRV_FAIL && q->ntx < *q->srvc) {
+	ns_reply(q, src, dq.hdr.rcode == DNS_RCODE_SRV_FAIL);
 
-		if (!q->tc) /* try next UDP server immediately */
+	/* try next server, unless another nameserver of the last UDP
+	   transmission may still answer, e.g. of a race */
+	if (dq.hdr.rcode == DNS_RCODE_SRV_FAIL &&
+	    ((!q->tc && q->lastmask) || q->ntx < *q->srvc)) {
+
+		/* try next UDP server immediately */
+		if (!q->tc && !q->lastmask)
 			tmr_start(&q->tmr, 0, udp_timeout_handler, q);
 
 		err = EPROTO;
 		goto out;
 	}
 
-	nv[0] = dq.hdr.nans;
-	nv[1] = dq.hdr.nauth;
-	nv[2] = dq.hdr.nadd;
-
-	DEBUG_INFO("--- ANSWER SECTION id: %d ---\n", q->id);
-	for (uint32_t i = 0; i < ARRAY_SIZE(nv); i++) {
-		uint32_t l = nv[i];
-
-		if (l > RR_MAX) {
-			l = RR_MAX;
-			DEBUG_WARNING("limit rr records %d\n", l);
-		}
-
-		for (uint32_t j = 0; j < l; j++) {
+	msg_ttl(msg, &ttl);
 
-			struct dnsrr *rr = NULL;
+	/* Only answers and NXDOMAIN are cached, and negative answers
+	   with the SOA minimum value (RFC 2308) */
+	cache = dnsc->conf.cache_ttl_max && q->type != DNS_QTYPE_AXFR &&
+		(dq.hdr.rcode == DNS_RCODE_OK ||
+		 dq.hdr.rcode == DNS_RCODE_NAME_ERR);
 
-			err = dns_rr_decode(mb, &rr, 0);
-			if (err) {
-				query_handler(q, err, NULL, NULL, NULL);
-				mem_deref(q);
-				goto out;
-			}
+	if (cache && !dq.hdr.nans) {
+		cache = !dns_msg_rr(msg, 1, 0, &soa) &&
+			soa.type == DNS_TYPE_SOA;
+		if (cache && soa.rdata.soa.ttlmin < ttl)
+			ttl = soa.rdata.soa.ttlmin;
+	}
 
-			DEBUG_INFO("%H\n", dns_rr_print, rr);
+	/* e.g. a prefetch into the shared cache has no use for them */
+	if (q->qh || q->coql.head || q->type == DNS_QTYPE_AXFR ||
+	    (cache && !dnsc->shared)) {
 
-			list_append(&q->rrlv[i], &rr->le_priv, rr);
-			if (rr->ttl < ttl)
-				ttl = rr->ttl;
+		DEBUG_INFO("--- ANSWER SECTION id: %d ---\n", q->id);
+		err = rrlv_decode(q->rrlv, msg);
+		if (err) {
+			query_handler(q, err, NULL, NULL, NULL);
+			mem_deref(q);
+			goto out;
 		}
 	}
 
@@ -316,41 +726,27 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 	q->hdr = dq.hdr;
 	query_handler(q, 0, &q->rrlv[0], &q->rrlv[1], &q->rrlv[2]);
 
-
-	if (!dnsc->conf.cache_ttl_max || q->type == DNS_QTYPE_AXFR) {
+	if (!cache) {
 		mem_deref(q);
 		goto out;
 	}
 
-	/* Don't cache empty RR answer if authority is also empty. */
-	if (!dq.hdr.nans && !dq.hdr.nauth) {
+	if (!dq.hdr.nans)
+		++dnsc->stats.cache_negative;
+
+	if (dnsc->shared) {
+		dnsc->stats.cache_evictions +=
+			dns_cache_insert(dnsc->shared, q->name, q->type,
+					 q->dnsclass, mb->buf + start,
+					 mb->end - start, ttl_msec(ttl));
 		mem_deref(q);
 		goto out;
 	}
 
-	/* Cache negative answer with SOA minimum value (RFC 2308) */
-	if (!dq.hdr.nans && dq.hdr.nauth) {
-		const struct dnsrr *rr = list_ledata(list_head(&q->rrlv[1]));
-
-		if (!rr || rr->type != DNS_TYPE_SOA) {
-			mem_deref(q);
-			goto out;
-		}
-
-		if (rr->rdata.soa.ttlmin < dnsc->conf.cache_ttl_max)
-			ttl = rr->rdata.soa.ttlmin;
-	}
-
-	/* Cache DNS query with TTL timeout */
-	hash_append(dnsc->ht_query_cache, hash_joaat_str_ci(q->name), &q->le,
-		    q);
-	DEBUG_INFO("cache %s. (id: %d) %d secs\n", q->name, q->id, ttl);
-	/* Fallback to 100ms for faster unit tests */
-	tmr_start(&q->tmr_ttl, ttl > 1 ? ttl * 1000 : 100,
-		  ttl_timeout_handler, q);
+	cache_insert(dnsc, q, ttl);
 
  out:
-	mem_deref(dq.name);
+	mem_deref(msg);
 
 	return err;
 }
@@ -358,8 +754,7 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 
 static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 {
-	(void)src;
-	(void)reply_recv(arg, mb);
+	(void)reply_recv(arg, src, mb);
 }
 
 
@@ -405,7 +800,8 @@ static void tcp_recv_handler(struct mbuf *mbrx, void *arg)
 
 	mb->pos = 0;
 
-	err = reply_recv(tc->dnsc, mb);
+	/* the health is tracked for UDP only */
+	err = reply_recv(tc->dnsc, NULL, mb);
 	if (err)
 		goto error;
 
@@ -639,6 +1035,76 @@ static void tcp_timeout_handler(void *arg)
 }
 
 
+static struct udp_sock *udp_sock(const struct dnsc *dnsc,
+				 const struct sa *srv)
+{
+	switch (sa_af(srv)) {
+
+	case AF_INET:
+		return dnsc->us;
+
+	case AF_INET6:
+		return dnsc->us6;
+
+	default:
+		return NULL;
+	}
+}
+
+
+/* Sends to the best nameserver which was not tried yet */
+static int send_udp_ns(struct dns_query *q, bool race)
+{
+	struct dnsc *dnsc = q->dnsc;
+	uint64_t now = tmr_jiffies();
+	int err = ETIMEDOUT;
+	uint32_t i;
+
+	for (i=0; i<dnsc->srvc; i++) {
+
+		const struct sa *srv;
+		struct udp_sock *us;
+		int idx;
+
+		idx = ns_best(dnsc, q->txmask);
+		if (idx < 0) {
+			/* all tried, start over */
+			q->txmask = 0;
+			idx = ns_best(dnsc, 0);
+		}
+
+		/* a quarantined nameserver is not raced */
+		if (race && ns_stat(dnsc, idx, now)->quarantine > now)
+			return ENOENT;
+
+		srv = &dnsc->srvv[idx];
+		q->txmask |= 1u << idx;
+		++q->ntx;
+
+		DEBUG_INFO("trying udp server#%d: %J\n", idx, srv);
+
+		us = udp_sock(dnsc, srv);
+		if (!us)
+			continue;
+
+		q->mb.pos = 0;
+		err = udp_send(us, srv, &q->mb);
+		if (!err) {
+			ns_sent(dnsc, idx);
+
+			if (q->sentmask & (1u << idx))
+				q->retxmask |= 1u << idx;
+
+			q->sentmask |= 1u << idx;
+			q->lastmask |= 1u << idx;
+			break;
+		}
+	}
+
+	return err;
+}
+
+
 static int send_udp(struct dns_query *q)
 {
 	const struct sa *srv;
@@ -648,6 +1114,13 @@ static int send_udp(struct dns_query *q)
 	if (!q)
 		return EINVAL;
 
+	if (ns_tracked(q)) {
+		q->lastmask = 0;
+		q->txts = tmr_jiffies_usec();
+
+		return send_udp_ns(q, false);
+	}
+
 	for (i=0; i<*q->srvc; i++) {
 
 		struct udp_sock *us;
@@ -656,19 +1129,9 @@ static int send_udp(struct dns_query *q)
 
 		DEBUG_INFO("trying udp server#%u: %J\n", i, srv);
 
-		switch (sa_af(srv)) {
-
-		case AF_INET:
-			us = q->dnsc->us;
-			break;
-
-		case AF_INET6:
-			us = q->dnsc->us6;
-			break;
-
-		default:
+		us = udp_sock(q->dnsc, srv);
+		if (!us)
 			continue;
-		}
 
 		q->mb.pos = 0;
 		err = udp_send(us, srv, &q->mb);
@@ -725,12 +1188,253 @@ static void hdl_tmr_cache(void *arg)
 }
 
 
+static int query_send(struct dns_query *q, const struct dnsrr *ans_rr,
+		      int proto)
+{
+	int err;
+
+	if (proto == IPPROTO_TCP)
+		q->mb.pos += 2;
+
+	err = dns_hdr_encode(&q->mb, &q->hdr);
+	if (err)
+		return err;
+
+	err = dns_dname_encode(&q->mb, q->name, NULL, 0, false);
+	if (err)
+		return err;
+
+	err |= mbuf_write_u16(&q->mb, htons(q->type));
+	err |= mbuf_write_u16(&q->mb, htons(q->dnsclass));
+	if (err)
+		return err;
+
+	if (ans_rr) {
+		err = dns_rr_encode(&q->mb, ans_rr, 0, NULL, 0);
+		if (err)
+			return err;
+	}
+
+	switch (proto) {
+
+	case IPPROTO_TCP:
+		q->mb.pos = 0;
+		(void)mbuf_write_u16(&q->mb, htons((uint16_t)q->mb.end - 2));
+
+		err = send_tcp(q);
+		if (err)
+			return err;
+
+		tmr_start(&q->tmr, 60 * 1000, tcp_timeout_handler, q);
+		break;
+
+	case IPPROTO_UDP:
+		err = send_udp(q);
+		if (err)
+			return err;
+
+		/* race the first transmission to the second best */
+		if (q->dnsc->conf.race && ns_tracked(q) && *q->srvc > 1 &&
+		    !send_udp_ns(q, true))
+			++q->dnsc->stats.races;
+
+		tmr_start(&q->tmr, ns_rto(q), udp_timeout_handler, q);
+		break;
+
+	default:
+		return EPROTONOSUPPORT;
+	}
+
+	++q->dnsc->stats.wire;
+
+	return 0;
+}
+
+
+static int lead_alloc(struct dns_query **lqp, struct dnsc *dnsc,
+		      const char *name, uint16_t type, uint16_t dnsclass,
+		      bool rd)
+{
+	struct dns_query *lq;
+	uint32_t i;
+	int err;
+
+	lq = mem_zalloc(sizeof(*lq), query_destructor);
+	if (!lq)
+		return ENOMEM;
+
+	hash_append(dnsc->ht_query, hash_wy_str_ci(name), &lq->le, lq);
+	tmr_init(&lq->tmr);
+	mbuf_init(&lq->mb);
+
+	for (i=0; i<ARRAY_SIZE(lq->rrlv); i++)
+		list_init(&lq->rrlv[i]);
+
+	err = str_dup(&lq->name, name);
+	if (err)
+		goto out;
+
+	lq->srvv     = dnsc->srvv;
+	lq->srvc     = &dnsc->srvc;
+	lq->id       = rand_u16();
+	lq->type     = type;
+	lq->opcode   = DNS_OPCODE_QUERY;
+	lq->dnsclass = dnsclass;
+	lq->dnsc     = dnsc;
+	lq->lead     = true;
+
+	lq->hdr.id     = lq->id;
+	lq->hdr.opcode = lq->opcode;
+	lq->hdr.rd     = rd;
+	lq->hdr.nq     = 1;
+
+	err = query_send(lq, NULL, IPPROTO_UDP);
+
+ out:
+	if (err)
+		mem_deref(lq);
+	else
+		*lqp = lq;
+
+	return err;
+}
+
+
+/*
+ * Attach a query to an identical one which is outstanding, or to a new
+ * lead query which is sent instead. The lead query has no handler of
+ * its own; it completes all attached queries and then is cached.
+ */
+static int query_coalesce(struct dns_query *q)
+{
+	struct dnsc *dnsc = q->dnsc;
+	struct dns_query *lq;
+	int err;
+
+	lq = list_ledata(hash_lookup(dnsc->ht_query, hash_wy_str_ci(q->name),
+				     query_lead_cmp_handler, q));
+	if (lq) {
+		++dnsc->stats.coalesced;
+	}
+	else {
+		err = lead_alloc(&lq, dnsc, q->name, q->type, q->dnsclass,
+				 q->hdr.rd);
+		if (err)
+			return err;
+	}
+
+	hash_unlink(&q->le);
+	list_append(&lq->coql, &q->le_co, q);
+
+	return 0;
+}
+
+
+/*
+ * Refreshes a hot cache entry which is close to expiry, so that the
+ * next lookups are not waiting for the nameservers. The reply replaces
+ * the entry.
+ */
+static void cache_prefetch(struct dns_query *qc)
+{
+	struct dnsc *dnsc = qc->dnsc;
+	struct dns_query *lq;
+
+	if (!qc->lead || qc->hits < PREFETCH_HITS)
+		return;
+
+	if ((qc->expires - tmr_jiffies()) * 10 > qc->ttl)
+		return;
+
+	if (hash_lookup(dnsc->ht_query, hash_wy_str_ci(qc->name),
+			query_lead_cmp_handler, qc))
+		return;
+
+	if (lead_alloc(&lq, dnsc, qc->name, qc->type, qc->dnsclass,
+		       qc->hdr.rd))
+		return;
+
+	++dnsc->stats.prefetches;
+}
+
+
+static bool shared_cache_handler(struct dns_query *q)
+{
+	struct dnsc *dnsc = q->dnsc;
+	bool rd = q->hdr.rd;
+	bool refresh = false;
+	bool own;
+	struct mbuf *mbc, mb;
+	struct dns_msg *msg;
+	uint32_t i;
+	int err;
+
+	if (!dnsc->conf.cache_ttl_max)
+		return false;
+
+	/* only queries on the client's nameservers are refreshed */
+	own = q->srvv == dnsc->srvv && q->srvc == &dnsc->srvc;
+
+	mbc = dns_cache_lookup(dnsc->shared, own ? &refresh : NULL,
+			       q->name, q->type, q->dnsclass);
+	if (!mbc) {
+		++dnsc->stats.cache_misses;
+		return false;
+	}
+
+	/* the cached message is shared, decode from a view of it */
+	mb = *mbc;
+	mb.pos = 0;
+
+	err = dns_msg_decode(&msg, &mb);
+	mem_deref(mbc);
+	if (err) {
+		++dnsc->stats.cache_misses;
+		return false;
+	}
+
+	err = rrlv_decode(q->rrlv, msg);
+	if (err) {
+		for (i=0; i<ARRAY_SIZE(q->rrlv); i++)
+			list_flush(&q->rrlv[i]);
+
+		mem_deref(msg);
+		++dnsc->stats.cache_misses;
+		return false;
+	}
+
+	q->hdr    = *dns_msg_hdr(msg);
+	q->hdr.id = q->id;
+
+	mem_deref(msg);
+
+	hash_unlink(&q->le);
+	list_append(&dnsc->hdl_cache, &q->le_hdl, q);
+
+	tmr_start(&dnsc->hdl_tmr, 0, hdl_tmr_cache, &dnsc->hdl_cache);
+
+	++dnsc->stats.cache_hits;
+
+	if (refresh) {
+		struct dns_query *lq;
+
+		if (!lead_alloc(&lq, dnsc, q->name, q->type, q->dnsclass, rd))
+			++dnsc->stats.prefetches;
+	}
+
+	return true;
+}
+
+
 static bool query_cache_handler(struct dns_query *q)
 {
 	struct dnsquery dq;
-	const struct dns_query *qc = NULL;
+	struct dns_query *qc = NULL;
 	struct le *le;
 
+	if (q->dnsc->shared)
+		return shared_cache_handler(q);
+
 	dq.hdr	    = q->hdr;
 	dq.type	    = q->type;
 	dq.dnsclass = q->dnsclass;
@@ -738,11 +1442,18 @@ static bool query_cache_handler(struct dns_query *q)
 	dq.cache    = true;
 
 	qc = list_ledata(hash_lookup(q->dnsc->ht_query_cache,
-				     hash_joaat_str_ci(q->name),
+				     hash_wy_str_ci(q->name),
 				     query_cmp_handler, &dq));
-	if (!qc)
+	if (!qc || qc->expires <= tmr_jiffies()) {
+		if (q->dnsc->conf.cache_ttl_max)
+			++q->dnsc->stats.cache_misses;
 		return false;
+	}
 
+	/* most recently used last */
+	list_unlink(&qc->le_lru);
+	list_append(&q->dnsc->cache_lru, &qc->le_lru, qc);
+	++qc->hits;
 
 	for (uint32_t i = 0; i < ARRAY_SIZE(qc->rrlv); i++) {
 		LIST_FOREACH(&qc->rrlv[i], le)
@@ -756,11 +1467,19 @@ static bool query_cache_handler(struct dns_query *q)
 	q->rrlv[1] = qc->rrlv[1];
 	q->rrlv[2] = qc->rrlv[2];
 
+	/* the cached reply header, including the rcode */
+	q->hdr    = qc->hdr;
+	q->hdr.id = q->id;
+
 	hash_unlink(&q->le);
 	list_append(&q->dnsc->hdl_cache, &q->le_hdl, q);
 
 	tmr_start(&q->dnsc->hdl_tmr, 0, hdl_tmr_cache, &q->dnsc->hdl_cache);
 
+	++q->dnsc->stats.cache_hits;
+
+	cache_prefetch(qc);
+
 	return true;
 }
 
@@ -786,9 +1505,8 @@ static int query(struct dns_query **qp, struct dnsc *dnsc, uint8_t opcode,
 	if (!q)
 		goto nmerr;
 
-	hash_append(dnsc->ht_query, hash_joaat_str_ci(name), &q->le, q);
+	hash_append(dnsc->ht_query, hash_wy_str_ci(name), &q->le, q);
 	tmr_init(&q->tmr);
-	tmr_init(&q->tmr_ttl);
 	mbuf_init(&q->mb);
 
 	for (i=0; i<ARRAY_SIZE(q->rrlv); i++)
@@ -823,57 +1541,20 @@ static int query(struct dns_query **qp, struct dnsc *dnsc, uint8_t opcode,
 	DEBUG_INFO("%s.\t%s\t%s\n", q->name, dns_rr_classname(q->dnsclass),
 		   dns_rr_typename(q->type));
 
+	++dnsc->stats.queries;
+
 	if (query_cache_handler(q))
 		goto out;
 
-	if (proto == IPPROTO_TCP)
-		q->mb.pos += 2;
-
-	err = dns_hdr_encode(&q->mb, &hdr);
-	if (err)
-		goto error;
-
-	err = dns_dname_encode(&q->mb, name, NULL, 0, false);
-	if (err)
-		goto error;
-
-	err |= mbuf_write_u16(&q->mb, htons(type));
-	err |= mbuf_write_u16(&q->mb, htons(dnsclass));
+	/* the lead query must not outlive caller-owned nameservers */
+	if (proto == IPPROTO_UDP && opcode == DNS_OPCODE_QUERY && !ans_rr &&
+	    srvv == dnsc->srvv && srvc == &dnsc->srvc)
+		err = query_coalesce(q);
+	else
+		err = query_send(q, ans_rr, proto);
 	if (err)
 		goto error;
 
-	if (ans_rr) {
-		err = dns_rr_encode(&q->mb, ans_rr, 0, NULL, 0);
-		if (err)
-			goto error;
-	}
-
-	switch (proto) {
-
-	case IPPROTO_TCP:
-		q->mb.pos = 0;
-		(void)mbuf_write_u16(&q->mb, htons((uint16_t)q->mb.end - 2));
-
-		err = send_tcp(q);
-		if (err)
-			goto error;
-
-		tmr_start(&q->tmr, 60 * 1000, tcp_timeout_handler, q);
-		break;
-
-	case IPPROTO_UDP:
-		err = send_udp(q);
-		if (err)
-			goto error;
-
-		tmr_start(&q->tmr, 500, udp_timeout_handler, q);
-		break;
-
-	default:
-		err = EPROTONOSUPPORT;
-		goto error;
-	}
-
 out:
 	if (qp) {
 		q->qp = qp;
@@ -981,10 +1662,12 @@ static void dnsc_destructor(void *data)
 	hash_flush(dnsc->ht_tcpconn);
 	hash_flush(dnsc->ht_query_cache);
 	tmr_cancel(&dnsc->hdl_tmr);
+	tmr_cancel(&dnsc->tmr_sweep);
 
 	mem_deref(dnsc->ht_tcpconn);
 	mem_deref(dnsc->ht_query);
 	mem_deref(dnsc->ht_query_cache);
+	mem_deref(dnsc->shared);
 	mem_deref(dnsc->us6);
 	mem_deref(dnsc->us);
 }
@@ -1050,6 +1733,8 @@ int dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
 
 	tmr_init(&dnsc->hdl_tmr);
 	list_init(&dnsc->hdl_cache);
+	tmr_init(&dnsc->tmr_sweep);
+	list_init(&dnsc->cache_lru);
 
  out:
 	if (err)
@@ -1061,6 +1746,13 @@ int dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
 }
 
 
+static void query_cache_flush(struct dnsc *dnsc)
+{
+	hash_flush(dnsc->ht_query_cache);
+	tmr_cancel(&dnsc->tmr_sweep);
+}
+
+
 int dnsc_conf_set(struct dnsc *dnsc, const struct dnsc_conf *conf)
 {
 	int err;
@@ -1072,6 +1764,8 @@ int dnsc_conf_set(struct dnsc *dnsc, const struct dnsc_conf *conf)
 	else
 		dnsc->conf = default_conf;
 
+	/* an attached shared cache is left to dnsc_cache_clear() */
+	query_cache_flush(dnsc);
 
 	dnsc->ht_query = mem_deref(dnsc->ht_query);
 	dnsc->ht_query_cache = mem_deref(dnsc->ht_query_cache);
@@ -1110,6 +1804,7 @@ int dnsc_srv_set(struct dnsc *dnsc, const struct sa *srvv, uint32_t srvc)
 		return EINVAL;
 
 	dnsc->srvc = min((uint32_t)ARRAY_SIZE(dnsc->srvv), srvc);
+	memset(dnsc->nsv, 0, sizeof(dnsc->nsv));
 
 	if (srvv) {
 		for (i=0; i<dnsc->srvc; i++)
@@ -1121,7 +1816,7 @@ int dnsc_srv_set(struct dnsc *dnsc, const struct sa *srvv, uint32_t srvc)
 
 
 /**
- * Flush DNS cache
+ * Flush DNS cache, including an attached shared DNS cache
  *
  * @param dnsc DNS Client
  */
@@ -1130,13 +1825,39 @@ void dnsc_cache_flush(struct dnsc *dnsc)
 	if (!dnsc)
 		return;
 
-	hash_flush(dnsc->ht_query_cache);
+	query_cache_flush(dnsc);
+	dnsc_cache_clear(dnsc->shared);
+}
+
+
+/**
+ * Attach a shared DNS Cache to a DNS Client
+ *
+ * The DNS Client then looks up and caches answers in the shared cache
+ * instead of its own. The cache statistics of the DNS Client count its
+ * own lookups only.
+ *
+ * @param dnsc  DNS Client
+ * @param cache Shared DNS Cache, NULL to detach
+ */
+void dnsc_cache_attach(struct dnsc *dnsc, struct dnsc_cache *cache)
+{
+	if (!dnsc)
+		return;
+
+	query_cache_flush(dnsc);
+
+	mem_deref(dnsc->shared);
+	dnsc->shared = mem_ref(cache);
 }
 
 
 /**
  * Set max. Cache TTL
  *
+ * Disabling the cache flushes the entries of the DNS Client, an attached
+ * shared DNS cache is cleared with dnsc_cache_clear() only.
+ *
  * @param dnsc  DNS Client
  * @param max   Value in [s] and 0 to disable caching
  */
@@ -1148,5 +1869,24 @@ void dnsc_cache_max(struct dnsc *dnsc, uint32_t max)
 	dnsc->conf.cache_ttl_max = max;
 
 	if (!max)
-		dnsc_cache_flush(dnsc);
+		query_cache_flush(dnsc);
+}
+
+
+/**
+ * Get the statistics of a DNS Client
+ *
+ * @param dnsc  DNS Client
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dnsc_stats_get(const struct dnsc *dnsc, struct dnsc_stats *stats)
+{
+	if (!dnsc || !stats)
+		return EINVAL;
+
+	*stats = dnsc->stats;
+
+	return 0;
 }
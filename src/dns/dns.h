@@ -14,3 +14,12 @@ int get_windns(char *domain, size_t dsize, struct sa *nav, uint32_t *n);
 #ifdef DARWIN
 int get_darwin_dns(char *domain, size_t dsize, struct sa *nsv, uint32_t *n);
 #endif
+
+
+/* shared cache */
+struct mbuf *dns_cache_lookup(struct dnsc_cache *cache, bool *refreshp,
+			      const char *name, uint16_t type,
+			      uint16_t dnsclass);
+uint32_t dns_cache_insert(struct dnsc_cache *cache, const char *name,
+			  uint16_t type, uint16_t dnsclass,
+			  const uint8_t *msg, size_t len, uint32_t ttl);
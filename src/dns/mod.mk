@@ -4,10 +4,12 @@
 # Copyright (C) 2010 Creytiv.com
 #
 
+SRCS	+= dns/cache.c
 SRCS	+= dns/client.c
 SRCS	+= dns/cstr.c
 SRCS	+= dns/dname.c
 SRCS	+= dns/hdr.c
+SRCS	+= dns/msg.c
 SRCS	+= dns/ns.c
 SRCS	+= dns/rr.c
 SRCS	+= dns/rrlist.c
@@ -0,0 +1,651 @@
+/**
+ * @file dns/msg.c  DNS Message decoding into an arena
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_list.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_net.h>
+#include <re_dns.h>
+
+
+/*
+ * A DNS message is decoded in two passes over the same code: the first
+ * pass counts the records and the length of the strings, the second one
+ * fills a single allocation. The strings are decompressed into a string
+ * area and referred to by offset. DNS Resource Records are only
+ * allocated when a list of them is requested, and share the strings.
+ */
+
+
+enum {
+	COMP_MASK   = 0xc0,
+	OFFSET_MASK = 0x3fff,
+	COMP_LOOP   = 255,
+	NAME_MAX    = 255,
+};
+
+
+/* Resource Record, with the strings as offsets */
+struct mrr {
+	uint32_t name;
+	uint32_t ttl;
+	uint16_t type;
+	uint16_t dnsclass;
+	uint16_t rdlen;
+	union {
+		uint32_t a;
+		uint32_t dname;        /* NS, CNAME, PTR */
+		uint32_t txt;
+		uint8_t aaaa[16];
+		struct {
+			uint32_t mname;
+			uint32_t rname;
+			uint32_t serial;
+			uint32_t refresh;
+			uint32_t retry;
+			uint32_t expire;
+			uint32_t ttlmin;
+		} soa;
+		struct {
+			uint16_t pref;
+			uint32_t exchange;
+		} mx;
+		struct {
+			uint16_t pri;
+			uint16_t weight;
+			uint16_t port;
+			uint32_t target;
+		} srv;
+		struct {
+			uint16_t order;
+			uint16_t pref;
+			uint32_t flags;
+			uint32_t services;
+			uint32_t regexp;
+			uint32_t replace;
+		} naptr;
+	} rd;
+};
+
+
+/** Defines a decoded DNS Message */
+struct dns_msg {
+	struct dnshdr hdr;
+	uint32_t qname;
+	uint16_t qtype;
+	uint16_t qclass;
+	uint32_t rrc[3];       /* per section */
+	struct mrr *rrv;
+	char *strv;
+};
+
+
+/* Resource Record sharing the strings of a DNS Message */
+struct msg_rr {
+	struct dnsrr rr;
+	struct dns_msg *msg;
+};
+
+
+/* Without a string area, the parser only counts */
+struct parser {
+	const uint8_t *buf;
+	size_t end;
+	size_t pos;
+	char *strv;
+	size_t strc;
+};
+
+
+static int name_get(struct parser *p, uint32_t *offp)
+{
+	uint32_t loopc = 0;
+	size_t pos = p->pos;
+	size_t next = 0;
+	size_t n = 0;
+
+	while (pos < p->end) {
+
+		uint8_t len = p->buf[pos++];
+
+		if (!len) {
+			if (p->strv)
+				p->strv[p->strc + n] = '\0';
+
+			*offp   = (uint32_t)p->strc;
+			p->strc += n + 1;
+			p->pos   = next ? next : pos;
+
+			return 0;
+		}
+		else if ((len & COMP_MASK) == COMP_MASK) {
+
+			if (loopc++ > COMP_LOOP || pos >= p->end)
+				break;
+
+			if (!next)
+				next = pos + 1;
+
+			pos = ((len << 8) | p->buf[pos]) & OFFSET_MASK;
+			continue;
+		}
+		else if (len > p->end - pos || n + len + 1 > NAME_MAX)
+			break;
+
+		if (n > 0) {
+			if (p->strv)
+				p->strv[p->strc + n] = '.';
+			++n;
+		}
+
+		if (p->strv)
+			memcpy(&p->strv[p->strc + n], &p->buf[pos], len);
+
+		n   += len;
+		pos += len;
+	}
+
+	return EBADMSG;
+}
+
+
+static int cstr_get(struct parser *p, uint32_t *offp)
+{
+	uint8_t len;
+
+	if (p->pos >= p->end)
+		return EBADMSG;
+
+	len = p->buf[p->pos++];
+
+	if (len > p->end - p->pos)
+		return EBADMSG;
+
+	if (p->strv) {
+		memcpy(&p->strv[p->strc], &p->buf[p->pos], len);
+		p->strv[p->strc + len] = '\0';
+	}
+
+	*offp    = (uint32_t)p->strc;
+	p->strc += len + 1;
+	p->pos  += len;
+
+	return 0;
+}
+
+
+/* The character-strings of a TXT record are joined */
+static int txt_get(struct parser *p, uint16_t rdlen, uint32_t *offp)
+{
+	size_t end = p->pos + rdlen;
+	size_t n = 0;
+
+	while (p->pos < end) {
+
+		uint8_t len = p->buf[p->pos++];
+
+		if (len > end - p->pos)
+			return EBADMSG;
+
+		if (p->strv)
+			memcpy(&p->strv[p->strc + n], &p->buf[p->pos], len);
+
+		n      += len;
+		p->pos += len;
+	}
+
+	if (p->strv)
+		p->strv[p->strc + n] = '\0';
+
+	*offp    = (uint32_t)p->strc;
+	p->strc += n + 1;
+
+	return 0;
+}
+
+
+static inline uint16_t get_u16(struct parser *p)
+{
+	uint16_t v = (uint16_t)(p->buf[p->pos] << 8 | p->buf[p->pos + 1]);
+
+	p->pos += 2;
+
+	return v;
+}
+
+
+static inline uint32_t get_u32(struct parser *p)
+{
+	uint32_t v = (uint32_t)p->buf[p->pos]     << 24 |
+		     (uint32_t)p->buf[p->pos + 1] << 16 |
+		     (uint32_t)p->buf[p->pos + 2] << 8  |
+		     (uint32_t)p->buf[p->pos + 3];
+
+	p->pos += 4;
+
+	return v;
+}
+
+
+static int rr_get(struct parser *p, struct mrr *rr)
+{
+	size_t rdend;
+	int err;
+
+	err = name_get(p, &rr->name);
+	if (err)
+		return err;
+
+	if (p->end - p->pos < 10)
+		return EBADMSG;
+
+	rr->type     = get_u16(p);
+	rr->dnsclass = get_u16(p);
+	rr->ttl      = get_u32(p);
+	rr->rdlen    = get_u16(p);
+
+	if (rr->rdlen > p->end - p->pos)
+		return EBADMSG;
+
+	rdend = p->pos + rr->rdlen;
+
+	switch (rr->type) {
+
+	case DNS_TYPE_A:
+		if (rr->rdlen != 4)
+			return EBADMSG;
+
+		rr->rd.a = get_u32(p);
+		break;
+
+	case DNS_TYPE_NS:
+	case DNS_TYPE_CNAME:
+	case DNS_TYPE_PTR:
+		err = name_get(p, &rr->rd.dname);
+		break;
+
+	case DNS_TYPE_SOA:
+		err  = name_get(p, &rr->rd.soa.mname);
+		err |= name_get(p, &rr->rd.soa.rname);
+		if (err || rdend < p->pos + 20)
+			return EBADMSG;
+
+		rr->rd.soa.serial  = get_u32(p);
+		rr->rd.soa.refresh = get_u32(p);
+		rr->rd.soa.retry   = get_u32(p);
+		rr->rd.soa.expire  = get_u32(p);
+		rr->rd.soa.ttlmin  = get_u32(p);
+		break;
+
+	case DNS_TYPE_MX:
+		if (rr->rdlen < 2)
+			return EBADMSG;
+
+		rr->rd.mx.pref = get_u16(p);
+		err = name_get(p, &rr->rd.mx.exchange);
+		break;
+
+	case DNS_TYPE_TXT:
+		err = txt_get(p, rr->rdlen, &rr->rd.txt);
+		break;
+
+	case DNS_TYPE_AAAA:
+		if (rr->rdlen != 16)
+			return EBADMSG;
+
+		memcpy(rr->rd.aaaa, &p->buf[p->pos], 16);
+		p->pos += 16;
+		break;
+
+	case DNS_TYPE_SRV:
+		if (rr->rdlen < 6)
+			return EBADMSG;
+
+		rr->rd.srv.pri    = get_u16(p);
+		rr->rd.srv.weight = get_u16(p);
+		rr->rd.srv.port   = get_u16(p);
+		err = name_get(p, &rr->rd.srv.target);
+		break;
+
+	case DNS_TYPE_NAPTR:
+		if (rr->rdlen < 4)
+			return EBADMSG;
+
+		rr->rd.naptr.order = get_u16(p);
+		rr->rd.naptr.pref  = get_u16(p);
+		err  = cstr_get(p, &rr->rd.naptr.flags);
+		err |= cstr_get(p, &rr->rd.naptr.services);
+		err |= cstr_get(p, &rr->rd.naptr.regexp);
+		err |= name_get(p, &rr->rd.naptr.replace);
+		break;
+
+	default:
+		break;
+	}
+
+	if (err || p->pos > rdend)
+		return EBADMSG;
+
+	p->pos = rdend;
+
+	return 0;
+}
+
+
+static int msg_parse(struct parser *p, struct dns_msg *msg)
+{
+	struct mrr rr;
+	uint32_t i, n;
+	int err;
+
+	n = msg->hdr.nans + msg->hdr.nauth + msg->hdr.nadd;
+
+	for (i=0; i<msg->hdr.nq; i++) {
+
+		uint32_t qname;
+
+		err = name_get(p, &qname);
+		if (err)
+			return err;
+
+		if (p->end - p->pos < 4)
+			return EBADMSG;
+
+		if (!i) {
+			msg->qname  = qname;
+			msg->qtype  = get_u16(p);
+			msg->qclass = get_u16(p);
+		}
+		else {
+			p->pos += 4;
+		}
+	}
+
+	for (i=0; i<n; i++) {
+
+		err = rr_get(p, msg->rrv ? &msg->rrv[i] : &rr);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+static void msg_rr_destructor(void *arg)
+{
+	struct msg_rr *mrr = arg;
+
+	mem_deref(mrr->msg);
+}
+
+
+/**
+ * Decode a DNS Message into a single allocation
+ *
+ * @param msgp Pointer to allocated DNS Message
+ * @param mb   Memory buffer to decode from
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dns_msg_decode(struct dns_msg **msgp, struct mbuf *mb)
+{
+	struct dns_msg *msg, tmp;
+	struct parser p;
+	size_t start, rrsz;
+	uint32_t n;
+	int err;
+
+	if (!msgp || !mb)
+		return EINVAL;
+
+	memset(&tmp, 0, sizeof(tmp));
+
+	start = mb->pos;
+
+	err = dns_hdr_decode(mb, &tmp.hdr);
+	if (err)
+		return err;
+
+	/* compression offsets are relative to the start of the message */
+	memset(&p, 0, sizeof(p));
+	p.buf = mb->buf + start;
+	p.end = mb->end - start;
+	p.pos = DNS_HEADER_SIZE;
+
+	err = msg_parse(&p, &tmp);
+	if (err)
+		return err;
+
+	n    = tmp.hdr.nans + tmp.hdr.nauth + tmp.hdr.nadd;
+	rrsz = n * sizeof(struct mrr);
+
+	msg = mem_alloc(sizeof(*msg) + rrsz + p.strc, NULL);
+	if (!msg)
+		return ENOMEM;
+
+	*msg = tmp;
+	msg->rrv  = (struct mrr *)(void *)(msg + 1);
+	msg->strv = (char *)msg->rrv + rrsz;
+
+	msg->rrc[0] = tmp.hdr.nans;
+	msg->rrc[1] = tmp.hdr.nauth;
+	msg->rrc[2] = tmp.hdr.nadd;
+
+	p.strv = msg->strv;
+	p.strc = 0;
+	p.pos  = DNS_HEADER_SIZE;
+
+	(void)msg_parse(&p, msg);
+
+	mb->pos = start + p.pos;
+
+	*msgp = msg;
+
+	return 0;
+}
+
+
+/**
+ * Get the DNS Header of a DNS Message
+ *
+ * @param msg DNS Message
+ *
+ * @return DNS Header
+ */
+const struct dnshdr *dns_msg_hdr(const struct dns_msg *msg)
+{
+	return msg ? &msg->hdr : NULL;
+}
+
+
+/**
+ * Get the (first) question of a DNS Message
+ *
+ * @param msg       DNS Message
+ * @param namep     Returned domain name, valid with the message
+ * @param typep     Returned query type
+ * @param dnsclassp Returned query class
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dns_msg_question(const struct dns_msg *msg, const char **namep,
+		     uint16_t *typep, uint16_t *dnsclassp)
+{
+	if (!msg || !msg->hdr.nq)
+		return EINVAL;
+
+	if (namep)
+		*namep = &msg->strv[msg->qname];
+	if (typep)
+		*typep = msg->qtype;
+	if (dnsclassp)
+		*dnsclassp = msg->qclass;
+
+	return 0;
+}
+
+
+/**
+ * Get the number of Resource Records in a section of a DNS Message
+ *
+ * @param msg  DNS Message
+ * @param sect Section, 0 for answer, 1 for authority, 2 for additional
+ *
+ * @return Number of Resource Records
+ */
+uint32_t dns_msg_count(const struct dns_msg *msg, unsigned sect)
+{
+	if (!msg || sect >= ARRAY_SIZE(msg->rrc))
+		return 0;
+
+	return msg->rrc[sect];
+}
+
+
+/**
+ * Get a Resource Record of a DNS Message without allocating it
+ *
+ * The strings of the returned Resource Record belong to the message,
+ * and it must not be dereferenced.
+ *
+ * @param msg  DNS Message
+ * @param sect Section, 0 for answer, 1 for authority, 2 for additional
+ * @param i    Index in the section
+ * @param rr   Resource Record to fill in
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dns_msg_rr(const struct dns_msg *msg, unsigned sect, uint32_t i,
+	       struct dnsrr *rr)
+{
+	const struct mrr *m;
+	char *strv;
+	unsigned s;
+
+	if (!msg || !rr || i >= dns_msg_count(msg, sect))
+		return EINVAL;
+
+	for (s=0; s<sect; s++)
+		i += msg->rrc[s];
+
+	m    = &msg->rrv[i];
+	strv = msg->strv;
+
+	memset(&rr->rdata, 0, sizeof(rr->rdata));
+
+	rr->name     = &strv[m->name];
+	rr->type     = m->type;
+	rr->dnsclass = m->dnsclass;
+	rr->ttl      = m->ttl;
+	rr->rdlen    = m->rdlen;
+
+	switch (m->type) {
+
+	case DNS_TYPE_A:
+		rr->rdata.a.addr = m->rd.a;
+		break;
+
+	case DNS_TYPE_NS:
+		rr->rdata.ns.nsdname = &strv[m->rd.dname];
+		break;
+
+	case DNS_TYPE_CNAME:
+		rr->rdata.cname.cname = &strv[m->rd.dname];
+		break;
+
+	case DNS_TYPE_SOA:
+		rr->rdata.soa.mname   = &strv[m->rd.soa.mname];
+		rr->rdata.soa.rname   = &strv[m->rd.soa.rname];
+		rr->rdata.soa.serial  = m->rd.soa.serial;
+		rr->rdata.soa.refresh = m->rd.soa.refresh;
+		rr->rdata.soa.retry   = m->rd.soa.retry;
+		rr->rdata.soa.expire  = m->rd.soa.expire;
+		rr->rdata.soa.ttlmin  = m->rd.soa.ttlmin;
+		break;
+
+	case DNS_TYPE_PTR:
+		rr->rdata.ptr.ptrdname = &strv[m->rd.dname];
+		break;
+
+	case DNS_TYPE_MX:
+		rr->rdata.mx.pref     = m->rd.mx.pref;
+		rr->rdata.mx.exchange = &strv[m->rd.mx.exchange];
+		break;
+
+	case DNS_TYPE_TXT:
+		rr->rdata.txt.data = &strv[m->rd.txt];
+		break;
+
+	case DNS_TYPE_AAAA:
+		memcpy(rr->rdata.aaaa.addr, m->rd.aaaa, 16);
+		break;
+
+	case DNS_TYPE_SRV:
+		rr->rdata.srv.pri    = m->rd.srv.pri;
+		rr->rdata.srv.weight = m->rd.srv.weight;
+		rr->rdata.srv.port   = m->rd.srv.port;
+		rr->rdata.srv.target = &strv[m->rd.srv.target];
+		break;
+
+	case DNS_TYPE_NAPTR:
+		rr->rdata.naptr.order    = m->rd.naptr.order;
+		rr->rdata.naptr.pref     = m->rd.naptr.pref;
+		rr->rdata.naptr.flags    = &strv[m->rd.naptr.flags];
+		rr->rdata.naptr.services = &strv[m->rd.naptr.services];
+		rr->rdata.naptr.regexp   = &strv[m->rd.naptr.regexp];
+		rr->rdata.naptr.replace  = &strv[m->rd.naptr.replace];
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Append the Resource Records of a section of a DNS Message to a list
+ *
+ * The Resource Records are allocated and linked by their private list
+ * element. They keep a reference to the message for their strings.
+ *
+ * @param rrl  List of Resource Records
+ * @param msg  DNS Message
+ * @param sect Section, 0 for answer, 1 for authority, 2 for additional
+ * @param max  Maximum number of Resource Records
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dns_msg_rrlist(struct list *rrl, struct dns_msg *msg, unsigned sect,
+		   uint32_t max)
+{
+	uint32_t i, n;
+
+	if (!rrl || !msg)
+		return EINVAL;
+
+	n = min(dns_msg_count(msg, sect), max);
+
+	for (i=0; i<n; i++) {
+
+		struct msg_rr *mrr;
+
+		mrr = mem_zalloc(sizeof(*mrr), msg_rr_destructor);
+		if (!mrr)
+			return ENOMEM;
+
+		(void)dns_msg_rr(msg, sect, i, &mrr->rr);
+		mrr->msg = mem_ref(msg);
+
+		list_append(rrl, &mrr->rr.le_priv, &mrr->rr);
+	}
+
+	return 0;
+}
@@ -4,8 +4,18 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
 #include <re_types.h>
+#include <re_mem.h>
 #include <re_fmt.h>
+#include <re_atomic.h>
+
+
+enum {
+	RX_OP_MAX     = 128,
+	RX_CLASS_MAX  = 32,
+	RX_CACHE_SIZE = 256,
+};
 
 
 /** Defines a character range */
@@ -35,33 +45,8 @@ static bool expr_match(const struct chr *chrv, uint32_t n, uint8_t c,
 }
 
 
-/**
- * Parse a string using basic regular expressions. Any number of matching
- * expressions can be given, and each match will be stored in a "struct pl"
- * pointer-length type.
- *
- * @param ptr  String to parse
- * @param len  Length of string
- * @param expr Regular expressions string
- *
- * @return 0 if success, otherwise errorcode
- *
- * Example:
- *
- *   We parse the buffer for any numerical values, to get a match we must have
- *   1 or more occurences of the digits 0-9. The result is stored in 'num',
- *   which is of pointer-length type and will point to the first location in
- *   the buffer that contains "42".
- *
- * <pre>
- const char buf[] = "foo 42 bar";
- struct pl num;
- int err = re_regex(buf, strlen(buf), "[0-9]+", &num);
-
- here num contains a pointer to '42'
- * </pre>
- */
-int re_regex(const char *ptr, size_t len, const char *expr, ...)
+static int regex_interp(const char *ptr, size_t len, const char *expr,
+			va_list ap0)
 {
 	struct chr chrv[64];
 	const char *p, *ep;
@@ -81,7 +66,7 @@ int re_regex(const char *ptr, size_t len, const char *expr, ...)
 	p  = ptr++;
 	ep = expr;
 
-	va_start(ap, expr);
+	va_copy(ap, ap0);
 
 	if (!l)
 		goto out;
@@ -258,3 +243,508 @@ int re_regex(const char *ptr, size_t len, const char *expr, ...)
 
 	return *ep ? ENOENT : 0;
 }
+
+
+/**
+ * Parse a string using basic regular expressions. Any number of matching
+ * expressions can be given, and each match will be stored in a "struct pl"
+ * pointer-length type.
+ *
+ * @param ptr  String to parse
+ * @param len  Length of string
+ * @param expr Regular expressions string
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * Example:
+ *
+ *   We parse the buffer for any numerical values, to get a match we must have
+ *   1 or more occurences of the digits 0-9. The result is stored in 'num',
+ *   which is of pointer-length type and will point to the first location in
+ *   the buffer that contains "42".
+ *
+ * <pre>
+ const char buf[] = "foo 42 bar";
+ struct pl num;
+ int err = re_regex(buf, strlen(buf), "[0-9]+", &num);
+
+ here num contains a pointer to '42'
+ * </pre>
+ */
+int re_regex(const char *ptr, size_t len, const char *expr, ...)
+{
+	va_list ap;
+	int err;
+
+	va_start(ap, expr);
+	err = regex_interp(ptr, len, expr, ap);
+	va_end(ap);
+
+	return err;
+}
+
+
+/*
+ * Compiled expressions
+ *
+ * The pattern is parsed once into a list of literals and character
+ * classes, where each class is a 256-bit membership table for the
+ * input byte. Matching follows re_regex() exactly: classes match
+ * greedily and without backtracking, and a failed attempt is retried
+ * at the next input offset.
+ */
+
+/** Compiled character class */
+struct rx_class {
+	uint8_t set[32];  /**< Bitmap of matching input bytes     */
+	uint32_t nmin;    /**< Minimum number of matches          */
+	uint32_t nmax;    /**< Maximum number of matches          */
+	bool qesc;        /**< Skip quoted strings and escapes    */
+};
+
+/** Compiled expression element */
+struct rx_op {
+	bool cls;         /**< True for class, false for literal  */
+	uint8_t v;        /**< Class index, or lowercase literal  */
+};
+
+/** Compiled regular expression */
+struct re_regex {
+	struct rx_class *clsv;  /**< Character classes               */
+	struct rx_op *opv;      /**< Expression elements             */
+	uint32_t clsc;          /**< Number of classes (captures)    */
+	uint32_t opc;           /**< Number of elements              */
+	bool empty;             /**< Expression string was empty     */
+};
+
+/*
+ * The pattern cache is keyed by the address of a constant expression.
+ * A slot is claimed once and never changes until the cache is flushed,
+ * so lookups are lock-free.
+ */
+static struct rx_slot {
+	RE_ATOMIC uintptr_t expr;  /**< Expression address, or 0        */
+	RE_ATOMIC uintptr_t rx;    /**< Compiled expression, or 0       */
+} rx_cache[RX_CACHE_SIZE];
+
+
+static void class_build(struct rx_class *cls, const struct chr *chrv,
+			uint32_t n, bool neg)
+{
+	uint32_t c;
+
+	memset(cls->set, 0, sizeof(cls->set));
+
+	for (c=0; c<256; c++) {
+
+		if (expr_match(chrv, n, (uint8_t)tolower(c), neg))
+			cls->set[c >> 3] |= 1 << (c & 7);
+	}
+}
+
+
+static inline bool class_has(const struct rx_class *cls, uint8_t c)
+{
+	return (cls->set[c >> 3] >> (c & 7)) & 1;
+}
+
+
+/**
+ * Compile a basic regular expression, see re_regex() for the syntax
+ *
+ * @param rxp  Pointer to allocated compiled expression
+ * @param expr Regular expressions string
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_regex_compile(struct re_regex **rxp, const char *expr)
+{
+	struct rx_class clsv[RX_CLASS_MAX];
+	struct rx_op opv[RX_OP_MAX];
+	struct chr chrv[64];
+	bool fm = false, range = false, ec = false, neg = false;
+	bool qesc = false, eesc = false;
+	uint32_t n = 0, opc = 0, clsc = 0;
+	struct re_regex *rx;
+	const char *ep;
+
+	if (!rxp || !expr)
+		return EINVAL;
+
+	for (ep = expr; *ep; ep++) {
+
+		if ('\\' == *ep && !eesc) {
+			eesc = true;
+			continue;
+		}
+
+		if (!fm) {
+
+			/* Start of character class */
+			if ('[' == *ep && !eesc) {
+				n     = 0;
+				fm    = true;
+				ec    = false;
+				neg   = false;
+				range = false;
+				qesc  = false;
+				continue;
+			}
+
+			if (opc >= RX_OP_MAX)
+				return EOVERFLOW;
+
+			opv[opc].cls = false;
+			opv[opc].v   = (uint8_t)tolower((uint8_t)*ep);
+			++opc;
+
+			eesc = false;
+			continue;
+		}
+		/* End of character class */
+		else if (ec) {
+
+			struct rx_class *cls;
+
+			if (opc >= RX_OP_MAX || clsc >= RX_CLASS_MAX)
+				return EOVERFLOW;
+
+			cls = &clsv[clsc];
+
+			if ('*' == *ep) {
+				cls->nmin = 0;
+				cls->nmax = -1;
+			}
+			else if ('+' == *ep) {
+				cls->nmin = 1;
+				cls->nmax = -1;
+			}
+			else if ('1' <= *ep && *ep <= '9') {
+				cls->nmin = *ep - '0';
+				cls->nmax = *ep - '0';
+			}
+			else
+				return EINVAL;
+
+			class_build(cls, chrv, n, neg);
+			cls->qesc = qesc;
+
+			opv[opc].cls = true;
+			opv[opc].v   = (uint8_t)clsc++;
+			++opc;
+
+			fm   = false;
+			eesc = false;
+			continue;
+		}
+
+		if (eesc) {
+			eesc = false;
+			goto chr;
+		}
+
+		switch (*ep) {
+
+		case ']':
+			ec = true;
+			continue;
+
+		case '~':
+			if (n)
+				break;
+
+			qesc = true;
+			neg  = true;
+			continue;
+
+		case '^':
+			if (n)
+				break;
+
+			neg = true;
+			continue;
+
+		case '-':
+			if (!n || range)
+				break;
+
+			range = true;
+			--n;
+			continue;
+		}
+
+	chr:
+		if (n >= ARRAY_SIZE(chrv))
+			return EINVAL;
+
+		chrv[n].max = tolower(*ep);
+
+		if (range)
+			range = false;
+		else
+			chrv[n].min = tolower(*ep);
+
+		++n;
+	}
+
+	if (fm)
+		return EINVAL;
+
+	/* the classes and elements are stored after the header */
+	rx = mem_zalloc(sizeof(*rx) + clsc * sizeof(*clsv) +
+			opc * sizeof(*opv), NULL);
+	if (!rx)
+		return ENOMEM;
+
+	rx->clsv = (struct rx_class *)(void *)(rx + 1);
+	rx->opv  = (struct rx_op *)(void *)(rx->clsv + clsc);
+
+	memcpy(rx->clsv, clsv, clsc * sizeof(*clsv));
+	memcpy(rx->opv, opv, opc * sizeof(*opv));
+	rx->clsc  = clsc;
+	rx->opc   = opc;
+	rx->empty = !*expr;
+
+	*rxp = rx;
+
+	return 0;
+}
+
+
+/* Match one attempt at a fixed offset, EAGAIN to retry at the next */
+static int rx_attempt(const struct re_regex *rx, const char *p, size_t l,
+		      struct pl **plv)
+{
+	uint32_t i;
+
+	for (i=0; i<rx->opc; i++) {
+
+		const struct rx_op *op = &rx->opv[i];
+		const struct rx_class *cls;
+		bool quote = false, esc = false;
+		uint32_t nm;
+		struct pl lpl;
+
+		if (!op->cls) {
+
+			if (!l)
+				return ENOENT;
+
+			if (tolower((uint8_t)*p) != op->v)
+				return EAGAIN;
+
+			++p;
+			--l;
+			continue;
+		}
+
+		cls = &rx->clsv[op->v];
+
+		lpl.p = p;
+		lpl.l = 0;
+
+		for (nm = 0; l && nm < cls->nmax; nm++, p++, l--, lpl.l++) {
+
+			if (cls->qesc) {
+
+				if (esc) {
+					esc = false;
+					continue;
+				}
+
+				switch (*p) {
+
+				case '\\':
+					esc = true;
+					continue;
+
+				case '"':
+					quote = !quote;
+					continue;
+				}
+
+				if (quote)
+					continue;
+			}
+
+			if (!class_has(cls, (uint8_t)*p))
+				break;
+		}
+
+		/* Strip quotes */
+		if (cls->qesc && lpl.l > 1 &&
+		    lpl.p[0] == '"' && lpl.p[lpl.l - 1] == '"') {
+
+			lpl.p += 1;
+			lpl.l -= 2;
+			nm    -= 2;
+		}
+
+		if (nm < cls->nmin || nm > cls->nmax)
+			return EAGAIN;
+
+		if (plv[op->v])
+			*plv[op->v] = lpl;
+	}
+
+	return 0;
+}
+
+
+static int rx_vmatch(const struct re_regex *rx, const char *ptr, size_t len,
+		     va_list ap)
+{
+	struct pl *plv[RX_CLASS_MAX];
+	uint32_t i;
+	int err;
+
+	for (i=0; i<rx->clsc; i++)
+		plv[i] = va_arg(ap, struct pl *);
+
+	/* like re_regex(), empty input only matches an empty expression */
+	if (!len)
+		return rx->empty ? 0 : ENOENT;
+
+	if (!rx->opc)
+		return 0;
+
+	for (; len; ptr++, len--) {
+
+		/* skip offsets that cannot match a leading literal */
+		if (!rx->opv[0].cls &&
+		    tolower((uint8_t)*ptr) != rx->opv[0].v)
+			continue;
+
+		err = rx_attempt(rx, ptr, len, plv);
+		if (err != EAGAIN)
+			return err;
+	}
+
+	return ENOENT;
+}
+
+
+/**
+ * Match a string against a compiled regular expression. This is
+ * equivalent to re_regex(), but without parsing the expression again.
+ *
+ * @param rx  Compiled regular expression
+ * @param ptr String to parse
+ * @param len Length of string
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_regex_match(const struct re_regex *rx, const char *ptr, size_t len,
+		   ...)
+{
+	va_list ap;
+	int err;
+
+	if (!rx || !ptr)
+		return EINVAL;
+
+	va_start(ap, len);
+	err = rx_vmatch(rx, ptr, len, ap);
+	va_end(ap);
+
+	return err;
+}
+
+
+static inline const struct re_regex *slot_rx(struct rx_slot *slot)
+{
+	return (const struct re_regex *)re_atomic_acq(&slot->rx);
+}
+
+
+static const struct re_regex *rx_cache_get(const char *expr)
+{
+	const uintptr_t key = (uintptr_t)expr;
+	size_t i, h = (key >> 3) % RX_CACHE_SIZE;
+
+	for (i=0; i<RX_CACHE_SIZE; i++) {
+
+		struct rx_slot *slot = &rx_cache[(h + i) % RX_CACHE_SIZE];
+		uintptr_t e = re_atomic_acq(&slot->expr);
+		struct re_regex *rx = NULL;
+
+		if (e == key)
+			return slot_rx(slot);
+
+		if (e)
+			continue;
+
+		if (!re_atomic_compare_exchange_strong(
+			    &slot->expr, &e, key,
+			    re_memory_order_acq_rel,
+			    re_memory_order_acquire)) {
+
+			/* another thread claimed the slot first */
+			if (e == key)
+				return slot_rx(slot);
+
+			continue;
+		}
+
+		/* until published, and after a failed compile, the
+		   interpreter is used */
+		if (!re_regex_compile(&rx, expr))
+			re_atomic_rls_set(&slot->rx, (uintptr_t)rx);
+
+		return rx;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Parse a string using a constant regular expression, see re_regex().
+ * The expression is compiled on first use and cached by its address,
+ * so it must be a string literal or otherwise never change.
+ *
+ * @param ptr  String to parse
+ * @param len  Length of string
+ * @param expr Constant regular expressions string
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int re_regex_cached(const char *ptr, size_t len, const char *expr, ...)
+{
+	const struct re_regex *rx;
+	va_list ap;
+	int err;
+
+	if (!ptr || !expr)
+		return EINVAL;
+
+	rx = rx_cache_get(expr);
+
+	va_start(ap, expr);
+	err = rx ? rx_vmatch(rx, ptr, len, ap)
+		 : regex_interp(ptr, len, expr, ap);
+	va_end(ap);
+
+	return err;
+}
+
+
+/**
+ * Free all expressions compiled by re_regex_cached()
+ *
+ * @note Must not be called while other threads may parse with
+ *       re_regex_cached(), libre_close() calls it after they have stopped.
+ */
+void re_regex_cache_flush(void)
+{
+	size_t i;
+
+	for (i=0; i<RX_CACHE_SIZE; i++) {
+
+		struct rx_slot *slot = &rx_cache[i];
+
+		mem_deref((void *)re_atomic_rlx(&slot->rx));
+		re_atomic_rlx_set(&slot->rx, 0);
+		re_atomic_rls_set(&slot->expr, 0);
+	}
+}
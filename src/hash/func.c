@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_list.h>
@@ -13,6 +14,13 @@
 #define FNV1_32A_INIT UINT32_C(0x811c9dc5)
 #define FNV_32_PRIME UINT32_C(0x01000193)
 
+#define WY_P0 UINT64_C(0xa0761d6478bd642f)
+#define WY_P1 UINT64_C(0xe7037ed1a0b428db)
+#define WY_P2 UINT64_C(0x8ebc6af09c88c6e3)
+
+#define ONES  UINT64_C(0x0101010101010101)
+#define HIGHS UINT64_C(0x8080808080808080)
+
 
 /**
  * Calculate hash-value using "Jenkins One-at-a-time" hash algorithm.
@@ -185,3 +193,211 @@ uint32_t hash_fast_str(const char *str)
 
 	return h;
 }
+
+
+/*
+ * Word-at-a-time hash
+ *
+ * Keys are read 8 bytes at a time and mixed with a 64x64->128 bit
+ * multiply, in the style of wyhash. The result depends on the byte
+ * order of the host, so it must not be sent on the wire or stored.
+ */
+
+static inline uint64_t wy_mum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t ha = a >> 32, la = (uint32_t)a;
+	uint64_t hb = b >> 32, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32);
+	uint64_t c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+
+	c += lo < t;
+
+	return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+
+static inline uint64_t wy_read(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+
+static inline uint64_t wy_read4(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+
+/* ASCII lower-case of all eight bytes of a word */
+static inline uint64_t wy_lower(uint64_t w)
+{
+	uint64_t b     = w & ~HIGHS;
+	uint64_t ge_a  = b + ONES * (0x80 - 'A');
+	uint64_t gt_z  = b + ONES * (0x80 - 'Z' - 1);
+	uint64_t upper = ge_a & ~gt_z & ~w & HIGHS;
+
+	return w | (upper >> 2);
+}
+
+
+static inline uint32_t wy_hash(const uint8_t *p, size_t len, bool ci)
+{
+	uint64_t seed = WY_P0;
+	uint64_t n = len;
+	uint64_t a, b;
+
+	while (len > 16) {
+		a = wy_read(p);
+		b = wy_read(p + 8);
+
+		if (ci) {
+			a = wy_lower(a);
+			b = wy_lower(b);
+		}
+
+		seed = wy_mum(a ^ WY_P1, b ^ seed);
+
+		p   += 16;
+		len -= 16;
+	}
+
+	/* the last 1-16 bytes, with overlapping reads */
+	if (len > 8) {
+		a = wy_read(p);
+		b = wy_read(p + len - 8);
+	}
+	else if (len >= 4) {
+		a = wy_read4(p) << 32 | wy_read4(p + len - 4);
+		b = 0;
+	}
+	else if (len) {
+		a = (uint64_t)p[0] << 16 | (uint64_t)p[len >> 1] << 8 |
+			p[len - 1];
+		b = 0;
+	}
+	else {
+		a = 0;
+		b = 0;
+	}
+
+	if (ci) {
+		a = wy_lower(a);
+		b = wy_lower(b);
+	}
+
+	seed = wy_mum(a ^ WY_P1, b ^ seed);
+	seed = wy_mum(seed ^ WY_P2, n ^ WY_P1);
+
+	return (uint32_t)(seed ^ (seed >> 32));
+}
+
+
+/**
+ * Calculate hash-value using a word-at-a-time hash algorithm.
+ *
+ * @param key  Pointer to key
+ * @param len  Key length
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy(const uint8_t *key, size_t len)
+{
+	if (!key)
+		return 0;
+
+	return wy_hash(key, len, false);
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a case-insensitive string,
+ * equal to the hash-value of the ASCII lower-case string
+ *
+ * @param str  String
+ * @param len  Length of string
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_ci(const char *str, size_t len)
+{
+	if (!str)
+		return 0;
+
+	return wy_hash((const uint8_t *)str, len, true);
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a NULL-terminated string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_str(const char *str)
+{
+	if (!str)
+		return 0;
+
+	return wy_hash((const uint8_t *)str, strlen(str), false);
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a case-insensitive
+ * NULL-terminated string
+ *
+ * @param str  String
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_str_ci(const char *str)
+{
+	if (!str)
+		return 0;
+
+	return wy_hash((const uint8_t *)str, strlen(str), true);
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a pointer-length object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_pl(const struct pl *pl)
+{
+	return pl ? hash_wy((const uint8_t *)pl->p, pl->l) : 0;
+}
+
+
+/**
+ * Calculate word-at-a-time hash-value for a case-insensitive
+ * pointer-length object
+ *
+ * @param pl Pointer-length object
+ *
+ * @return Calculated hash-value
+ */
+uint32_t hash_wy_pl_ci(const struct pl *pl)
+{
+	return pl ? hash_wy_ci(pl->p, pl->l) : 0;
+}
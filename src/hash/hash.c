@@ -3,17 +3,41 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_fmt.h>
 #include <re_hash.h>
 
 
+enum {
+	HASH_SIZE_MIN = 16,       /**< Default minimum dynamic size       */
+	HASH_SIZE_MAX = 1 << 24,  /**< Maximum dynamic size               */
+	HASH_LOAD_MAX = 2,        /**< Grow above this load factor        */
+	HASH_LOAD_DIV = 8,        /**< Shrink below 1/8 load factor       */
+	HASH_STEP     = 2,        /**< Old buckets rehashed per operation */
+	HASH_SWEEP    = 4,        /**< Buckets counted per operation      */
+};
+
+
 /** Defines a hashmap table */
 struct hash {
 	struct list *bucket;  /**< Bucket with linked lists */
 	uint32_t bsize;       /**< Bucket size              */
+
+	/* dynamic tables only */
+	hash_key_h *keyh;      /**< Element key handler              */
+	struct list *obucket;  /**< Old buckets, while rehashing     */
+	uint32_t obsize;       /**< Old bucket size                  */
+	uint32_t rehash;       /**< Next old bucket to rehash        */
+	uint32_t bsize_min;    /**< Minimum bucket size              */
+	uint32_t count;        /**< Measured number of elements      */
+	uint32_t sweep;        /**< Next bucket to count             */
+	uint32_t sweep_count;  /**< Elements counted in this sweep   */
+	uint32_t resizes;      /**< Number of resizes                */
+	uint32_t apply;        /**< Nesting depth of hash_apply()    */
 };
 
 
@@ -22,6 +46,128 @@ static void hash_destructor(void *data)
 	struct hash *h = data;
 
 	mem_deref(h->bucket);
+	mem_deref(h->obucket);
+}
+
+
+/*
+ * Dynamic tables
+ *
+ * The bucket array is resized by powers of two, and the elements are
+ * moved from the old to the new array a few buckets at a time on each
+ * append. Before a key is appended to the new array its old bucket is
+ * moved in full, so a non-empty old bucket holds all elements of its
+ * keys. Lookups read either array and never move elements. The element
+ * count is measured by counting a few buckets per append, since elements
+ * are unlinked without a reference to their table, and the table is only
+ * resized after a complete count.
+ */
+
+static void bucket_rehash(struct hash *h, uint32_t i)
+{
+	struct le *le;
+
+	while ((le = list_head(&h->obucket[i])) != NULL) {
+
+		uint32_t key = h->keyh(le);
+
+		list_unlink(le);
+		list_append(&h->bucket[key & (h->bsize-1)], le, le->data);
+	}
+}
+
+
+static void rehash_step(struct hash *h, uint32_t n)
+{
+	while (n-- && h->rehash < h->obsize)
+		bucket_rehash(h, h->rehash++);
+
+	if (h->rehash >= h->obsize) {
+		h->obucket = mem_deref(h->obucket);
+		h->obsize  = 0;
+		h->rehash  = 0;
+	}
+}
+
+
+static void hash_resize(struct hash *h, uint32_t bsize)
+{
+	struct list *bucket;
+
+	/* the bucket arrays must stay in place while being walked */
+	if (h->apply)
+		return;
+
+	bucket = mem_zalloc(bsize*sizeof(*bucket), NULL);
+	if (!bucket)
+		return;  /* keep the current size */
+
+	h->obucket = h->bucket;
+	h->obsize  = h->bsize;
+	h->rehash  = 0;
+	h->bucket  = bucket;
+	h->bsize   = bsize;
+
+	h->sweep       = 0;
+	h->sweep_count = 0;
+	++h->resizes;
+}
+
+
+/* Bounded per-operation work, and making the key's bucket current */
+static void hash_maint(struct hash *h, uint32_t key)
+{
+	uint32_t n;
+
+	if (h->obucket) {
+		rehash_step(h, HASH_STEP);
+
+		if (h->obucket)
+			bucket_rehash(h, key & (h->obsize-1));
+
+		return;
+	}
+
+	for (n=0; n<HASH_SWEEP && h->sweep < h->bsize; n++)
+		h->sweep_count += list_count(&h->bucket[h->sweep++]);
+
+	if (h->sweep < h->bsize)
+		return;
+
+	h->count       = h->sweep_count;
+	h->sweep       = 0;
+	h->sweep_count = 0;
+
+	if (h->count > h->bsize * HASH_LOAD_MAX && h->bsize < HASH_SIZE_MAX)
+		hash_resize(h, h->bsize * 2);
+	else if (h->bsize > h->bsize_min &&
+		 h->count < h->bsize / HASH_LOAD_DIV)
+		hash_resize(h, h->bsize / 2);
+
+	if (h->obucket)
+		bucket_rehash(h, key & (h->obsize-1));
+}
+
+
+static inline void hash_sync(struct hash *h)
+{
+	if (h->obucket)
+		rehash_step(h, h->obsize);
+}
+
+
+/* The bucket holding the elements of a key, without moving them */
+static inline struct list *key_bucket(const struct hash *h, uint32_t key)
+{
+	if (h->obucket) {
+
+		struct list *ob = &h->obucket[key & (h->obsize-1)];
+
+		if (!list_isempty(ob))
+			return ob;
+	}
+
+	return &h->bucket[key & (h->bsize-1)];
 }
 
 
@@ -67,6 +213,42 @@ int hash_alloc(struct hash **hp, uint32_t bsize)
 }
 
 
+/**
+ * Allocate a new hashmap table, which resizes itself with the number of
+ * elements. The elements are rehashed incrementally, so that no single
+ * operation has to move the whole table.
+ *
+ * @param hp        Address of hashmap pointer
+ * @param bsize_min Minimum bucket size, 0 for default
+ * @param keyh      Handler returning the hash key of an element, which
+ *                  must be the key it was added with
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_alloc_dynamic(struct hash **hp, uint32_t bsize_min,
+		       hash_key_h *keyh)
+{
+	struct hash *h;
+	int err;
+
+	if (!keyh)
+		return EINVAL;
+
+	bsize_min = hash_valid_size(bsize_min ? bsize_min : HASH_SIZE_MIN);
+
+	err = hash_alloc(&h, bsize_min);
+	if (err)
+		return err;
+
+	h->keyh      = keyh;
+	h->bsize_min = bsize_min;
+
+	*hp = h;
+
+	return 0;
+}
+
+
 /**
  * Add an element to the hashmap table
  *
@@ -80,7 +262,16 @@ void hash_append(struct hash *h, uint32_t key, struct le *le, void *data)
 	if (!h || !le)
 		return;
 
-	list_append(&h->bucket[key & (h->bsize-1)], le, data);
+	if (!h->keyh) {
+		list_append(&h->bucket[key & (h->bsize-1)], le, data);
+		return;
+	}
+
+	/* elements are not moved while hash_apply() walks the table */
+	if (!h->apply)
+		hash_maint(h, key);
+
+	list_append(key_bucket(h, key), le, data);
 }
 
 
@@ -111,7 +302,7 @@ struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
 	if (!h || !ah)
 		return NULL;
 
-	return list_apply(&h->bucket[key & (h->bsize-1)], true, ah, arg);
+	return list_apply(key_bucket(h, key), true, ah, arg);
 }
 
 
@@ -132,9 +323,16 @@ struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
 	if (!h || !ah)
 		return NULL;
 
+	++((struct hash *)h)->apply;
+
 	for (i=0; (i<h->bsize) && !le; i++)
 		le = list_apply(&h->bucket[i], true, ah, arg);
 
+	for (i=0; (i<h->obsize) && !le; i++)
+		le = list_apply(&h->obucket[i], true, ah, arg);
+
+	--((struct hash *)h)->apply;
+
 	return le;
 }
 
@@ -142,6 +340,9 @@ struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
 /**
  * Return bucket list for a given bucket index
  *
+ * While a dynamic table is being resized, the indices from the current
+ * bucket size up to hash_bsize() are the buckets not yet rehashed.
+ *
  * @param h  Hashmap table
  * @param i  Bucket index
  *
@@ -149,10 +350,16 @@ struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
  */
 struct list *hash_list_idx(const struct hash *h, uint32_t i)
 {
-	if (!h || i >= h->bsize)
+	if (!h)
 		return NULL;
 
-	return &h->bucket[i];
+	if (i < h->bsize)
+		return &h->bucket[i];
+
+	if (i - h->bsize < h->obsize)
+		return &h->obucket[i - h->bsize];
+
+	return NULL;
 }
 
 
@@ -166,20 +373,29 @@ struct list *hash_list_idx(const struct hash *h, uint32_t i)
  */
 struct list *hash_list(const struct hash *h, uint32_t key)
 {
-	return h ? &h->bucket[key & (h->bsize - 1)] : NULL;
+	if (!h)
+		return NULL;
+
+	return key_bucket(h, key);
 }
 
 
 /**
  * Get hash bucket size
  *
+ * While a dynamic table is being resized, this includes the buckets not
+ * yet rehashed, see hash_list_idx().
+ *
  * @param h Hashmap table
  *
  * @return hash bucket size
  */
 uint32_t hash_bsize(const struct hash *h)
 {
-	return h ? h->bsize : 0;
+	if (!h)
+		return 0;
+
+	return h->bsize + h->obsize;
 }
 
 
@@ -195,6 +411,8 @@ void hash_flush(struct hash *h)
 	if (!h)
 		return;
 
+	hash_sync(h);
+
 	for (i=0; i<h->bsize; i++)
 		list_flush(&h->bucket[i]);
 }
@@ -212,6 +430,8 @@ void hash_clear(struct hash *h)
 	if (!h)
 		return;
 
+	hash_sync(h);
+
 	for (i=0; i<h->bsize; i++)
 		list_clear(&h->bucket[i]);
 }
@@ -233,3 +453,75 @@ uint32_t hash_valid_size(uint32_t size)
 
 	return 1<<x;
 }
+
+
+static void stats_add(struct hash_stats *stats, const struct list *bucket,
+		      uint32_t bsize)
+{
+	uint32_t i;
+
+	for (i=0; i<bsize; i++) {
+
+		uint32_t n = list_count(&bucket[i]);
+
+		stats->count    += n;
+		stats->used     += n ? 1 : 0;
+		stats->chain_max = max(stats->chain_max, n);
+	}
+}
+
+
+/**
+ * Get the statistics of a hashmap table, by walking all buckets
+ *
+ * @param h     Hashmap table
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_stats(const struct hash *h, struct hash_stats *stats)
+{
+	if (!h || !stats)
+		return EINVAL;
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->bsize   = h->bsize;
+	stats->resizes = h->resizes;
+	stats->dynamic = h->keyh != NULL;
+
+	stats_add(stats, h->bucket, h->bsize);
+	if (h->obucket)
+		stats_add(stats, h->obucket, h->obsize);
+
+	return 0;
+}
+
+
+/**
+ * Print the statistics of a hashmap table
+ *
+ * @param pf Print function
+ * @param h  Hashmap table
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_debug(struct re_printf *pf, const struct hash *h)
+{
+	struct hash_stats stats;
+	uint32_t load;
+	int err;
+
+	err = hash_stats(h, &stats);
+	if (err)
+		return err;
+
+	load = (uint32_t)((uint64_t)stats.count * 100 / stats.bsize);
+
+	return re_hprintf(pf, "%u elements in %u buckets (%s), load %u.%02u,"
+			  " %u used, longest chain %u, %u resizes",
+			  stats.count, stats.bsize,
+			  stats.dynamic ? "dynamic" : "fixed",
+			  load / 100, load % 100, stats.used,
+			  stats.chain_max, stats.resizes);
+}
@@ -14,11 +14,12 @@
 
 enum { KEY_SIZE = 256 };
 
+/*
+ * The keyed state is computed once and copied for each digest,
+ * so the key schedule is not repeated for every message.
+ */
 struct hmac {
-	CCHmacContext ctx;
-	uint8_t key[KEY_SIZE];
-	size_t key_len;
-	CCHmacAlgorithm algo;
+	CCHmacContext init;
 };
 
 
@@ -26,7 +27,7 @@ static void destructor(void *arg)
 {
 	struct hmac *hmac = arg;
 
-	memset(&hmac->ctx, 0, sizeof(hmac->ctx));
+	memset(&hmac->init, 0, sizeof(hmac->init));
 }
 
 
@@ -57,9 +58,7 @@ int hmac_create(struct hmac **hmacp, enum hmac_hash hash,
 	if (!hmac)
 		return ENOMEM;
 
-	memcpy(hmac->key, key, key_len);
-	hmac->key_len = key_len;
-	hmac->algo = algo;
+	CCHmacInit(&hmac->init, algo, key, key_len);
 
 	*hmacp = hmac;
 
@@ -67,17 +66,34 @@ int hmac_create(struct hmac **hmacp, enum hmac_hash hash,
 }
 
 
+/**
+ * Calculate the HMAC of a buffer
+ *
+ * The keyed state is copied to a local context, so the same HMAC may be
+ * used concurrently.
+ *
+ * @param hmac     HMAC state
+ * @param md       Buffer for the message digest
+ * @param md_len   Size of the message digest buffer
+ * @param data     Data to authenticate
+ * @param data_len Number of bytes of data
+ *
+ * @return 0 if success, otherwise errorcode
+ */
 int hmac_digest(struct hmac *hmac, uint8_t *md, size_t md_len,
 		const uint8_t *data, size_t data_len)
 {
+	CCHmacContext ctx;
+
 	if (!hmac || !md || !md_len || !data || !data_len)
 		return EINVAL;
 
-	/* reset state */
-	CCHmacInit(&hmac->ctx, hmac->algo, hmac->key, hmac->key_len);
+	ctx = hmac->init;
+
+	CCHmacUpdate(&ctx, data, data_len);
+	CCHmacFinal(&ctx, md);
 
-	CCHmacUpdate(&hmac->ctx, data, data_len);
-	CCHmacFinal(&hmac->ctx, md);
+	memset(&ctx, 0, sizeof(ctx));
 
 	return 0;
 }
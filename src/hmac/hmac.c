@@ -10,8 +10,10 @@
 #include <re_hmac.h>
 
 
+enum { KEY_SIZE = 256 };
+
 struct hmac {
-	uint8_t key[SHA_DIGEST_LENGTH];
+	uint8_t key[KEY_SIZE];
 	size_t key_len;
 };
 
@@ -35,7 +37,7 @@ int hmac_create(struct hmac **hmacp, enum hmac_hash hash,
 	if (hash != HMAC_HASH_SHA1)
 		return ENOTSUP;
 
-	if (key_len > SHA_DIGEST_LENGTH)
+	if (key_len > KEY_SIZE)
 		return EINVAL;
 
 	hmac = mem_zalloc(sizeof(*hmac), destructor);
@@ -7,16 +7,32 @@
 
 #include <openssl/hmac.h>
 #include <openssl/err.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
 #include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_hmac.h>
 
 
+/*
+ * The keyed context is set up once in hmac_create(), so that every
+ * digest only copies the precomputed inner/outer pad state instead of
+ * running the key schedule again. The shared context is never modified
+ * after creation, so one HMAC can be used from several threads.
+ */
 struct hmac {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_MAC_CTX *ctx;
+#elif OPENSSL_VERSION_NUMBER >= 0x10100000L
+	HMAC_CTX *ctx;
+#else
 	const EVP_MD *evp;
 	uint8_t *key;
 	int key_len;
+#endif
 };
 
 
@@ -24,7 +40,13 @@ static void destructor(void *arg)
 {
 	struct hmac *hmac = arg;
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	EVP_MAC_CTX_free(hmac->ctx);
+#elif OPENSSL_VERSION_NUMBER >= 0x10100000L
+	HMAC_CTX_free(hmac->ctx);
+#else
 	mem_deref(hmac->key);
+#endif
 }
 
 
@@ -32,15 +54,70 @@ int hmac_create(struct hmac **hmacp, enum hmac_hash hash, const uint8_t *key,
 		size_t key_len)
 {
 	struct hmac *hmac;
+	const char *digest;
 	int err = 0;
 
 	if (!hmacp || !key || !key_len)
 		return EINVAL;
 
+	switch (hash) {
+
+	case HMAC_HASH_SHA1:
+		digest = "SHA1";
+		break;
+
+	case HMAC_HASH_SHA256:
+		digest = "SHA256";
+		break;
+
+	default:
+		return ENOTSUP;
+	}
+
 	hmac = mem_zalloc(sizeof(*hmac), destructor);
 	if (!hmac)
 		return ENOMEM;
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	{
+		OSSL_PARAM params[] = {
+			OSSL_PARAM_utf8_string(OSSL_MAC_PARAM_DIGEST,
+					       (char *)digest, strlen(digest)),
+			OSSL_PARAM_END
+		};
+		EVP_MAC *mac;
+
+		mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+		if (!mac) {
+			err = ENOTSUP;
+			goto error;
+		}
+
+		hmac->ctx = EVP_MAC_CTX_new(mac);
+		EVP_MAC_free(mac);
+		if (!hmac->ctx) {
+			err = ENOMEM;
+			goto error;
+		}
+
+		if (!EVP_MAC_init(hmac->ctx, key, key_len, params)) {
+			err = EPROTO;
+			goto error;
+		}
+	}
+#elif OPENSSL_VERSION_NUMBER >= 0x10100000L
+	hmac->ctx = HMAC_CTX_new();
+	if (!hmac->ctx) {
+		err = ENOMEM;
+		goto error;
+	}
+
+	if (!HMAC_Init_ex(hmac->ctx, key, (int)key_len,
+			  EVP_get_digestbyname(digest), NULL)) {
+		err = EPROTO;
+		goto error;
+	}
+#else
 	hmac->key = mem_zalloc(key_len, NULL);
 	if (!hmac->key) {
 		err = ENOMEM;
@@ -49,47 +126,99 @@ int hmac_create(struct hmac **hmacp, enum hmac_hash hash, const uint8_t *key,
 
 	memcpy(hmac->key, key, key_len);
 	hmac->key_len = (int)key_len;
-
-	switch (hash) {
-
-	case HMAC_HASH_SHA1:
-		hmac->evp = EVP_sha1();
-		break;
-
-	case HMAC_HASH_SHA256:
-		hmac->evp = EVP_sha256();
-		break;
-
-	default:
-		err = ENOTSUP;
-		goto error;
-	}
+	hmac->evp = EVP_get_digestbyname(digest);
+#endif
 
 	*hmacp = hmac;
 
 	return 0;
 
 error:
+	ERR_clear_error();
 	mem_deref(hmac);
 	return err;
 }
 
 
+/**
+ * Calculate the HMAC of a buffer
+ *
+ * The function is reentrant, and the same HMAC may be used concurrently.
+ *
+ * @param hmac     HMAC state
+ * @param md       Buffer for the message digest
+ * @param md_len   Size of the message digest buffer
+ * @param data     Data to authenticate
+ * @param data_len Number of bytes of data
+ *
+ * @return 0 if success, otherwise errorcode
+ */
 int hmac_digest(struct hmac *hmac, uint8_t *md, size_t md_len,
 		const uint8_t *data, size_t data_len)
 {
-	unsigned int len = (unsigned int)md_len;
-	unsigned char *rval;
+	uint8_t buf[EVP_MAX_MD_SIZE];
 
 	if (!hmac || !md || !md_len || !data || !data_len)
 		return EINVAL;
 
-	rval = HMAC(hmac->evp, hmac->key, hmac->key_len, data, data_len, md,
-		    &len);
-	if (!rval) {
-		ERR_clear_error();
-		return EPROTO;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	{
+		EVP_MAC_CTX *ctx;
+		size_t len;
+		int err = 0;
+
+		ctx = EVP_MAC_CTX_dup(hmac->ctx);
+		if (!ctx)
+			return ENOMEM;
+
+		if (!EVP_MAC_update(ctx, data, data_len) ||
+		    !EVP_MAC_final(ctx, buf, &len, sizeof(buf))) {
+			ERR_clear_error();
+			err = EPROTO;
+		}
+
+		EVP_MAC_CTX_free(ctx);
+		if (err)
+			return err;
+
+		memcpy(md, buf, min(md_len, len));
+	}
+#elif OPENSSL_VERSION_NUMBER >= 0x10100000L
+	{
+		HMAC_CTX *ctx;
+		unsigned int len;
+		int err = 0;
+
+		ctx = HMAC_CTX_new();
+		if (!ctx)
+			return ENOMEM;
+
+		if (!HMAC_CTX_copy(ctx, hmac->ctx) ||
+		    !HMAC_Update(ctx, data, data_len) ||
+		    !HMAC_Final(ctx, buf, &len)) {
+			ERR_clear_error();
+			err = EPROTO;
+		}
+
+		HMAC_CTX_free(ctx);
+		if (err)
+			return err;
+
+		memcpy(md, buf, min(md_len, (size_t)len));
+	}
+#else
+	{
+		unsigned int len;
+
+		if (!HMAC(hmac->evp, hmac->key, hmac->key_len, data,
+			  data_len, buf, &len)) {
+			ERR_clear_error();
+			return EPROTO;
+		}
+
+		memcpy(md, buf, min(md_len, (size_t)len));
 	}
+#endif
 
 	return 0;
 }
@@ -157,7 +157,8 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 	p = (const char *)mbuf_buf(mb);
 	l = mbuf_get_left(mb);
 
-	if (re_regex(p, l, "[\r\n]*[^\r\n]+[\r]*[\n]1", &b, &s, NULL, &e))
+	if (re_regex_cached(p, l, "[\r\n]*[^\r\n]+[\r]*[\n]1",
+			    &b, &s, NULL, &e))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
 	msg = mem_zalloc(sizeof(*msg), destructor);
@@ -173,16 +174,18 @@ int http_msg_decode(struct http_msg **msgp, struct mbuf *mb, bool req)
 	}
 
 	if (req) {
-		if (re_regex(s.p, s.l, "[a-z]+ [^? ]+[^ ]* HTTP/[0-9.]+",
-			     &msg->met, &msg->path, &msg->prm, &msg->ver) ||
+		if (re_regex_cached(s.p, s.l,
+				    "[a-z]+ [^? ]+[^ ]* HTTP/[0-9.]+",
+				    &msg->met, &msg->path, &msg->prm,
+				    &msg->ver) ||
 		    msg->met.p != s.p) {
 			err = EBADMSG;
 			goto out;
 		}
 	}
 	else {
-		if (re_regex(s.p, s.l, "HTTP/[0-9.]+ [0-9]+[ ]*[^]*",
-			     &msg->ver, &scode, NULL, &msg->reason) ||
+		if (re_regex_cached(s.p, s.l, "HTTP/[0-9.]+ [0-9]+[ ]*[^]*",
+				    &msg->ver, &scode, NULL, &msg->reason) ||
 		    msg->ver.p != s.p + 5) {
 			err = EBADMSG;
 			goto out;
@@ -296,17 +296,22 @@ int icem_conncheck_send(struct ice_candpair *cp, bool use_cand, bool trigged)
 	case ICE_CAND_TYPE_SRFLX:
 	case ICE_CAND_TYPE_PRFLX:
 		cp->ct_conn = mem_deref(cp->ct_conn);
-		err = stun_request(&cp->ct_conn, icem->stun, icem->proto,
-				   cp->comp->sock, &cp->rcand->addr, presz,
-				   STUN_METHOD_BINDING,
-				   (uint8_t *)icem->rpwd, str_len(icem->rpwd),
-				   true, stunc_resp_handler, cp,
-				   4,
-				   STUN_ATTR_USERNAME, username_buf,
-				   STUN_ATTR_PRIORITY, &prio_prflx,
-				   ctrl_attr, &icem->tiebrk,
-				   STUN_ATTR_USE_CAND,
-				   use_cand ? &use_cand : 0);
+
+		/* an empty password has no precomputed key, and keys
+		   MESSAGE-INTEGRITY itself */
+		err = stun_request_hmac(&cp->ct_conn, icem->stun,
+					icem->proto, cp->comp->sock,
+					&cp->rcand->addr, presz,
+					STUN_METHOD_BINDING, icem->rhmac,
+					(uint8_t *)icem->rpwd,
+					str_len(icem->rpwd), true,
+					stunc_resp_handler, cp,
+					4,
+					STUN_ATTR_USERNAME, username_buf,
+					STUN_ATTR_PRIORITY, &prio_prflx,
+					ctrl_attr, &icem->tiebrk,
+					STUN_ATTR_USE_CAND,
+					use_cand ? &use_cand : 0);
 		break;
 
 	default:
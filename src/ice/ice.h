@@ -71,6 +71,8 @@ struct icem {
 	char *lpwd;                  /**< Local Password                     */
 	char *rufrag;                /**< Remote Username fragment           */
 	char *rpwd;                  /**< Remote Password                    */
+	struct hmac *lhmac;          /**< Precomputed local MI key           */
+	struct hmac *rhmac;          /**< Precomputed remote MI key          */
 	ice_connchk_h *chkh;         /**< Connectivity check handler         */
 	void *arg;                   /**< Handler argument                   */
 	char name[32];               /**< Name of the media stream           */
@@ -165,6 +167,7 @@ int icem_stund_recv(struct icem_comp *comp, const struct sa *src,
 
 /* ICE media */
 void icem_printf(struct icem *icem, const char *fmt, ...);
+int  icem_set_rpwd(struct icem *icem, const char *pwd);
 
 
 /* Checklist */
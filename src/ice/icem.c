@@ -10,6 +10,7 @@
 #include <re_list.h>
 #include <re_tmr.h>
 #include <re_sa.h>
+#include <re_hmac.h>
 #include <re_stun.h>
 #include <re_turn.h>
 #include <re_ice.h>
@@ -60,6 +61,8 @@ static void icem_destructor(void *data)
 	mem_deref(icem->lpwd);
 	mem_deref(icem->rufrag);
 	mem_deref(icem->rpwd);
+	mem_deref(icem->lhmac);
+	mem_deref(icem->rhmac);
 	mem_deref(icem->stun);
 }
 
@@ -121,6 +124,11 @@ int  icem_alloc(struct icem **icemp, enum ice_role role, int proto, int layer,
 	if (err)
 		goto out;
 
+	err = hmac_create(&icem->lhmac, HMAC_HASH_SHA1,
+			  (uint8_t *)lpwd, str_len(lpwd));
+	if (err)
+		goto out;
+
 	ice_determine_role(icem, role);
 
 	err = stun_alloc(&icem->stun, NULL, NULL, NULL);
@@ -561,3 +569,36 @@ void icem_printf(struct icem *icem, const char *fmt, ...)
 	(void)re_printf("{%11s. } %v", icem->name, fmt, &ap);
 	va_end(ap);
 }
+
+
+/**
+ * Set the remote password and precompute its MESSAGE-INTEGRITY key
+ *
+ * An empty password has no precomputed key, and the connectivity checks
+ * compute MESSAGE-INTEGRITY over the empty key per request.
+ *
+ * @param icem ICE Media object
+ * @param pwd  Remote password
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int icem_set_rpwd(struct icem *icem, const char *pwd)
+{
+	int err;
+
+	if (!icem || !pwd)
+		return EINVAL;
+
+	icem->rpwd  = mem_deref(icem->rpwd);
+	icem->rhmac = mem_deref(icem->rhmac);
+
+	err = str_dup(&icem->rpwd, pwd);
+	if (err)
+		return err;
+
+	if (!str_isset(pwd))
+		return 0;
+
+	return hmac_create(&icem->rhmac, HMAC_HASH_SHA1,
+			   (uint8_t *)pwd, str_len(pwd));
+}
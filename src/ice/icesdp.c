@@ -154,19 +154,7 @@ static int ufrag_decode(struct icem *icem, const char *value)
 
 static int pwd_decode(struct icem *icem, const char *value)
 {
-	char *pwd = NULL;
-	int err;
-
-	err = str_dup(&pwd, value);
-	if (err)
-		return err;
-
-	mem_deref(icem->rpwd);
-	icem->rpwd = mem_ref(pwd);
-
-	mem_deref(pwd);
-
-	return 0;
+	return icem_set_rpwd(icem, value);
 }
 
 
@@ -180,9 +168,7 @@ static int media_ufrag_decode(struct icem *icem, const char *value)
 
 static int media_pwd_decode(struct icem *icem, const char *value)
 {
-	icem->rpwd = mem_deref(icem->rpwd);
-
-	return str_dup(&icem->rpwd, value);
+	return icem_set_rpwd(icem, value);
 }
 
 
@@ -197,10 +183,11 @@ static int cand_decode(struct icem *icem, const char *val)
 
 	sa_init(&rel_addr, AF_INET);
 
-	err = re_regex(val, strlen(val),
-		       "[^ ]+ [0-9]+ [^ ]+ [0-9]+ [^ ]+ [0-9]+ typ [a-z]+[^]*",
-		       &foundation, &compid, &transp, &prio,
-		       &addr, &port, &cand_type, &extra);
+	err = re_regex_cached(val, strlen(val),
+			      "[^ ]+ [0-9]+ [^ ]+ [0-9]+ [^ ]+ [0-9]+ "
+			      "typ [a-z]+[^]*",
+			      &foundation, &compid, &transp, &prio,
+			      &addr, &port, &cand_type, &extra);
 	if (err)
 		return err;
 
@@ -216,8 +203,8 @@ static int cand_decode(struct icem *icem, const char *val)
 		struct pl name, value;
 
 		/* Loop through " SP attr SP value" pairs */
-		while (!re_regex(extra.p, extra.l, " [^ ]+ [^ ]+",
-				 &name, &value)) {
+		while (!re_regex_cached(extra.p, extra.l, " [^ ]+ [^ ]+",
+					&name, &value)) {
 
 			pl_advance(&extra, value.p + value.l - extra.p);
 
@@ -370,11 +357,11 @@ int ice_cand_attr_decode(struct ice_cand_attr *cand, const char *val)
 
 	len = str_len(val);
 
-	err = re_regex(val, len,
-		       "[^ ]+ [0-9]+ [a-z]+ [0-9]+ [^ ]+ [0-9]+ typ [a-z]+"
-		       "[^]*",
-		       &pl_fnd, &pl_compid, &pl_transp, &pl_prio,
-		       &pl_addr, &pl_port, &pl_type, &pl_opt);
+	err = re_regex_cached(val, len,
+			      "[^ ]+ [0-9]+ [a-z]+ [0-9]+ [^ ]+ [0-9]+ "
+			      "typ [a-z]+[^]*",
+			      &pl_fnd, &pl_compid, &pl_transp, &pl_prio,
+			      &pl_addr, &pl_port, &pl_type, &pl_opt);
 	if (err)
 		return err;
 
@@ -400,8 +387,9 @@ int ice_cand_attr_decode(struct ice_cand_attr *cand, const char *val)
 
 	/* optional */
 
-	if (0 == re_regex(pl_opt.p, pl_opt.l, "raddr [^ ]+ rport [0-9]+",
-			  &pl_raddr, &pl_rport)) {
+	if (0 == re_regex_cached(pl_opt.p, pl_opt.l,
+				 "raddr [^ ]+ rport [0-9]+",
+				 &pl_raddr, &pl_rport)) {
 
 		err = sa_set(&cand->rel_addr, &pl_raddr, pl_u32(&pl_rport));
 		if (err)
@@ -412,8 +400,8 @@ int ice_cand_attr_decode(struct ice_cand_attr *cand, const char *val)
 
 		struct pl tcptype;
 
-		err = re_regex(pl_opt.p, pl_opt.l, "tcptype [^ ]+",
-			       &tcptype);
+		err = re_regex_cached(pl_opt.p, pl_opt.l, "tcptype [^ ]+",
+				      &tcptype);
 		if (err)
 			return err;
 
@@ -168,10 +168,9 @@ static int stunsrv_ereply(struct icem_comp *comp, const struct sa *src,
 {
 	struct icem *icem = comp->icem;
 
-	return stun_ereply(icem->proto, comp->sock, src, presz, req,
-			   scode, reason,
-			   (uint8_t *)icem->lpwd, strlen(icem->lpwd), true, 1,
-			   STUN_ATTR_SOFTWARE, sw);
+	return stun_ereply_hmac(icem->proto, comp->sock, src, presz, req,
+				scode, reason, icem->lhmac, true, 1,
+				STUN_ATTR_SOFTWARE, sw);
 }
 
 
@@ -192,7 +191,7 @@ int icem_stund_recv(struct icem_comp *comp, const struct sa *src,
 	if (err)
 		return err;
 
-	err = stun_msg_chk_mi(req, (uint8_t *)icem->lpwd, strlen(icem->lpwd));
+	err = stun_msg_chk_mi_hmac(req, icem->lhmac);
 	if (err) {
 		if (err == EBADMSG)
 			goto unauth;
@@ -257,10 +256,10 @@ int icem_stund_recv(struct icem_comp *comp, const struct sa *src,
 	if (err)
 		goto badmsg;
 
-	return stun_reply(icem->proto, comp->sock, src, presz, req,
-			  (uint8_t *)icem->lpwd, strlen(icem->lpwd), true, 2,
-			  STUN_ATTR_XOR_MAPPED_ADDR, src,
-			  STUN_ATTR_SOFTWARE, sw);
+	return stun_reply_hmac(icem->proto, comp->sock, src, presz, req,
+			       icem->lhmac, true, 2,
+			       STUN_ATTR_XOR_MAPPED_ADDR, src,
+			       STUN_ATTR_SOFTWARE, sw);
 
  badmsg:
 	return stunsrv_ereply(comp, src, presz, req, 400, "Bad Request");
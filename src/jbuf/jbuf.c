@@ -16,6 +16,8 @@
 #include <re_rtp.h>
 #include <re_thread.h>
 #include <re_tmr.h>
+#include <re_h264.h>
+#include <re_h265.h>
 #include <re_jbuf.h>
 
 #include <stdlib.h>
@@ -42,14 +44,17 @@ enum {
 	JBUF_RDIFF_EMA_COEFF = 1024,
 	JBUF_RDIFF_UP_SPEED  = 512,
 	JBUF_PUT_TIMEOUT     = 400,
+	JBUF_VIDEO_WAIT      = 150,  /* [ms] wait for missing packets */
 };
 
 
 /** Defines a packet frame */
 struct frame {
-	struct le le;           /**< Linked list element       */
 	struct rtp_header hdr;  /**< RTP Header                */
 	void *mem;              /**< Reference counted pointer */
+	uint64_t tr;            /**< Arrival time              */
+	bool used;              /**< Slot holds a frame        */
+	bool key;               /**< Packet begins a keyframe  */
 };
 
 
@@ -57,11 +62,20 @@ struct frame {
  * Defines a jitter buffer
  *
  * The jitter buffer is for incoming RTP packets, which are sorted by
- * sequence number.
+ * sequence number. The frames are kept in a ring indexed by sequence
+ * number, which spans the sequence numbers from the oldest to the newest
+ * buffered frame.
+ *
+ * In video mode the packets are grouped into video frames by their RTP
+ * timestamp, and jbuf_get() only returns the packets of complete frames.
+ * Then min, max and wish for adaptive mode count video frames, while the
+ * buffer is still limited to max packets.
  */
 struct jbuf {
-	struct list pooll;   /**< List of free frames in pool               */
-	struct list framel;  /**< List of buffered frames                   */
+	struct frame *ring;  /**< Frames indexed by sequence number         */
+	uint32_t mask;       /**< Ring size - 1                             */
+	uint16_t seq_head;   /**< Sequence number of oldest buffered frame  */
+	uint16_t seq_tail;   /**< Sequence number of newest buffered frame  */
 	uint32_t n;          /**< [# frames] Current # of frames in buffer  */
 	uint32_t min;        /**< [# frames] Minimum # of frames to buffer  */
 	uint32_t max;        /**< [# frames] Maximum # of frames to buffer  */
@@ -77,6 +91,12 @@ struct jbuf {
 
 	mtx_t lock;          /**< Makes jitter buffer thread safe           */
 	enum jbuf_type jbtype;     /**< Jitter buffer type                  */
+	enum jbuf_video video;     /**< Video payload format                */
+	struct jbuf_frame vf;      /**< Video frame returned by jbuf_get()  */
+	uint16_t vf_left;          /**< Packets of the video frame left     */
+	bool vf_cut;               /**< Video frame was dropped on overflow */
+	uint32_t ts_put;           /**< Newest video frame timestamp        */
+	uint32_t ts_step;          /**< Timestamp increment between frames  */
 #if JBUF_STAT
 	struct jbuf_stat stat; /**< Jitter buffer Statistics       */
 #endif
@@ -90,48 +110,58 @@ static inline bool seq_less(uint16_t x, uint16_t y)
 }
 
 
-/**
- * Get a frame from the pool
- */
-static void frame_alloc(struct jbuf *jb, struct frame **f)
+static inline struct frame *frame_get(const struct jbuf *jb, uint16_t seq)
 {
-	struct le *le;
+	return &jb->ring[seq & jb->mask];
+}
 
-	le = jb->pooll.head;
-	if (le) {
-		list_unlink(le);
-		++jb->n;
-	}
-	else {
-		struct frame *f0;
 
-		/* Steal an old frame */
-		le = jb->framel.head;
-		f0 = le->data;
+/**
+ * Release a frame, and move the head to the next buffered frame
+ */
+static void frame_deref(struct jbuf *jb, struct frame *f)
+{
+	f->mem  = mem_deref(f->mem);
+	f->used = false;
+	--jb->n;
 
-#if JBUF_STAT
-		STAT_INC(n_overflow);
-		DEBUG_INFO("drop 1 old frame seq=%u (total dropped %u)\n",
-			   f0->hdr.seq, jb->stat.n_overflow);
-#endif
+	/* the oldest frame belongs to the video frame being returned */
+	if (jb->vf_left && f->hdr.seq == jb->seq_head)
+		--jb->vf_left;
 
-		f0->mem = mem_deref(f0->mem);
-		list_unlink(le);
-	}
+	if (!jb->n || f->hdr.seq != jb->seq_head)
+		return;
 
-	*f = le->data;
+	do {
+		++jb->seq_head;
+	} while (!frame_get(jb, jb->seq_head)->used);
 }
 
 
 /**
- * Release a frame, put it back in the pool
+ * Drop the oldest frame to make room for a new one. The video frame
+ * being returned is dropped as a whole, and the next one is reported
+ * as skipped.
  */
-static void frame_deref(struct jbuf *jb, struct frame *f)
+static void frame_drop(struct jbuf *jb)
 {
-	f->mem = mem_deref(f->mem);
-	list_unlink(&f->le);
-	list_append(&jb->pooll, &f->le, f);
-	--jb->n;
+	do {
+		struct frame *f = frame_get(jb, jb->seq_head);
+
+		STAT_INC(n_overflow);
+#if JBUF_STAT
+		DEBUG_INFO("drop 1 old frame seq=%u (total dropped %u)\n",
+			   f->hdr.seq, jb->stat.n_overflow);
+#endif
+
+		if (jb->vf_left) {
+			jb->seq_get = f->hdr.seq;
+			jb->vf_cut  = true;
+		}
+
+		frame_deref(jb, f);
+
+	} while (jb->vf_left);
 }
 
 
@@ -142,8 +172,7 @@ static void jbuf_destructor(void *data)
 	tmr_cancel(&jb->tmr);
 	jbuf_flush(jb);
 
-	/* Free all frames in the pool list */
-	list_flush(&jb->pooll);
+	mem_deref(jb->ring);
 	mtx_destroy(&jb->lock);
 }
 
@@ -160,10 +189,10 @@ static void jbuf_destructor(void *data)
 int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 {
 	struct jbuf *jb;
-	uint32_t i;
+	uint32_t size;
 	int err = 0;
 
-	if (!jbp || ( min > max))
+	if (!jbp || ( min > max) || !max || max > 16384)
 		return EINVAL;
 
 	/* self-test: x < y (also handle wrap around) */
@@ -176,9 +205,6 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 	if (!jb)
 		return ENOMEM;
 
-	list_init(&jb->pooll);
-	list_init(&jb->framel);
-
 	jb->jbtype = JBUF_FIXED;
 	jb->min  = min;
 	jb->max  = max;
@@ -194,18 +220,18 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 		goto out;
 	}
 
-	/* Allocate all frames now */
-	for (i=0; i<jb->max; i++) {
-		struct frame *f = mem_zalloc(sizeof(*f), NULL);
-		if (!f) {
-			err = ENOMEM;
-			break;
-		}
+	/* Allocate all frames now, with room for gaps of lost frames */
+	for (size=1; size<2*max; size<<=1)
+		;
 
-		list_append(&jb->pooll, &f->le, f);
-		DEBUG_INFO("alloc: adding to pool list %u\n", i);
+	jb->ring = mem_zalloc(size * sizeof(*jb->ring), NULL);
+	if (!jb->ring) {
+		err = ENOMEM;
+		goto out;
 	}
 
+	jb->mask = size - 1;
+
 out:
 	if (err)
 		mem_deref(jb);
@@ -216,6 +242,33 @@ out:
 }
 
 
+/**
+ * Set the video payload format, for a frame-aware jitter buffer
+ *
+ * In video mode jbuf_get() returns the packets of complete video frames,
+ * see jbuf_frame(). The memory objects passed to jbuf_put() must then be
+ * mbufs positioned at the RTP payload, for keyframe detection.
+ *
+ * @param jb     The jitter buffer.
+ * @param video  Video payload format, JBUF_VIDEO_OFF for packets
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int jbuf_set_video(struct jbuf *jb, enum jbuf_video video)
+{
+	if (!jb)
+		return EINVAL;
+
+	jbuf_flush(jb);
+
+	mtx_lock(&jb->lock);
+	jb->video = video;
+	mtx_unlock(&jb->lock);
+
+	return 0;
+}
+
+
 /**
  * Set jitter buffer type.
  *
@@ -247,9 +300,8 @@ static void wish_down(void *arg)
 }
 
 
-static void calc_rdiff(struct jbuf *jb, uint16_t seq)
+static void calc_rdiff(struct jbuf *jb, int32_t rdiff)
 {
-	int32_t rdiff;
 	int32_t adiff;
 	int32_t s;                         /**< EMA coefficient              */
 	uint32_t wish;
@@ -261,7 +313,6 @@ static void calc_rdiff(struct jbuf *jb, uint16_t seq)
 	if (!jb->seq_get)
 		return;
 
-	rdiff = (int16_t)(jb->seq_put + 1 - seq);
 	adiff = abs(rdiff * JBUF_RDIFF_EMA_COEFF);
 	s = adiff > jb->rdiff ? JBUF_RDIFF_UP_SPEED :
 		jb->wish > 2  ? 1 :
@@ -292,11 +343,129 @@ static void calc_rdiff(struct jbuf *jb, uint16_t seq)
 }
 
 
+static bool h264_key(unsigned type)
+{
+	return h264_is_keyframe(type) || type == H264_NALU_SPS ||
+		type == H264_NALU_PPS;
+}
+
+
+static bool h265_key(unsigned type)
+{
+	return h265_is_keyframe(type) || type == H265_NAL_VPS_NUT ||
+		type == H265_NAL_SPS_NUT || type == H265_NAL_PPS_NUT;
+}
+
+
+/*
+ * Does the RTP payload begin a keyframe? A keyframe begins with its
+ * parameter sets, or with the first fragment of its first NAL unit.
+ */
+static bool payload_keyframe(enum jbuf_video video, const struct mbuf *mb)
+{
+	const uint8_t *p;
+	size_t len, sz;
+
+	if (!mb)
+		return false;
+
+	p   = mbuf_buf(mb);
+	len = mbuf_get_left(mb);
+
+	switch (video) {
+
+	case JBUF_VIDEO_H264:
+		if (len < 2)
+			return false;
+
+		switch (p[0] & 0x1f) {
+
+		case H264_NALU_STAP_A:
+			for (p += 1, len -= 1; len > 2; p += sz, len -= sz) {
+
+				sz = p[0] << 8 | p[1];
+				p += 2;
+				len -= 2;
+
+				if (!sz || sz > len)
+					return false;
+
+				if (h264_key(p[0] & 0x1f))
+					return true;
+			}
+			return false;
+
+		case H264_NALU_FU_A:
+			return (p[1] & 0x80) && h264_key(p[1] & 0x1f);
+
+		default:
+			return h264_key(p[0] & 0x1f);
+		}
+
+	case JBUF_VIDEO_H265:
+		if (len < 3)
+			return false;
+
+		switch ((p[0] >> 1) & 0x3f) {
+
+		case H265_NAL_AP:
+			for (p += 2, len -= 2; len > 2; p += sz, len -= sz) {
+
+				sz = p[0] << 8 | p[1];
+				p += 2;
+				len -= 2;
+
+				if (!sz || sz > len)
+					return false;
+
+				if (h265_key((p[0] >> 1) & 0x3f))
+					return true;
+			}
+			return false;
+
+		case H265_NAL_FU:
+			return (p[2] & 0x80) && h265_key(p[2] & 0x3f);
+
+		default:
+			return h265_key((p[0] >> 1) & 0x3f);
+		}
+
+	case JBUF_VIDEO_AV1:
+		/* N bit of the aggregation header, a new coded sequence */
+		return len >= 1 && (p[0] & 0x08);
+
+	default:
+		return false;
+	}
+}
+
+
+/* Number of video frames a packet is behind the newest one */
+static int32_t video_rdiff(struct jbuf *jb, uint32_t ts)
+{
+	int32_t d = (int32_t)(ts - jb->ts_put);
+
+	if (!jb->running) {
+		jb->ts_put  = ts;
+		jb->ts_step = 0;
+		return 0;
+	}
+
+	if (d > 0) {
+		jb->ts_step = d;
+		jb->ts_put  = ts;
+		return 0;
+	}
+
+	return jb->ts_step ? -d / (int32_t)jb->ts_step : 0;
+}
+
+
 /**
  * Put one frame into the jitter buffer
  *
  * @param jb   Jitter buffer
- * @param hdr  RTP Header
+ * @param hdr  RTP Header, with the arrival time if known
  * @param mem  Memory pointer - will be referenced
  *
  * @return 0 if success, otherwise errorcode
@@ -304,9 +473,10 @@ static void calc_rdiff(struct jbuf *jb, uint16_t seq)
 int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 {
 	struct frame *f;
-	struct le *le, *tail;
 	uint16_t seq;
 	uint64_t tr, dt;
+	int32_t rdiff;
+	bool key;
 	int err = 0;
 
 	if (!jb || !hdr)
@@ -321,7 +491,7 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 		jbuf_flush(jb);
 	}
 
-	tr = tmr_jiffies();
+	tr = hdr->arrival ? hdr->arrival / 1000 : tmr_jiffies();
 	dt = tr - jb->tr;
 	if (jb->tr && dt > JBUF_PUT_TIMEOUT) {
 		DEBUG_INFO("put timeout %lu ms, marker %d\n", dt, hdr->m);
@@ -334,10 +504,17 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 	mtx_lock(&jb->lock);
 	jb->ssrc = hdr->ssrc;
 
+	key = payload_keyframe(jb->video, mem);
+
+	if (jb->video)
+		rdiff = video_rdiff(jb, hdr->ts);
+	else
+		rdiff = (int16_t)(jb->seq_put + 1 - seq);
+
 	if (jb->running) {
 
 		if (jb->jbtype == JBUF_ADAPTIVE)
-			calc_rdiff(jb, seq);
+			calc_rdiff(jb, rdiff);
 
 		/* Packet arrived too late to be put into buffer */
 		if (jb->seq_get && seq_less(seq, jb->seq_get + 1)) {
@@ -353,59 +530,75 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 
 	STAT_INC(n_put);
 
-	frame_alloc(jb, &f);
+	f = frame_get(jb, seq);
 
-	tail = jb->framel.tail;
+	/* Detect duplicates */
+	if (f->used && f->hdr.seq == seq) {
+		DEBUG_INFO("duplicate: seq=%u\n", seq);
+		STAT_INC(n_dups);
+		err = EALREADY;
+		goto out;
+	}
 
-	/* If buffer is empty -> append to tail
-	   Frame is later than tail -> append to tail
-	*/
-	if (!tail || seq_less(((struct frame *)tail->data)->hdr.seq, seq)) {
-		list_append(&jb->framel, &f->le, f);
-		goto success;
+	if (!jb->n) {
+		jb->seq_head = seq;
+		jb->seq_tail = seq;
 	}
+	else if (seq_less(jb->seq_tail, seq)) {
 
-	/* Out-of-sequence, find right position */
-	for (le = tail; le; le = le->prev) {
-		const uint16_t seq_le = ((struct frame *)le->data)->hdr.seq;
+		/* Frame is later than tail, the ring moves forward */
+		while (jb->n && (jb->n >= jb->max ||
+				 (uint16_t)(seq - jb->seq_head) > jb->mask))
+			frame_drop(jb);
 
-		if (seq_less(seq_le, seq)) { /* most likely */
-			DEBUG_PRINTF("put: out-of-sequence"
-				   " - inserting after seq=%u (seq=%u)\n",
-				   seq_le, seq);
-			list_insert_after(&jb->framel, le, &f->le, f);
-			break;
-		}
-		else if (seq == seq_le) { /* less likely */
-			/* Detect duplicates */
-			DEBUG_INFO("duplicate: seq=%u\n", seq);
-			STAT_INC(n_dups);
-			list_insert_after(&jb->framel, le, &f->le, f);
-			frame_deref(jb, f);
-			err = EALREADY;
-			goto out;
-		}
+		if (!jb->n)
+			jb->seq_head = seq;
 
-		/* sequence number less than current seq, continue */
+		jb->seq_tail = seq;
 	}
+	else if (seq_less(seq, jb->seq_head)) {
+
+		/* Out-of-sequence, older than all buffered frames */
+		if (jb->n >= jb->max ||
+		    (uint16_t)(jb->seq_tail - seq) > jb->mask) {
+			STAT_INC(n_overflow);
+			DEBUG_INFO("put: out-of-sequence"
+				   " - no room for seq=%u\n", seq);
+			err = ETIMEDOUT;
+			goto out;
+		}
 
-	/* no earlier timestamps found, put in head */
-	if (!le) {
 		DEBUG_PRINTF("put: out-of-sequence"
 			   " - put in head (seq=%u)\n", seq);
-		list_prepend(&jb->framel, &f->le, f);
+		jb->seq_head = seq;
+		STAT_INC(n_oos);
 	}
+	else {
+		/* Out-of-sequence, fills a gap */
+		DEBUG_PRINTF("put: out-of-sequence - fill gap (seq=%u)\n",
+			     seq);
+
+		if (jb->n >= jb->max)
+			frame_drop(jb);
 
-	STAT_INC(n_oos);
+		/* the gap may have been the oldest frame */
+		if (!jb->n || seq_less(seq, jb->seq_head))
+			jb->seq_head = seq;
+
+		STAT_INC(n_oos);
+	}
 
-success:
 	/* Update last timestamp */
 	jb->running = true;
 	jb->seq_put = seq;
 
 	/* Success */
-	f->hdr = *hdr;
-	f->mem = mem_ref(mem);
+	f->hdr  = *hdr;
+	f->mem  = mem_ref(mem);
+	f->tr   = tr;
+	f->used = true;
+	f->key  = key;
+	++jb->n;
 
 out:
 	mtx_unlock(&jb->lock);
@@ -413,6 +606,129 @@ out:
 }
 
 
+/*
+ * Finds the oldest complete video frame, and counts the buffered video
+ * frames up to it. A frame is complete when its packets are contiguous,
+ * it begins after a packet of another frame or with a keyframe, and it
+ * ends with the marker bit or before a packet of another frame.
+ */
+static bool vframe_find(const struct jbuf *jb, struct jbuf_frame *vf,
+			uint32_t *nfp)
+{
+	const uint16_t end = jb->seq_tail + 1;
+	struct jbuf_frame cur = {0, 0, 0, false, false};
+	bool found = false;
+	bool prev = false;      /* previous packet is buffered */
+	bool ok = false;        /* current frame is complete so far */
+	bool m = false;         /* marker bit of previous packet */
+	uint32_t nf = 0;
+	uint16_t seq;
+
+	for (seq = jb->seq_head; seq != end; seq++) {
+
+		const struct frame *f = frame_get(jb, seq);
+
+		if (!f->used) {
+			prev = false;
+			continue;
+		}
+
+		if (nf && f->hdr.ts == cur.ts) {
+
+			++cur.n;
+			cur.keyframe |= f->key;
+			ok = ok && prev;
+		}
+		else {
+			/* the current frame ends before this packet */
+			if (!found && nf && ok && (prev || m)) {
+				found = true;
+				*vf = cur;
+			}
+
+			if (found && nf > jb->wish)
+				break;
+
+			/* after the last returned frame, a new one starts */
+			if (!nf)
+				ok = !jb->seq_get ||
+					seq == (uint16_t)(jb->seq_get + 1);
+			else
+				ok = prev;
+
+			ok = ok || f->key;
+
+			cur.ts       = f->hdr.ts;
+			cur.seq      = seq;
+			cur.n        = 1;
+			cur.keyframe = f->key;
+			++nf;
+		}
+
+		prev = true;
+		m    = f->hdr.m;
+	}
+
+	/* the newest frame ends with the marker bit */
+	if (!found && nf && ok && prev && m) {
+		found = true;
+		*vf = cur;
+	}
+
+	*nfp = nf;
+
+	return found;
+}
+
+
+/*
+ * Selects the video frame returned by jbuf_get(). Incomplete frames
+ * before a complete one are skipped when it is a keyframe, or when the
+ * missing packets did not arrive in time.
+ */
+static int vframe_open(struct jbuf *jb)
+{
+	struct jbuf_frame vf;
+	uint32_t nf;
+
+	if (!jb->n || !vframe_find(jb, &vf, &nf))
+		return ENOENT;
+
+	if (vf.seq == jb->seq_head) {
+
+		if (nf <= jb->wish)
+			return ENOENT;
+	}
+	else {
+		const struct frame *f = frame_get(jb, jb->seq_head);
+
+		if (!vf.keyframe &&
+		    tmr_jiffies() - f->tr < JBUF_VIDEO_WAIT)
+			return ENOENT;
+
+		DEBUG_INFO("skipping incomplete frames: seq=%u-%u\n",
+			   jb->seq_head, vf.seq - 1);
+
+		while (jb->seq_head != vf.seq)
+			frame_deref(jb, frame_get(jb, jb->seq_head));
+
+		STAT_INC(n_lost);
+		jb->seq_get = vf.seq - 1;
+		vf.skipped  = true;
+	}
+
+	if (jb->vf_cut) {
+		vf.skipped = true;
+		jb->vf_cut = false;
+	}
+
+	jb->vf      = vf;
+	jb->vf_left = vf.n;
+
+	return 0;
+}
+
+
 /**
  * Get one frame from the jitter buffer
  *
@@ -422,6 +738,11 @@ out:
  *
  * @return 0 if success, EAGAIN if it should be called again in order to avoid
  * a jitter buffer overflow, otherwise errorcode
+ *
+ * In video mode EAGAIN means that more packets of the video frame follow,
+ * and 0 that the packet is the last one of the frame. A video frame
+ * dropped on overflow ends without it, and jbuf_frame() reports the next
+ * one as skipped.
  */
 int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 {
@@ -434,7 +755,16 @@ int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 	mtx_lock(&jb->lock);
 	STAT_INC(n_get);
 
-	if (jb->n <= jb->wish || !jb->framel.head) {
+	if (jb->video) {
+		if (!jb->vf_left && vframe_open(jb)) {
+			DEBUG_INFO("no complete video frame - wait.. "
+				   "(n=%u wish=%u)\n", jb->n, jb->wish);
+			STAT_INC(n_underflow);
+			err = ENOENT;
+			goto out;
+		}
+	}
+	else if (jb->n <= jb->wish || !jb->n) {
 		DEBUG_INFO("not enough buffer frames - wait.. "
 			   "(n=%u wish=%u)\n", jb->n, jb->wish);
 		STAT_INC(n_underflow);
@@ -446,7 +776,7 @@ int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 	   is present and have a seq no. of seq[i] + 1.
 	   If not, we should consider that packet lost. */
 
-	f = jb->framel.head->data;
+	f = frame_get(jb, jb->seq_head);
 
 #if JBUF_STAT
 	/* Check timestamp of previously played frame */
@@ -471,7 +801,11 @@ int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 
 	frame_deref(jb, f);
 
-	if (jb->jbtype == JBUF_ADAPTIVE && jb->n > jb->wish) {
+	if (jb->video) {
+		if (jb->vf_left)
+			err = EAGAIN;
+	}
+	else if (jb->jbtype == JBUF_ADAPTIVE && jb->n > jb->wish) {
 		DEBUG_INFO("reducing jitter buffer "
 			   "(n=%u min=%u wish=%u max=%u)\n",
 			   jb->n, jb->min, jb->wish, jb->max);
@@ -502,16 +836,12 @@ int jbuf_drain(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 
 	mtx_lock(&jb->lock);
 
-	if (jb->n <= 0 || !jb->framel.head) {
+	if (!jb->n) {
 		err = ENOENT;
 		goto out;
 	}
 
-	/* When we get one frame F[i], check that the next frame F[i+1]
-	   is present and have a seq no. of seq[i] + 1.
-	   If not, we should consider that packet lost. */
-
-	f = jb->framel.head->data;
+	f = frame_get(jb, jb->seq_head);
 
 	/* Update sequence number for 'get' */
 	jb->seq_get = f->hdr.seq;
@@ -526,6 +856,101 @@ out:
 	return err;
 }
 
+
+/**
+ * Get the video frame whose packets are returned by jbuf_get()
+ *
+ * @param jb    Jitter buffer in video mode
+ * @param frame Returned video frame
+ *
+ * @return 0 if success, ENOENT if no complete frame, otherwise errorcode
+ */
+int jbuf_frame(struct jbuf *jb, struct jbuf_frame *frame)
+{
+	int err = 0;
+
+	if (!jb || !frame)
+		return EINVAL;
+
+	mtx_lock(&jb->lock);
+
+	if (!jb->video)
+		err = EINVAL;
+	else if (!jb->vf_left)
+		err = vframe_open(jb);
+
+	if (!err)
+		*frame = jb->vf;
+
+	mtx_unlock(&jb->lock);
+
+	return err;
+}
+
+
+/**
+ * Get the missing packets as Generic NACK items (RFC 4585)
+ *
+ * Packets are missing between the last returned packet and the newest
+ * buffered one.
+ *
+ * @param jb     Jitter buffer
+ * @param gnackv Returned Generic NACK items
+ * @param n      Maximum number of items, returned number of items
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int jbuf_nack(struct jbuf *jb, struct gnack *gnackv, uint32_t *n)
+{
+	uint16_t seq, end;
+	uint32_t i = 0;
+
+	if (!jb || !gnackv || !n)
+		return EINVAL;
+
+	mtx_lock(&jb->lock);
+
+	if (!jb->n)
+		goto out;
+
+	seq = jb->seq_head;
+	end = jb->seq_tail;
+
+	if (jb->seq_get && seq_less(jb->seq_get, seq) &&
+	    (uint16_t)(end - jb->seq_get) <= jb->mask)
+		seq = jb->seq_get + 1;
+
+	for (; seq != end; seq++) {
+
+		const struct frame *f = frame_get(jb, seq);
+		uint16_t d;
+
+		if (f->used && f->hdr.seq == seq)
+			continue;
+
+		/* bitmask of following lost packets */
+		d = i ? (uint16_t)(seq - gnackv[i-1].pid) : 0;
+		if (i && d <= 16) {
+			gnackv[i-1].blp |= 1 << (d - 1);
+			continue;
+		}
+
+		if (i >= *n)
+			break;
+
+		gnackv[i].pid = seq;
+		gnackv[i].blp = 0;
+		++i;
+	}
+
+ out:
+	mtx_unlock(&jb->lock);
+	*n = i;
+
+	return 0;
+}
+
+
 /**
  * Flush all frames in the jitter buffer
  *
@@ -533,7 +958,6 @@ out:
  */
 void jbuf_flush(struct jbuf *jb)
 {
-	struct le *le;
 #if JBUF_STAT
 	uint32_t n_flush;
 #endif
@@ -542,20 +966,20 @@ void jbuf_flush(struct jbuf *jb)
 		return;
 
 	mtx_lock(&jb->lock);
-	if (jb->framel.head) {
+	if (jb->n) {
 		DEBUG_INFO("flush: %u frames\n", jb->n);
 	}
 
-	/* put all buffered frames back in free list */
-	for (le = jb->framel.head; le; le = jb->framel.head) {
-		DEBUG_INFO(" flush frame: seq=%u\n",
-			   ((struct frame *)(le->data))->hdr.seq);
+	/* release all buffered frames, oldest first */
+	while (jb->n) {
+		DEBUG_INFO(" flush frame: seq=%u\n", jb->seq_head);
 
-		frame_deref(jb, le->data);
+		frame_deref(jb, frame_get(jb, jb->seq_head));
 	}
 
-	jb->n       = 0;
 	jb->running = false;
+	jb->vf_left = 0;
+	jb->vf_cut  = false;
 
 	jb->seq_get = 0;
 #if JBUF_STAT
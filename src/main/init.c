@@ -47,4 +47,5 @@ void libre_close(void)
 	(void)fd_setsize(0);
 	net_sock_close();
 	re_thread_close();
+	re_regex_cache_flush();
 }
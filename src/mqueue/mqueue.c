@@ -58,32 +58,42 @@ static void destructor(void *arg)
 }
 
 
-static void event_handler(int flags, void *arg)
+/* Handles one message, returns false if there was none */
+static bool msg_handle(struct mqueue *mq)
 {
-	struct mqueue *mq = arg;
 	struct msg msg;
 	ssize_t n;
 
-	if (!(flags & FD_READ))
-		return;
-
 	n = pipe_read(mq->pfd[0], &msg, sizeof(msg));
-	if (n < 0)
-		return;
+	if (n <= 0)
+		return false;
 
 	if (n != sizeof(msg)) {
 		(void)re_fprintf(stderr, "mqueue: short read of %d bytes\n",
 				 n);
-		return;
+		return true;
 	}
 
 	if (msg.magic != MAGIC) {
 		(void)re_fprintf(stderr, "mqueue: bad magic on read (%08x)\n",
 				 msg.magic);
-		return;
+		return true;
 	}
 
 	mq->h(msg.id, msg.data, mq->arg);
+
+	return true;
+}
+
+
+static void event_handler(int flags, void *arg)
+{
+	struct mqueue *mq = arg;
+
+	if (!(flags & FD_READ))
+		return;
+
+	(void)msg_handle(mq);
 }
 
 
@@ -166,3 +176,22 @@ int mqueue_push(struct mqueue *mq, int id, void *data)
 
 	return (n != sizeof(msg)) ? EPIPE : 0;
 }
+
+
+/**
+ * Handle all pending messages of a Message Queue
+ *
+ * For the receiving thread after its re_main() loop has returned, so
+ * that the data of the pending messages can be released before the
+ * Message Queue is freed.
+ *
+ * @param mq Message Queue
+ */
+void mqueue_drain(struct mqueue *mq)
+{
+	if (!mq)
+		return;
+
+	while (msg_handle(mq))
+		;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file ext.c  RTP Header Extensions (RFC 8285)
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_fmt.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_list.h>
+#include <re_sa.h>
+#include <re_rtp.h>
+
+
+enum {
+	EXT_ONE_BYTE = 0xbede,
+	EXT_TWO_BYTE = 0x1000,
+	EXT_TWO_BYTE_MASK = 0xfff0,
+	EXT_ID_RESERVED = 15,
+	EXT_ABS_TIME_FRAC = 18,
+};
+
+
+/**
+ * Encode RTP header extension elements in the one-byte header form
+ *
+ * The buffer position must be at the start of the RTP payload, as
+ * passed to rtp_send() with the extension bit set. The extension block
+ * is padded to 32 bits.
+ *
+ * @param mb   Buffer to encode into
+ * @param extv Extension elements
+ * @param extc Number of extension elements
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtp_ext_encode(struct mbuf *mb, const struct rtp_ext *extv, size_t extc)
+{
+	size_t i, sz = 0;
+	int err;
+
+	if (!mb || !extv || !extc)
+		return EINVAL;
+
+	for (i=0; i<extc; i++) {
+
+		if (!extv[i].id || extv[i].id >= EXT_ID_RESERVED ||
+		    !extv[i].len || extv[i].len > sizeof(extv[i].data))
+			return EINVAL;
+
+		sz += 1 + extv[i].len;
+	}
+
+	err  = mbuf_write_u16(mb, htons(EXT_ONE_BYTE));
+	err |= mbuf_write_u16(mb, htons((uint16_t)((sz + 3) / 4)));
+
+	for (i=0; i<extc; i++) {
+		err |= mbuf_write_u8(mb, extv[i].id << 4 | (extv[i].len - 1));
+		err |= mbuf_write_mem(mb, extv[i].data, extv[i].len);
+	}
+
+	for (; sz & 0x3; sz++)
+		err |= mbuf_write_u8(mb, 0x00);
+
+	return err;
+}
+
+
+/**
+ * Find an RTP header extension element in a received RTP packet
+ *
+ * The buffer position must be at the start of the RTP payload, as
+ * passed to the RTP receive handler. Both the one-byte and the two-byte
+ * header forms are supported.
+ *
+ * @param ext Extension element (set on return)
+ * @param id  Extension identifier
+ * @param hdr Decoded RTP header
+ * @param mb  RTP packet
+ *
+ * @return 0 if found, otherwise errorcode
+ */
+int rtp_ext_find(struct rtp_ext *ext, uint8_t id,
+		 const struct rtp_header *hdr, const struct mbuf *mb)
+{
+	const uint8_t *p, *end;
+	size_t sz;
+	bool two;
+
+	if (!ext || !id || !hdr || !mb)
+		return EINVAL;
+
+	if (!hdr->ext)
+		return ENOENT;
+
+	if (hdr->x.type == EXT_ONE_BYTE)
+		two = false;
+	else if ((hdr->x.type & EXT_TWO_BYTE_MASK) == EXT_TWO_BYTE)
+		two = true;
+	else
+		return ENOENT;
+
+	sz = hdr->x.len * sizeof(uint32_t);
+	if (mb->pos < sz)
+		return EINVAL;
+
+	end = mbuf_buf(mb);
+	p   = end - sz;
+
+	while (p < end) {
+
+		uint8_t eid, len;
+
+		/* padding */
+		if (!*p) {
+			++p;
+			continue;
+		}
+
+		if (two) {
+			if (p + 2 > end)
+				return EBADMSG;
+
+			eid = p[0];
+			len = p[1];
+			p += 2;
+		}
+		else {
+			eid = *p >> 4;
+			len = (*p & 0x0f) + 1;
+			p += 1;
+
+			if (eid == EXT_ID_RESERVED)
+				return ENOENT;
+		}
+
+		if (p + len > end)
+			return EBADMSG;
+
+		if (eid == id) {
+
+			if (len > sizeof(ext->data))
+				return EOVERFLOW;
+
+			ext->id  = eid;
+			ext->len = len;
+			memcpy(ext->data, p, len);
+
+			return 0;
+		}
+
+		p += len;
+	}
+
+	return ENOENT;
+}
+
+
+/**
+ * Set a transport-wide sequence number extension element
+ * (draft-holmer-rmcat-transport-wide-cc-extensions-01)
+ *
+ * @param ext Extension element
+ * @param id  Negotiated extension identifier
+ * @param seq Transport-wide sequence number
+ */
+void rtp_ext_set_twseq(struct rtp_ext *ext, uint8_t id, uint16_t seq)
+{
+	if (!ext)
+		return;
+
+	ext->id  = id;
+	ext->len = 2;
+	ext->data[0] = seq >> 8;
+	ext->data[1] = seq & 0xff;
+}
+
+
+/**
+ * Set an absolute send time extension element, in 6.18 fixed point
+ * seconds (http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time)
+ *
+ * @param ext Extension element
+ * @param id  Negotiated extension identifier
+ * @param us  Send time in [us]
+ */
+void rtp_ext_set_abs_time(struct rtp_ext *ext, uint8_t id, uint64_t us)
+{
+	uint32_t v;
+
+	if (!ext)
+		return;
+
+	/* the 6.18 value wraps every 64 seconds */
+	us %= 64000000;
+	v = (uint32_t)(((us << EXT_ABS_TIME_FRAC) / 1000000) & 0xffffff);
+
+	ext->id  = id;
+	ext->len = 3;
+	ext->data[0] = v >> 16;
+	ext->data[1] = v >> 8 & 0xff;
+	ext->data[2] = v & 0xff;
+}
+
+
+/**
+ * Get the transport-wide sequence number of an extension element
+ *
+ * @param ext Extension element
+ *
+ * @return Transport-wide sequence number
+ */
+uint16_t rtp_ext_twseq(const struct rtp_ext *ext)
+{
+	if (!ext || ext->len < 2)
+		return 0;
+
+	return ext->data[0] << 8 | ext->data[1];
+}
+
+
+/**
+ * Get the absolute send time of an extension element
+ *
+ * @param ext Extension element
+ *
+ * @return Send time in 6.18 fixed point seconds
+ */
+uint32_t rtp_ext_abs_time(const struct rtp_ext *ext)
+{
+	if (!ext || ext->len < 3)
+		return 0;
+
+	return (uint32_t)ext->data[0] << 16 | ext->data[1] << 8 |
+		ext->data[2];
+}
@@ -23,10 +23,50 @@
 enum {
 	GNACK_SIZE = 4,
 	FIR_SIZE = 8,
-	SLI_SIZE   = 4
+	SLI_SIZE   = 4,
+	TWCC_SIZE_MAX = 16384,
+	TWCC_RUN_MAX = 0x1fff,
+	TWCC_DELTA_US = 250,     /* delta resolution in [us]     */
+	TWCC_REFTIME_US = 64000, /* reference time unit in [us]  */
 };
 
 
+/* Transport-wide packet status */
+enum {
+	TWCC_NOT_RECV = 0,
+	TWCC_SMALL    = 1,
+	TWCC_LARGE    = 2,
+};
+
+
+/*
+ * The transport-wide feedback builder records the arrival times of a
+ * window of transport-wide sequence numbers. All storage is allocated
+ * up front, so recording a packet never allocates.
+ */
+struct rtcp_twcc {
+	uint64_t *arrv;     /* arrival time in [us], 0 if not received */
+	int16_t *deltav;    /* receive delta in [250 us]               */
+	uint8_t *statv;     /* packet status                           */
+	uint16_t size;
+	uint16_t seq;       /* base sequence number                    */
+	uint16_t count;     /* packet status count                     */
+	uint16_t next;      /* first sequence number not yet reported  */
+	uint8_t fbcount;    /* feedback packet count                   */
+	bool sent;
+};
+
+
+static void twcc_destructor(void *arg)
+{
+	struct rtcp_twcc *twcc = arg;
+
+	mem_deref(twcc->arrv);
+	mem_deref(twcc->deltav);
+	mem_deref(twcc->statv);
+}
+
+
 /* Encode functions */
 
 
@@ -66,6 +106,286 @@ int rtcp_psfb_sli_encode(struct mbuf *mb, uint16_t first, uint16_t number,
 }
 
 
+/**
+ * Allocate a Transport-wide congestion control feedback builder
+ *
+ * @param twccp Pointer to allocated feedback builder
+ * @param size  Maximum number of packets per feedback message
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtcp_twcc_alloc(struct rtcp_twcc **twccp, uint16_t size)
+{
+	struct rtcp_twcc *twcc;
+
+	if (!twccp || !size || size > TWCC_SIZE_MAX)
+		return EINVAL;
+
+	twcc = mem_zalloc(sizeof(*twcc), twcc_destructor);
+	if (!twcc)
+		return ENOMEM;
+
+	twcc->arrv   = mem_zalloc(size * sizeof(*twcc->arrv), NULL);
+	twcc->deltav = mem_zalloc(size * sizeof(*twcc->deltav), NULL);
+	twcc->statv  = mem_zalloc(size * sizeof(*twcc->statv), NULL);
+	if (!twcc->arrv || !twcc->deltav || !twcc->statv) {
+		mem_deref(twcc);
+		return ENOMEM;
+	}
+
+	twcc->size = size;
+	*twccp = twcc;
+
+	return 0;
+}
+
+
+/**
+ * Record the arrival of a packet in the Transport-wide feedback builder
+ *
+ * @param twcc    Feedback builder
+ * @param seq     Transport-wide sequence number
+ * @param arrival Arrival time in [us], non-zero
+ *
+ * @return 0 for success, EALREADY if the packet is older than the last
+ *         feedback, EOVERFLOW if the feedback must be sent first,
+ *         otherwise errorcode
+ */
+int rtcp_twcc_add(struct rtcp_twcc *twcc, uint16_t seq, uint64_t arrival)
+{
+	int d;
+
+	if (!twcc || !arrival)
+		return EINVAL;
+
+	if (twcc->sent && rtp_seq_diff(twcc->next, seq) < 0)
+		return EALREADY;
+
+	if (!twcc->count) {
+		/* losses since the last feedback are reported */
+		twcc->seq = twcc->sent ? twcc->next : seq;
+		if (rtp_seq_diff(twcc->seq, seq) >= twcc->size)
+			twcc->seq = seq;
+	}
+
+	d = rtp_seq_diff(twcc->seq, seq);
+	if (d < 0) {
+		const size_t shift = -d;
+
+		if (twcc->count + shift > twcc->size)
+			return EOVERFLOW;
+
+		memmove(&twcc->arrv[shift], twcc->arrv,
+			twcc->count * sizeof(*twcc->arrv));
+		memset(twcc->arrv, 0, shift * sizeof(*twcc->arrv));
+
+		twcc->seq    = seq;
+		twcc->count += shift;
+		d = 0;
+	}
+	else if (d >= twcc->size) {
+		return EOVERFLOW;
+	}
+	else if (d >= twcc->count) {
+		twcc->count = d + 1;
+	}
+
+	/* a duplicate keeps the first arrival */
+	if (!twcc->arrv[d])
+		twcc->arrv[d] = arrival;
+
+	return 0;
+}
+
+
+/**
+ * Get the number of packets covered by the Transport-wide feedback builder
+ *
+ * @param twcc Feedback builder
+ *
+ * @return Packet status count
+ */
+uint16_t rtcp_twcc_count(const struct rtcp_twcc *twcc)
+{
+	return twcc ? twcc->count : 0;
+}
+
+
+static int twcc_chunks_encode(struct mbuf *mb, const uint8_t *stv, size_t n)
+{
+	size_t i = 0;
+	int err = 0;
+
+	while (i < n && !err) {
+
+		size_t run, vec, j;
+		bool wide = false;
+		uint16_t chunk;
+
+		for (run = 1; i + run < n && run < TWCC_RUN_MAX; run++) {
+			if (stv[i + run] != stv[i])
+				break;
+		}
+
+		vec = min(n - i, (size_t)14);
+		for (j = 0; j < vec; j++) {
+			if (stv[i + j] > TWCC_SMALL)
+				wide = true;
+		}
+
+		if (run >= (wide ? 7u : 14u) || i + run == n) {
+			/* run length chunk */
+			chunk = stv[i] << 13 | run;
+			i += run;
+		}
+		else if (!wide) {
+			/* status vector chunk with 14 1-bit symbols */
+			chunk = 0x8000;
+			for (j = 0; j < vec; j++)
+				chunk |= stv[i + j] << (14 - 1 - j);
+			i += vec;
+		}
+		else {
+			/* status vector chunk with 7 2-bit symbols */
+			vec = min(n - i, (size_t)7);
+			chunk = 0xc000;
+			for (j = 0; j < vec; j++)
+				chunk |= stv[i + j] << (2 * (7 - 1 - j));
+			i += vec;
+		}
+
+		err = mbuf_write_u16(mb, htons(chunk));
+	}
+
+	return err;
+}
+
+
+/*
+ * Encodes the feedback message without advancing the builder, and
+ * returns the number of packets it covers for rtcp_twcc_commit().
+ */
+int rtcp_rtpfb_twcc_encode(struct mbuf *mb, struct rtcp_twcc *twcc,
+			   uint16_t *np)
+{
+	uint64_t ref;
+	int64_t t;
+	size_t i, n;
+	int err;
+
+	if (!mb || !twcc || !np)
+		return EINVAL;
+
+	if (!twcc->count)
+		return ENODATA;
+
+	/* the last packet is always received */
+	for (i = 0; !twcc->arrv[i]; i++)
+		;
+
+	ref = twcc->arrv[i] / TWCC_REFTIME_US;
+	t = ref * TWCC_REFTIME_US;
+
+	for (n = 0; n < twcc->count; n++) {
+
+		int64_t d;
+
+		twcc->statv[n] = TWCC_NOT_RECV;
+
+		if (!twcc->arrv[n])
+			continue;
+
+		/* rounded, so that the quantization error does not add up */
+		d = (int64_t)twcc->arrv[n] - t;
+		d = (d + (d < 0 ? -TWCC_DELTA_US : TWCC_DELTA_US) / 2) /
+			TWCC_DELTA_US;
+
+		if (0 <= d && d <= UINT8_MAX)
+			twcc->statv[n] = TWCC_SMALL;
+		else if (INT16_MIN <= d && d <= INT16_MAX)
+			twcc->statv[n] = TWCC_LARGE;
+		else
+			break;
+
+		twcc->deltav[n] = (int16_t)d;
+		t += d * TWCC_DELTA_US;
+	}
+
+	err  = mbuf_write_u16(mb, htons(twcc->seq));
+	err |= mbuf_write_u16(mb, htons((uint16_t)n));
+	err |= mbuf_write_u32(mb, htonl((uint32_t)(ref & 0xffffff) << 8 |
+					twcc->fbcount));
+	err |= twcc_chunks_encode(mb, twcc->statv, n);
+	if (err)
+		return err;
+
+	for (i = 0; i < n && !err; i++) {
+
+		switch (twcc->statv[i]) {
+
+		case TWCC_SMALL:
+			err = mbuf_write_u8(mb, (uint8_t)twcc->deltav[i]);
+			break;
+
+		case TWCC_LARGE:
+			err = mbuf_write_u16(mb,
+					     htons((uint16_t)twcc->deltav[i]));
+			break;
+
+		default:
+			break;
+		}
+	}
+	if (err)
+		return err;
+
+	*np = (uint16_t)n;
+
+	return 0;
+}
+
+
+/* Removes the first n packets of an encoded feedback message */
+void rtcp_twcc_commit(struct rtcp_twcc *twcc, uint16_t n)
+{
+	twcc->count -= n;
+	memmove(twcc->arrv, &twcc->arrv[n],
+		twcc->count * sizeof(*twcc->arrv));
+	memset(&twcc->arrv[twcc->count], 0, n * sizeof(*twcc->arrv));
+
+	twcc->seq  += n;
+	twcc->next  = twcc->seq;
+	twcc->sent  = true;
+	++twcc->fbcount;
+}
+
+
+/**
+ * Encode an RTCP Transport-wide congestion control Feedback Message
+ *
+ * A receive delta that does not fit into 16 bits ends the message, and
+ * the remaining packets are kept for the next feedback message.
+ *
+ * @param mb   Buffer to encode into
+ * @param twcc Feedback builder, advanced on success
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtcp_twcc_encode(struct mbuf *mb, struct rtcp_twcc *twcc)
+{
+	uint16_t n;
+	int err;
+
+	err = rtcp_rtpfb_twcc_encode(mb, twcc, &n);
+	if (err)
+		return err;
+
+	rtcp_twcc_commit(twcc, n);
+
+	return 0;
+}
+
+
 /* Decode functions */
 
 
@@ -147,6 +467,101 @@ int rtcp_rtpfb_twcc_decode(struct mbuf *mb, struct twcc *msg, int n)
 	return 0;
 }
 
+/**
+ * Apply a function handler to the packets of a decoded Transport-wide
+ * congestion control Feedback Message, in sequence order
+ *
+ * The arrival time passed to the handler is in [us], relative to the
+ * time base of the sender, and only valid for received packets.
+ *
+ * @param msg Decoded transport-cc message
+ * @param h   Packet handler, returns true to stop
+ * @param arg Handler argument
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtcp_twcc_apply(const struct twcc *msg, rtcp_twcc_h *h, void *arg)
+{
+	const struct mbuf *ch, *dl;
+	size_t ci, di, i = 0;
+	int64_t t;
+
+	if (!msg || !msg->chunks || !msg->deltas || !h)
+		return EINVAL;
+
+	ch = msg->chunks;
+	dl = msg->deltas;
+	ci = ch->pos;
+	di = dl->pos;
+	t  = (int64_t)msg->reftime * TWCC_REFTIME_US;
+
+	while (i < msg->count) {
+
+		uint16_t chunk;
+		size_t j, n;
+
+		if (ci + 2 > ch->end)
+			return EBADMSG;
+
+		chunk = ch->buf[ci] << 8 | ch->buf[ci + 1];
+		ci += 2;
+
+		if (!(chunk & 0x8000))
+			n = chunk & TWCC_RUN_MAX;
+		else if (chunk & 0x4000)
+			n = 7;
+		else
+			n = 14;
+
+		for (j = 0; j < n && i < msg->count; j++, i++) {
+
+			int16_t d;
+			uint8_t st;
+
+			if (!(chunk & 0x8000))
+				st = chunk >> 13 & 0x03;
+			else if (chunk & 0x4000)
+				st = chunk >> (2 * (7 - 1 - j)) & 0x03;
+			else
+				st = chunk >> (14 - 1 - j) & 0x01;
+
+			switch (st) {
+
+			case TWCC_NOT_RECV:
+				break;
+
+			case TWCC_SMALL:
+				if (di + 1 > dl->end)
+					return EBADMSG;
+
+				t += dl->buf[di] * TWCC_DELTA_US;
+				di += 1;
+				break;
+
+			case TWCC_LARGE:
+				if (di + 2 > dl->end)
+					return EBADMSG;
+
+				d = (int16_t)(dl->buf[di] << 8 |
+					      dl->buf[di + 1]);
+				t += d * TWCC_DELTA_US;
+				di += 2;
+				break;
+
+			default:
+				return EBADMSG;
+			}
+
+			if (h((uint16_t)(msg->seq + i), st != TWCC_NOT_RECV,
+			      t, arg))
+				return 0;
+		}
+	}
+
+	return 0;
+}
+
+
 /**
  * Decode an RTCP Transport Layer Feedback Message
  *
@@ -4,6 +4,7 @@
 # Copyright (C) 2010 Creytiv.com
 #
 
+SRCS	+= rtp/ext.c
 SRCS	+= rtp/fb.c
 SRCS	+= rtp/member.c
 SRCS	+= rtp/ntp.c
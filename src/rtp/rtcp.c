@@ -131,6 +131,51 @@ int rtcp_send_fir_rfc5104(struct rtp_sock *rs, uint32_t ssrc, uint8_t fir_seqn)
 			       &encode_fir_rfc5104_fci, &fci);
 }
 
+
+struct twcc_fci {
+	struct rtcp_twcc *twcc;
+	uint16_t n;
+};
+
+
+static int encode_twcc_fci(struct mbuf *mb, void *arg)
+{
+	struct twcc_fci *fci = arg;
+
+	return rtcp_rtpfb_twcc_encode(mb, fci->twcc, &fci->n);
+}
+
+
+/**
+ * Send an RTCP Transport-wide congestion control Feedback Message
+ *
+ * @param rs         RTP Socket
+ * @param ssrc_media SSRC of the media source
+ * @param twcc       Feedback builder, advanced only when sent
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtcp_send_twcc(struct rtp_sock *rs, uint32_t ssrc_media,
+		   struct rtcp_twcc *twcc)
+{
+	struct twcc_fci fci = {twcc, 0};
+	int err;
+
+	if (!rtcp_twcc_count(twcc))
+		return ENODATA;
+
+	err = rtcp_quick_send(rs, RTCP_RTPFB, RTCP_RTPFB_TWCC,
+			      rtp_sess_ssrc(rs), ssrc_media,
+			      &encode_twcc_fci, &fci);
+	if (err)
+		return err;
+
+	rtcp_twcc_commit(twcc, fci.n);
+
+	return 0;
+}
+
+
 const char *rtcp_type_name(enum rtcp_type type)
 {
 	switch (type) {
@@ -279,6 +324,12 @@ int rtcp_msg_print(struct re_printf *pf, const struct rtcp_msg *msg)
 						  msg->r.fb.fci.gnackv[i].blp);
 			}
 		}
+		else if (msg->hdr.count == RTCP_RTPFB_TWCC) {
+			err |= re_hprintf(pf, " TWCC seq=%u count=%u fb=%u",
+					  msg->r.fb.fci.twccv->seq,
+					  msg->r.fb.fci.twccv->count,
+					  msg->r.fb.fci.twccv->fbcount);
+		}
 		break;
 
 	case RTCP_PSFB:
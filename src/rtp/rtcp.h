@@ -83,6 +83,9 @@ int rtcp_sdes_decode(struct mbuf *mb, struct rtcp_sdes *sdes);
 int rtcp_rtpfb_gnack_encode(struct mbuf *mb, uint16_t pid, uint16_t blp);
 int rtcp_psfb_sli_encode(struct mbuf *mb, uint16_t first, uint16_t number,
 			 uint8_t picid);
+int rtcp_rtpfb_twcc_encode(struct mbuf *mb, struct rtcp_twcc *twcc,
+			   uint16_t *np);
+void rtcp_twcc_commit(struct rtcp_twcc *twcc, uint16_t n);
 int rtcp_rtpfb_twcc_decode(struct mbuf *mb, struct twcc *msg, int n);
 int rtcp_rtpfb_decode(struct mbuf *mb, struct rtcp_msg *msg);
 int rtcp_psfb_decode(struct mbuf *mb, struct rtcp_msg *msg);
@@ -116,6 +119,5 @@ int  rtcp_send(struct rtp_sock *rs, struct mbuf *mb);
 void rtcp_handler(struct rtcp_sess *sess, struct rtcp_msg *msg);
 void rtcp_sess_tx_rtp(struct rtcp_sess *sess, uint32_t ts,
 		      size_t payload_size);
-void rtcp_sess_rx_rtp(struct rtcp_sess *sess, uint16_t seq, uint32_t ts,
-		      uint32_t src, size_t payload_size,
-		      const struct sa *peer);
+void rtcp_sess_rx_rtp(struct rtcp_sess *sess, const struct rtp_header *hdr,
+		      size_t payload_size, const struct sa *peer);
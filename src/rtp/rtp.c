@@ -9,6 +9,7 @@
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_tmr.h>
 #include <re_sa.h>
 #include <re_sys.h>
 #include <re_net.h>
@@ -113,6 +114,8 @@ int rtp_hdr_decode(struct rtp_header *hdr, struct mbuf *mb)
 	hdr->ts   = ntohl(mbuf_read_u32(mb));
 	hdr->ssrc = ntohl(mbuf_read_u32(mb));
 
+	hdr->arrival = 0;
+
 	header_len = hdr->cc*sizeof(uint32_t);
 	if (mbuf_get_left(mb) < header_len)
 		return EBADMSG;
@@ -205,10 +208,11 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 	if (err)
 		return;
 
-	if (rs->rtcp) {
-		rtcp_sess_rx_rtp(rs->rtcp, hdr.seq, hdr.ts,
-				 hdr.ssrc, mbuf_get_left(mb), src);
-	}
+	/* the one clock reading for this packet */
+	hdr.arrival = tmr_jiffies_usec();
+
+	if (rs->rtcp)
+		rtcp_sess_rx_rtp(rs->rtcp, &hdr, mbuf_get_left(mb), src);
 
 	if (rs->recvh)
 		rs->recvh(src, &hdr, mb, rs->arg);
@@ -19,7 +19,7 @@
 #include <re_hash.h>
 #include <re_tmr.h>
 #include <re_sa.h>
-#include <re_thread.h>
+#include <re_atomic.h>
 #include <re_rtp.h>
 #include "rtcp.h"
 
@@ -35,13 +35,28 @@ enum {
 	MAX_MEMBERS   = 8,
 };
 
-/** RTP Transmit stats */
+/**
+ * RTP Transmit stats
+ *
+ * The stats are written by the sending thread only, and read as a
+ * snapshot which is consistent with a sequence count (seqlock). The
+ * sending thread never waits for the readers.
+ */
 struct txstat {
+	RE_ATOMIC unsigned seq;      /**< Sequence count, odd while written */
+	RE_ATOMIC uint32_t psent;    /**< Total number of RTP packets sent  */
+	RE_ATOMIC uint32_t osent;    /**< Total number of RTP octets  sent  */
+	RE_ATOMIC uint64_t jfs_ref;  /**< Timer ticks at RTP ts reference   */
+	RE_ATOMIC uint32_t ts_ref;   /**< RTP timestamp reference (tx)      */
+	RE_ATOMIC bool ts_synced;    /**< RTP timestamp synchronized        */
+};
+
+/** Snapshot of the RTP Transmit stats */
+struct txsnap {
 	uint32_t psent;      /**< Total number of RTP packets sent */
 	uint32_t osent;      /**< Total number of RTP octets  sent */
 	uint64_t jfs_ref;    /**< Timer ticks at RTP timestamp reference */
 	uint32_t ts_ref;     /**< RTP timestamp reference (transmit)     */
-	bool ts_synced;      /**< RTP timestamp synchronization flag     */
 };
 
 /** RTCP Session */
@@ -56,7 +71,6 @@ struct rtcp_sess {
 	uint32_t srate_rx;          /**< Receive sampling rate               */
 
 	/* stats */
-	mtx_t *lock;                /**< Lock for txstat                     */
 	struct txstat txstat;       /**< Local transmit statistics           */
 };
 
@@ -78,7 +92,23 @@ static void sess_destructor(void *data)
 	mem_deref(sess->cname);
 	hash_flush(sess->members);
 	mem_deref(sess->members);
-	mem_deref(sess->lock);
+}
+
+
+static void txstat_get(const struct txstat *tx, struct txsnap *snap)
+{
+	unsigned seq;
+
+	/* the acquire loads keep the second count load after the stats */
+	do {
+		seq = re_atomic_acq(&tx->seq);
+
+		snap->psent   = re_atomic_acq(&tx->psent);
+		snap->osent   = re_atomic_acq(&tx->osent);
+		snap->jfs_ref = re_atomic_acq(&tx->jfs_ref);
+		snap->ts_ref  = re_atomic_acq(&tx->ts_ref);
+
+	} while ((seq & 1) || seq != re_atomic_rlx(&tx->seq));
 }
 
 
@@ -248,10 +278,6 @@ int rtcp_sess_alloc(struct rtcp_sess **sessp, struct rtp_sock *rs)
 	sess->rs = rs;
 	tmr_init(&sess->tmr);
 
-	err = mutex_alloc(&sess->lock);
-	if (err)
-		goto out;
-
 	err  = hash_alloc(&sess->members, MAX_MEMBERS);
 	if (err)
 		goto out;
@@ -395,7 +421,7 @@ static int encode_handler(struct mbuf *mb, void *arg)
 static int mk_sr(struct rtcp_sess *sess, struct mbuf *mb)
 {
 	struct ntp_time ntp = {0, 0};
-	struct txstat txstat;
+	struct txsnap txstat;
 	uint32_t dur, rtp_ts = 0;
 	int err;
 
@@ -403,10 +429,8 @@ static int mk_sr(struct rtcp_sess *sess, struct mbuf *mb)
 	if (err)
 		return err;
 
-	mtx_lock(sess->lock);
-	txstat = sess->txstat;
-	sess->txstat.ts_synced = false;
-	mtx_unlock(sess->lock);
+	txstat_get(&sess->txstat, &txstat);
+	re_atomic_rlx_set(&sess->txstat.ts_synced, false);
 
 	if (txstat.jfs_ref) {
 		dur = (uint32_t)(tmr_jiffies() - txstat.jfs_ref);
@@ -513,65 +537,76 @@ static void schedule(struct rtcp_sess *sess)
 
 void rtcp_sess_tx_rtp(struct rtcp_sess *sess, uint32_t ts, size_t payload_size)
 {
+	struct txstat *tx;
+	unsigned seq;
+
 	if (!sess)
 		return;
 
-	mtx_lock(sess->lock);
+	tx  = &sess->txstat;
+	seq = re_atomic_rlx(&tx->seq);
 
-	sess->txstat.osent += (uint32_t)payload_size;
-	sess->txstat.psent += 1;
+	/* the release stores keep the odd count before the stats */
+	re_atomic_rlx_set(&tx->seq, seq + 1);
 
-	if (!sess->txstat.ts_synced) {
-		sess->txstat.jfs_ref   = tmr_jiffies();
-		sess->txstat.ts_ref    = ts;
-		sess->txstat.ts_synced = true;
+	re_atomic_rls_set(&tx->osent,
+			  re_atomic_rlx(&tx->osent) + (uint32_t)payload_size);
+	re_atomic_rls_set(&tx->psent, re_atomic_rlx(&tx->psent) + 1);
+
+	/* a lost resync request is repeated with the next report */
+	if (!re_atomic_rlx(&tx->ts_synced)) {
+		re_atomic_rls_set(&tx->jfs_ref, tmr_jiffies());
+		re_atomic_rls_set(&tx->ts_ref, ts);
+		re_atomic_rlx_set(&tx->ts_synced, true);
 	}
 
-	mtx_unlock(sess->lock);
+	re_atomic_rls_set(&tx->seq, seq + 2);
 }
 
 
-void rtcp_sess_rx_rtp(struct rtcp_sess *sess, uint16_t seq, uint32_t ts,
-		      uint32_t ssrc, size_t payload_size,
-		      const struct sa *peer)
+void rtcp_sess_rx_rtp(struct rtcp_sess *sess, const struct rtp_header *hdr,
+		      size_t payload_size, const struct sa *peer)
 {
 	struct rtp_member *mbr;
 
-	if (!sess)
+	if (!sess || !hdr)
 		return;
 
-	mbr = get_member(sess, ssrc);
+	mbr = get_member(sess, hdr->ssrc);
 	if (!mbr) {
-		DEBUG_NOTICE("could not add member: 0x%08x\n", ssrc);
+		DEBUG_NOTICE("could not add member: 0x%08x\n", hdr->ssrc);
 		return;
 	}
 
 	if (!mbr->s) {
 		mbr->s = mem_zalloc(sizeof(*mbr->s), NULL);
 		if (!mbr->s) {
-			DEBUG_NOTICE("could not add sender: 0x%08x\n", ssrc);
+			DEBUG_NOTICE("could not add sender: 0x%08x\n",
+				     hdr->ssrc);
 			return;
 		}
 
 		/* first packet - init sequence number */
-		source_init_seq(mbr->s, seq);
+		source_init_seq(mbr->s, hdr->seq);
 		/* probation not used */
 		sa_cpy(&mbr->s->rtp_peer, peer);
 		++sess->senderc;
 	}
 
-	if (!source_update_seq(mbr->s, seq)) {
+	if (!source_update_seq(mbr->s, hdr->seq)) {
 		DEBUG_WARNING("rtp_update_seq() returned 0\n");
 	}
 
 	if (sess->srate_rx) {
 
+		uint64_t us = hdr->arrival ? hdr->arrival : tmr_jiffies_usec();
 		uint64_t ts_arrive;
 
 		/* Convert from wall-clock time to timestamp units */
-		ts_arrive = tmr_jiffies() * sess->srate_rx / 1000;
+		ts_arrive = us / 1000000 * sess->srate_rx +
+			us % 1000000 * sess->srate_rx / 1000000;
 
-		source_calc_jitter(mbr->s, ts, (uint32_t)ts_arrive);
+		source_calc_jitter(mbr->s, hdr->ts, (uint32_t)ts_arrive);
 	}
 
 	mbr->s->rtp_rx_bytes += payload_size;
@@ -599,9 +634,7 @@ int rtcp_stats(struct rtp_sock *rs, uint32_t ssrc, struct rtcp_stats *stats)
 	if (!mbr)
 		return ENOENT;
 
-	mtx_lock(sess->lock);
-	stats->tx.sent = sess->txstat.psent;
-	mtx_unlock(sess->lock);
+	stats->tx.sent = re_atomic_rlx(&sess->txstat.psent);
 
 	stats->tx.lost = mbr->cum_lost;
 	stats->tx.jit  = mbr->jit;
@@ -653,6 +686,7 @@ static bool debug_handler(struct le *le, void *arg)
 int rtcp_debug(struct re_printf *pf, const struct rtp_sock *rs)
 {
 	const struct rtcp_sess *sess = rtp_rtcp_sess(rs);
+	struct txsnap txstat;
 	int err = 0;
 
 	if (!sess)
@@ -666,10 +700,9 @@ int rtcp_debug(struct re_printf *pf, const struct rtp_sock *rs)
 
 	hash_apply(sess->members, debug_handler, pf);
 
-	mtx_lock(sess->lock);
+	txstat_get(&sess->txstat, &txstat);
 	err |= re_hprintf(pf, "  TX: packets=%u, octets=%u\n",
-			  sess->txstat.psent, sess->txstat.osent);
-	mtx_unlock(sess->lock);
+			  txstat.psent, txstat.osent);
 
 	return err;
 }
@@ -21,7 +21,7 @@ static int attr_decode_fmtp(struct sdp_media *m, const struct pl *pl)
 	if (!m)
 		return 0;
 
-	if (re_regex(pl->p, pl->l, "[^ ]+ [^]*", &id, &params))
+	if (re_regex_cached(pl->p, pl->l, "[^ ]+ [^]*", &id, &params))
 		return EBADMSG;
 
 	fmt = sdp_format_find(&m->rfmtl, &id);
@@ -42,11 +42,11 @@ static int attr_decode_rtcp(struct sdp_media *m, const struct pl *pl)
 	if (!m)
 		return 0;
 
-	if (!re_regex(pl->p, pl->l, "[0-9]+ IN IP[46]1 [^ ]+",
-		      &port, NULL, &addr)) {
+	if (!re_regex_cached(pl->p, pl->l, "[0-9]+ IN IP[46]1 [^ ]+",
+			     &port, NULL, &addr)) {
 		(void)sa_set(&m->raddr_rtcp, &addr, pl_u32(&port));
 	}
-	else if (!re_regex(pl->p, pl->l, "[0-9]+", &port)) {
+	else if (!re_regex_cached(pl->p, pl->l, "[0-9]+", &port)) {
 		sa_set_port(&m->raddr_rtcp, pl_u32(&port));
 	}
 	else
@@ -65,8 +65,8 @@ static int attr_decode_rtpmap(struct sdp_media *m, const struct pl *pl)
 	if (!m)
 		return 0;
 
-	if (re_regex(pl->p, pl->l, "[^ ]+ [^/]+/[0-9]+[/]*[^]*",
-		     &id, &name, &srate, NULL, &ch))
+	if (re_regex_cached(pl->p, pl->l, "[^ ]+ [^/]+/[0-9]+[/]*[^]*",
+			    &id, &name, &srate, NULL, &ch))
 		return EBADMSG;
 
 	fmt = sdp_format_find(&m->rfmtl, &id);
@@ -92,7 +92,7 @@ static int attr_decode(struct sdp_session *sess, struct sdp_media *m,
 	struct pl name, val;
 	int err = 0;
 
-	if (re_regex(pl->p, pl->l, "[^:]+:[^]+", &name, &val)) {
+	if (re_regex_cached(pl->p, pl->l, "[^:]+:[^]+", &name, &val)) {
 		name = *pl;
 		val  = pl_null;
 	}
@@ -130,7 +130,7 @@ static int bandwidth_decode(int32_t *bwv, const struct pl *pl)
 {
 	struct pl type, bw;
 
-	if (re_regex(pl->p, pl->l, "[^:]+:[0-9]+", &type, &bw))
+	if (re_regex_cached(pl->p, pl->l, "[^:]+:[0-9]+", &type, &bw))
 		return EBADMSG;
 
 	if (!pl_strcmp(&type, "CT"))
@@ -156,7 +156,7 @@ static int conn_decode(struct sa *sa, const struct pl *pl)
 {
 	struct pl v;
 
-	if (re_regex(pl->p, pl->l, "IN IP[46]1 [^ ]+", NULL, &v))
+	if (re_regex_cached(pl->p, pl->l, "IN IP[46]1 [^ ]+", NULL, &v))
 		return EBADMSG;
 
 	(void)sa_set(sa, &v, sa_port(sa));
@@ -172,8 +172,8 @@ static int media_decode(struct sdp_media **mp, struct sdp_session *sess,
 	struct sdp_media *m;
 	int err;
 
-	if (re_regex(pl->p, pl->l, "[a-z]+ [^ ]+ [^ ]+[^]*",
-		     &name, &port, &proto, &fmtv))
+	if (re_regex_cached(pl->p, pl->l, "[a-z]+ [^ ]+ [^ ]+[^]*",
+			    &name, &port, &proto, &fmtv))
 		return EBADMSG;
 
 	m = list_ledata(*mp ? (*mp)->le.next : sess->medial.head);
@@ -208,7 +208,7 @@ static int media_decode(struct sdp_media **mp, struct sdp_session *sess,
 		}
 	}
 
-	while (!re_regex(fmtv.p, fmtv.l, " [^ ]+", &fmt)) {
+	while (!re_regex_cached(fmtv.p, fmtv.l, " [^ ]+", &fmt)) {
 
 		pl_advance(&fmtv, fmt.p + fmt.l - fmtv.p);
 
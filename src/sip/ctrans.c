@@ -85,7 +85,7 @@ static int request_copy(struct mbuf **mbp, struct sip_ctrans *ct,
 	err |= sip_msg_hdr_apply(ct->req, true, SIP_HDR_ROUTE,
 				 route_handler, mb) ? ENOMEM : 0;
 	err |= mbuf_printf(mb, "To: %r\r\n",
-			   resp ? &resp->to.val : &ct->req->to.val);
+			   resp ? &sip_msg_to(resp)->val : &ct->req->to.val);
 	err |= mbuf_printf(mb, "From: %r\r\n", &ct->req->from.val);
 	err |= mbuf_printf(mb, "Call-ID: %r\r\n", &ct->req->callid);
 	err |= mbuf_printf(mb, "CSeq: %u %s\r\n", ct->req->cseq.num, met);
@@ -269,7 +269,7 @@ static bool response_handler(const struct sip_msg *msg, void *arg)
 	struct sip *sip = arg;
 
 	ct = list_ledata(hash_lookup(sip->ht_ctrans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_handler, (void *)msg));
 	if (!ct)
 		return false;
@@ -324,8 +324,6 @@ int sip_ctrans_request(struct sip_ctrans **ctp, struct sip *sip,
 	if (!ct)
 		return ENOMEM;
 
-	hash_append(sip->ht_ctrans, hash_joaat_str(branch), &ct->he, ct);
-
 	ct->invite = !strcmp(met, "INVITE");
 	ct->branch = mem_ref(branch);
 	ct->host   = mem_ref(host);
@@ -338,6 +336,8 @@ int sip_ctrans_request(struct sip_ctrans **ctp, struct sip *sip,
 	ct->resph  = resph ? resph : dummy_handler;
 	ct->arg    = arg;
 
+	hash_append(sip->ht_ctrans, hash_wy_str(branch), &ct->he, ct);
+
 	err = sip_transp_send(&ct->qent, sip, NULL, tp, dst, host, mb,
 			      transport_handler, ct);
 	if (err)
@@ -401,6 +401,14 @@ int sip_ctrans_cancel(struct sip_ctrans *ct)
 }
 
 
+static uint32_t ctrans_key(const struct le *le)
+{
+	const struct sip_ctrans *ct = le->data;
+
+	return hash_wy_str(ct->branch);
+}
+
+
 int sip_ctrans_init(struct sip *sip, uint32_t sz)
 {
 	int err;
@@ -409,7 +417,7 @@ int sip_ctrans_init(struct sip *sip, uint32_t sz)
 	if (err)
 		return err;
 
-	return hash_alloc(&sip->ht_ctrans, sz);
+	return sip_hash_alloc(&sip->ht_ctrans, sz, ctrans_key);
 }
 
 
@@ -445,7 +453,8 @@ int sip_ctrans_debug(struct re_printf *pf, const struct sip *sip)
 {
 	int err;
 
-	err = re_hprintf(pf, "client transactions:\n");
+	err = re_hprintf(pf, "client transactions: %H\n",
+			 hash_debug, sip->ht_ctrans);
 	hash_apply(sip->ht_ctrans, debug_handler, pf);
 
 	return err;
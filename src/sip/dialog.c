@@ -34,6 +34,7 @@ struct sip_dialog {
 	uint32_t hash;
 	uint32_t lseq;
 	uint32_t rseq;
+	uint32_t rev;
 	size_t cpos;
 	enum sip_transp tp;
 };
@@ -149,6 +150,19 @@ int sip_dialog_alloc(struct sip_dialog **dlgp,
 }
 
 
+/* Address of our side of the dialog, as seen in the message */
+static inline const struct sip_taddr *local_addr(const struct sip_msg *msg)
+{
+	return msg->req ? sip_msg_to(msg) : sip_msg_from(msg);
+}
+
+
+static inline const struct sip_taddr *remote_addr(const struct sip_msg *msg)
+{
+	return msg->req ? sip_msg_from(msg) : sip_msg_to(msg);
+}
+
+
 static bool record_route_handler(const struct sip_hdr *hdr,
 				 const struct sip_msg *msg,
 				 void *arg)
@@ -191,6 +205,11 @@ int sip_dialog_accept(struct sip_dialog **dlgp, const struct sip_msg *msg)
 	if (!contact || !msg->callid.p)
 		return EBADMSG;
 
+	/* malformed in a lazily decoded message */
+	if (!pl_isset(&sip_msg_to(msg)->auri) ||
+	    !pl_isset(&sip_msg_from(msg)->auri))
+		return EBADMSG;
+
 	if (sip_addr_decode(&addr, &contact->val))
 		return EBADMSG;
 
@@ -215,7 +234,7 @@ int sip_dialog_accept(struct sip_dialog **dlgp, const struct sip_msg *msg)
 	if (err)
 		goto out;
 
-	err = pl_strdup(&dlg->rtag, &msg->from.tag);
+	err = pl_strdup(&dlg->rtag, &sip_msg_from(msg)->tag);
 	if (err)
 		goto out;
 
@@ -230,9 +249,9 @@ int sip_dialog_accept(struct sip_dialog **dlgp, const struct sip_msg *msg)
 
 	err |= sip_msg_hdr_apply(msg, true, SIP_HDR_RECORD_ROUTE,
 				 record_route_handler, &renc) ? ENOMEM : 0;
-	err |= mbuf_printf(dlg->mb, "To: %r\r\n", &msg->from.val);
-	err |= mbuf_printf(dlg->mb, "From: %r;tag=%016llx\r\n", &msg->to.val,
-			   msg->tag);
+	err |= mbuf_printf(dlg->mb, "To: %r\r\n", &sip_msg_from(msg)->val);
+	err |= mbuf_printf(dlg->mb, "From: %r;tag=%016llx\r\n",
+			   &sip_msg_to(msg)->val, msg->tag);
 	if (err)
 		goto out;
 
@@ -281,7 +300,7 @@ int sip_dialog_create(struct sip_dialog *dlg, const struct sip_msg *msg)
 
 	contact = sip_msg_hdr(msg, SIP_HDR_CONTACT);
 
-	if (!contact)
+	if (!contact || !pl_isset(&remote_addr(msg)->auri))
 		return EBADMSG;
 
 	if (sip_addr_decode(&addr, &contact->val))
@@ -295,7 +314,7 @@ int sip_dialog_create(struct sip_dialog *dlg, const struct sip_msg *msg)
 	if (err)
 		goto out;
 
-	err = pl_strdup(&rtag, msg->req ? &msg->from.tag : &msg->to.tag);
+	err = pl_strdup(&rtag, &remote_addr(msg)->tag);
 	if (err)
 		goto out;
 
@@ -304,7 +323,7 @@ int sip_dialog_create(struct sip_dialog *dlg, const struct sip_msg *msg)
 	err |= sip_msg_hdr_apply(msg, msg->req, SIP_HDR_RECORD_ROUTE,
 				 record_route_handler, &renc) ? ENOMEM : 0;
 	err |= mbuf_printf(renc.mb, "To: %r\r\n",
-			   msg->req ? &msg->from.val : &msg->to.val);
+			   &remote_addr(msg)->val);
 
 	dlg->mb->pos = dlg->cpos;
 	err |= mbuf_write_mem(renc.mb, mbuf_buf(dlg->mb),
@@ -345,6 +364,7 @@ int sip_dialog_create(struct sip_dialog *dlg, const struct sip_msg *msg)
 	dlg->rseq = msg->req ? msg->cseq.num : 0;
 	dlg->cpos = 0;
 	dlg->tp   = msg->tp;
+	++dlg->rev;
 
  out:
 	mem_deref(renc.mb);
@@ -379,7 +399,7 @@ int sip_dialog_fork(struct sip_dialog **dlgp, struct sip_dialog *odlg,
 
 	contact = sip_msg_hdr(msg, SIP_HDR_CONTACT);
 
-	if (!contact || !msg->callid.p)
+	if (!contact || !msg->callid.p || !pl_isset(&remote_addr(msg)->auri))
 		return EBADMSG;
 
 	if (sip_addr_decode(&addr, &contact->val))
@@ -400,7 +420,7 @@ int sip_dialog_fork(struct sip_dialog **dlgp, struct sip_dialog *odlg,
 	if (err)
 		goto out;
 
-	err = pl_strdup(&dlg->rtag, msg->req ? &msg->from.tag : &msg->to.tag);
+	err = pl_strdup(&dlg->rtag, &remote_addr(msg)->tag);
 	if (err)
 		goto out;
 
@@ -416,7 +436,7 @@ int sip_dialog_fork(struct sip_dialog **dlgp, struct sip_dialog *odlg,
 	err |= sip_msg_hdr_apply(msg, msg->req, SIP_HDR_RECORD_ROUTE,
 				 record_route_handler, &renc) ? ENOMEM : 0;
 	err |= mbuf_printf(dlg->mb, "To: %r\r\n",
-			   msg->req ? &msg->from.val : &msg->to.val);
+			   &remote_addr(msg)->val);
 
 	odlg->mb->pos = odlg->cpos;
 	err |= mbuf_write_mem(dlg->mb, mbuf_buf(odlg->mb),
@@ -493,6 +513,7 @@ int sip_dialog_update(struct sip_dialog *dlg, const struct sip_msg *msg)
 
 	mem_deref(dlg->uri);
 	dlg->uri = mem_ref(uri);
+	++dlg->rev;
 
  out:
 	mem_deref(uri);
@@ -540,6 +561,34 @@ int sip_dialog_encode(struct mbuf *mb, struct sip_dialog *dlg, uint32_t cseq,
 }
 
 
+/* The headers of sip_dialog_encode() which only change with the revision */
+int sip_dialog_encode_hdrs(struct mbuf *mb, const struct sip_dialog *dlg)
+{
+	int err;
+
+	if (!mb || !dlg)
+		return EINVAL;
+
+	err  = mbuf_write_mem(mb, mbuf_buf(dlg->mb), mbuf_get_left(dlg->mb));
+	err |= mbuf_printf(mb, "Call-ID: %s\r\n", dlg->callid);
+
+	return err;
+}
+
+
+uint32_t sip_dialog_cseq(struct sip_dialog *dlg, uint32_t cseq,
+			 const char *met)
+{
+	return strcmp(met, "ACK") ? dlg->lseq++ : cseq;
+}
+
+
+uint32_t sip_dialog_rev(const struct sip_dialog *dlg)
+{
+	return dlg ? dlg->rev : 0;
+}
+
+
 const char *sip_dialog_uri(const struct sip_dialog *dlg)
 {
 	return dlg ? dlg->uri : NULL;
@@ -574,6 +623,7 @@ const char *sip_dialog_callid(const struct sip_dialog *dlg)
 int sip_dialog_set_callid(struct sip_dialog *dlg, const char *callid)
 {
 	dlg->callid = mem_deref(dlg->callid);
+	++dlg->rev;
 	return str_dup(&dlg->callid, callid);
 }
 
@@ -626,10 +676,10 @@ bool sip_dialog_cmp(const struct sip_dialog *dlg, const struct sip_msg *msg)
 	if (pl_strcmp(&msg->callid, dlg->callid))
 		return false;
 
-	if (pl_strcmp(msg->req ? &msg->to.tag : &msg->from.tag, dlg->ltag))
+	if (pl_strcmp(&local_addr(msg)->tag, dlg->ltag))
 		return false;
 
-	if (pl_strcmp(msg->req ? &msg->from.tag : &msg->to.tag, dlg->rtag))
+	if (pl_strcmp(&remote_addr(msg)->tag, dlg->rtag))
 		return false;
 
 	return true;
@@ -653,7 +703,7 @@ bool sip_dialog_cmp_half(const struct sip_dialog *dlg,
 	if (pl_strcmp(&msg->callid, dlg->callid))
 		return false;
 
-	if (pl_strcmp(msg->req ? &msg->to.tag : &msg->from.tag, dlg->ltag))
+	if (pl_strcmp(&local_addr(msg)->tag, dlg->ltag))
 		return false;
 
 	return true;
@@ -0,0 +1,349 @@
+/**
+ * @file sip/fwd.c  SIP Stateless Forwarding
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_sa.h>
+#include <re_list.h>
+#include <re_hash.h>
+#include <re_fmt.h>
+#include <re_uri.h>
+#include <re_udp.h>
+#include <re_msg.h>
+#include <re_sip.h>
+#include "sip.h"
+
+
+/*
+ * A received message is forwarded by splicing a few byte ranges of its
+ * receive buffer, instead of decoding and encoding it again. The splices
+ * are applied in place for UDP, where the buffer holds just the one
+ * message. Stream transports may have the next message in the same
+ * buffer, so the result is copied into a buffer of its own there.
+ */
+
+
+enum {
+	SPLICE_MAX = 2,
+};
+
+
+/** Replaces the bytes start..end of the message with p..p+l */
+struct splice {
+	size_t start;
+	size_t end;
+	const char *p;
+	size_t l;
+};
+
+
+static inline ssize_t splice_delta(const struct splice *s)
+{
+	return (ssize_t)s->l - (ssize_t)(s->end - s->start);
+}
+
+
+/*
+ * The unchanged segments between the splices are moved to their new
+ * offsets, the ones moving left in ascending order and the ones moving
+ * right in descending order, so that no segment overwrites another one
+ * before it was moved. The replacements are written last.
+ */
+static int splice_inplace(struct mbuf *mb, size_t pos,
+			  const struct splice *v, size_t n)
+{
+	ssize_t shift[SPLICE_MAX + 1];
+	size_t segs[SPLICE_MAX + 1], sege[SPLICE_MAX + 1];
+	size_t i, end;
+	int err;
+
+	shift[0] = 0;
+	segs[0]  = pos;
+
+	for (i=0; i<n; i++) {
+		sege[i]    = v[i].start;
+		segs[i+1]  = v[i].end;
+		shift[i+1] = shift[i] + splice_delta(&v[i]);
+	}
+
+	sege[n] = mb->end;
+	end = (size_t)((ssize_t)mb->end + shift[n]);
+
+	if (end > mb->size) {
+		err = mbuf_resize(mb, end);
+		if (err)
+			return err;
+	}
+
+	for (i=0; i<=n; i++) {
+		if (shift[i] < 0)
+			memmove(mb->buf + segs[i] + shift[i],
+				mb->buf + segs[i], sege[i] - segs[i]);
+	}
+
+	for (i=n+1; i-- > 0;) {
+		if (shift[i] > 0)
+			memmove(mb->buf + segs[i] + shift[i],
+				mb->buf + segs[i], sege[i] - segs[i]);
+	}
+
+	for (i=0; i<n; i++)
+		memcpy(mb->buf + v[i].start + shift[i], v[i].p, v[i].l);
+
+	mb->pos = pos;
+	mb->end = end;
+
+	return 0;
+}
+
+
+static int splice_copy(struct mbuf **mbp, const struct mbuf *mbs, size_t pos,
+		       const struct splice *v, size_t n)
+{
+	struct mbuf *mb;
+	ssize_t len = mbs->end - pos;
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<n; i++)
+		len += splice_delta(&v[i]);
+
+	mb = mbuf_alloc(len);
+	if (!mb)
+		return ENOMEM;
+
+	for (i=0; i<n; i++) {
+		err |= mbuf_write_mem(mb, mbs->buf + pos, v[i].start - pos);
+		err |= mbuf_write_mem(mb, (const uint8_t *)v[i].p, v[i].l);
+		pos = v[i].end;
+	}
+
+	err |= mbuf_write_mem(mb, mbs->buf + pos, mbs->end - pos);
+	if (err) {
+		mem_deref(mb);
+		return err;
+	}
+
+	mb->pos = 0;
+	*mbp = mb;
+
+	return 0;
+}
+
+
+static int splice_send(struct sip *sip, const struct sip_msg *msg,
+		       enum sip_transp tp, const struct sa *dst,
+		       struct splice *v, size_t n)
+{
+	struct mbuf *mb = msg->mb;
+	const char *start = msg->req ? msg->met.p : msg->ver.p;
+	size_t pos = start - (const char *)mb->buf;
+	int err;
+
+	if (n == 2 && v[1].start < v[0].start) {
+		struct splice s = v[0];
+
+		v[0] = v[1];
+		v[1] = s;
+	}
+
+	if (msg->tp == SIP_TRANSP_UDP) {
+		err = splice_inplace(mb, pos, v, n);
+		if (err)
+			return err;
+
+		return sip_send(sip, NULL, tp, dst, mb);
+	}
+
+	err = splice_copy(&mb, msg->mb, pos, v, n);
+	if (err)
+		return err;
+
+	err = sip_send(sip, NULL, tp, dst, mb);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/* RFC 3261 16.11: the same for retransmissions, ACK and CANCEL */
+static void branch_hash(uint32_t h[2], const struct sip_msg *msg)
+{
+	h[0] = hash_joaat_pl(&msg->via.branch);
+	h[1] = hash_joaat_pl(&msg->via.sentby) ^ hash_joaat_pl(&msg->ruri);
+}
+
+
+/**
+ * Forward a SIP request statelessly (RFC 3261 16.11)
+ *
+ * A Via header is pushed and Max-Forwards is decremented by editing the
+ * receive buffer of the request, which must not be used afterwards.
+ *
+ * @param sip SIP stack instance
+ * @param msg Received SIP request
+ * @param tp  SIP transport to forward on
+ * @param dst Destination network address
+ *
+ * @return 0 if success, ELOOP if Max-Forwards is zero, otherwise errorcode
+ */
+int sip_fwd_request(struct sip *sip, const struct sip_msg *msg,
+		    enum sip_transp tp, const struct sa *dst)
+{
+	struct splice v[SPLICE_MAX];
+	const struct sip_hdr *hdr;
+	char via[256], maxfwd[16];
+	struct sa laddr;
+	uint32_t mf, h[2];
+	int len;
+	int err;
+
+	if (!sip || !msg || !msg->req || !dst)
+		return EINVAL;
+
+	/* both are checked on receive */
+	hdr = sip_msg_hdr(msg, SIP_HDR_VIA);
+	if (!hdr || !pl_isset(&msg->maxfwd))
+		return EBADMSG;
+
+	mf = pl_u32(&msg->maxfwd);
+	if (!mf)
+		return ELOOP;
+
+	err = sip_transp_laddr(sip, &laddr, tp, dst);
+	if (err)
+		return err;
+
+	branch_hash(h, msg);
+
+	len = re_snprintf(via, sizeof(via),
+			  "Via: SIP/2.0/%s %J;"
+			  "branch=z9hG4bK%08x%08x;rport\r\n",
+			  sip_transp_name(tp), &laddr, h[0], h[1]);
+	if (len < 0)
+		return ENOMEM;
+
+	v[0].start = hdr->name.p - (const char *)msg->mb->buf;
+	v[0].end   = v[0].start;
+	v[0].p     = via;
+	v[0].l     = len;
+
+	len = re_snprintf(maxfwd, sizeof(maxfwd), "%u", mf - 1);
+	if (len < 0)
+		return ENOMEM;
+
+	v[1].start = msg->maxfwd.p - (const char *)msg->mb->buf;
+	v[1].end   = v[1].start + msg->maxfwd.l;
+	v[1].p     = maxfwd;
+	v[1].l     = len;
+
+	return splice_send(sip, msg, tp, dst, v, 2);
+}
+
+
+static int via_addr(struct sa *addr, const struct sip_via *via)
+{
+	uint16_t port = sip_transp_port(via->tp, sa_port(&via->addr));
+	struct pl pl;
+
+	if (!msg_param_decode(&via->params, "maddr", &pl))
+		return sa_set(addr, &pl, port);
+
+	if (!msg_param_decode(&via->params, "received", &pl)) {
+		if (sa_set(addr, &pl, port))
+			return EBADMSG;
+	}
+	else if (sa_isset(&via->addr, SA_ADDR)) {
+		*addr = via->addr;
+		sa_set_port(addr, port);
+	}
+	else {
+		/* a host name would need a DNS lookup */
+		return EDESTADDRREQ;
+	}
+
+	if (!msg_param_decode(&via->params, "rport", &pl) && pl_isset(&pl))
+		sa_set_port(addr, pl_u32(&pl));
+
+	return 0;
+}
+
+
+/**
+ * Forward a SIP response statelessly (RFC 3261 16.7)
+ *
+ * The top Via header must be one of the local transports. It is popped
+ * from the receive buffer of the response, which must not be used
+ * afterwards, and the response is sent to the next Via.
+ *
+ * @param sip SIP stack instance
+ * @param msg Received SIP response
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_fwd_response(struct sip *sip, const struct sip_msg *msg)
+{
+	const struct sip_hdr *hdr, *next = NULL;
+	struct sip_via via;
+	struct splice v;
+	struct sa dst;
+	const char *p, *end;
+	struct le *le;
+	int err;
+
+	if (!sip || !msg || msg->req)
+		return EINVAL;
+
+	hdr = sip_msg_hdr(msg, SIP_HDR_VIA);
+	if (!hdr)
+		return EBADMSG;
+
+	if (!sip_transp_isladdr(sip, msg->via.tp, &msg->via.addr))
+		return ENOENT;
+
+	for (le = hdr->le.next; le && !next; le = le->next) {
+
+		const struct sip_hdr *h = le->data;
+
+		if (h->id == SIP_HDR_VIA)
+			next = h;
+	}
+
+	/* the response was for this proxy */
+	if (!next)
+		return ENOENT;
+
+	err = sip_via_decode(&via, &next->val);
+	if (err)
+		return err;
+
+	err = via_addr(&dst, &via);
+	if (err)
+		return err;
+
+	if (next->name.p == hdr->name.p) {
+		/* comma-separated values on one line */
+		p   = hdr->val.p;
+		end = next->val.p;
+	}
+	else {
+		p   = hdr->name.p;
+		end = hdr->val.p + hdr->val.l;
+
+		while (end < (const char *)mbuf_buf(msg->mb) && *end != '\n')
+			++end;
+
+		++end;
+	}
+
+	v.start = p - (const char *)msg->mb->buf;
+	v.end   = end - (const char *)msg->mb->buf;
+	v.p     = NULL;
+	v.l     = 0;
+
+	return splice_send(sip, msg, via.tp, &dst, &v, 1);
+}
@@ -11,6 +11,7 @@
 #include <re_mbuf.h>
 #include <re_sa.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_sys.h>
 #include <re_uri.h>
 #include <re_udp.h>
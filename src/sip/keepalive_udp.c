@@ -155,6 +155,20 @@ static struct sip_udpconn *udpconn_find(struct sip *sip, struct udp_sock *us,
 }
 
 
+static uint32_t udpconn_key(const struct le *le)
+{
+	const struct sip_udpconn *uc = le->data;
+
+	return sa_hash(&uc->paddr, SA_ALL);
+}
+
+
+int sip_udpconn_init(struct sip *sip, uint32_t sz)
+{
+	return sip_hash_alloc(&sip->ht_udpconn, sz, udpconn_key);
+}
+
+
 int  sip_keepalive_udp(struct sip_keepalive *ka, struct sip *sip,
 		       struct udp_sock *us, const struct sa *paddr,
 		       uint32_t interval)
@@ -170,14 +184,14 @@ int  sip_keepalive_udp(struct sip_keepalive *ka, struct sip *sip,
 		if (!uc)
 			return ENOMEM;
 
-		hash_append(sip->ht_udpconn, sa_hash(paddr, SA_ALL),
-			    &uc->he, uc);
-
 		uc->paddr = *paddr;
 		uc->stun  = mem_ref(sip->stun);
 		uc->us    = mem_ref(us);
 		uc->ka_interval = interval ? interval : UDP_KEEPALIVE_INTVAL;
 
+		hash_append(sip->ht_udpconn, sa_hash(paddr, SA_ALL),
+			    &uc->he, uc);
+
 		/* learn mapped address immediately */
 		tmr_start(&uc->tmr_ka, 0, udpconn_keepalive_handler, uc);
 	}
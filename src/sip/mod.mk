@@ -10,13 +10,17 @@ SRCS	+= sip/contact.c
 SRCS	+= sip/cseq.c
 SRCS	+= sip/ctrans.c
 SRCS	+= sip/dialog.c
+SRCS	+= sip/fwd.c
 SRCS	+= sip/keepalive.c
 SRCS	+= sip/keepalive_udp.c
 SRCS	+= sip/msg.c
 SRCS	+= sip/rack.c
 SRCS	+= sip/reply.c
 SRCS	+= sip/request.c
+SRCS	+= sip/shard.c
 SRCS	+= sip/sip.c
 SRCS	+= sip/strans.c
+SRCS	+= sip/tmpl.c
+SRCS	+= sip/trace.c
 SRCS	+= sip/transp.c
 SRCS	+= sip/via.c
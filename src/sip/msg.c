@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <ctype.h>
+#include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_sys.h>
@@ -19,18 +20,172 @@
 #include "sip.h"
 
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_SCAN_X86 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_M_X64)
+#include <immintrin.h>
+#define HAVE_SCAN_X86 1
+#define AVX2_TARGET
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_SCAN_NEON 1
+#endif
+
+
 enum {
 	HDR_HASH_SIZE = 32,
 	STARTLINE_MAX = 8192,
+	HDRS_MAX      = 256,
+};
+
+
+/** Fields of a lazily decoded SIP message, pending their first access */
+enum {
+	LAZY_URI   = 1<<0,
+	LAZY_TO    = 1<<1,
+	LAZY_FROM  = 1<<2,
+	LAZY_RACK  = 1<<3,
+	LAZY_CTYPE = 1<<4,
+};
+
+
+/** Flat storage for the headers of a SIP message */
+struct sip_hdrs {
+	struct sip_hdrs *next;  /**< Previous (full) storage block */
+	uint32_t n;             /**< Number of used headers        */
+	uint32_t sz;            /**< Number of allocated headers   */
+	struct sip_hdr v[];     /**< Headers, in decode order      */
+};
+
+
+/*
+ * Perfect hash of the known header names, keyed on the length and
+ * five characters of the lowercase name. The header ID itself is the
+ * JOAAT hash of the name, which is still used for unknown headers.
+ */
+#define HDR_PHASH_MUL 0x365dc8ea6a164839ULL
+#define HDR_PHASH_BITS 9
+
+static const struct hdr_name {
+	struct pl name;
+	enum sip_hdrid id;
+} hdr_names[1 << HDR_PHASH_BITS] = {
+	[  0] = {PL("SIP-If-Match"), SIP_HDR_SIP_IF_MATCH},
+	[  6] = {PL("Content-Language"), SIP_HDR_CONTENT_LANGUAGE},
+	[ 13] = {PL("Path"), SIP_HDR_PATH},
+	[ 16] = {PL("Identity"), SIP_HDR_IDENTITY},
+	[ 17] = {PL("P-Answer-State"), SIP_HDR_P_ANSWER_STATE},
+	[ 25] = {PL("Proxy-Authorization"), SIP_HDR_PROXY_AUTHORIZATION},
+	[ 30] = {PL("Call-Info"), SIP_HDR_CALL_INFO},
+	[ 31] = {PL("Contact"), SIP_HDR_CONTACT},
+	[ 39] = {PL("Priority"), SIP_HDR_PRIORITY},
+	[ 41] = {PL("CSeq"), SIP_HDR_CSEQ},
+	[ 45] = {PL("Reply-To"), SIP_HDR_REPLY_TO},
+	[ 47] = {PL("Permission-Missing"), SIP_HDR_PERMISSION_MISSING},
+	[ 53] = {PL("Accept-Language"), SIP_HDR_ACCEPT_LANGUAGE},
+	[ 55] = {PL("Supported"), SIP_HDR_SUPPORTED},
+	[ 70] = {PL("Response-Key"), SIP_HDR_RESPONSE_KEY},
+	[ 77] = {PL("MIME-Version"), SIP_HDR_MIME_VERSION},
+	[ 79] = {PL("Warning"), SIP_HDR_WARNING},
+	[ 89] = {PL("Replaces"), SIP_HDR_REPLACES},
+	[ 90] = {PL("Event"), SIP_HDR_EVENT},
+	[ 94] = {PL("Content-Type"), SIP_HDR_CONTENT_TYPE},
+	[ 95] = {PL("Session-Expires"), SIP_HDR_SESSION_EXPIRES},
+	[106] = {PL("Route"), SIP_HDR_ROUTE},
+	[107] = {PL("Refer-Sub"), SIP_HDR_REFER_SUB},
+	[108] = {PL("Retry-After"), SIP_HDR_RETRY_AFTER},
+	[109] = {PL("Reason"), SIP_HDR_REASON},
+	[111] = {PL("P-User-Database"), SIP_HDR_P_USER_DATABASE},
+	[115] = {PL("Authorization"), SIP_HDR_AUTHORIZATION},
+	[119] = {PL("Date"), SIP_HDR_DATE},
+	[120] = {PL("Security-Verify"), SIP_HDR_SECURITY_VERIFY},
+	[136] = {PL("RSeq"), SIP_HDR_RSEQ},
+	[143] = {PL("Server"), SIP_HDR_SERVER},
+	[145] = {PL("Accept"), SIP_HDR_ACCEPT},
+	[161] = {PL("Allow"), SIP_HDR_ALLOW},
+	[170] = {PL("Subscription-State"), SIP_HDR_SUBSCRIPTION_STATE},
+	[180] = {PL("Allow-Events"), SIP_HDR_ALLOW_EVENTS},
+	[181] = {PL("Organization"), SIP_HDR_ORGANIZATION},
+	[182] = {PL("SIP-ETag"), SIP_HDR_SIP_ETAG},
+	[185] = {PL("Timestamp"), SIP_HDR_TIMESTAMP},
+	[186] = {PL("P-Media-Authorization"), SIP_HDR_P_MEDIA_AUTHORIZATION},
+	[189] = {PL("Resource-Priority"), SIP_HDR_RESOURCE_PRIORITY},
+	[201] = {PL("Proxy-Require"), SIP_HDR_PROXY_REQUIRE},
+	[202] = {PL("P-Served-User"), SIP_HDR_P_SERVED_USER},
+	[214] = {PL("Security-Server"), SIP_HDR_SECURITY_SERVER},
+	[216] = {PL("Max-Forwards"), SIP_HDR_MAX_FORWARDS},
+	[219] = {PL("Max-Breadth"), SIP_HDR_MAX_BREADTH},
+	[223] = {PL("P-Profile-Key"), SIP_HDR_P_PROFILE_KEY},
+	[245] = {PL("P-DCS-Redirect"), SIP_HDR_P_DCS_REDIRECT},
+	[250] = {PL("Security-Client"), SIP_HDR_SECURITY_CLIENT},
+	[254] = {PL("Request-Disposition"), SIP_HDR_REQUEST_DISPOSITION},
+	[257] = {PL("Identity-Info"), SIP_HDR_IDENTITY_INFO},
+	[259] = {PL("Accept-Contact"), SIP_HDR_ACCEPT_CONTACT},
+	[264] = {PL("Call-ID"), SIP_HDR_CALL_ID},
+	[265] = {PL("Referred-By"), SIP_HDR_REFERRED_BY},
+	[270] = {PL("P-Refused-URI-List"), SIP_HDR_P_REFUSED_URI_LIST},
+	[275] = {PL("Via"), SIP_HDR_VIA},
+	[277] = {PL("Content-Length"), SIP_HDR_CONTENT_LENGTH},
+	[288] = {PL("Privacy"), SIP_HDR_PRIVACY},
+	[290] = {PL("Expires"), SIP_HDR_EXPIRES},
+	[304] = {PL("Refer-To"), SIP_HDR_REFER_TO},
+	[306] = {PL("P-DCS-LAES"), SIP_HDR_P_DCS_LAES},
+	[307] = {PL("WWW-Authenticate"), SIP_HDR_WWW_AUTHENTICATE},
+	[313] = {PL("Min-SE"), SIP_HDR_MIN_SE},
+	[324] = {PL("P-Charging-Function-Addresses"),
+		 SIP_HDR_P_CHARGING_FUNCTION_ADDRESSES},
+	[328] = {PL("Authentication-Info"), SIP_HDR_AUTHENTICATION_INFO},
+	[330] = {PL("Record-Route"), SIP_HDR_RECORD_ROUTE},
+	[335] = {PL("P-Called-Party-ID"), SIP_HDR_P_CALLED_PARTY_ID},
+	[338] = {PL("Join"), SIP_HDR_JOIN},
+	[343] = {PL("P-DCS-OSPS"), SIP_HDR_P_DCS_OSPS},
+	[344] = {PL("In-Reply-To"), SIP_HDR_IN_REPLY_TO},
+	[354] = {PL("P-Associated-URI"), SIP_HDR_P_ASSOCIATED_URI},
+	[358] = {PL("From"), SIP_HDR_FROM},
+	[363] = {PL("P-Early-Media"), SIP_HDR_P_EARLY_MEDIA},
+	[380] = {PL("Encryption"), SIP_HDR_ENCRYPTION},
+	[383] = {PL("Answer-Mode"), SIP_HDR_ANSWER_MODE},
+	[384] = {PL("Alert-Info"), SIP_HDR_ALERT_INFO},
+	[387] = {PL("Content-Encoding"), SIP_HDR_CONTENT_ENCODING},
+	[388] = {PL("Priv-Answer-Mode"), SIP_HDR_PRIV_ANSWER_MODE},
+	[391] = {PL("P-Access-Network-Info"), SIP_HDR_P_ACCESS_NETWORK_INFO},
+	[393] = {PL("P-Asserted-Identity"), SIP_HDR_P_ASSERTED_IDENTITY},
+	[394] = {PL("User-Agent"), SIP_HDR_USER_AGENT},
+	[402] = {PL("RAck"), SIP_HDR_RACK},
+	[403] = {PL("Accept-Resource-Priority"),
+		 SIP_HDR_ACCEPT_RESOURCE_PRIORITY},
+	[408] = {PL("Error-Info"), SIP_HDR_ERROR_INFO},
+	[412] = {PL("Hide"), SIP_HDR_HIDE},
+	[413] = {PL("To"), SIP_HDR_TO},
+	[414] = {PL("Subject"), SIP_HDR_SUBJECT},
+	[415] = {PL("Proxy-Authenticate"), SIP_HDR_PROXY_AUTHENTICATE},
+	[418] = {PL("Trigger-Consent"), SIP_HDR_TRIGGER_CONSENT},
+	[434] = {PL("Accept-Encoding"), SIP_HDR_ACCEPT_ENCODING},
+	[435] = {PL("Reject-Contact"), SIP_HDR_REJECT_CONTACT},
+	[438] = {PL("P-Preferred-Identity"), SIP_HDR_P_PREFERRED_IDENTITY},
+	[441] = {PL("Flow-Timer"), SIP_HDR_FLOW_TIMER},
+	[443] = {PL("P-DCS-Trace-Party-ID"), SIP_HDR_P_DCS_TRACE_PARTY_ID},
+	[454] = {PL("Require"), SIP_HDR_REQUIRE},
+	[456] = {PL("Min-Expires"), SIP_HDR_MIN_EXPIRES},
+	[458] = {PL("Service-Route"), SIP_HDR_SERVICE_ROUTE},
+	[474] = {PL("Unsupported"), SIP_HDR_UNSUPPORTED},
+	[475] = {PL("P-Visited-Network-ID"), SIP_HDR_P_VISITED_NETWORK_ID},
+	[482] = {PL("Target-Dialog"), SIP_HDR_TARGET_DIALOG},
+	[491] = {PL("History-Info"), SIP_HDR_HISTORY_INFO},
+	[493] = {PL("P-Charging-Vector"), SIP_HDR_P_CHARGING_VECTOR},
+	[498] = {PL("Content-Disposition"), SIP_HDR_CONTENT_DISPOSITION},
+	[510] = {PL("P-DCS-Billing-Info"), SIP_HDR_P_DCS_BILLING_INFO},
 };
 
 
-static void hdr_destructor(void *arg)
+static void hdrs_destructor(void *arg)
 {
-	struct sip_hdr *hdr = arg;
+	struct sip_hdrs *hdrs = arg;
 
-	list_unlink(&hdr->le);
-	hash_unlink(&hdr->he);
+	mem_deref(hdrs->next);
 }
 
 
@@ -38,16 +193,33 @@ static void destructor(void *arg)
 {
 	struct sip_msg *msg = arg;
 
-	list_flush(&msg->hdrl);
-	hash_flush(msg->hdrht);
+	/* the headers are not reference counted */
+	list_clear(&msg->hdrl);
 	mem_deref(msg->hdrht);
+	mem_deref(msg->hdrs);
 	mem_deref(msg->sock);
 	mem_deref(msg->mb);
 }
 
 
+static inline uint64_t phash_key(const struct pl *name)
+{
+	const uint8_t *p = (const uint8_t *)name->p;
+	size_t n = name->l;
+
+	return ((uint64_t)(p[0]   | 0x20)      ) |
+	       ((uint64_t)(p[1]   | 0x20) <<  8) |
+	       ((uint64_t)(p[n/2] | 0x20) << 16) |
+	       ((uint64_t)(p[n-2] | 0x20) << 24) |
+	       ((uint64_t)(p[n-1] | 0x20) << 32) |
+	       ((uint64_t)n << 40);
+}
+
+
 static enum sip_hdrid hdr_hash(const struct pl *name)
 {
+	const struct hdr_name *hn;
+
 	if (!name->l)
 		return SIP_HDR_NONE;
 
@@ -62,6 +234,11 @@ static enum sip_hdrid hdr_hash(const struct pl *name)
 			/*@fallthrough@*/
 
 		default:
+			hn = &hdr_names[(phash_key(name) * HDR_PHASH_MUL) >>
+					(64 - HDR_PHASH_BITS)];
+			if (hn->name.p && !pl_casecmp(name, &hn->name))
+				return hn->id;
+
 			return (enum sip_hdrid)
 				(hash_joaat_ci(name->p, name->l) & 0xfff);
 		}
@@ -149,6 +326,38 @@ static inline bool hdr_comma_separated(enum sip_hdrid id)
 }
 
 
+static int taddr_decode(struct sip_taddr *addr, const struct pl *val)
+{
+	int err;
+
+	err = sip_addr_decode((struct sip_addr *)addr, val);
+	if (err)
+		return err;
+
+	(void)msg_param_decode(&addr->params, "tag", &addr->tag);
+	addr->val = *val;
+
+	return 0;
+}
+
+
+static int hdrs_alloc(struct sip_msg *msg, uint32_t sz)
+{
+	struct sip_hdrs *hdrs;
+
+	hdrs = mem_zalloc(sizeof(*hdrs) + sz * sizeof(struct sip_hdr),
+			  hdrs_destructor);
+	if (!hdrs)
+		return ENOMEM;
+
+	hdrs->sz   = sz;
+	hdrs->next = msg->hdrs;
+	msg->hdrs  = hdrs;
+
+	return 0;
+}
+
+
 static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 			  enum sip_hdrid id, const char *p, ssize_t l,
 			  bool atomic, bool line)
@@ -156,9 +365,26 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 	struct sip_hdr *hdr;
 	int err = 0;
 
-	hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
-	if (!hdr)
-		return ENOMEM;
+	switch (id) {
+
+	case SIP_HDR_VIA:
+	case SIP_HDR_ROUTE:
+		/* only the individual values are stored */
+		if (!atomic)
+			return 0;
+		break;
+
+	default:
+		break;
+	}
+
+	if (msg->hdrs->n == msg->hdrs->sz) {
+		err = hdrs_alloc(msg, 2 * msg->hdrs->sz);
+		if (err)
+			return err;
+	}
+
+	hdr = &msg->hdrs->v[msg->hdrs->n++];
 
 	hdr->name  = *name;
 	hdr->val.p = p;
@@ -169,18 +395,15 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 
 	case SIP_HDR_VIA:
 	case SIP_HDR_ROUTE:
-		if (!atomic)
-			break;
-
-		hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
-		list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
+		hash_append(msg->hdrht, id, &hdr->he, hdr);
+		list_append(&msg->hdrl, &hdr->le, hdr);
 		break;
 
 	default:
 		if (atomic)
-			hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
+			hash_append(msg->hdrht, id, &hdr->he, hdr);
 		if (line)
-			list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
+			list_append(&msg->hdrl, &hdr->le, hdr);
 		break;
 	}
 
@@ -195,23 +418,17 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 		break;
 
 	case SIP_HDR_TO:
-		err = sip_addr_decode((struct sip_addr *)&msg->to, &hdr->val);
-		if (err)
+		if (msg->lazy & LAZY_TO)
 			break;
 
-		(void)msg_param_decode(&msg->to.params, "tag", &msg->to.tag);
-		msg->to.val = hdr->val;
+		err = taddr_decode(&msg->to, &hdr->val);
 		break;
 
 	case SIP_HDR_FROM:
-		err = sip_addr_decode((struct sip_addr *)&msg->from,
-				      &hdr->val);
-		if (err)
+		if (msg->lazy & LAZY_FROM)
 			break;
 
-		(void)msg_param_decode(&msg->from.params, "tag",
-				       &msg->from.tag);
-		msg->from.val = hdr->val;
+		err = taddr_decode(&msg->from, &hdr->val);
 		break;
 
 	case SIP_HDR_CALL_ID:
@@ -227,6 +444,9 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 		break;
 
 	case SIP_HDR_RACK:
+		if (msg->lazy & LAZY_RACK)
+			break;
+
 		err = sip_rack_decode(&msg->rack, &hdr->val);
 		break;
 
@@ -235,6 +455,9 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 		break;
 
 	case SIP_HDR_CONTENT_TYPE:
+		if (msg->lazy & LAZY_CTYPE)
+			break;
+
 		err = msg_ctype_decode(&msg->ctyp, &hdr->val);
 		break;
 
@@ -251,29 +474,213 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 		break;
 	}
 
-	mem_deref(hdr);
-
 	return err;
 }
 
 
-/**
- * Decode a SIP message
+/*
+ * Header value scanner
  *
- * @param msgp Pointer to allocated SIP Message
- * @param mb   Buffer containing SIP Message
- *
- * @return 0 if success, otherwise errorcode
+ * Returns the offset of the first byte that is significant to the
+ * header parser: CR and LF, plus comma and double-quote for comma
+ * separated headers. Everything in between is plain value text.
  */
-int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
+
+typedef size_t (scan_h)(const char *p, size_t l, bool comsep);
+
+
+static inline bool scan_special(char c, bool comsep)
+{
+	return c == '\r' || c == '\n' ||
+		(comsep && (c == ',' || c == '"'));
+}
+
+
+static size_t scan_scalar(const char *p, size_t l, bool comsep)
+{
+	size_t i;
+
+	for (i = 0; i < l; i++) {
+		if (scan_special(p[i], comsep))
+			break;
+	}
+
+	return i;
+}
+
+
+#if defined(HAVE_SCAN_X86) || defined(HAVE_SCAN_NEON)
+static inline unsigned first_bit(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long i;
+
+	_BitScanForward(&i, mask);
+
+	return (unsigned)i;
+#else
+	return (unsigned)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+
+#ifdef HAVE_SCAN_X86
+
+static size_t scan_sse2(const char *p, size_t l, bool comsep)
+{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i cm = _mm_set1_epi8(comsep ? ',' : '\r');
+	const __m128i qt = _mm_set1_epi8(comsep ? '"' : '\r');
+	size_t i;
+
+	for (i = 0; i + 16 <= l; i += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)(void *)(p + i));
+		__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+						      _mm_cmpeq_epi8(v, lf)),
+					 _mm_or_si128(_mm_cmpeq_epi8(v, cm),
+						      _mm_cmpeq_epi8(v, qt)));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+
+		if (mask)
+			return i + first_bit(mask);
+	}
+
+	return i + scan_scalar(p + i, l - i, comsep);
+}
+
+
+AVX2_TARGET
+static size_t scan_avx2(const char *p, size_t l, bool comsep)
 {
-	struct pl x, y, z, e, name;
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	const __m256i cm = _mm256_set1_epi8(comsep ? ',' : '\r');
+	const __m256i qt = _mm256_set1_epi8(comsep ? '"' : '\r');
+	size_t i;
+
+	for (i = 0; i + 32 <= l; i += 32) {
+
+		__m256i v = _mm256_loadu_si256((const __m256i *)(void *)
+					       (p + i));
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+					_mm256_cmpeq_epi8(v, lf)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, cm),
+					_mm256_cmpeq_epi8(v, qt)));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+
+		if (mask)
+			return i + first_bit(mask);
+	}
+
+	return i + scan_sse2(p + i, l - i, comsep);
+}
+
+#endif
+
+
+#ifdef HAVE_SCAN_NEON
+
+static size_t scan_neon(const char *p, size_t l, bool comsep)
+{
+	const uint8x16_t cr = vdupq_n_u8('\r');
+	const uint8x16_t lf = vdupq_n_u8('\n');
+	const uint8x16_t cm = vdupq_n_u8(comsep ? ',' : '\r');
+	const uint8x16_t qt = vdupq_n_u8(comsep ? '"' : '\r');
+	size_t i;
+
+	for (i = 0; i + 16 <= l; i += 16) {
+
+		uint8x16_t v = vld1q_u8((const uint8_t *)p + i);
+		uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, cr),
+						 vceqq_u8(v, lf)),
+					vorrq_u8(vceqq_u8(v, cm),
+						 vceqq_u8(v, qt)));
+		/* narrow to 4 bits per byte */
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+			vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+
+		if (mask)
+			return i + (size_t)(__builtin_ctzll(mask) >> 2);
+	}
+
+	return i + scan_scalar(p + i, l - i, comsep);
+}
+
+#endif
+
+
+static scan_h *scan_handler(void)
+{
+#if defined(HAVE_SCAN_X86)
+	if (sys_cpu_has(CPU_AVX2))
+		return scan_avx2;
+
+	if (sys_cpu_has(CPU_SSE2))
+		return scan_sse2;
+#elif defined(HAVE_SCAN_NEON)
+	return scan_neon;
+#endif
+
+	return scan_scalar;
+}
+
+
+/*
+ * Start-line:  Method SP Request-URI SP SIP-Version CRLF
+ *              SIP-Version SP Status-Code SP Reason-Phrase CRLF
+ */
+static int startline_decode(struct pl *x, struct pl *y, struct pl *z,
+			    const char *p, size_t l, size_t *len)
+{
+	const char *eol, *end, *q;
+
+	eol = memchr(p, '\n', l);
+	if (!eol)
+		return ENODATA;
+
+	end = eol;
+	while (end > p && end[-1] == '\r')
+		--end;
+
+	x->p = q = p;
+	while (q < end && *q != ' ' && *q != '\t' && *q != '\r')
+		++q;
+	x->l = q - x->p;
+	if (!x->l || q == end || *q != ' ')
+		return EBADMSG;
+
+	y->p = ++q;
+	while (q < end && *q != ' ' && *q != '\t' && *q != '\r')
+		++q;
+	y->l = q - y->p;
+	if (!y->l || q == end || *q != ' ')
+		return EBADMSG;
+
+	z->p = ++q;
+	z->l = end - z->p;
+	if (memchr(z->p, '\r', z->l))
+		return EBADMSG;
+
+	*len = eol + 1 - p;
+
+	return 0;
+}
+
+
+static int msg_decode(struct sip_msg **msgp, struct mbuf *mb, bool lazy)
+{
+	struct pl x, y, z, name;
 	const char *p, *v, *cv;
 	struct sip_msg *msg;
 	bool comsep, quote;
 	enum sip_hdrid id = SIP_HDR_NONE;
 	uint32_t ws, lf;
-	size_t l;
+	scan_h *scan;
+	size_t l, sl;
 	int err;
 
 	if (!msgp || !mb)
@@ -282,8 +689,7 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 	p = (const char *)mbuf_buf(mb);
 	l = mbuf_get_left(mb);
 
-	if (re_regex(p, l, "[^ \t\r\n]+ [^ \t\r\n]+ [^\r\n]*[\r]*[\n]1",
-		     &x, &y, &z, NULL, &e) || x.p != (char *)mbuf_buf(mb))
+	if (startline_decode(&x, &y, &z, p, l, &sl))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
 	msg = mem_zalloc(sizeof(*msg), destructor);
@@ -294,6 +700,11 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 	if (err)
 		goto out;
 
+	/* a header line is rarely shorter than 24 bytes */
+	err = hdrs_alloc(msg, (uint32_t)MIN(l / 24 + 4, HDRS_MAX));
+	if (err)
+		goto out;
+
 	msg->tag = rand_u64();
 	msg->mb  = mem_ref(mb);
 	msg->req = (0 == pl_strcmp(&z, "SIP/2.0"));
@@ -304,7 +715,9 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 		msg->ruri = y;
 		msg->ver = z;
 
-		if (uri_decode(&msg->uri, &y)) {
+		if (lazy)
+			msg->lazy |= LAZY_URI;
+		else if (uri_decode(&msg->uri, &y)) {
 			err = EBADMSG;
 			goto out;
 		}
@@ -320,16 +733,38 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 		}
 	}
 
-	l -= e.p + e.l - p;
-	p = e.p + e.l;
+	if (lazy)
+		msg->lazy |= LAZY_TO | LAZY_FROM | LAZY_RACK | LAZY_CTYPE;
+
+	l -= sl;
+	p += sl;
 
 	name.p = v = cv = NULL;
 	name.l = ws = lf = 0;
 	comsep = false;
 	quote = false;
+	scan = scan_handler();
 
 	for (; l > 0; p++, l--) {
 
+		/* skip plain value text in one go */
+		if (cv && !lf) {
+			size_t n = scan(p, l, comsep), t = 0;
+
+			if (n) {
+				while (t < n && (p[n-1-t] == ' ' ||
+						 p[n-1-t] == '\t'))
+					++t;
+
+				ws = (t == n) ? ws + (uint32_t)n : (uint32_t)t;
+				p += n;
+				l -= n;
+
+				if (!l)
+					break;
+			}
+		}
+
 		switch (*p) {
 
 		case ' ':
@@ -445,6 +880,197 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 }
 
 
+/**
+ * Decode a SIP message
+ *
+ * @param msgp Pointer to allocated SIP Message
+ * @param mb   Buffer containing SIP Message
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
+{
+	return msg_decode(msgp, mb, false);
+}
+
+
+/**
+ * Decode a SIP message, deferring the parsing of structured fields
+ *
+ * Only the start-line, the top Via, CSeq and the cached headers are
+ * decoded up front. The request URI, To, From, RAck and Content-Type
+ * are parsed on first access through sip_msg_uri(), sip_msg_to(),
+ * sip_msg_from(), sip_msg_rack() and sip_msg_ctype().
+ *
+ * @param msgp Pointer to allocated SIP Message
+ * @param mb   Buffer containing SIP Message
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_msg_decode_lazy(struct sip_msg **msgp, struct mbuf *mb)
+{
+	return msg_decode(msgp, mb, true);
+}
+
+
+static void lazy_decode(const struct sip_msg *cmsg, uint8_t field)
+{
+	struct sip_msg *msg = (struct sip_msg *)cmsg;
+	const struct sip_hdr *hdr;
+	int err = 0;
+
+	if (!(msg->lazy & field))
+		return;
+
+	msg->lazy &= ~field;
+
+	/* like the eager decoder, the last header of a kind wins */
+	switch (field) {
+
+	case LAZY_URI:
+		err = uri_decode(&msg->uri, &msg->ruri);
+		if (err)
+			memset(&msg->uri, 0, sizeof(msg->uri));
+		break;
+
+	case LAZY_TO:
+		hdr = sip_msg_hdr_apply(msg, false, SIP_HDR_TO, NULL, NULL);
+		if (hdr)
+			err = taddr_decode(&msg->to, &hdr->val);
+		if (err)
+			memset(&msg->to, 0, sizeof(msg->to));
+		break;
+
+	case LAZY_FROM:
+		hdr = sip_msg_hdr_apply(msg, false, SIP_HDR_FROM, NULL, NULL);
+		if (hdr)
+			err = taddr_decode(&msg->from, &hdr->val);
+		if (err)
+			memset(&msg->from, 0, sizeof(msg->from));
+		break;
+
+	case LAZY_RACK:
+		hdr = sip_msg_hdr_apply(msg, false, SIP_HDR_RACK, NULL, NULL);
+		if (hdr)
+			err = sip_rack_decode(&msg->rack, &hdr->val);
+		if (err)
+			memset(&msg->rack, 0, sizeof(msg->rack));
+		break;
+
+	case LAZY_CTYPE:
+		hdr = sip_msg_hdr_apply(msg, false, SIP_HDR_CONTENT_TYPE,
+					NULL, NULL);
+		if (hdr)
+			err = msg_ctype_decode(&msg->ctyp, &hdr->val);
+		if (err)
+			memset(&msg->ctyp, 0, sizeof(msg->ctyp));
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+/**
+ * Get the parsed request URI of a SIP message
+ *
+ * A lazily decoded message is parsed on first access. If the URI is
+ * malformed the returned URI is empty.
+ *
+ * @param msg SIP Message
+ *
+ * @return Request URI, or NULL if no message
+ */
+const struct uri *sip_msg_uri(const struct sip_msg *msg)
+{
+	if (!msg)
+		return NULL;
+
+	lazy_decode(msg, LAZY_URI);
+
+	return &msg->uri;
+}
+
+
+/**
+ * Get the parsed To header of a SIP message
+ *
+ * A lazily decoded message is parsed on first access. If the header is
+ * missing or malformed the returned address is empty.
+ *
+ * @param msg SIP Message
+ *
+ * @return To header, or NULL if no message
+ */
+const struct sip_taddr *sip_msg_to(const struct sip_msg *msg)
+{
+	if (!msg)
+		return NULL;
+
+	lazy_decode(msg, LAZY_TO);
+
+	return &msg->to;
+}
+
+
+/**
+ * Get the parsed From header of a SIP message
+ *
+ * A lazily decoded message is parsed on first access. If the header is
+ * missing or malformed the returned address is empty.
+ *
+ * @param msg SIP Message
+ *
+ * @return From header, or NULL if no message
+ */
+const struct sip_taddr *sip_msg_from(const struct sip_msg *msg)
+{
+	if (!msg)
+		return NULL;
+
+	lazy_decode(msg, LAZY_FROM);
+
+	return &msg->from;
+}
+
+
+/**
+ * Get the parsed RAck header of a SIP message
+ *
+ * @param msg SIP Message
+ *
+ * @return RAck header, or NULL if no message
+ */
+const struct sip_rack *sip_msg_rack(const struct sip_msg *msg)
+{
+	if (!msg)
+		return NULL;
+
+	lazy_decode(msg, LAZY_RACK);
+
+	return &msg->rack;
+}
+
+
+/**
+ * Get the parsed Content-Type header of a SIP message
+ *
+ * @param msg SIP Message
+ *
+ * @return Content-Type, or NULL if no message
+ */
+const struct msg_ctype *sip_msg_ctype(const struct sip_msg *msg)
+{
+	if (!msg)
+		return NULL;
+
+	lazy_decode(msg, LAZY_CTYPE);
+
+	return &msg->ctyp;
+}
+
+
 /**
  * Get a SIP Header from a SIP Message
  *
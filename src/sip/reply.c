@@ -8,6 +8,7 @@
 #include <re_mbuf.h>
 #include <re_sa.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_fmt.h>
 #include <re_uri.h>
 #include <re_udp.h>
@@ -76,7 +77,7 @@ static int vreplyf(struct sip_strans **stp, struct mbuf **mbp, bool trans,
 		case SIP_HDR_TO:
 			err |= mbuf_printf(mb, "%r: %r", &hdr->name,
 					   &hdr->val);
-			if (!pl_isset(&msg->to.tag) && scode > 100)
+			if (!pl_isset(&sip_msg_to(msg)->tag) && scode > 100)
 				err |= mbuf_printf(mb, ";tag=%016llx",
 						   msg->tag);
 			err |= mbuf_write_str(mb, "\r\n");
@@ -8,6 +8,7 @@
 #include <re_mbuf.h>
 #include <re_sa.h>
 #include <re_list.h>
+#include <re_hash.h>
 #include <re_fmt.h>
 #include <re_dns.h>
 #include <re_uri.h>
@@ -28,6 +29,7 @@ struct sip_request {
 	struct dns_query *dnsq;
 	struct dns_query *dnsq2;
 	struct sip *sip;
+	struct sip_tmpl *tmpl;
 	char *met;
 	char *uri;
 	char *host;
@@ -89,6 +91,7 @@ static void destructor(void *arg)
 	mem_deref(req->uri);
 	mem_deref(req->host);
 	mem_deref(req->mb);
+	mem_deref(req->tmpl);
 }
 
 
@@ -189,9 +192,16 @@ static int request(struct sip_request *req, enum sip_transp tp,
 		goto out;
 
 	mbuf_set_pos(mbs, 0);
-	err  = mbuf_printf(mb, "%s %s SIP/2.0\r\n", req->met, req->uri);
-	err |= mbuf_printf(mb, "Via: SIP/2.0/%s %J;branch=%s;rport\r\n",
-			   sip_transp_name(tp), &laddr, branch);
+	if (req->tmpl) {
+		err = sip_tmpl_prefix(mb, req->tmpl, tp, &laddr, branch);
+	}
+	else {
+		err  = mbuf_printf(mb, "%s %s SIP/2.0\r\n",
+				   req->met, req->uri);
+		err |= mbuf_printf(mb,
+				   "Via: SIP/2.0/%s %J;branch=%s;rport\r\n",
+				   sip_transp_name(tp), &laddr, branch);
+	}
 	err |= mbuf_write_mem(mb, mbuf_buf(mbs), mbuf_get_left(mbs));
 	err |= mbuf_write_mem(mb, mbuf_buf(req->mb), mbuf_get_left(req->mb));
 	err |= cont ? mbuf_write_mem(mb, mbuf_buf(cont), mbuf_get_left(cont)) :
@@ -874,7 +884,6 @@ int sip_drequestf(struct sip_request **reqp, struct sip *sip, bool stateful,
 		  struct sip_auth *auth, sip_send_h *sendh, sip_resp_h *resph,
 		  void *arg, const char *fmt, ...)
 {
-	struct sip_request *req;
 	struct mbuf *mb;
 	va_list ap;
 	int err;
@@ -908,20 +917,36 @@ int sip_drequestf(struct sip_request **reqp, struct sip *sip, bool stateful,
 
 	mb->pos = 0;
 
+	err = sip_request_dialog(reqp, sip, stateful, met, dlg, mb, NULL,
+				 sendh, resph, arg);
+
+out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+int sip_request_dialog(struct sip_request **reqp, struct sip *sip,
+		       bool stateful, const char *met,
+		       struct sip_dialog *dlg, struct mbuf *mb,
+		       struct sip_tmpl *tmpl, sip_send_h *sendh,
+		       sip_resp_h *resph, void *arg)
+{
+	struct sip_request *req;
+	int err;
+
 	err = sip_request_alloc(&req, sip, stateful, met, -1,
 				sip_dialog_uri(dlg), -1, sip_dialog_route(dlg),
 				sip_dialog_tp(dlg),
 				mb, sip_dialog_hash(dlg), sendh, resph, arg);
 	if (err)
-		goto out;
+		return err;
 
+	req->tmpl = mem_ref(tmpl);
 	req->reqp = reqp;
-	err = sip_request_send(req, sip, sip_dialog_route(dlg));
 
-out:
-	mem_deref(mb);
-
-	return err;
+	return sip_request_send(req, sip, sip_dialog_route(dlg));
 }
 
 
@@ -0,0 +1,483 @@
+/**
+ * @file sip/shard.c  SIP Stack Sharding
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_sa.h>
+#include <re_list.h>
+#include <re_hash.h>
+#include <re_fmt.h>
+#include <re_uri.h>
+#include <re_sys.h>
+#include <re_udp.h>
+#include <re_stun.h>
+#include <re_msg.h>
+#include <re_net.h>
+#include <re_main.h>
+#include <re_mqueue.h>
+#include <re_thread.h>
+#include <re_atomic.h>
+#include <re_sip.h>
+#include "sip.h"
+
+
+/*
+ * A sharded SIP stack runs one SIP stack per worker thread, each with
+ * its own transactions, dialogs and timers. The thread which owns the
+ * UDP socket only looks up the Call-ID of a received datagram and hands
+ * it to the worker selected by the Call-ID hash, so that all messages
+ * of a call are handled by the same worker. The workers send directly
+ * on the shared socket.
+ *
+ * Requests sent by a worker outside of an existing dialog must use a
+ * Call-ID from sip_shard_callid(), for their responses and the later
+ * in-dialog requests to come back to the same worker.
+ */
+
+
+enum {
+	SHARD_PKT  = 0,
+	SHARD_STOP = 1,
+};
+
+
+struct shard_worker {
+	struct sip_shard *sh;
+	struct mqueue *mq;
+	struct sip *sip;
+	thrd_t thr;
+	unsigned idx;
+	bool started;
+	bool ready;
+	RE_ATOMIC bool stopped;  /* event loop has returned       */
+	RE_ATOMIC bool pushing;  /* socket thread in worker_push() */
+	int err;
+};
+
+
+/** Defines a sharded SIP stack */
+struct sip_shard {
+	struct shard_worker *wv;
+	struct udp_sock *us;
+	sip_shard_init_h *inith;
+	sip_shard_close_h *closeh;
+	void *arg;
+	mtx_t *mtx;
+	cnd_t cnd;
+	unsigned n;
+	RE_ATOMIC size_t dropped;
+};
+
+
+struct shard_pkt {
+	struct mbuf *mb;
+	struct sa src;
+};
+
+
+static void pkt_destructor(void *arg)
+{
+	struct shard_pkt *pkt = arg;
+
+	mem_deref(pkt->mb);
+}
+
+
+/*
+ * Pushes a message to a worker whose event loop is running. A worker
+ * sets the stopped flag before it waits for pushing to clear, so that
+ * it frees the message queue only when no push can follow.
+ */
+static int worker_push(struct shard_worker *w, int id, void *data)
+{
+	int err = ENOTCONN;
+
+	re_atomic_store(&w->pushing, true, re_memory_order_seq_cst);
+
+	if (!re_atomic_load(&w->stopped, re_memory_order_seq_cst))
+		err = mqueue_push(w->mq, id, data);
+
+	re_atomic_rls_set(&w->pushing, false);
+
+	return err;
+}
+
+
+static void destructor(void *arg)
+{
+	struct sip_shard *sh = arg;
+	unsigned i;
+
+	for (i=0; i<sh->n; i++) {
+
+		struct shard_worker *w = &sh->wv[i];
+
+		if (!w->started)
+			continue;
+
+		/* a worker which failed to start has exited already */
+		if (!w->err)
+			(void)worker_push(w, SHARD_STOP, NULL);
+
+		(void)thrd_join(w->thr, NULL);
+	}
+
+	mem_deref(sh->wv);
+	mem_deref(sh->us);
+
+	if (sh->mtx) {
+		cnd_destroy(&sh->cnd);
+		mem_deref(sh->mtx);
+	}
+}
+
+
+/* Finds the Call-ID header without decoding the message */
+static bool callid_find(struct pl *cid, const struct mbuf *mb)
+{
+	const char *p   = (const char *)mbuf_buf(mb);
+	const char *end = p + mbuf_get_left(mb);
+
+	for (;;) {
+		const char *eol = memchr(p, '\n', end - p);
+		struct pl name;
+
+		if (!eol)
+			return false;
+
+		p = eol + 1;
+
+		/* end of headers */
+		if (p >= end || *p == '\r' || *p == '\n')
+			return false;
+
+		name.p = p;
+		while (p < end && *p != ':' && *p != ' ' && *p != '\t' &&
+		       *p != '\n')
+			++p;
+		name.l = p - name.p;
+
+		if (pl_strcasecmp(&name, "Call-ID") &&
+		    pl_strcasecmp(&name, "i"))
+			continue;
+
+		while (p < end && (*p == ' ' || *p == '\t'))
+			++p;
+
+		if (p >= end || *p != ':')
+			return false;
+
+		do {
+			++p;
+		} while (p < end && (*p == ' ' || *p == '\t'));
+
+		cid->p = p;
+		while (p < end && *p != '\r' && *p != '\n')
+			++p;
+
+		while (p > cid->p && (p[-1] == ' ' || p[-1] == '\t'))
+			--p;
+
+		cid->l = p - cid->p;
+
+		return cid->l > 0;
+	}
+}
+
+
+static unsigned shard_index(const struct sip_shard *sh, const struct pl *cid)
+{
+	return hash_wy_pl(cid) % sh->n;
+}
+
+
+static void udp_recv_handler(const struct sa *src, struct mbuf *mb,
+			     void *arg)
+{
+	struct sip_shard *sh = arg;
+	struct shard_pkt *pkt;
+	struct pl cid;
+	unsigned i;
+
+	/* keep-alive Binding Requests need no worker */
+	if (stun_msg_probe(mb) &&
+	    !stun_binding_reply(IPPROTO_UDP, sh->us, src, 0, mb, NULL))
+		return;
+
+	/* STUN and keep-alives have no Call-ID */
+	if (callid_find(&cid, mb))
+		i = shard_index(sh, &cid);
+	else
+		i = sa_hash(src, SA_ALL) % sh->n;
+
+	pkt = mem_zalloc(sizeof(*pkt), pkt_destructor);
+	if (!pkt)
+		return;
+
+	pkt->mb  = mem_ref(mb);
+	pkt->src = *src;
+
+	/* the worker is behind or has stopped */
+	if (worker_push(&sh->wv[i], SHARD_PKT, pkt)) {
+		re_atomic_rlx_add(&sh->dropped, 1);
+		mem_deref(pkt);
+	}
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct shard_worker *w = arg;
+	struct shard_pkt *pkt = data;
+
+	switch (id) {
+
+	case SHARD_PKT:
+		/* drained after the event loop has returned */
+		if (re_atomic_rlx(&w->stopped))
+			re_atomic_rlx_add(&w->sh->dropped, 1);
+		else
+			sip_transp_udp_recv(w->sip, &pkt->src, pkt->mb);
+
+		mem_deref(pkt);
+		break;
+
+	case SHARD_STOP:
+		re_cancel();
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static void worker_ready(struct shard_worker *w, int err)
+{
+	struct sip_shard *sh = w->sh;
+
+	mtx_lock(sh->mtx);
+	w->err   = err;
+	w->ready = true;
+	cnd_signal(&sh->cnd);
+	mtx_unlock(sh->mtx);
+}
+
+
+/* Stops the pushes to a worker, and releases the pending packets */
+static void worker_stop(struct shard_worker *w)
+{
+	re_atomic_store(&w->stopped, true, re_memory_order_seq_cst);
+
+	while (re_atomic_load(&w->pushing, re_memory_order_seq_cst))
+		sys_usleep(100);
+
+	mqueue_drain(w->mq);
+	w->mq = mem_deref(w->mq);
+}
+
+
+static int worker_thread(void *arg)
+{
+	struct shard_worker *w = arg;
+	struct sip_shard *sh = w->sh;
+	int err;
+
+	err = re_thread_init();
+	if (err) {
+		worker_ready(w, err);
+		return err;
+	}
+
+	err = mqueue_alloc(&w->mq, mqueue_handler, w);
+	if (err)
+		goto out;
+
+	err = sh->inith(&w->sip, w->idx, sh->arg);
+	if (err)
+		goto out;
+
+	err = sip_transp_add_shared(w->sip, sh->us);
+	if (err)
+		goto out;
+
+	worker_ready(w, 0);
+
+	err = re_main(NULL);
+
+	/* also after re_cancel() from the application */
+	worker_stop(w);
+
+	if (sh->closeh)
+		sh->closeh(w->sip, w->idx, sh->arg);
+
+ out:
+	if (!w->ready) {
+		w->mq = mem_deref(w->mq);
+		worker_ready(w, err);
+	}
+
+	if (w->sip)
+		sip_close(w->sip, true);
+
+	w->sip = mem_deref(w->sip);
+
+	re_thread_close();
+
+	return err;
+}
+
+
+/**
+ * Allocate a sharded SIP stack on a UDP socket
+ *
+ * The calling thread owns the UDP socket and must run re_main(). Each
+ * worker thread calls the init handler to allocate its SIP stack and
+ * to add its listeners, then runs its own re_main(). The UDP transport
+ * on the shared socket is added to each SIP stack by the shard; other
+ * transports are not sharded. UDP helpers and SIP keepalives on the
+ * shared socket are not supported.
+ *
+ * @param shp    Pointer to allocated sharded SIP stack
+ * @param laddr  Local network address of the UDP socket
+ * @param n      Number of worker threads
+ * @param inith  Worker init handler, called from the worker thread
+ * @param closeh Worker close handler, called from the worker thread
+ * @param arg    Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_shard_alloc(struct sip_shard **shp, const struct sa *laddr,
+		    unsigned n, sip_shard_init_h *inith,
+		    sip_shard_close_h *closeh, void *arg)
+{
+	struct sip_shard *sh;
+	unsigned i;
+	int err;
+
+	if (!shp || !laddr || !n || !inith)
+		return EINVAL;
+
+	sh = mem_zalloc(sizeof(*sh), destructor);
+	if (!sh)
+		return ENOMEM;
+
+	sh->n      = n;
+	sh->inith  = inith;
+	sh->closeh = closeh;
+	sh->arg    = arg;
+	re_atomic_rlx_set(&sh->dropped, 0);
+
+	sh->wv = mem_zalloc(n * sizeof(*sh->wv), NULL);
+	if (!sh->wv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = mutex_alloc(&sh->mtx);
+	if (err)
+		goto out;
+
+	if (cnd_init(&sh->cnd) != thrd_success) {
+		sh->mtx = mem_deref(sh->mtx);
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = udp_listen(&sh->us, laddr, udp_recv_handler, sh);
+	if (err)
+		goto out;
+
+	for (i=0; i<n; i++) {
+
+		struct shard_worker *w = &sh->wv[i];
+
+		w->sh  = sh;
+		w->idx = i;
+		re_atomic_rlx_set(&w->stopped, false);
+		re_atomic_rlx_set(&w->pushing, false);
+
+		err = thread_create_name(&w->thr, "sip shard", worker_thread,
+					 w);
+		if (err)
+			goto out;
+
+		w->started = true;
+
+		mtx_lock(sh->mtx);
+		while (!w->ready)
+			cnd_wait(&sh->cnd, sh->mtx);
+		err = w->err;
+		mtx_unlock(sh->mtx);
+
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(sh);
+	else
+		*shp = sh;
+
+	return err;
+}
+
+
+/**
+ * Allocate a Call-ID which is dispatched to a given worker
+ *
+ * @param callidp Pointer to allocated Call-ID
+ * @param sh      Sharded SIP stack
+ * @param idx     Worker index
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_shard_callid(char **callidp, const struct sip_shard *sh,
+		     unsigned idx)
+{
+	char *callid;
+	int err;
+
+	if (!callidp || !sh || idx >= sh->n)
+		return EINVAL;
+
+	for (;;) {
+		struct pl pl;
+
+		err = str_x64dup(&callid, rand_u64());
+		if (err)
+			return err;
+
+		pl_set_str(&pl, callid);
+
+		if (shard_index(sh, &pl) == idx)
+			break;
+
+		mem_deref(callid);
+	}
+
+	*callidp = callid;
+
+	return 0;
+}
+
+
+/**
+ * Get the number of datagrams dropped because a worker was behind
+ *
+ * @param sh Sharded SIP stack
+ *
+ * @return Number of dropped datagrams
+ */
+size_t sip_shard_dropped(struct sip_shard *sh)
+{
+	if (!sh)
+		return 0;
+
+	return re_atomic_rlx(&sh->dropped);
+}
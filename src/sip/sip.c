@@ -86,6 +86,7 @@ static void destructor(void *arg)
 	mem_deref(sip->stun);
 
 	mem_deref(sip->websock);
+	mem_deref(sip->tring);
 }
 
 
@@ -100,14 +101,27 @@ static void lsnr_destructor(void *arg)
 }
 
 
+/* A size of 0 selects a table that resizes itself with the load */
+int sip_hash_alloc(struct hash **htp, uint32_t sz, hash_key_h *keyh)
+{
+	if (!sz)
+		return hash_alloc_dynamic(htp, 0, keyh);
+
+	return hash_alloc(htp, sz);
+}
+
+
 /**
  * Allocate a SIP stack instance
  *
  * @param sipp     Pointer to allocated SIP stack
  * @param dnsc     DNS Client (optional)
- * @param ctsz     Size of client transactions hashtable (power of 2)
- * @param stsz     Size of server transactions hashtable (power of 2)
- * @param tcsz     Size of SIP transport hashtable (power of 2)
+ * @param ctsz     Size of client transactions hashtable (power of 2),
+ *                 or 0 for a self-resizing hashtable
+ * @param stsz     Size of server transactions hashtable (power of 2),
+ *                 or 0 for a self-resizing hashtable
+ * @param tcsz     Size of SIP transport hashtable (power of 2),
+ *                 or 0 for a self-resizing hashtable
  * @param software Software identifier
  * @param exith    SIP-stack exit handler
  * @param arg      Handler argument
@@ -141,7 +155,7 @@ int sip_alloc(struct sip **sipp, struct dnsc *dnsc, uint32_t ctsz,
 	if (err)
 		goto out;
 
-	err = hash_alloc(&sip->ht_udpconn, tcsz);
+	err = sip_udpconn_init(sip, tcsz);
 	if (err)
 		goto out;
 
@@ -284,6 +298,28 @@ void sip_set_trace_handler(struct sip *sip, sip_trace_h *traceh)
 }
 
 
+/**
+ * Enable lazy decoding of received SIP messages
+ *
+ * The structured fields of a message, such as the request URI and the
+ * To and From headers, are then only parsed on first access through the
+ * sip_msg_uri(), sip_msg_to() etc. accessors. This saves the parse
+ * work in stateless proxies, which mostly look at the top Via only.
+ * A malformed To or From is not rejected on receipt; its accessor
+ * returns an empty address, and the dialog functions fail with EBADMSG.
+ *
+ * @param sip    SIP stack instance
+ * @param enable True to enable, false to disable
+ */
+void sip_set_lazy_decode(struct sip *sip, bool enable)
+{
+	if (!sip)
+		return;
+
+	sip->lazy = enable;
+}
+
+
 struct sip_conncfg *sip_conncfg_find(struct sip *sip,
 				     const struct sa *paddr)
 {
@@ -21,8 +21,10 @@ struct sip {
 	char *software;
 	sip_exit_h *exith;
 	sip_trace_h *traceh;
+	struct sip_trace_ring *tring;
 	void *arg;
 	bool closing;
+	bool lazy;
 	uint8_t tos;
 	enum sip_transp tp_def;
 };
@@ -57,6 +59,7 @@ int  sip_ctrans_request(struct sip_ctrans **ctp, struct sip *sip,
 			char *branch, char *host, struct mbuf *mb,
 			sip_resp_h *resph, void *arg);
 int  sip_ctrans_cancel(struct sip_ctrans *ct);
+int  sip_hash_alloc(struct hash **htp, uint32_t sz, hash_key_h *keyh);
 int  sip_ctrans_init(struct sip *sip, uint32_t sz);
 int  sip_ctrans_debug(struct re_printf *pf, const struct sip *sip);
 
@@ -79,15 +82,42 @@ bool sip_transp_supported(struct sip *sip, enum sip_transp tp, int af);
 const char *sip_transp_srvid(enum sip_transp tp);
 bool sip_transp_reliable(enum sip_transp tp);
 int  sip_transp_debug(struct re_printf *pf, const struct sip *sip);
+int  sip_transp_add_shared(struct sip *sip, struct udp_sock *us);
+void sip_transp_udp_recv(struct sip *sip, const struct sa *src,
+			 struct mbuf *mb);
 
 
 /* dialog */
 int  sip_dialog_encode(struct mbuf *mb, struct sip_dialog *dlg, uint32_t cseq,
 		       const char *met);
+int  sip_dialog_encode_hdrs(struct mbuf *mb, const struct sip_dialog *dlg);
+uint32_t sip_dialog_cseq(struct sip_dialog *dlg, uint32_t cseq,
+			 const char *met);
+uint32_t sip_dialog_rev(const struct sip_dialog *dlg);
 const struct uri *sip_dialog_route(const struct sip_dialog *dlg);
 uint32_t sip_dialog_hash(const struct sip_dialog *dlg);
 
 
+/* request */
+int  sip_request_dialog(struct sip_request **reqp, struct sip *sip,
+			bool stateful, const char *met,
+			struct sip_dialog *dlg, struct mbuf *mb,
+			struct sip_tmpl *tmpl, sip_send_h *sendh,
+			sip_resp_h *resph, void *arg);
+
+
+/* request template */
+int  sip_tmpl_prefix(struct mbuf *mb, struct sip_tmpl *tmpl,
+		     enum sip_transp tp, const struct sa *laddr,
+		     const char *branch);
+
+
+/* trace ring */
+void sip_trace_ring_push(struct sip_trace_ring *ring, bool tx,
+			 enum sip_transp tp, const struct sa *src,
+			 const struct sa *dst, const uint8_t *pkt, size_t len);
+
+
 /* keepalive */
 struct sip_conn;
 
@@ -95,6 +125,7 @@ void sip_keepalive_signal(struct list *kal, int err);
 uint64_t sip_keepalive_wait(uint32_t interval);
 int  sip_keepalive_tcp(struct sip_keepalive *ka, struct sip_conn *conn,
 		       uint32_t interval);
+int  sip_udpconn_init(struct sip *sip, uint32_t sz);
 int  sip_keepalive_udp(struct sip_keepalive *ka, struct sip *sip,
 		       struct udp_sock *us, const struct sa *paddr,
 		       uint32_t interval);
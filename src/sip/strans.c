@@ -129,7 +129,7 @@ static bool cmp_merge_handler(struct le *le, void *arg)
 	if (pl_cmp(&st->msg->callid, &msg->callid))
 		return false;
 
-	if (pl_cmp(&st->msg->from.tag, &msg->from.tag))
+	if (pl_cmp(&sip_msg_from(st->msg)->tag, &sip_msg_from(msg)->tag))
 		return false;
 
 	if (pl_cmp(&st->msg->ruri, &msg->ruri))
@@ -171,7 +171,7 @@ static bool ack_handler(struct sip *sip, const struct sip_msg *msg)
 	struct sip_strans *st;
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_ack_handler, (void *)msg));
 	if (!st)
 		return false;
@@ -206,7 +206,7 @@ static bool cancel_handler(struct sip *sip, const struct sip_msg *msg)
 	struct sip_strans *st;
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_cancel_handler, (void *)msg));
 	if (!st)
 		return false;
@@ -239,7 +239,7 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 		return ack_handler(sip, msg);
 
 	st = list_ledata(hash_lookup(sip->ht_strans,
-				     hash_joaat_pl(&msg->via.branch),
+				     hash_wy_pl(&msg->via.branch),
 				     cmp_handler, (void *)msg));
 	if (st) {
 		switch (st->state) {
@@ -256,10 +256,10 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 
 		return true;
 	}
-	else if (!pl_isset(&msg->to.tag)) {
+	else if (!pl_isset(&sip_msg_to(msg)->tag)) {
 
 		st = list_ledata(hash_lookup(sip->ht_strans_mrg,
-					     hash_joaat_pl(&msg->callid),
+					     hash_wy_pl(&msg->callid),
 					     cmp_merge_handler, (void *)msg));
 		if (st) {
 			(void)sip_reply(sip, msg, 482, "Loop Detected");
@@ -298,14 +298,15 @@ int sip_strans_alloc(struct sip_strans **stp, struct sip *sip,
 	if (!st)
 		return ENOMEM;
 
-	hash_append(sip->ht_strans, hash_joaat_pl(&msg->via.branch),
+	st->invite  = !pl_strcmp(&msg->met, "INVITE");
+	st->msg     = mem_ref((void *)msg);
+
+	hash_append(sip->ht_strans, hash_wy_pl(&msg->via.branch),
 		    &st->he, st);
 
-	hash_append(sip->ht_strans_mrg, hash_joaat_pl(&msg->callid),
+	hash_append(sip->ht_strans_mrg, hash_wy_pl(&msg->callid),
 		    &st->he_mrg, st);
 
-	st->invite  = !pl_strcmp(&msg->met, "INVITE");
-	st->msg     = mem_ref((void *)msg);
 	st->state   = TRYING;
 	st->cancelh = cancelh ? cancelh : dummy_handler;
 	st->arg     = arg;
@@ -399,6 +400,22 @@ int sip_strans_reply(struct sip_strans **stp, struct sip *sip,
 }
 
 
+static uint32_t strans_key(const struct le *le)
+{
+	const struct sip_strans *st = le->data;
+
+	return hash_wy_pl(&st->msg->via.branch);
+}
+
+
+static uint32_t strans_mrg_key(const struct le *le)
+{
+	const struct sip_strans *st = le->data;
+
+	return hash_wy_pl(&st->msg->callid);
+}
+
+
 int sip_strans_init(struct sip *sip, uint32_t sz)
 {
 	int err;
@@ -407,11 +424,11 @@ int sip_strans_init(struct sip *sip, uint32_t sz)
 	if (err)
 		return err;
 
-	err = hash_alloc(&sip->ht_strans_mrg, sz);
+	err = sip_hash_alloc(&sip->ht_strans_mrg, sz, strans_mrg_key);
 	if (err)
 		return err;
 
-	return hash_alloc(&sip->ht_strans, sz);
+	return sip_hash_alloc(&sip->ht_strans, sz, strans_key);
 }
 
 
@@ -448,7 +465,8 @@ int sip_strans_debug(struct re_printf *pf, const struct sip *sip)
 {
 	int err;
 
-	err = re_hprintf(pf, "server transactions:\n");
+	err = re_hprintf(pf, "server transactions: %H\n",
+			 hash_debug, sip->ht_strans);
 	hash_apply(sip->ht_strans, debug_handler, pf);
 
 	return err;
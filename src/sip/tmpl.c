@@ -0,0 +1,292 @@
+/**
+ * @file sip/tmpl.c  SIP Request Templates
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_sa.h>
+#include <re_list.h>
+#include <re_hash.h>
+#include <re_fmt.h>
+#include <re_uri.h>
+#include <re_udp.h>
+#include <re_msg.h>
+#include <re_sip.h>
+#include "sip.h"
+
+
+/*
+ * A request template holds the parts of an in-dialog request which do
+ * not change from one send to the next, rendered once with the string
+ * formatter. Each send then only copies these and writes the branch,
+ * CSeq number and Content-Length. The rendered parts are refreshed when
+ * the dialog changes its target, tags or route set.
+ */
+
+/** Defines a SIP Request Template */
+struct sip_tmpl {
+	struct sip *sip;          /**< SIP Stack                            */
+	struct sip_dialog *dlg;   /**< SIP Dialog                           */
+	char *met;                /**< SIP Method                           */
+	struct mbuf *hdrs;        /**< Headers from the format string       */
+	struct mbuf *mb;          /**< Rendered headers                     */
+	size_t cpos;              /**< Position of the CSeq number in mb    */
+	uint32_t rev;             /**< Dialog revision of mb                */
+	struct mbuf *pfx;         /**< Request-Line and Via up to branch    */
+	struct sa pfx_laddr;      /**< Local address in pfx                 */
+	enum sip_transp pfx_tp;   /**< SIP transport in pfx                 */
+	uint32_t pfx_rev;         /**< Dialog revision of pfx               */
+};
+
+
+static void destructor(void *arg)
+{
+	struct sip_tmpl *tmpl = arg;
+
+	mem_deref(tmpl->dlg);
+	mem_deref(tmpl->met);
+	mem_deref(tmpl->hdrs);
+	mem_deref(tmpl->mb);
+	mem_deref(tmpl->pfx);
+}
+
+
+static int write_u32(struct mbuf *mb, uint32_t v)
+{
+	char buf[10];
+	size_t i = sizeof(buf);
+
+	do {
+		buf[--i] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	return mbuf_write_mem(mb, (uint8_t *)&buf[i], sizeof(buf) - i);
+}
+
+
+static int render(struct sip_tmpl *tmpl)
+{
+	struct mbuf *mb;
+	int err;
+
+	mb = mbuf_alloc(512);
+	if (!mb)
+		return ENOMEM;
+
+	err  = sip_dialog_encode_hdrs(mb, tmpl->dlg);
+	err |= mbuf_write_str(mb, "CSeq: ");
+	tmpl->cpos = mb->pos;
+	err |= mbuf_printf(mb, " %s\r\n", tmpl->met);
+
+	if (tmpl->sip->software)
+		err |= mbuf_printf(mb, "User-Agent: %s\r\n",
+				   tmpl->sip->software);
+
+	if (tmpl->hdrs)
+		err |= mbuf_write_mem(mb, tmpl->hdrs->buf, tmpl->hdrs->end);
+
+	if (err) {
+		mem_deref(mb);
+		return err;
+	}
+
+	mem_deref(tmpl->mb);
+	tmpl->mb  = mb;
+	tmpl->rev = sip_dialog_rev(tmpl->dlg);
+
+	return 0;
+}
+
+
+/**
+ * Allocate a SIP Request Template for requests within a dialog
+ *
+ * @param tmplp Pointer to allocated SIP Request Template
+ * @param sip   SIP Stack
+ * @param dlg   SIP Dialog state
+ * @param met   Null-terminated SIP Method string
+ * @param fmt   Formatted SIP headers which stay the same (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_tmpl_alloc(struct sip_tmpl **tmplp, struct sip *sip,
+		   struct sip_dialog *dlg, const char *met,
+		   const char *fmt, ...)
+{
+	struct sip_tmpl *tmpl;
+	va_list ap;
+	int err;
+
+	if (!tmplp || !sip || !dlg || !met)
+		return EINVAL;
+
+	tmpl = mem_zalloc(sizeof(*tmpl), destructor);
+	if (!tmpl)
+		return ENOMEM;
+
+	tmpl->sip = sip;
+	tmpl->dlg = mem_ref(dlg);
+
+	err = str_dup(&tmpl->met, met);
+	if (err)
+		goto out;
+
+	if (fmt) {
+		tmpl->hdrs = mbuf_alloc(256);
+		if (!tmpl->hdrs) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		va_start(ap, fmt);
+		err = mbuf_vprintf(tmpl->hdrs, fmt, ap);
+		va_end(ap);
+		if (err)
+			goto out;
+	}
+
+	err = render(tmpl);
+
+ out:
+	if (err)
+		mem_deref(tmpl);
+	else
+		*tmplp = tmpl;
+
+	return err;
+}
+
+
+/* Everything after the Via header, as sip_drequestf() would write it */
+static int tmpl_encode(struct mbuf *mb, struct sip_tmpl *tmpl, uint32_t cseq,
+		       struct sip_auth *auth, const char *ctype,
+		       const struct mbuf *body)
+{
+	size_t blen = body ? mbuf_get_left(body) : 0;
+	int err;
+
+	if (tmpl->rev != sip_dialog_rev(tmpl->dlg)) {
+		err = render(tmpl);
+		if (err)
+			return err;
+	}
+
+	err = mbuf_write_str(mb, "Max-Forwards: 70\r\n");
+
+	if (auth)
+		err |= sip_auth_encode(mb, auth, tmpl->met,
+				       sip_dialog_uri(tmpl->dlg));
+
+	err |= mbuf_write_mem(mb, tmpl->mb->buf, tmpl->cpos);
+	err |= write_u32(mb, sip_dialog_cseq(tmpl->dlg, cseq, tmpl->met));
+	err |= mbuf_write_mem(mb, tmpl->mb->buf + tmpl->cpos,
+			      tmpl->mb->end - tmpl->cpos);
+
+	if (ctype) {
+		err |= mbuf_write_str(mb, "Content-Type: ");
+		err |= mbuf_write_str(mb, ctype);
+		err |= mbuf_write_str(mb, "\r\n");
+	}
+
+	err |= mbuf_write_str(mb, "Content-Length: ");
+	err |= write_u32(mb, (uint32_t)blen);
+	err |= mbuf_write_str(mb, "\r\n\r\n");
+
+	if (blen)
+		err |= mbuf_write_mem(mb, mbuf_buf(body), blen);
+
+	return err;
+}
+
+
+/* The Request-Line and a Via header with the given branch */
+int sip_tmpl_prefix(struct mbuf *mb, struct sip_tmpl *tmpl,
+		    enum sip_transp tp, const struct sa *laddr,
+		    const char *branch)
+{
+	int err;
+
+	if (!mb || !tmpl || !laddr || !branch)
+		return EINVAL;
+
+	if (!tmpl->pfx || tmpl->pfx_tp != tp ||
+	    tmpl->pfx_rev != sip_dialog_rev(tmpl->dlg) ||
+	    !sa_cmp(&tmpl->pfx_laddr, laddr, SA_ALL)) {
+
+		struct mbuf *pfx = mbuf_alloc(128);
+		if (!pfx)
+			return ENOMEM;
+
+		err = mbuf_printf(pfx, "%s %s SIP/2.0\r\n"
+				  "Via: SIP/2.0/%s %J;branch=",
+				  tmpl->met, sip_dialog_uri(tmpl->dlg),
+				  sip_transp_name(tp), laddr);
+		if (err) {
+			mem_deref(pfx);
+			return err;
+		}
+
+		mem_deref(tmpl->pfx);
+		tmpl->pfx       = pfx;
+		tmpl->pfx_tp    = tp;
+		tmpl->pfx_rev   = sip_dialog_rev(tmpl->dlg);
+		tmpl->pfx_laddr = *laddr;
+	}
+
+	err  = mbuf_write_mem(mb, tmpl->pfx->buf, tmpl->pfx->end);
+	err |= mbuf_write_str(mb, branch);
+	err |= mbuf_write_str(mb, ";rport\r\n");
+
+	return err;
+}
+
+
+/**
+ * Send a SIP dialog request from a SIP Request Template
+ *
+ * @param reqp     Pointer to allocated SIP request object
+ * @param tmpl     SIP Request Template
+ * @param stateful Stateful client transaction
+ * @param cseq     CSeq number, used for ACK only
+ * @param auth     SIP authentication state (optional)
+ * @param ctype    Content-Type of the body (optional)
+ * @param body     Message body (optional)
+ * @param sendh    Send handler
+ * @param resph    Response handler
+ * @param arg      Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_tmpl_drequest(struct sip_request **reqp, struct sip_tmpl *tmpl,
+		      bool stateful, uint32_t cseq, struct sip_auth *auth,
+		      const char *ctype, const struct mbuf *body,
+		      sip_send_h *sendh, sip_resp_h *resph, void *arg)
+{
+	struct mbuf *mb;
+	int err;
+
+	if (!tmpl)
+		return EINVAL;
+
+	mb = mbuf_alloc(2048);
+	if (!mb)
+		return ENOMEM;
+
+	err = tmpl_encode(mb, tmpl, cseq, auth, ctype, body);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+
+	err = sip_request_dialog(reqp, tmpl->sip, stateful, tmpl->met,
+				 tmpl->dlg, mb, tmpl, sendh, resph, arg);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
@@ -0,0 +1,558 @@
+/**
+ * @file sip/trace.c  SIP Message Trace Ring
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#include <time.h>
+#endif
+#include <string.h>
+#include <re_types.h>
+#include <re_mem.h>
+#include <re_mbuf.h>
+#include <re_sa.h>
+#include <re_list.h>
+#include <re_hash.h>
+#include <re_fmt.h>
+#include <re_uri.h>
+#include <re_tmr.h>
+#include <re_udp.h>
+#include <re_msg.h>
+#include <re_atomic.h>
+#include <re_sip.h>
+#include "sip.h"
+
+
+/*
+ * The trace ring captures every SIP message sent or received by one SIP
+ * stack into a fixed-size byte ring, as a record header followed by the
+ * raw message. The SIP stack thread is the only producer and one other
+ * thread is the only consumer, so the two positions are enough to hand
+ * over the records without a lock. A record which does not fit is
+ * dropped and counted, the SIP stack never waits for the consumer.
+ *
+ * Records are not split at the end of the ring; the rest of the ring is
+ * then filled with a pad record instead.
+ */
+
+
+enum {
+	RING_MIN   = 4096,
+	REC_ALIGN  = 8,
+	REC_PAD    = 0xffffffff,
+	CACHE_LINE = 64,
+};
+
+
+struct rec_hdr {
+	uint32_t size;     /**< Record size including header and padding */
+	uint32_t len;      /**< Message length, or REC_PAD               */
+	uint64_t ts;       /**< Capture time in [us], from jiffies       */
+	struct sa src;     /**< Source address                           */
+	struct sa dst;     /**< Destination address                      */
+	uint8_t tx;        /**< Sent or received                         */
+	uint8_t tp;        /**< SIP transport                            */
+};
+
+
+/** Defines a SIP Message Trace Ring */
+struct sip_trace_ring {
+	RE_ATOMIC size_t head;    /**< Write position, owned by producer   */
+	uint8_t pad1[CACHE_LINE - sizeof(size_t)];
+	RE_ATOMIC size_t tail;    /**< Read position, owned by consumer    */
+	uint8_t pad2[CACHE_LINE - sizeof(size_t)];
+	RE_ATOMIC size_t dropped; /**< Number of dropped records           */
+	uint64_t wall;            /**< Unix time minus jiffies in [us]     */
+	size_t size;              /**< Ring size, a power of two           */
+	uint8_t *buf;             /**< Ring memory                         */
+};
+
+
+static void destructor(void *arg)
+{
+	struct sip_trace_ring *ring = arg;
+
+	mem_deref(ring->buf);
+}
+
+
+static uint64_t unix_usec(void)
+{
+#ifdef WIN32
+	union {
+		long long ns100;
+		FILETIME ft;
+	} now;
+
+	GetSystemTimeAsFileTime(&now.ft);
+
+	return (now.ns100 - 116444736000000000LL) / 10LL;
+#else
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) != 0)
+		return 0;
+
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+static inline size_t rec_size(size_t len)
+{
+	return (sizeof(struct rec_hdr) + len + REC_ALIGN - 1) &
+		~(size_t)(REC_ALIGN - 1);
+}
+
+
+/**
+ * Allocate a SIP Message Trace Ring
+ *
+ * @param ringp Pointer to allocated SIP Message Trace Ring
+ * @param size  Ring size in bytes, rounded up to a power of two
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_trace_ring_alloc(struct sip_trace_ring **ringp, size_t size)
+{
+	struct sip_trace_ring *ring;
+	size_t sz = RING_MIN;
+
+	if (!ringp)
+		return EINVAL;
+
+	while (sz < size) {
+		if (sz > (size_t)-1 / 4)
+			return EINVAL;
+		sz <<= 1;
+	}
+
+	ring = mem_zalloc(sizeof(*ring), destructor);
+	if (!ring)
+		return ENOMEM;
+
+	ring->buf = mem_alloc(sz, NULL);
+	if (!ring->buf) {
+		mem_deref(ring);
+		return ENOMEM;
+	}
+
+	ring->size = sz;
+	ring->wall = unix_usec() - tmr_jiffies_usec();
+
+	re_atomic_rlx_set(&ring->head, 0);
+	re_atomic_rlx_set(&ring->tail, 0);
+	re_atomic_rlx_set(&ring->dropped, 0);
+
+	*ringp = ring;
+
+	return 0;
+}
+
+
+/**
+ * Capture all SIP messages of a SIP stack into a SIP Message Trace Ring
+ *
+ * This can be used together with, or instead of a trace handler. The
+ * ring is drained with sip_trace_ring_drain() from one other thread.
+ *
+ * @param sip  SIP stack instance
+ * @param ring SIP Message Trace Ring, or NULL to stop capturing
+ */
+void sip_set_trace_ring(struct sip *sip, struct sip_trace_ring *ring)
+{
+	if (!sip)
+		return;
+
+	mem_deref(sip->tring);
+	sip->tring = mem_ref(ring);
+}
+
+
+/* Called from the SIP stack thread only */
+void sip_trace_ring_push(struct sip_trace_ring *ring, bool tx,
+			 enum sip_transp tp, const struct sa *src,
+			 const struct sa *dst, const uint8_t *pkt, size_t len)
+{
+	struct rec_hdr hdr;
+	size_t head, tail, off, need, cont, total;
+
+	if (!ring || !pkt)
+		return;
+
+	head = re_atomic_rlx(&ring->head);
+	tail = re_atomic_acq(&ring->tail);
+
+	need = rec_size(len);
+	off  = head & (ring->size - 1);
+	cont = ring->size - off;
+
+	total = need > cont ? cont + need : need;
+
+	if (len >= ring->size || need > ring->size ||
+	    total > ring->size - (head - tail)) {
+		re_atomic_rlx_add(&ring->dropped, 1);
+		return;
+	}
+
+	if (need > cont) {
+		uint32_t pad[2] = {(uint32_t)cont, REC_PAD};
+
+		memcpy(ring->buf + off, pad, sizeof(pad));
+		head += cont;
+		off = 0;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.size = (uint32_t)need;
+	hdr.len  = (uint32_t)len;
+	hdr.ts   = tmr_jiffies_usec();
+	hdr.tx   = tx;
+	hdr.tp   = tp;
+
+	if (src)
+		hdr.src = *src;
+	if (dst)
+		hdr.dst = *dst;
+
+	memcpy(ring->buf + off, &hdr, sizeof(hdr));
+	memcpy(ring->buf + off + sizeof(hdr), pkt, len);
+
+	re_atomic_rls_set(&ring->head, head + need);
+}
+
+
+/**
+ * Drain a SIP Message Trace Ring
+ *
+ * Only one thread may drain a ring. The record and its message are only
+ * valid during the handler call.
+ *
+ * @param ring SIP Message Trace Ring
+ * @param h    Record handler
+ * @param arg  Handler argument
+ *
+ * @return Number of drained records
+ */
+size_t sip_trace_ring_drain(struct sip_trace_ring *ring, sip_trace_rec_h *h,
+			    void *arg)
+{
+	size_t head, tail, n = 0;
+
+	if (!ring || !h)
+		return 0;
+
+	tail = re_atomic_rlx(&ring->tail);
+	head = re_atomic_acq(&ring->head);
+
+	while (tail != head) {
+
+		const uint8_t *p = ring->buf + (tail & (ring->size - 1));
+		struct sip_trace_rec rec;
+		struct rec_hdr hdr;
+		uint32_t pad[2];
+
+		memcpy(pad, p, sizeof(pad));
+		if (pad[1] == REC_PAD) {
+			tail += pad[0];
+			continue;
+		}
+
+		memcpy(&hdr, p, sizeof(hdr));
+
+		rec.tx  = hdr.tx;
+		rec.tp  = hdr.tp;
+		rec.src = hdr.src;
+		rec.dst = hdr.dst;
+		rec.ts  = hdr.ts + ring->wall;
+		rec.pkt = p + sizeof(hdr);
+		rec.len = hdr.len;
+
+		h(&rec, arg);
+
+		tail += hdr.size;
+		re_atomic_rls_set(&ring->tail, tail);
+		++n;
+	}
+
+	re_atomic_rls_set(&ring->tail, tail);
+
+	return n;
+}
+
+
+/**
+ * Get the number of records dropped because the ring was full
+ *
+ * @param ring SIP Message Trace Ring
+ *
+ * @return Number of dropped records
+ */
+size_t sip_trace_ring_dropped(struct sip_trace_ring *ring)
+{
+	if (!ring)
+		return 0;
+
+	return re_atomic_rlx(&ring->dropped);
+}
+
+
+/**
+ * Encode the pcap file header for sip_trace_pcap_encode()
+ *
+ * @param mb Memory buffer
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_trace_pcap_hdr(struct mbuf *mb)
+{
+	int err;
+
+	if (!mb)
+		return EINVAL;
+
+	err  = mbuf_write_u32(mb, 0xa1b2c3d4);  /* usec resolution */
+	err |= mbuf_write_u16(mb, 2);
+	err |= mbuf_write_u16(mb, 4);
+	err |= mbuf_write_u32(mb, 0);           /* thiszone        */
+	err |= mbuf_write_u32(mb, 0);           /* sigfigs         */
+	err |= mbuf_write_u32(mb, 0xffff);      /* snaplen         */
+	err |= mbuf_write_u32(mb, 101);         /* LINKTYPE_RAW    */
+
+	return err;
+}
+
+
+static uint16_t ip_csum(const uint8_t *p, size_t n)
+{
+	uint32_t sum = 0;
+	size_t i;
+
+	for (i=0; i+1<n; i+=2)
+		sum += (uint32_t)p[i] << 8 | p[i+1];
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return (uint16_t)~sum;
+}
+
+
+/**
+ * Encode a traced SIP message as a pcap record
+ *
+ * The message is framed as an IP/UDP datagram. Messages received or sent
+ * on a stream transport are written as one datagram each as well, which
+ * keeps them readable in packet analysers without TCP reassembly.
+ *
+ * @param mb  Memory buffer
+ * @param rec Traced SIP message
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_trace_pcap_encode(struct mbuf *mb, const struct sip_trace_rec *rec)
+{
+	uint8_t ip[40];
+	size_t iplen, plen;
+	int af, err;
+
+	if (!mb || !rec)
+		return EINVAL;
+
+	af = sa_af(&rec->dst);
+
+	switch (af) {
+
+	case AF_INET:
+		iplen = 20;
+		break;
+
+#ifdef HAVE_INET6
+	case AF_INET6:
+		iplen = 40;
+		break;
+#endif
+
+	default:
+		return EAFNOSUPPORT;
+	}
+
+	plen = iplen + 8 + rec->len;
+	if (plen > 0xffff)
+		return EOVERFLOW;
+
+	memset(ip, 0, sizeof(ip));
+
+	if (af == AF_INET) {
+		uint32_t a;
+
+		ip[0] = 0x45;
+		ip[2] = (uint8_t)(plen >> 8);
+		ip[3] = (uint8_t)plen;
+		ip[8] = 64;
+		ip[9] = IPPROTO_UDP;
+
+		if (sa_af(&rec->src) == AF_INET) {
+			a = htonl(sa_in(&rec->src));
+			memcpy(&ip[12], &a, 4);
+		}
+
+		a = htonl(sa_in(&rec->dst));
+		memcpy(&ip[16], &a, 4);
+
+		a = ip_csum(ip, 20);
+		ip[10] = (uint8_t)(a >> 8);
+		ip[11] = (uint8_t)a;
+	}
+#ifdef HAVE_INET6
+	else {
+		ip[0] = 0x60;
+		ip[4] = (uint8_t)((plen - iplen) >> 8);
+		ip[5] = (uint8_t)(plen - iplen);
+		ip[6] = IPPROTO_UDP;
+		ip[7] = 64;
+
+		if (sa_af(&rec->src) == AF_INET6)
+			sa_in6(&rec->src, &ip[8]);
+
+		sa_in6(&rec->dst, &ip[24]);
+	}
+#endif
+
+	err  = mbuf_write_u32(mb, (uint32_t)(rec->ts / 1000000));
+	err |= mbuf_write_u32(mb, (uint32_t)(rec->ts % 1000000));
+	err |= mbuf_write_u32(mb, (uint32_t)plen);
+	err |= mbuf_write_u32(mb, (uint32_t)plen);
+	err |= mbuf_write_mem(mb, ip, iplen);
+	err |= mbuf_write_u16(mb, htons(sa_port(&rec->src)));
+	err |= mbuf_write_u16(mb, htons(sa_port(&rec->dst)));
+	err |= mbuf_write_u16(mb, htons((uint16_t)(8 + rec->len)));
+	err |= mbuf_write_u16(mb, 0);
+	err |= mbuf_write_mem(mb, rec->pkt, rec->len);
+
+	return err;
+}
+
+
+static int hep_chunk(struct mbuf *mb, uint16_t type, const void *p,
+		     size_t len)
+{
+	int err;
+
+	err  = mbuf_write_u16(mb, 0);
+	err |= mbuf_write_u16(mb, htons(type));
+	err |= mbuf_write_u16(mb, htons((uint16_t)(6 + len)));
+	err |= mbuf_write_mem(mb, p, len);
+
+	return err;
+}
+
+
+static int hep_chunk_u8(struct mbuf *mb, uint16_t type, uint8_t v)
+{
+	return hep_chunk(mb, type, &v, sizeof(v));
+}
+
+
+static int hep_chunk_u16(struct mbuf *mb, uint16_t type, uint16_t v)
+{
+	v = htons(v);
+	return hep_chunk(mb, type, &v, sizeof(v));
+}
+
+
+static int hep_chunk_u32(struct mbuf *mb, uint16_t type, uint32_t v)
+{
+	v = htonl(v);
+	return hep_chunk(mb, type, &v, sizeof(v));
+}
+
+
+/**
+ * Encode a traced SIP message as a HEPv3 packet
+ *
+ * @param mb      Memory buffer
+ * @param rec     Traced SIP message
+ * @param capt_id Capture agent ID
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sip_trace_hep_encode(struct mbuf *mb, const struct sip_trace_rec *rec,
+			 uint32_t capt_id)
+{
+	uint8_t src[16], dst[16];
+	size_t start, end, alen;
+	uint16_t ctype;
+	int af, err;
+
+	if (!mb || !rec)
+		return EINVAL;
+
+	af = sa_af(&rec->dst);
+	memset(src, 0, sizeof(src));
+
+	switch (af) {
+
+	case AF_INET: {
+		uint32_t a;
+
+		alen  = 4;
+		ctype = 0x0003;
+
+		if (sa_af(&rec->src) == AF_INET) {
+			a = htonl(sa_in(&rec->src));
+			memcpy(src, &a, 4);
+		}
+
+		a = htonl(sa_in(&rec->dst));
+		memcpy(dst, &a, 4);
+	}
+		break;
+
+#ifdef HAVE_INET6
+	case AF_INET6:
+		alen  = 16;
+		ctype = 0x0005;
+
+		if (sa_af(&rec->src) == AF_INET6)
+			sa_in6(&rec->src, src);
+
+		sa_in6(&rec->dst, dst);
+		break;
+#endif
+
+	default:
+		return EAFNOSUPPORT;
+	}
+
+	if (rec->len > 0xffff - 128)
+		return EOVERFLOW;
+
+	start = mb->pos;
+
+	err  = mbuf_write_str(mb, "HEP3");
+	err |= mbuf_write_u16(mb, 0);
+	err |= hep_chunk_u8(mb, 0x0001, af == AF_INET ? 2 : 10);
+	err |= hep_chunk_u8(mb, 0x0002, rec->tp == SIP_TRANSP_UDP ?
+			    IPPROTO_UDP : IPPROTO_TCP);
+	err |= hep_chunk(mb, ctype, src, alen);
+	err |= hep_chunk(mb, ctype + 1, dst, alen);
+	err |= hep_chunk_u16(mb, 0x0007, sa_port(&rec->src));
+	err |= hep_chunk_u16(mb, 0x0008, sa_port(&rec->dst));
+	err |= hep_chunk_u32(mb, 0x0009, (uint32_t)(rec->ts / 1000000));
+	err |= hep_chunk_u32(mb, 0x000a, (uint32_t)(rec->ts % 1000000));
+	err |= hep_chunk_u8(mb, 0x000b, 1);   /* SIP */
+	err |= hep_chunk_u32(mb, 0x000c, capt_id);
+	err |= hep_chunk(mb, 0x000f, rec->pkt, rec->len);
+	if (err)
+		return err;
+
+	end = mb->pos;
+	mb->pos = start + 4;
+	err = mbuf_write_u16(mb, htons((uint16_t)(end - start)));
+	mb->pos = end;
+
+	return err;
+}
@@ -56,6 +56,7 @@ struct sip_transport {
 	void *sock;
 	enum sip_transp tp;
 	uint8_t tos;
+	bool shared;
 
 	struct http_cli *http_cli;
 	struct http_sock *http_sock;
@@ -105,7 +106,7 @@ static void transp_destructor(void *arg)
 {
 	struct sip_transport *transp = arg;
 
-	if (transp->tp == SIP_TRANSP_UDP)
+	if (transp->tp == SIP_TRANSP_UDP && !transp->shared)
 		udp_handler_set(transp->sock, NULL, NULL);
 
 	list_unlink(&transp->le);
@@ -309,10 +310,21 @@ static void conn_keepalive_handler(void *arg)
 		  conn_keepalive_handler, conn);
 }
 
+static int msg_decode(struct sip *sip, struct sip_msg **msgp,
+		      struct mbuf *mb)
+{
+	if (sip->lazy)
+		return sip_msg_decode_lazy(msgp, mb);
+
+	return sip_msg_decode(msgp, mb);
+}
+
+
 static bool have_essential_fields(const struct sip_msg *msg)
 {
-	if (pl_isset(&(msg->to.auri)) &&
-		pl_isset(&(msg->from.auri)) &&
+	/* a lazily decoded To or From is checked by its consumers */
+	if (sip_msg_hdr(msg, SIP_HDR_TO) &&
+		sip_msg_hdr(msg, SIP_HDR_FROM) &&
 		pl_isset(&(msg->cseq.met)) &&
 		pl_isset(&(msg->callid)) &&
 		pl_isset(&(msg->maxfwd)) &&
@@ -333,6 +345,12 @@ static void sip_recv(struct sip *sip, const struct sip_msg *msg,
 			    sip->arg);
 	}
 
+	if (sip->tring) {
+		sip_trace_ring_push(sip->tring, false, msg->tp, &msg->src,
+				    &msg->dst, msg->mb->buf + start,
+				    msg->mb->end - start);
+	}
+
 	if (msg->req) {
 		if (!have_essential_fields(msg)){
 			(void)sip_reply(sip, msg, 400, "Bad Request");
@@ -388,7 +406,17 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 	if (mb->end <= 4)
 		return;
 
-	if (!stun_msg_decode(&stun_msg, mb, &ua)) {
+	/* SIP messages start with a letter */
+	if (stun_msg_probe(mb)) {
+
+		/* keep-alive Binding Requests are answered in place */
+		err = stun_binding_reply(IPPROTO_UDP, transp->sock, src, 0,
+					 mb, transp->sip->software);
+		if (err != ENOTSUP)
+			return;
+
+		if (stun_msg_decode(&stun_msg, mb, &ua))
+			return;
 
 		if (stun_msg_method(stun_msg) == STUN_METHOD_BINDING) {
 
@@ -416,7 +444,7 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 		return;
 	}
 
-	err = sip_msg_decode(&msg, mb);
+	err = msg_decode(transp->sip, &msg, mb);
 	if (err) {
 		(void)re_fprintf(stderr, "sip: msg decode err: %m\n", err);
 		return;
@@ -501,7 +529,7 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 
 		pos = conn->mb->pos;
 
-		err = sip_msg_decode(&msg, conn->mb);
+		err = msg_decode(conn->sip, &msg, conn->mb);
 		if (err) {
 			if (err == ENODATA)
 				err = 0;
@@ -571,33 +599,40 @@ static void trace_send(struct sip *sip, enum sip_transp tp,
 	struct sa src;
 	struct sip_conn *conn;
 
-	if (sip->traceh) {
+	if (!sip->traceh && !sip->tring)
+		return;
 
-		switch (tp) {
+	switch (tp) {
 
-		case SIP_TRANSP_UDP:
+	case SIP_TRANSP_UDP:
 
-			if (udp_local_get(sock, &src))
-				sa_init(&src, sa_af(dst));
+		if (udp_local_get(sock, &src))
+			sa_init(&src, sa_af(dst));
 
-			break;
+		break;
 
-		case SIP_TRANSP_TCP:
-		case SIP_TRANSP_TLS:
-		case SIP_TRANSP_WS:
-		case SIP_TRANSP_WSS:
-			conn = sock;
-			src = conn->laddr;
-			break;
+	case SIP_TRANSP_TCP:
+	case SIP_TRANSP_TLS:
+	case SIP_TRANSP_WS:
+	case SIP_TRANSP_WSS:
+		conn = sock;
+		src = conn->laddr;
+		break;
 
-		default:
-			return;
-		}
+	default:
+		return;
+	}
 
+	if (sip->traceh) {
 		sip->traceh(true, tp, &src, dst,
 			    mbuf_buf(mb), mbuf_get_left(mb),
 			    sip->arg);
 	}
+
+	if (sip->tring) {
+		sip_trace_ring_push(sip->tring, true, tp, &src, dst,
+				    mbuf_buf(mb), mbuf_get_left(mb));
+	}
 }
 
 
@@ -661,12 +696,12 @@ static void tcp_connect_handler(const struct sa *paddr, void *arg)
 		goto out;
 	}
 
-	hash_append(transp->sip->ht_conn, sa_hash(paddr, SA_ALL),
-		    &conn->he, conn);
-
 	conn->paddr = *paddr;
 	conn->sip   = transp->sip;
 
+	hash_append(transp->sip->ht_conn, sa_hash(paddr, SA_ALL),
+		    &conn->he, conn);
+
 	err = tcp_accept(&conn->tc, transp->sock, tcp_estab_handler,
 			 tcp_recv_handler, tcp_close_handler, conn);
 	if (err)
@@ -720,7 +755,7 @@ static uint32_t get_hash_of_fromhdr(struct mbuf *mb)
 		goto out;
 
 	mbuf_set_pos(sup, 0);
-	hsup = hash_joaat(mbuf_buf(sup), mbuf_get_left(sup));
+	hsup = hash_wy(mbuf_buf(sup), mbuf_get_left(sup));
 	mbuf_set_pos(mb, 0);
 
  out:
@@ -762,9 +797,9 @@ static int conn_send(struct sip_connqent **qentp, struct sip *sip, bool secure,
 	if (!conn)
 		return ENOMEM;
 
-	hash_append(sip->ht_conn, sa_hash(dst, SA_ALL), &conn->he, conn);
 	conn->paddr = *dst;
 	conn->sip   = sip;
+	hash_append(sip->ht_conn, sa_hash(dst, SA_ALL), &conn->he, conn);
 	conn->tp    = secure ? SIP_TRANSP_TLS : SIP_TRANSP_TCP;
 
 	conncfg = sip_conncfg_find(sip, dst);
@@ -928,7 +963,7 @@ static void websock_recv_handler(const struct websock_hdr *hdr,
 
 	start = mb->pos;
 
-	err = sip_msg_decode(&msg, mb);
+	err = msg_decode(conn->sip, &msg, mb);
 	if (err) {
 		(void)re_fprintf(stderr, "sip: msg decode err: %m\n", err);
 		return;
@@ -1003,9 +1038,9 @@ static int ws_conn_send(struct sip_connqent **qentp, struct sip *sip,
 	if (!conn)
 		return ENOMEM;
 
-	hash_append(sip->ht_conn, sa_hash(dst, SA_ALL), &conn->he, conn);
 	conn->paddr = *dst;
 	conn->sip   = sip;
+	hash_append(sip->ht_conn, sa_hash(dst, SA_ALL), &conn->he, conn);
 	conn->tp    = tp;
 
 	/* TODO: how to select ports of outbound SIP/WS proxy ?
@@ -1099,12 +1134,28 @@ static int dst_set_scopeid(struct sip *sip, struct sa *dst, enum sip_transp tp)
 #endif
 
 
+static uint32_t conn_key(const struct le *le)
+{
+	const struct sip_conn *conn = le->data;
+
+	return sa_hash(&conn->paddr, SA_ALL);
+}
+
+
+static uint32_t conncfg_key(const struct le *le)
+{
+	const struct sip_conncfg *cfg = le->data;
+
+	return sa_hash(&cfg->paddr, SA_ALL);
+}
+
+
 int sip_transp_init(struct sip *sip, uint32_t sz)
 {
 	int err;
 
-	err  = hash_alloc(&sip->ht_conn, sz);
-	err |= hash_alloc(&sip->ht_conncfg, sz);
+	err  = sip_hash_alloc(&sip->ht_conn, sz, conn_key);
+	err |= sip_hash_alloc(&sip->ht_conncfg, sz, conncfg_key);
 	return err;
 }
 
@@ -1141,13 +1192,13 @@ static void http_req_handler(struct http_conn *hc, const struct http_msg *msg,
 		goto out;
 	}
 
-	hash_append(transp->sip->ht_conn, sa_hash(paddr, SA_ALL),
-		    &conn->he, conn);
-
 	conn->paddr = *paddr;
 	conn->sip   = transp->sip;
 	conn->tp    = transp->tp;
 
+	hash_append(transp->sip->ht_conn, sa_hash(paddr, SA_ALL),
+		    &conn->he, conn);
+
 	err = websock_accept(&conn->websock_conn, transp->sip->websock,
 			     hc, msg, 15000,
                              websock_recv_handler, websock_close_handler,
@@ -1255,6 +1306,61 @@ int sip_transp_add(struct sip *sip, enum sip_transp tp,
 }
 
 
+/*
+ * Add a UDP transport on a socket owned by another thread. Its receive
+ * handler stays with the owner, which hands the datagrams over with
+ * sip_transp_udp_recv(). Sending from this thread is safe as long as no
+ * UDP helpers are registered on the socket.
+ */
+int sip_transp_add_shared(struct sip *sip, struct udp_sock *us)
+{
+	struct sip_transport *transp;
+	int err;
+
+	if (!sip || !us)
+		return EINVAL;
+
+	transp = mem_zalloc(sizeof(*transp), transp_destructor);
+	if (!transp)
+		return ENOMEM;
+
+	transp->sip    = sip;
+	transp->tp     = SIP_TRANSP_UDP;
+	transp->sock   = mem_ref(us);
+	transp->shared = true;
+
+	err = udp_local_get(us, &transp->laddr);
+	if (err) {
+		mem_deref(transp);
+		return err;
+	}
+
+	list_append(&sip->transpl, &transp->le, transp);
+
+	return 0;
+}
+
+
+void sip_transp_udp_recv(struct sip *sip, const struct sa *src,
+			 struct mbuf *mb)
+{
+	struct le *le;
+
+	if (!sip || !src || !mb)
+		return;
+
+	for (le=sip->transpl.head; le; le=le->next) {
+
+		struct sip_transport *transp = le->data;
+
+		if (transp->shared) {
+			udp_recv_handler(src, mb, transp);
+			return;
+		}
+	}
+}
+
+
 /**
  * Add a SIP websocket transport
  *
@@ -1364,7 +1470,7 @@ int sip_transp_add_ccert(struct sip *sip, const struct uri *uri,
 
 	mbuf_set_pos(sup, 0);
 
-	hsup = hash_joaat(mbuf_buf(sup), mbuf_get_left(sup));
+	hsup = hash_wy(mbuf_buf(sup), mbuf_get_left(sup));
 	transp = transp_find(sip, SIP_TRANSP_TLS, AF_INET, NULL);
 	if (transp) {
 		ccert = mem_zalloc(sizeof(*ccert), NULL);
@@ -1772,7 +1878,8 @@ int sip_transp_debug(struct re_printf *pf, const struct sip *sip)
 	err = re_hprintf(pf, "transports:\n");
 	list_apply(&sip->transpl, true, debug_handler, pf);
 
-	err |= re_hprintf(pf, "connections:\n");
+	err |= re_hprintf(pf, "connections: %H\n",
+			  hash_debug, sip->ht_conn);
 	hash_apply(sip->ht_conn, conn_debug_handler, pf);
 
 	err |= re_hprintf(pf, "connection configurations:\n");
@@ -17,13 +17,13 @@ static int decode_hostport(const struct pl *hostport, struct pl *host,
 			   struct pl *port)
 {
 	/* Try IPv6 first */
-	if (!re_regex(hostport->p, hostport->l, "\\[[0-9a-f:]+\\][:]*[0-9]*",
-		      host, NULL, port))
+	if (!re_regex_cached(hostport->p, hostport->l,
+			     "\\[[0-9a-f:]+\\][:]*[0-9]*", host, NULL, port))
 		return 0;
 
 	/* Then non-IPv6 host */
-	return re_regex(hostport->p, hostport->l, "[^:]+[:]*[0-9]*",
-			host, NULL, port);
+	return re_regex_cached(hostport->p, hostport->l, "[^:]+[:]*[0-9]*",
+			       host, NULL, port);
 }
 
 
@@ -43,11 +43,12 @@ int sip_via_decode(struct sip_via *via, const struct pl *pl)
 	if (!via || !pl)
 		return EINVAL;
 
-	err = re_regex(pl->p, pl->l,
-		       "SIP[  \t\r\n]*/[ \t\r\n]*2.0[ \t\r\n]*/[ \t\r\n]*"
-		       "[A-Z]+[ \t\r\n]*[^; \t\r\n]+[ \t\r\n]*[^]*",
-		       NULL, NULL, NULL, NULL, &transp,
-		       NULL, &via->sentby, NULL, &via->params);
+	err = re_regex_cached(pl->p, pl->l,
+			      "SIP[  \t\r\n]*/[ \t\r\n]*2.0[ \t\r\n]*/"
+			      "[ \t\r\n]*[A-Z]+[ \t\r\n]*[^; \t\r\n]+"
+			      "[ \t\r\n]*[^]*",
+			      NULL, NULL, NULL, NULL, &transp,
+			      NULL, &via->sentby, NULL, &via->params);
 	if (err)
 		return err;
 
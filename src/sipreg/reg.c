@@ -33,6 +33,7 @@ struct sipreg {
 	struct sip_keepalive *ka;
 	struct sip_request *req;
 	struct sip_dialog *dlg;
+	struct sip_tmpl *tmpl;
 	struct sip_auth *auth;
 	struct mbuf *hdrs;
 	char *cuser;
@@ -87,6 +88,7 @@ static void destructor(void *arg)
 	}
 
 	mem_deref(reg->ka);
+	mem_deref(reg->tmpl);
 	mem_deref(reg->dlg);
 	mem_deref(reg->auth);
 	mem_deref(reg->cuser);
@@ -315,16 +317,9 @@ static int request(struct sipreg *reg, bool reset_ls)
 		sip_loopstate_reset(&reg->ls);
 	}
 
-	return sip_drequestf(&reg->req, reg->sip, true, "REGISTER", reg->dlg,
-			     0, reg->auth, send_handler, response_handler, reg,
-			     "%s"
-			     "%b"
-			     "Content-Length: 0\r\n"
-			     "\r\n",
-			     reg->regid > 0
-			     ? "Supported: gruu, outbound, path\r\n" : "",
-			     reg->hdrs ? mbuf_buf(reg->hdrs) : NULL,
-			     reg->hdrs ? mbuf_get_left(reg->hdrs) : (size_t)0);
+	return sip_tmpl_drequest(&reg->req, reg->tmpl, true, 0, reg->auth,
+				 NULL, NULL, send_handler, response_handler,
+				 reg);
 }
 
 
@@ -383,6 +378,14 @@ static int vsipreg_alloc(struct sipreg **regp, struct sip *sip,
 	reg->arg     = arg;
 	reg->regid   = regid;
 
+	/* only Contact and Expires change between refreshes */
+	err = sip_tmpl_alloc(&reg->tmpl, sip, reg->dlg, "REGISTER",
+			     "%s%b",
+			     regid > 0
+			     ? "Supported: gruu, outbound, path\r\n" : "",
+			     reg->hdrs ? mbuf_buf(reg->hdrs) : NULL,
+			     reg->hdrs ? mbuf_get_left(reg->hdrs) : (size_t)0);
+
  out:
 	if (err)
 		mem_deref(reg);
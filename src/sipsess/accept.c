@@ -89,7 +89,7 @@ int sipsess_accept(struct sipsess **sessp, struct sipsess_sock *sock,
 		goto out;
 
 	hash_append(sock->ht_sess,
-		    hash_joaat_str(sip_dialog_callid(sess->dlg)),
+		    hash_wy_str(sip_dialog_callid(sess->dlg)),
 		    &sess->he, sess);
 
 	sess->msg = mem_ref((void *)msg);
@@ -79,6 +79,14 @@ static void resp_handler(int err, const struct sip_msg *msg, void *arg)
 }
 
 
+uint32_t sipsess_ack_key(const struct le *le)
+{
+	const struct sipsess_ack *ack = le->data;
+
+	return hash_wy_str(sip_dialog_callid(ack->dlg));
+}
+
+
 int sipsess_ack(struct sipsess_sock *sock, struct sip_dialog *dlg,
 		uint32_t cseq, struct sip_auth *auth,
 		const char *ctype, struct mbuf *desc)
@@ -90,13 +98,13 @@ int sipsess_ack(struct sipsess_sock *sock, struct sip_dialog *dlg,
 	if (!ack)
 		return ENOMEM;
 
-	hash_append(sock->ht_ack,
-		    hash_joaat_str(sip_dialog_callid(dlg)),
-		    &ack->he, ack);
-
 	ack->dlg  = mem_ref(dlg);
 	ack->cseq = cseq;
 
+	hash_append(sock->ht_ack,
+		    hash_wy_str(sip_dialog_callid(dlg)),
+		    &ack->he, ack);
+
 	err = sip_drequestf(&ack->req, sock->sip, false, "ACK", dlg, cseq,
 			    auth, send_handler, resp_handler, ack,
 			    "%s%s%s"
@@ -140,7 +148,7 @@ int sipsess_ack_again(struct sipsess_sock *sock, const struct sip_msg *msg)
 	struct sipsess_ack *ack;
 
 	ack = list_ledata(hash_lookup(sock->ht_ack,
-				      hash_joaat_pl(&msg->callid),
+				      hash_wy_pl(&msg->callid),
 				      cmp_handler, (void *)msg));
 	if (!ack)
 		return ENOENT;
@@ -309,7 +309,7 @@ int sipsess_connect(struct sipsess **sessp, struct sipsess_sock *sock,
 		goto out;
 
 	hash_append(sock->ht_sess,
-		    hash_joaat_str(sip_dialog_callid(sess->dlg)),
+		    hash_wy_str(sip_dialog_callid(sess->dlg)),
 		    &sess->he, sess);
 
 	err = invite(sess);
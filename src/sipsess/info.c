@@ -75,16 +75,16 @@ static void info_resp_handler(int err, const struct sip_msg *msg, void *arg)
 
 static int info_request(struct sipsess_request *req)
 {
-	return sip_drequestf(&req->req, req->sess->sip, true, "INFO",
-			     req->sess->dlg, 0, req->sess->auth,
-			     NULL, info_resp_handler, req,
-			     "Content-Type: %s\r\n"
-			     "Content-Length: %zu\r\n"
-			     "\r\n"
-			     "%b",
-			     req->ctype,
-			     mbuf_get_left(req->body),
-			     mbuf_buf(req->body), mbuf_get_left(req->body));
+	struct sipsess *sess = req->sess;
+	int err;
+
+	err = sipsess_tmpl(&sess->tmpl_info, sess, "INFO");
+	if (err)
+		return err;
+
+	return sip_tmpl_drequest(&req->req, sess->tmpl_info, true, 0,
+				 sess->auth, req->ctype, req->body,
+				 NULL, info_resp_handler, req);
 }
 
 
@@ -283,7 +283,7 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 
 	if (!pl_strcmp(&msg->met, "INVITE")) {
 
-		if (pl_isset(&msg->to.tag))
+		if (pl_isset(&sip_msg_to(msg)->tag))
 			target_refresh_handler(sock, msg);
 		else
 			invite_handler(sock, msg);
@@ -312,7 +312,7 @@ static bool request_handler(const struct sip_msg *msg, void *arg)
 	}
 	else if (!pl_strcmp(&msg->met, "REFER")) {
 
-		if (!pl_isset(&msg->to.tag))
+		if (!pl_isset(&sip_msg_to(msg)->tag))
 			return false;
 
 		refer_handler(sock, msg);
@@ -339,12 +339,21 @@ static bool response_handler(const struct sip_msg *msg, void *arg)
 }
 
 
+static int ht_alloc(struct hash **htp, uint32_t sz, hash_key_h *keyh)
+{
+	if (!sz)
+		return hash_alloc_dynamic(htp, 0, keyh);
+
+	return hash_alloc(htp, sz);
+}
+
+
 /**
  * Listen to a SIP Session socket for incoming connections
  *
  * @param sockp    Pointer to allocated SIP Session socket
  * @param sip      SIP Stack instance
- * @param htsize   Hashtable size
+ * @param htsize   Hashtable size, or 0 for self-resizing hashtables
  * @param connh    Connection handler
  * @param arg      Handler argument
  *
@@ -356,7 +365,7 @@ int sipsess_listen(struct sipsess_sock **sockp, struct sip *sip,
 	struct sipsess_sock *sock;
 	int err;
 
-	if (!sockp || !sip || !htsize)
+	if (!sockp || !sip)
 		return EINVAL;
 
 	sock = mem_zalloc(sizeof(*sock), destructor);
@@ -371,15 +380,15 @@ int sipsess_listen(struct sipsess_sock **sockp, struct sip *sip,
 	if (err)
 		goto out;
 
-	err = hash_alloc(&sock->ht_sess, htsize);
+	err = ht_alloc(&sock->ht_sess, htsize, sipsess_key);
 	if (err)
 		goto out;
 
-	err = hash_alloc(&sock->ht_ack, htsize);
+	err = ht_alloc(&sock->ht_ack, htsize, sipsess_ack_key);
 	if (err)
 		goto out;
 
-	err = hash_alloc(&sock->ht_prack, htsize);
+	err = ht_alloc(&sock->ht_prack, htsize, sipsess_prack_key);
 	if (err)
 		goto out;
 
@@ -133,6 +133,8 @@ static int send_handler(enum sip_transp tp, struct sa *src,
 
 int sipsess_reinvite(struct sipsess *sess, bool reset_ls)
 {
+	int err;
+
 	if (sess->req)
 		return EPROTO;
 
@@ -142,43 +144,37 @@ int sipsess_reinvite(struct sipsess *sess, bool reset_ls)
 	if (reset_ls)
 		sip_loopstate_reset(&sess->ls);
 
-	return sip_drequestf(&sess->req, sess->sip, true, "INVITE",
-			     sess->dlg, 0, sess->auth,
-			     send_handler, target_refresh_resp_handler, sess,
-			     "%s%s%s"
-			     "Content-Length: %zu\r\n"
-			     "\r\n"
-			     "%b",
-			     sess->desc ? "Content-Type: " : "",
-			     sess->desc ? sess->ctype : "",
-			     sess->desc ? "\r\n" : "",
-			     sess->desc ? mbuf_get_left(sess->desc) :(size_t)0,
-			     sess->desc ? mbuf_buf(sess->desc) : NULL,
-			     sess->desc ? mbuf_get_left(sess->desc):(size_t)0);
+	err = sipsess_tmpl(&sess->tmpl_invite, sess, "INVITE");
+	if (err)
+		return err;
+
+	return sip_tmpl_drequest(&sess->req, sess->tmpl_invite, true, 0,
+				 sess->auth,
+				 sess->desc ? sess->ctype : NULL, sess->desc,
+				 send_handler, target_refresh_resp_handler,
+				 sess);
 }
 
 
 int sipsess_update(struct sipsess *sess, bool reset_ls)
 {
+	int err;
+
 	sess->sent_offer = sess->desc ? true : false;
 	sess->modify_pending = false;
 
 	if (reset_ls)
 		sip_loopstate_reset(&sess->ls);
 
-	return sip_drequestf(&sess->req, sess->sip, true, "UPDATE",
-			     sess->dlg, 0, sess->auth,
-			     send_handler, target_refresh_resp_handler, sess,
-			     "%s%s%s"
-			     "Content-Length: %zu\r\n"
-			     "\r\n"
-			     "%b",
-			     sess->desc ? "Content-Type: " : "",
-			     sess->desc ? sess->ctype : "",
-			     sess->desc ? "\r\n" : "",
-			     sess->desc ? mbuf_get_left(sess->desc) :(size_t)0,
-			     sess->desc ? mbuf_buf(sess->desc) : NULL,
-			     sess->desc ? mbuf_get_left(sess->desc):(size_t)0);
+	err = sipsess_tmpl(&sess->tmpl_update, sess, "UPDATE");
+	if (err)
+		return err;
+
+	return sip_tmpl_drequest(&sess->req, sess->tmpl_update, true, 0,
+				 sess->auth,
+				 sess->desc ? sess->ctype : NULL, sess->desc,
+				 send_handler, target_refresh_resp_handler,
+				 sess);
 }
 
 
@@ -88,6 +88,14 @@ out:
 }
 
 
+uint32_t sipsess_prack_key(const struct le *le)
+{
+	const struct sipsess_prack *prack = le->data;
+
+	return hash_wy_str(sip_dialog_callid(prack->dlg));
+}
+
+
 /**
  * Send PRACK message (RFC 3262)
  *
@@ -111,14 +119,14 @@ int sipsess_prack(struct sipsess *sess, uint32_t cseq, uint32_t rseq,
 	if (!prack)
 		return ENOMEM;
 
-	hash_append(sess->sock->ht_prack,
-		    hash_joaat_str(sip_dialog_callid(sess->dlg)),
-		    &prack->he, prack);
-
 	prack->dlg  = mem_ref(sess->dlg);
 	prack->sock  = mem_ref(sess->sock);
 	prack->cseq = cseq;
 
+	hash_append(sess->sock->ht_prack,
+		    hash_wy_str(sip_dialog_callid(sess->dlg)),
+		    &prack->he, prack);
+
 	(void)pl_strcpy(met, method, sizeof(method));
 	re_snprintf(rack_header, sizeof(rack_header), "%d %d %s", rseq, cseq,
 		    method);
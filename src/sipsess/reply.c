@@ -258,9 +258,11 @@ static bool cmp_handler(struct le *le, void *arg)
 	const struct sip_msg *msg = arg;
 
 	if (!pl_strcmp(&msg->met, "PRACK")) {
-		return msg->rack.cseq == reply->seq &&
-				msg->rack.rel_seq == reply->rel_seq &&
-				!pl_cmp(&msg->rack.met, &reply->msg->met);
+		const struct sip_rack *rack = sip_msg_rack(msg);
+
+		return rack->cseq == reply->seq &&
+				rack->rel_seq == reply->rel_seq &&
+				!pl_cmp(&rack->met, &reply->msg->met);
 	}
 
 	return msg->cseq.num == reply->seq;
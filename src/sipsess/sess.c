@@ -142,6 +142,9 @@ static void destructor(void *arg)
 	list_flush(&sess->requestl);
 	mem_deref((void *)sess->msg);
 	mem_deref(sess->req);
+	mem_deref(sess->tmpl_invite);
+	mem_deref(sess->tmpl_update);
+	mem_deref(sess->tmpl_info);
 	mem_deref(sess->dlg);
 	mem_deref(sess->auth);
 	mem_deref(sess->cuser);
@@ -155,6 +158,28 @@ static void destructor(void *arg)
 }
 
 
+/*
+ * In-dialog requests which are sent repeatedly are built from a request
+ * template, allocated on first use. The dialog of a session never changes.
+ */
+int sipsess_tmpl(struct sip_tmpl **tmplp, struct sipsess *sess,
+		 const char *met)
+{
+	if (*tmplp)
+		return 0;
+
+	return sip_tmpl_alloc(tmplp, sess->sip, sess->dlg, met, NULL);
+}
+
+
+uint32_t sipsess_key(const struct le *le)
+{
+	const struct sipsess *sess = le->data;
+
+	return hash_wy_str(sip_dialog_callid(sess->dlg));
+}
+
+
 int sipsess_alloc(struct sipsess **sessp, struct sipsess_sock *sock,
 		  const char *cuser, const char *ctype, struct mbuf *desc,
 		  sip_auth_h *authh, void *aarg, bool aref,
@@ -242,7 +267,7 @@ struct sipsess *sipsess_find(struct sipsess_sock *sock,
 			     const struct sip_msg *msg)
 {
 	return list_ledata(hash_lookup(sock->ht_sess,
-				       hash_joaat_pl(&msg->callid),
+				       hash_wy_pl(&msg->callid),
 				       cmp_handler, (void *)msg));
 }
 
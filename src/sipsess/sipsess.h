@@ -15,6 +15,9 @@ struct sipsess {
 	const struct sip_msg *msg;
 	struct sip_request *req;
 	struct sip_dialog *dlg;
+	struct sip_tmpl *tmpl_invite;
+	struct sip_tmpl *tmpl_update;
+	struct sip_tmpl *tmpl_info;
 	struct sip_strans *st;
 	struct sip_auth *auth;
 	struct sip *sip;
@@ -79,6 +82,9 @@ int  sipsess_alloc(struct sipsess **sessp, struct sipsess_sock *sock,
 		   sipsess_close_h *closeh, void *arg);
 void sipsess_terminate(struct sipsess *sess, int err,
 		       const struct sip_msg *msg);
+uint32_t sipsess_key(const struct le *le);
+uint32_t sipsess_ack_key(const struct le *le);
+uint32_t sipsess_prack_key(const struct le *le);
 int  sipsess_ack(struct sipsess_sock *sock, struct sip_dialog *dlg,
 		 uint32_t cseq, struct sip_auth *auth,
 		 const char *ctype, struct mbuf *desc);
@@ -97,6 +103,8 @@ int  sipsess_reply_ack(struct sipsess *sess, const struct sip_msg *msg,
 int  sipsess_reinvite(struct sipsess *sess, bool reset_ls);
 int  sipsess_update(struct sipsess *sess, bool reset_ls);
 int  sipsess_bye(struct sipsess *sess, bool reset_ls);
+int  sipsess_tmpl(struct sip_tmpl **tmplp, struct sipsess *sess,
+		  const char *met);
 int  sipsess_request_alloc(struct sipsess_request **reqp, struct sipsess *sess,
 			   const char *ctype, struct mbuf *body,
 			   sip_resp_h *resph, void *arg);
@@ -41,16 +41,18 @@ uint64_t srtp_get_index(uint32_t roc, uint16_t s_l, uint16_t seq)
 }
 
 
+/*
+ * The AES context must be keyed with the master key in Counter Mode,
+ * so that one key schedule serves all labels of a master key.
+ */
 int srtp_derive(uint8_t *out, size_t out_len, uint8_t label,
-		const uint8_t *master_key, size_t key_bytes,
+		struct aes *aes,
 		const uint8_t *master_salt, size_t salt_bytes)
 {
 	uint8_t x[AES_BLOCK_SIZE] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
 	static const uint8_t null[AES_BLOCK_SIZE * 2];
-	struct aes *aes;
-	int err;
 
-	if (!out || !master_key || !master_salt)
+	if (!out || !aes || !master_salt)
 		return EINVAL;
 
 	if (out_len > sizeof(null) || salt_bytes > sizeof(x))
@@ -59,17 +61,9 @@ int srtp_derive(uint8_t *out, size_t out_len, uint8_t label,
 	memcpy(x, master_salt, salt_bytes);
 	x[7] ^= label;
 
-	/* NOTE: Counter Mode is used for both CTR and GCM */
-	err = aes_alloc(&aes, AES_MODE_CTR, master_key, key_bytes*8, x);
-	if (err)
-		return err;
-
-	err = aes_encr(aes, out, null, out_len);
-
-	mem_deref(aes);
-
-	return err;
+	aes_set_iv(aes, x);
 
+	return aes_encr(aes, out, null, out_len);
 }
 
 
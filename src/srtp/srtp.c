@@ -31,7 +31,7 @@ static inline int seq_diff(uint16_t x, uint16_t y)
 
 
 static int comp_init(struct comp *c, unsigned offs,
-		     const uint8_t *key, size_t key_b,
+		     struct aes *kdf, size_t key_b,
 		     const uint8_t *s, size_t s_b,
 		     size_t tag_len, bool encrypted, bool hash,
 		     enum aes_mode mode)
@@ -48,24 +48,31 @@ static int comp_init(struct comp *c, unsigned offs,
 	c->tag_len = tag_len;
 	c->mode = mode;
 
-	err |= srtp_derive(k_e, key_b,       0x00+offs, key, key_b, s, s_b);
-	err |= srtp_derive(k_a, sizeof(k_a), 0x01+offs, key, key_b, s, s_b);
-	err |= srtp_derive(c->k_s.u8, 14,    0x02+offs, key, key_b, s, s_b);
+	/* only derive the session keys that are actually used */
+	if (encrypted)
+		err |= srtp_derive(k_e, key_b, 0x00+offs, kdf, s, s_b);
+	if (hash)
+		err |= srtp_derive(k_a, sizeof(k_a), 0x01+offs, kdf, s, s_b);
+	err |= srtp_derive(c->k_s.u8, 14, 0x02+offs, kdf, s, s_b);
 	if (err)
-		return err;
+		goto out;
 
 	if (encrypted) {
 		err = aes_alloc(&c->aes, mode, k_e, key_b*8, NULL);
 		if (err)
-			return err;
+			goto out;
 	}
 
 	if (hash) {
 		err = hmac_create(&c->hmac, HMAC_HASH_SHA1, k_a, sizeof(k_a));
 		if (err)
-			return err;
+			goto out;
 	}
 
+ out:
+	memset(k_e, 0, sizeof(k_e));
+	memset(k_a, 0, sizeof(k_a));
+
 	return err;
 }
 
@@ -83,17 +90,35 @@ static void destructor(void *arg)
 }
 
 
-int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
-	       const uint8_t *key, size_t key_bytes, int flags)
+/**
+ * Allocate an SRTP session from a master key and a master salt
+ *
+ * Both the RTP and RTCP session keys are derived here, once. The key
+ * and salt need not be adjacent, so keying material exported from a
+ * DTLS-SRTP handshake can be used as is.
+ *
+ * @param srtpp      Pointer to allocated SRTP session
+ * @param suite      SRTP crypto suite
+ * @param key        Master key
+ * @param key_bytes  Number of bytes in master key
+ * @param salt       Master salt
+ * @param salt_bytes Number of bytes in master salt
+ * @param flags      SRTP flags (enum srtp_flags)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int srtp_alloc_keysalt(struct srtp **srtpp, enum srtp_suite suite,
+		       const uint8_t *key, size_t key_bytes,
+		       const uint8_t *salt, size_t salt_bytes, int flags)
 {
 	struct srtp *srtp;
-	const uint8_t *master_salt;
-	size_t cipher_bytes, salt_bytes, auth_bytes;
+	struct aes *kdf = NULL;
+	size_t cipher_bytes, sbytes, auth_bytes;
 	enum aes_mode mode;
 	bool hash;
 	int err = 0;
 
-	if (!srtpp || !key)
+	if (!srtpp || !key || !salt)
 		return EINVAL;
 
 	switch (suite) {
@@ -101,7 +126,7 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	case SRTP_AES_CM_128_HMAC_SHA1_80:
 		mode         = AES_MODE_CTR;
 		cipher_bytes = 16;
-		salt_bytes   = 14;
+		sbytes       = 14;
 		auth_bytes   = 10;
 		hash         = true;
 		break;
@@ -109,7 +134,7 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	case SRTP_AES_CM_128_HMAC_SHA1_32:
 		mode         = AES_MODE_CTR;
 		cipher_bytes = 16;
-		salt_bytes   = 14;
+		sbytes       = 14;
 		auth_bytes   =  4;
 		hash         = true;
 		break;
@@ -117,7 +142,7 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	case SRTP_AES_256_CM_HMAC_SHA1_80:
 		mode         = AES_MODE_CTR;
 		cipher_bytes = 32;
-		salt_bytes   = 14;
+		sbytes       = 14;
 		auth_bytes   = 10;
 		hash         = true;
 		break;
@@ -125,7 +150,7 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	case SRTP_AES_256_CM_HMAC_SHA1_32:
 		mode         = AES_MODE_CTR;
 		cipher_bytes = 32;
-		salt_bytes   = 14;
+		sbytes       = 14;
 		auth_bytes   =  4;
 		hash         = true;
 		break;
@@ -133,7 +158,7 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	case SRTP_AES_128_GCM:
 		mode         = AES_MODE_GCM;
 		cipher_bytes = 16;
-		salt_bytes   = 12;
+		sbytes       = 12;
 		auth_bytes   = 0;
 		hash         = false;
 		break;
@@ -141,7 +166,7 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 	case SRTP_AES_256_GCM:
 		mode         = AES_MODE_GCM;
 		cipher_bytes = 32;
-		salt_bytes   = 12;
+		sbytes       = 12;
 		auth_bytes   = 0;
 		hash         = false;
 		break;
@@ -150,25 +175,30 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 		return ENOTSUP;
 	};
 
-	if ((cipher_bytes + salt_bytes) != key_bytes)
+	if (cipher_bytes != key_bytes || sbytes != salt_bytes)
 		return EINVAL;
 
-	master_salt = &key[cipher_bytes];
-
 	srtp = mem_zalloc(sizeof(*srtp), destructor);
 	if (!srtp)
 		return ENOMEM;
 
-	err |= comp_init(&srtp->rtp,  0, key, cipher_bytes,
-			 master_salt, salt_bytes, auth_bytes,
+	/* NOTE: Counter Mode is used for both CTR and GCM */
+	err = aes_alloc(&kdf, AES_MODE_CTR, key, cipher_bytes*8, NULL);
+	if (err)
+		goto out;
+
+	err |= comp_init(&srtp->rtp,  0, kdf, cipher_bytes,
+			 salt, salt_bytes, auth_bytes,
 			 true, hash, mode);
-	err |= comp_init(&srtp->rtcp, 3, key, cipher_bytes,
-			 master_salt, salt_bytes, auth_bytes,
+	err |= comp_init(&srtp->rtcp, 3, kdf, cipher_bytes,
+			 salt, salt_bytes, auth_bytes,
 			 !(flags & SRTP_UNENCRYPTED_SRTCP), hash, mode);
 	if (err)
 		goto out;
 
  out:
+	mem_deref(kdf);
+
 	if (err)
 		mem_deref(srtp);
 	else
@@ -178,6 +208,41 @@ int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
 }
 
 
+int srtp_alloc(struct srtp **srtpp, enum srtp_suite suite,
+	       const uint8_t *key, size_t key_bytes, int flags)
+{
+	size_t cipher_bytes;
+
+	if (!srtpp || !key)
+		return EINVAL;
+
+	switch (suite) {
+
+	case SRTP_AES_CM_128_HMAC_SHA1_80:
+	case SRTP_AES_CM_128_HMAC_SHA1_32:
+	case SRTP_AES_128_GCM:
+		cipher_bytes = 16;
+		break;
+
+	case SRTP_AES_256_CM_HMAC_SHA1_80:
+	case SRTP_AES_256_CM_HMAC_SHA1_32:
+	case SRTP_AES_256_GCM:
+		cipher_bytes = 32;
+		break;
+
+	default:
+		return ENOTSUP;
+	}
+
+	if (key_bytes <= cipher_bytes)
+		return EINVAL;
+
+	return srtp_alloc_keysalt(srtpp, suite, key, cipher_bytes,
+				  &key[cipher_bytes], key_bytes - cipher_bytes,
+				  flags);
+}
+
+
 int srtp_encrypt(struct srtp *srtp, struct mbuf *mb)
 {
 	struct srtp_stream *strm;
@@ -57,7 +57,7 @@ int stream_get_seq(struct srtp_stream **strmp, struct srtp *srtp,
 
 
 int  srtp_derive(uint8_t *out, size_t out_len, uint8_t label,
-		 const uint8_t *master_key, size_t key_bytes,
+		 struct aes *aes,
 		 const uint8_t *master_salt, size_t salt_bytes);
 void srtp_iv_calc(union vect128 *iv, const union vect128 *k_s,
 		  uint32_t ssrc, uint64_t ix);
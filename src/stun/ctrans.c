@@ -28,6 +28,7 @@ struct stun_ctrans {
 	struct stun_ctrans **ctp;
 	uint8_t *key;
 	size_t keylen;
+	struct hmac *hmac;
 	void *sock;
 	struct mbuf *mb;
 	size_t pos;
@@ -72,6 +73,7 @@ static void destructor(void *arg)
 	list_unlink(&ct->le);
 	tmr_cancel(&ct->tmr);
 	mem_deref(ct->key);
+	mem_deref(ct->hmac);
 	mem_deref(ct->sock);
 	mem_deref(ct->mb);
 }
@@ -200,10 +202,11 @@ int stun_ctrans_recv(struct stun *stun, const struct stun_msg *msg,
 			break;
 
 		default:
-			if (!ct->key)
-				break;
-
-			err = stun_msg_chk_mi(msg, ct->key, ct->keylen);
+			if (ct->hmac)
+				err = stun_msg_chk_mi_hmac(msg, ct->hmac);
+			else if (ct->key)
+				err = stun_msg_chk_mi(msg, ct->key,
+						      ct->keylen);
 			break;
 		}
 
@@ -227,7 +230,8 @@ int stun_ctrans_recv(struct stun *stun, const struct stun_msg *msg,
 int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 			void *sock, const struct sa *dst, struct mbuf *mb,
 			const uint8_t tid[], uint16_t met, const uint8_t *key,
-			size_t keylen, stun_resp_h *resph, void *arg)
+			size_t keylen, struct hmac *hmac, stun_resp_h *resph,
+			void *arg)
 {
 	struct stun_ctrans *ct;
 	int err = 0;
@@ -247,8 +251,9 @@ int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 	ct->pos   = mb->pos;
 	ct->stun  = stun;
 	ct->met   = met;
+	ct->hmac  = mem_ref(hmac);
 
-	if (key) {
+	if (key && !hmac) {
 		ct->key = mem_alloc(keylen, NULL);
 		if (!ct->key) {
 			err = ENOMEM;
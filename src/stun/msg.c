@@ -56,6 +56,19 @@ static uint32_t fingerprint(const uint8_t *buf, size_t len)
 }
 
 
+static int mi_calc(uint8_t *mi, struct hmac *hmac,
+		   const uint8_t *key, size_t keylen,
+		   const uint8_t *buf, size_t len)
+{
+	if (hmac)
+		return hmac_digest(hmac, mi, SHA_DIGEST_LENGTH, buf, len);
+
+	hmac_sha1(key, keylen, buf, len, mi, SHA_DIGEST_LENGTH);
+
+	return 0;
+}
+
+
 static void destructor(void *arg)
 {
 	struct stun_msg *msg = arg;
@@ -133,6 +146,35 @@ int stun_msg_decode(struct stun_msg **msgpp, struct mbuf *mb,
 }
 
 
+/**
+ * Check if a packet may be a STUN message, without decoding it
+ *
+ * STUN messages are told apart from other protocols on the same port by
+ * the first byte (RFC 7983), and by a length which fits the packet.
+ *
+ * @param mb Buffer containing the packet
+ *
+ * @return True if the packet may be a STUN message, otherwise false
+ */
+bool stun_msg_probe(const struct mbuf *mb)
+{
+	const uint8_t *p;
+	size_t len;
+
+	if (!mb || mbuf_get_left(mb) < STUN_HEADER_SIZE)
+		return false;
+
+	p = mbuf_buf(mb);
+
+	if (p[0] > 3)
+		return false;
+
+	len = (size_t)p[2] << 8 | p[3];
+
+	return !(len & 0x3) && STUN_HEADER_SIZE + len <= mbuf_get_left(mb);
+}
+
+
 /**
  * Get the STUN message type
  *
@@ -250,28 +292,10 @@ struct stun_attr *stun_msg_attr_apply(const struct stun_msg *msg,
 }
 
 
-/**
- * Encode a STUN message
- *
- * @param mb      Buffer to encode message into
- * @param method  STUN Method
- * @param class   STUN Method class
- * @param tid     Transaction ID
- * @param ec      STUN error code (optional)
- * @param key     Authentication key (optional)
- * @param keylen  Number of bytes in authentication key
- * @param fp      Use STUN Fingerprint attribute
- * @param padding Padding byte
- * @param attrc   Number of attributes to encode (variable arguments)
- * @param ap      Variable list of attribute-tuples
- *                Each attribute has 2 arguments, attribute type and value
- *
- * @return 0 if success, otherwise errorcode
- */
-int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
-		     const uint8_t *tid, const struct stun_errcode *ec,
-		     const uint8_t *key, size_t keylen, bool fp,
-		     uint8_t padding, uint32_t attrc, va_list ap)
+static int msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
+		       const uint8_t *tid, const struct stun_errcode *ec,
+		       struct hmac *hmac, const uint8_t *key, size_t keylen,
+		       bool fp, uint8_t padding, uint32_t attrc, va_list ap)
 {
 	struct stun_hdr hdr;
 	size_t start, len;
@@ -303,19 +327,23 @@ int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
 		err |= stun_attr_encode(mb, type, v, hdr.tid, padding);
 	}
 
+	if (hmac)
+		key = NULL;
+
 	/* header */
-	len = mb->pos - start - STUN_HEADER_SIZE + (key ? MI_SIZE : 0);
+	len = mb->pos - start - STUN_HEADER_SIZE +
+		(key || hmac ? MI_SIZE : 0);
 	hdr.len = (uint16_t)len;
 	mb->pos = start;
 	err |= stun_hdr_encode(mb, &hdr);
-	mb->pos += hdr.len - (key ? MI_SIZE : 0);
+	mb->pos += hdr.len - (key || hmac ? MI_SIZE : 0);
 
-	if (key) {
+	if (key || hmac) {
 		uint8_t mi[20];
 
 		mb->pos = start;
-		hmac_sha1(key, keylen, mbuf_buf(mb), mbuf_get_left(mb),
-			  mi, sizeof(mi));
+		err |= mi_calc(mi, hmac, key, keylen, mbuf_buf(mb),
+			       mbuf_get_left(mb));
 
 		mb->pos += STUN_HEADER_SIZE + hdr.len - MI_SIZE;
 		err |= stun_attr_encode(mb, STUN_ATTR_MSG_INTEGRITY, mi,
@@ -343,6 +371,62 @@ int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
 }
 
 
+/**
+ * Encode a STUN message
+ *
+ * @param mb      Buffer to encode message into
+ * @param method  STUN Method
+ * @param class   STUN Method class
+ * @param tid     Transaction ID
+ * @param ec      STUN error code (optional)
+ * @param key     Authentication key (optional)
+ * @param keylen  Number of bytes in authentication key
+ * @param fp      Use STUN Fingerprint attribute
+ * @param padding Padding byte
+ * @param attrc   Number of attributes to encode (variable arguments)
+ * @param ap      Variable list of attribute-tuples
+ *                Each attribute has 2 arguments, attribute type and value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stun_msg_vencode(struct mbuf *mb, uint16_t method, uint8_t class,
+		     const uint8_t *tid, const struct stun_errcode *ec,
+		     const uint8_t *key, size_t keylen, bool fp,
+		     uint8_t padding, uint32_t attrc, va_list ap)
+{
+	return msg_vencode(mb, method, class, tid, ec, NULL, key, keylen,
+			   fp, padding, attrc, ap);
+}
+
+
+/**
+ * Encode a STUN message using a precomputed MESSAGE-INTEGRITY key
+ *
+ * @param mb      Buffer to encode message into
+ * @param method  STUN Method
+ * @param class   STUN Method class
+ * @param tid     Transaction ID
+ * @param ec      STUN error code (optional)
+ * @param hmac    HMAC-SHA1 context keyed with the authentication key
+ *                (optional)
+ * @param fp      Use STUN Fingerprint attribute
+ * @param padding Padding byte
+ * @param attrc   Number of attributes to encode (variable arguments)
+ * @param ap      Variable list of attribute-tuples
+ *                Each attribute has 2 arguments, attribute type and value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stun_msg_vencode_hmac(struct mbuf *mb, uint16_t method, uint8_t class,
+			  const uint8_t *tid, const struct stun_errcode *ec,
+			  struct hmac *hmac, bool fp, uint8_t padding,
+			  uint32_t attrc, va_list ap)
+{
+	return msg_vencode(mb, method, class, tid, ec, hmac, NULL, 0,
+			   fp, padding, attrc, ap);
+}
+
+
 /**
  * Encode a STUN message
  *
@@ -378,23 +462,12 @@ int stun_msg_encode(struct mbuf *mb, uint16_t method, uint8_t class,
 }
 
 
-/**
- * Verify the Message-Integrity of a STUN message
- *
- * @param msg    STUN Message
- * @param key    Authentication key
- * @param keylen Number of bytes in authentication key
- *
- * @return 0 if verified, otherwise errorcode
- */
-int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
-		    size_t keylen)
+static int chk_mi(const struct stun_msg *msg, struct hmac *hmac,
+		  const uint8_t *key, size_t keylen)
 {
-	uint8_t hmac[SHA_DIGEST_LENGTH] = {0};
+	uint8_t md[SHA_DIGEST_LENGTH] = {0};
 	struct stun_attr *mi, *fp;
-
-	if (!msg)
-		return EINVAL;
+	int err;
 
 	mi = stun_msg_attr(msg, STUN_ATTR_MSG_INTEGRITY);
 	if (!mi)
@@ -409,9 +482,8 @@ int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		msg->mb->pos -= STUN_HEADER_SIZE;
 	}
 
-	hmac_sha1(key, keylen, mbuf_buf(msg->mb),
-		  STUN_HEADER_SIZE + msg->hdr.len - MI_SIZE,
-		  hmac, sizeof(hmac));
+	err = mi_calc(md, hmac, key, keylen, mbuf_buf(msg->mb),
+		      STUN_HEADER_SIZE + msg->hdr.len - MI_SIZE);
 
 	if (fp) {
 		((struct stun_msg *)msg)->hdr.len += FP_SIZE;
@@ -419,13 +491,53 @@ int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
 		msg->mb->pos -= STUN_HEADER_SIZE;
 	}
 
-	if (memcmp(mi->v.msg_integrity, hmac, SHA_DIGEST_LENGTH))
+	if (err)
+		return err;
+
+	if (memcmp(mi->v.msg_integrity, md, SHA_DIGEST_LENGTH))
 		return EBADMSG;
 
 	return 0;
 }
 
 
+/**
+ * Verify the Message-Integrity of a STUN message
+ *
+ * @param msg    STUN Message
+ * @param key    Authentication key
+ * @param keylen Number of bytes in authentication key
+ *
+ * @return 0 if verified, otherwise errorcode
+ */
+int stun_msg_chk_mi(const struct stun_msg *msg, const uint8_t *key,
+		    size_t keylen)
+{
+	if (!msg)
+		return EINVAL;
+
+	return chk_mi(msg, NULL, key, keylen);
+}
+
+
+/**
+ * Verify the Message-Integrity of a STUN message using a precomputed
+ * key, avoiding the HMAC key schedule for every message
+ *
+ * @param msg  STUN Message
+ * @param hmac HMAC-SHA1 context keyed with the authentication key
+ *
+ * @return 0 if verified, otherwise errorcode
+ */
+int stun_msg_chk_mi_hmac(const struct stun_msg *msg, struct hmac *hmac)
+{
+	if (!msg || !hmac)
+		return EINVAL;
+
+	return chk_mi(msg, hmac, NULL, 0);
+}
+
+
 /**
  * Check the Fingerprint of a STUN message
  *
@@ -3,15 +3,58 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_sa.h>
 #include <re_list.h>
+#include <re_crc32.h>
 #include <re_stun.h>
 #include "stun.h"
 
 
+enum {
+	BINDING_REQ   = 0x0001,
+	BINDING_BUFSZ = 256,
+};
+
+
+static int vreply(int proto, void *sock, const struct sa *dst, size_t presz,
+		  const struct stun_msg *req, const struct stun_errcode *ec,
+		  const uint8_t *key, size_t keylen, struct hmac *hmac,
+		  bool fp, uint32_t attrc, va_list ap)
+{
+	uint8_t class = ec ? STUN_CLASS_ERROR_RESP : STUN_CLASS_SUCCESS_RESP;
+	struct mbuf *mb = NULL;
+	int err = ENOMEM;
+
+	mb = mbuf_alloc(256);
+	if (!mb)
+		goto out;
+
+	mb->pos = presz;
+	if (hmac)
+		err = stun_msg_vencode_hmac(mb, stun_msg_method(req), class,
+					    stun_msg_tid(req), ec, hmac,
+					    fp, 0x00, attrc, ap);
+	else
+		err = stun_msg_vencode(mb, stun_msg_method(req), class,
+				       stun_msg_tid(req), ec, key, keylen,
+				       fp, 0x00, attrc, ap);
+	if (err)
+		goto out;
+
+	mb->pos = presz;
+	err = stun_send(proto, sock, dst, mb);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
 /**
  * Send a STUN response message
  *
@@ -33,31 +76,53 @@ int stun_reply(int proto, void *sock, const struct sa *dst, size_t presz,
 	       const struct stun_msg *req, const uint8_t *key,
 	       size_t keylen, bool fp, uint32_t attrc, ...)
 {
-	struct mbuf *mb = NULL;
-	int err = ENOMEM;
 	va_list ap;
+	int err;
 
 	if (!sock || !req)
 		return EINVAL;
 
-	mb = mbuf_alloc(256);
-	if (!mb)
-		goto out;
-
 	va_start(ap, attrc);
-	mb->pos = presz;
-	err = stun_msg_vencode(mb, stun_msg_method(req),
-			       STUN_CLASS_SUCCESS_RESP, stun_msg_tid(req),
-			       NULL, key, keylen, fp, 0x00, attrc, ap);
+	err = vreply(proto, sock, dst, presz, req, NULL, key, keylen, NULL,
+		     fp, attrc, ap);
 	va_end(ap);
-	if (err)
-		goto out;
 
-	mb->pos = presz;
-	err = stun_send(proto, sock, dst, mb);
+	return err;
+}
 
- out:
-	mem_deref(mb);
+
+/**
+ * Send a STUN response message, with the MESSAGE-INTEGRITY key
+ * precomputed in a HMAC-SHA1 context
+ *
+ * @param proto   Transport Protocol
+ * @param sock    Socket; UDP (struct udp_sock) or TCP (struct tcp_conn)
+ * @param dst     Destination network address
+ * @param presz   Number of bytes in preamble, if sending over TURN
+ * @param req     Matching STUN request
+ * @param hmac    HMAC-SHA1 context keyed with the authentication key
+ *                (optional)
+ * @param fp      Use STUN Fingerprint attribute
+ * @param attrc   Number of attributes to encode (variable arguments)
+ * @param ...     Variable list of attribute-tuples
+ *                Each attribute has 2 arguments, attribute type and value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stun_reply_hmac(int proto, void *sock, const struct sa *dst, size_t presz,
+		    const struct stun_msg *req, struct hmac *hmac, bool fp,
+		    uint32_t attrc, ...)
+{
+	va_list ap;
+	int err;
+
+	if (!sock || !req)
+		return EINVAL;
+
+	va_start(ap, attrc);
+	err = vreply(proto, sock, dst, presz, req, NULL, NULL, 0, hmac,
+		     fp, attrc, ap);
+	va_end(ap);
 
 	return err;
 }
@@ -88,34 +153,185 @@ int stun_ereply(int proto, void *sock, const struct sa *dst, size_t presz,
 		bool fp, uint32_t attrc, ...)
 {
 	struct stun_errcode ec;
-	struct mbuf *mb = NULL;
-	int err = ENOMEM;
 	va_list ap;
+	int err;
 
 	if (!sock || !req || !scode || !reason)
 		return EINVAL;
 
-	mb = mbuf_alloc(256);
-	if (!mb)
-		goto out;
-
 	ec.code = scode;
 	ec.reason = (char *)reason;
 
 	va_start(ap, attrc);
-	mb->pos = presz;
-	err = stun_msg_vencode(mb, stun_msg_method(req), STUN_CLASS_ERROR_RESP,
-			       stun_msg_tid(req), &ec, key, keylen,
-			       fp, 0x00, attrc, ap);
+	err = vreply(proto, sock, dst, presz, req, &ec, key, keylen, NULL,
+		     fp, attrc, ap);
 	va_end(ap);
-	if (err)
-		goto out;
 
-	mb->pos = presz;
-	err = stun_send(proto, sock, dst, mb);
+	return err;
+}
 
- out:
-	mem_deref(mb);
+
+/**
+ * Send a STUN error response, with the MESSAGE-INTEGRITY key
+ * precomputed in a HMAC-SHA1 context
+ *
+ * @param proto   Transport Protocol
+ * @param sock    Socket; UDP (struct udp_sock) or TCP (struct tcp_conn)
+ * @param dst     Destination network address
+ * @param presz   Number of bytes in preamble, if sending over TURN
+ * @param req     Matching STUN request
+ * @param scode   Status code
+ * @param reason  Reason string
+ * @param hmac    HMAC-SHA1 context keyed with the authentication key
+ *                (optional)
+ * @param fp      Use STUN Fingerprint attribute
+ * @param attrc   Number of attributes to encode (variable arguments)
+ * @param ...     Variable list of attribute-tuples
+ *                Each attribute has 2 arguments, attribute type and value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stun_ereply_hmac(int proto, void *sock, const struct sa *dst,
+		     size_t presz, const struct stun_msg *req, uint16_t scode,
+		     const char *reason, struct hmac *hmac, bool fp,
+		     uint32_t attrc, ...)
+{
+	struct stun_errcode ec;
+	va_list ap;
+	int err;
+
+	if (!sock || !req || !scode || !reason)
+		return EINVAL;
+
+	ec.code = scode;
+	ec.reason = (char *)reason;
+
+	va_start(ap, attrc);
+	err = vreply(proto, sock, dst, presz, req, &ec, NULL, 0, hmac,
+		     fp, attrc, ap);
+	va_end(ap);
 
 	return err;
 }
+
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+		(uint32_t)p[2] << 8 | p[3];
+}
+
+
+/**
+ * Reply to a STUN Binding Request without decoding it
+ *
+ * The request is checked in place and the response is encoded into a
+ * buffer on the stack, which serves the keep-alives and NAT discovery
+ * requests of clients without credentials. A request which has a
+ * MESSAGE-INTEGRITY, or any other comprehension-required attribute, is
+ * left to stun_msg_decode() and the regular reply functions.
+ *
+ * @param proto    Transport Protocol
+ * @param sock     Socket; UDP (struct udp_sock) or TCP (struct tcp_conn)
+ * @param dst      Destination network address
+ * @param presz    Number of bytes in preamble, if sending over TURN
+ * @param req      Buffer with the raw STUN request
+ * @param software SOFTWARE attribute of the response (optional)
+ *
+ * @return 0 if replied, ENOTSUP if the request needs to be decoded,
+ *         otherwise errorcode
+ */
+int stun_binding_reply(int proto, void *sock, const struct sa *dst,
+		       size_t presz, const struct mbuf *req,
+		       const char *software)
+{
+	uint8_t buf[BINDING_BUFSZ];
+	const uint8_t *p;
+	size_t len, pos;
+	struct mbuf mb;
+	bool fp = false;
+	int err;
+
+	if (!sock || !dst || !req)
+		return EINVAL;
+
+	p = mbuf_buf(req);
+
+	if (mbuf_get_left(req) < STUN_HEADER_SIZE)
+		return EBADMSG;
+
+	if (get_u16(p) != BINDING_REQ)
+		return ENOTSUP;
+
+	len = get_u16(p + 2);
+	if (len & 0x3 || STUN_HEADER_SIZE + len > mbuf_get_left(req))
+		return EBADMSG;
+
+	/* RFC 3489 clients */
+	if (get_u32(p + 4) != STUN_MAGIC_COOKIE)
+		return ENOTSUP;
+
+	len += STUN_HEADER_SIZE;
+
+	for (pos = STUN_HEADER_SIZE; pos < len;) {
+
+		uint16_t type, alen;
+
+		/* FINGERPRINT must be the last attribute */
+		if (fp || pos + 4 > len)
+			return EBADMSG;
+
+		type = get_u16(p + pos);
+		alen = get_u16(p + pos + 2);
+
+		if (pos + 4 + alen > len)
+			return EBADMSG;
+
+		if (type == STUN_ATTR_FINGERPRINT) {
+
+			uint32_t crc;
+
+			if (alen != 4)
+				return EBADMSG;
+
+			crc = (uint32_t)crc32(0, p, (unsigned int)pos);
+			if ((crc ^ 0x5354554e) != get_u32(p + pos + 4))
+				return EBADMSG;
+
+			fp = true;
+		}
+		else if (type < 0x8000) {
+			return ENOTSUP;
+		}
+
+		pos += 4 + ((alen + 3) & ~3);
+	}
+
+	/* header, XOR-MAPPED-ADDRESS for IPv6, SOFTWARE and FINGERPRINT */
+	if (presz + STUN_HEADER_SIZE + 24 + 4 +
+	    (software ? strlen(software) + 3 : 0) + 8 > sizeof(buf))
+		return ENOTSUP;
+
+	mb.buf  = buf;
+	mb.size = sizeof(buf);
+	mb.pos  = presz;
+	mb.end  = presz;
+
+	err = stun_msg_encode(&mb, STUN_METHOD_BINDING,
+			      STUN_CLASS_SUCCESS_RESP, p + 8, NULL, NULL, 0,
+			      fp, 0x00, 2,
+			      STUN_ATTR_XOR_MAPPED_ADDR, dst,
+			      STUN_ATTR_SOFTWARE, software);
+	if (err)
+		return err;
+
+	mb.pos = presz;
+
+	return stun_send(proto, sock, dst, &mb);
+}
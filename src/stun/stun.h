@@ -59,6 +59,7 @@ int  stun_addr_decode(struct mbuf *mb, struct sa *addr, const uint8_t *tid);
 int stun_ctrans_request(struct stun_ctrans **ctp, struct stun *stun, int proto,
 			void *sock, const struct sa *dst, struct mbuf *mb,
 			const uint8_t tid[], uint16_t met, const uint8_t *key,
-			size_t keylen, stun_resp_h *resph, void *arg);
+			size_t keylen, struct hmac *hmac, stun_resp_h *resph,
+			void *arg);
 void stun_ctrans_close(struct stun *stun);
 int  stun_ctrans_debug(struct re_printf *pf, const struct stun *stun);
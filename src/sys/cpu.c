@@ -0,0 +1,143 @@
+/**
+ * @file cpu.c  CPU feature detection
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re_types.h>
+#include <re_atomic.h>
+#include <re_sys.h>
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__GNUC__) || defined(__clang__)
+#include <cpuid.h>
+#define HAVE_X86_CPUID 1
+#endif
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define HAVE_X86_CPUID 1
+#elif defined(__aarch64__) && defined(LINUX)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+
+enum {
+	CPU_INITED = 1u<<31,
+};
+
+
+static RE_ATOMIC uint32_t cpu_features = 0;
+
+
+#ifdef HAVE_X86_CPUID
+static void cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4])
+{
+#if defined(_MSC_VER)
+	int v[4];
+
+	__cpuidex(v, (int)leaf, (int)sub);
+	r[0] = v[0]; r[1] = v[1]; r[2] = v[2]; r[3] = v[3];
+#else
+	r[0] = r[1] = r[2] = r[3] = 0;
+	__cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+
+static uint64_t xgetbv0(void)
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+#endif
+
+
+static uint32_t cpu_detect(void)
+{
+	uint32_t f = 0;
+
+#ifdef HAVE_X86_CPUID
+	uint32_t r[4];
+	uint32_t max;
+
+	cpuid(0, 0, r);
+	max = r[0];
+	if (max < 1)
+		return 0;
+
+	cpuid(1, 0, r);
+
+	if (r[3] & (1u<<26)) f |= CPU_SSE2;
+	if (r[2] & (1u<<9))  f |= CPU_SSSE3;
+	if (r[2] & (1u<<19)) f |= CPU_SSE41;
+	if (r[2] & (1u<<1))  f |= CPU_PCLMUL;
+	if (r[2] & (1u<<25)) f |= CPU_AES;
+
+	/* AVX2 requires OS support for saving the YMM state */
+	if ((r[2] & (1u<<27)) && (r[2] & (1u<<28)) &&
+	    (xgetbv0() & 0x6) == 0x6 && max >= 7) {
+
+		cpuid(7, 0, r);
+		if (r[1] & (1u<<5)) f |= CPU_AVX2;
+	}
+
+#elif defined(__aarch64__) && defined(__APPLE__)
+	/* All Apple Silicon has the Armv8 crypto and CRC extensions */
+	f |= CPU_NEON | CPU_ARM_AES | CPU_ARM_PMULL | CPU_ARM_CRC32;
+
+#elif defined(__aarch64__) && defined(LINUX)
+	unsigned long hwcap = getauxval(AT_HWCAP);
+
+	f |= CPU_NEON;
+	if (hwcap & HWCAP_AES)   f |= CPU_ARM_AES;
+	if (hwcap & HWCAP_PMULL) f |= CPU_ARM_PMULL;
+	if (hwcap & HWCAP_CRC32) f |= CPU_ARM_CRC32;
+
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	f |= CPU_NEON;
+#endif
+
+	return f;
+}
+
+
+/**
+ * Get the instruction set extensions supported by the CPU
+ *
+ * The features are detected once and cached.
+ *
+ * @return Bitmask of supported features (enum cpu_feature)
+ */
+uint32_t sys_cpu_features(void)
+{
+	uint32_t f = re_atomic_load(&cpu_features, re_memory_order_relaxed);
+
+	if (f & CPU_INITED)
+		return f & ~CPU_INITED;
+
+	f = cpu_detect();
+
+	re_atomic_store(&cpu_features, f | CPU_INITED,
+			re_memory_order_relaxed);
+
+	return f;
+}
+
+
+/**
+ * Check if the CPU supports a set of instruction set extensions
+ *
+ * @param mask Bitmask of required features (enum cpu_feature)
+ *
+ * @return True if all features are supported, otherwise false
+ */
+bool sys_cpu_has(uint32_t mask)
+{
+	return (sys_cpu_features() & mask) == mask;
+}
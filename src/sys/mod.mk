@@ -4,6 +4,7 @@
 # Copyright (C) 2010 Creytiv.com
 #
 
+SRCS	+= sys/cpu.c
 SRCS	+= sys/daemon.c
 SRCS	+= sys/endian.c
 SRCS	+= sys/fs.c
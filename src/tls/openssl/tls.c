@@ -1111,30 +1111,17 @@ int tls_peer_verify(const struct tls_conn *tc)
 }
 
 
-/**
- * Get SRTP suite and keying material of a TLS connection
- *
- * @param tc           TLS Connection
- * @param suite        Returned SRTP suite
- * @param cli_key      Client key
- * @param cli_key_size Client key size
- * @param srv_key      Server key
- * @param srv_key_size Server key size
- *
- * @return 0 if success, otherwise errorcode
+#ifdef USE_OPENSSL_SRTP
+/*
+ * Export the DTLS-SRTP keying material (RFC 5764 4.2), laid out as
+ * client key, server key, client salt, server salt.
  */
-int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
-		     uint8_t *cli_key, size_t cli_key_size,
-		     uint8_t *srv_key, size_t srv_key_size)
+static int srtp_keymat(const struct tls_conn *tc, enum srtp_suite *suite,
+		       uint8_t *keymat, size_t keymat_size,
+		       size_t *key_size, size_t *salt_size)
 {
-#ifdef USE_OPENSSL_SRTP
 	static const char *label = "EXTRACTOR-dtls_srtp";
-	size_t key_size, salt_size, size;
 	SRTP_PROTECTION_PROFILE *sel;
-	uint8_t keymat[256], *p;
-
-	if (!tc || !suite || !cli_key || !srv_key)
-		return EINVAL;
 
 	sel = SSL_get_selected_srtp_profile(tc->ssl);
 	if (!sel)
@@ -1144,29 +1131,29 @@ int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
 
 	case SRTP_AES128_CM_SHA1_80:
 		*suite = SRTP_AES_CM_128_HMAC_SHA1_80;
-		key_size  = 16;
-		salt_size = 14;
+		*key_size  = 16;
+		*salt_size = 14;
 		break;
 
 	case SRTP_AES128_CM_SHA1_32:
 		*suite = SRTP_AES_CM_128_HMAC_SHA1_32;
-		key_size  = 16;
-		salt_size = 14;
+		*key_size  = 16;
+		*salt_size = 14;
 		break;
 
 #ifdef SRTP_AEAD_AES_128_GCM
 	case SRTP_AEAD_AES_128_GCM:
 		*suite = SRTP_AES_128_GCM;
-		key_size  = 16;
-		salt_size = 12;
+		*key_size  = 16;
+		*salt_size = 12;
 		break;
 #endif
 
 #ifdef SRTP_AEAD_AES_256_GCM
 	case SRTP_AEAD_AES_256_GCM:
 		*suite = SRTP_AES_256_GCM;
-		key_size  = 32;
-		salt_size = 12;
+		*key_size  = 32;
+		*salt_size = 12;
 		break;
 #endif
 
@@ -1174,20 +1161,58 @@ int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
 		return ENOSYS;
 	}
 
-	size = key_size + salt_size;
-
-	if (cli_key_size < size || srv_key_size < size)
-		return EOVERFLOW;
-
-	if (sizeof(keymat) < 2*size)
+	if (keymat_size < 2 * (*key_size + *salt_size))
 		return EOVERFLOW;
 
-	if (1 != SSL_export_keying_material(tc->ssl, keymat, 2*size, label,
-					    strlen(label), NULL, 0, 0)) {
+	if (1 != SSL_export_keying_material(tc->ssl, keymat,
+					    2 * (*key_size + *salt_size),
+					    label, strlen(label),
+					    NULL, 0, 0)) {
 		ERR_clear_error();
 		return ENOENT;
 	}
 
+	return 0;
+}
+#endif
+
+
+/**
+ * Get SRTP suite and keying material of a TLS connection
+ *
+ * @param tc           TLS Connection
+ * @param suite        Returned SRTP suite
+ * @param cli_key      Client key
+ * @param cli_key_size Client key size
+ * @param srv_key      Server key
+ * @param srv_key_size Server key size
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
+		     uint8_t *cli_key, size_t cli_key_size,
+		     uint8_t *srv_key, size_t srv_key_size)
+{
+#ifdef USE_OPENSSL_SRTP
+	size_t key_size, salt_size, size;
+	uint8_t keymat[256], *p;
+	int err;
+
+	if (!tc || !suite || !cli_key || !srv_key)
+		return EINVAL;
+
+	err = srtp_keymat(tc, suite, keymat, sizeof(keymat),
+			  &key_size, &salt_size);
+	if (err)
+		return err;
+
+	size = key_size + salt_size;
+
+	if (cli_key_size < size || srv_key_size < size) {
+		err = EOVERFLOW;
+		goto out;
+	}
+
 	p = keymat;
 
 	memcpy(cli_key,            p, key_size);  p += key_size;
@@ -1195,7 +1220,10 @@ int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
 	memcpy(cli_key + key_size, p, salt_size); p += salt_size;
 	memcpy(srv_key + key_size, p, salt_size);
 
-	return 0;
+ out:
+	memset(keymat, 0, sizeof(keymat));
+
+	return err;
 #else
 	(void)tc;
 	(void)suite;
@@ -1209,6 +1237,86 @@ int tls_srtp_keyinfo(const struct tls_conn *tc, enum srtp_suite *suite,
 }
 
 
+/**
+ * Allocate the SRTP sessions of an established DTLS-SRTP connection
+ *
+ * The keying material is exported and the session keys derived
+ * straight into the SRTP contexts, one per direction, according to
+ * the local DTLS role.
+ *
+ * @param txp   Pointer to allocated SRTP session for sending
+ * @param rxp   Pointer to allocated SRTP session for receiving
+ * @param suite Returned SRTP suite (optional)
+ * @param tc    DTLS Connection
+ * @param flags SRTP flags (enum srtp_flags)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dtls_srtp_alloc(struct srtp **txp, struct srtp **rxp,
+		    enum srtp_suite *suite, const struct tls_conn *tc,
+		    int flags)
+{
+#ifdef USE_OPENSSL_SRTP
+	const uint8_t *cli_key, *srv_key, *cli_salt, *srv_salt;
+	struct srtp *tx = NULL, *rx = NULL;
+	size_t key_size, salt_size;
+	enum srtp_suite st;
+	uint8_t keymat[2 * (32 + 14)];
+	int err;
+
+	if (!txp || !rxp || !tc)
+		return EINVAL;
+
+	err = srtp_keymat(tc, &st, keymat, sizeof(keymat),
+			  &key_size, &salt_size);
+	if (err)
+		return err;
+
+	cli_key  = keymat;
+	srv_key  = cli_key + key_size;
+	cli_salt = srv_key + key_size;
+	srv_salt = cli_salt + salt_size;
+
+	if (SSL_is_server(tc->ssl)) {
+		err  = srtp_alloc_keysalt(&tx, st, srv_key, key_size,
+					  srv_salt, salt_size, flags);
+		err |= srtp_alloc_keysalt(&rx, st, cli_key, key_size,
+					  cli_salt, salt_size, flags);
+	}
+	else {
+		err  = srtp_alloc_keysalt(&tx, st, cli_key, key_size,
+					  cli_salt, salt_size, flags);
+		err |= srtp_alloc_keysalt(&rx, st, srv_key, key_size,
+					  srv_salt, salt_size, flags);
+	}
+
+	memset(keymat, 0, sizeof(keymat));
+
+	if (err) {
+		mem_deref(tx);
+		mem_deref(rx);
+		return err;
+	}
+
+	*txp = tx;
+	*rxp = rx;
+
+	if (suite)
+		*suite = st;
+
+	return 0;
+#else
+	(void)txp;
+	(void)rxp;
+	(void)suite;
+	(void)tc;
+	(void)flags;
+
+	return ENOSYS;
+#endif
+}
+
+
 /**
  * Get cipher name of a TLS connection
  *
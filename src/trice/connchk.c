@@ -335,17 +335,17 @@ int trice_conncheck_stun_request(struct ice_checklist *ic,
 	/* A connectivity check MUST utilize the STUN short term credential
 	   mechanism. */
 
-	err = stun_request(&cc->ct_conn, ic->stun, lcand->attr.proto,
-			   sock, &cp->rcand->attr.addr, presz,
-			   STUN_METHOD_BINDING,
-			   (uint8_t *)icem->rpwd, str_len(icem->rpwd),
-			   true, stunc_resp_handler, cc,
-			   4,
-			   STUN_ATTR_USERNAME, username_buf,
-			   STUN_ATTR_PRIORITY, &prio_prflx,
-			   ctrl_attr, &icem->tiebrk,
-			   STUN_ATTR_USE_CAND,
-			   use_cand ? &use_cand : 0);
+	err = stun_request_hmac(&cc->ct_conn, ic->stun, lcand->attr.proto,
+				sock, &cp->rcand->attr.addr, presz,
+				STUN_METHOD_BINDING,
+				icem->rhmac, NULL, 0, true,
+				stunc_resp_handler, cc,
+				4,
+				STUN_ATTR_USERNAME, username_buf,
+				STUN_ATTR_PRIORITY, &prio_prflx,
+				ctrl_attr, &icem->tiebrk,
+				STUN_ATTR_USE_CAND,
+				use_cand ? &use_cand : 0);
 	if (err) {
 		DEBUG_NOTICE("stun_request from %H to %H failed (%m)\n",
 			      trice_cand_print, lcand,
@@ -137,10 +137,9 @@ static int stunsrv_ereply(struct trice *icem, struct ice_lcand *lcand,
 		     trice_cand_print, lcand,
 		     scode, reason);
 
-	return stun_ereply(lcand->attr.proto, sock, src, presz, req,
-			   scode, reason,
-			   (uint8_t *)icem->lpwd, strlen(icem->lpwd), true, 1,
-			   STUN_ATTR_SOFTWARE, icem->sw ? icem->sw : sw);
+	return stun_ereply_hmac(lcand->attr.proto, sock, src, presz, req,
+				scode, reason, icem->lhmac, true, 1,
+				STUN_ATTR_SOFTWARE, icem->sw ? icem->sw : sw);
 }
 
 
@@ -157,7 +156,7 @@ int trice_stund_recv(struct trice *icem, struct ice_lcand *lcand,
 	if (err)
 		return err;
 
-	err = stun_msg_chk_mi(req, (uint8_t *)icem->lpwd, strlen(icem->lpwd));
+	err = stun_msg_chk_mi_hmac(req, icem->lhmac);
 	if (err) {
 		DEBUG_WARNING("message-integrity failed (src=%J)\n", src);
 		if (err == EBADMSG)
@@ -264,10 +263,10 @@ int trice_stund_recv_role_set(struct trice *icem, struct ice_lcand *lcand,
 		     lcand->attr.compid,
 		     trice_cand_print, lcand, src);
 
-	return stun_reply(lcand->attr.proto, sock, src, presz, req,
-			  (uint8_t *)icem->lpwd, strlen(icem->lpwd), true, 2,
-			  STUN_ATTR_XOR_MAPPED_ADDR, src,
-			  STUN_ATTR_SOFTWARE, icem->sw ? icem->sw : sw);
+	return stun_reply_hmac(lcand->attr.proto, sock, src, presz, req,
+			       icem->lhmac, true, 2,
+			       STUN_ATTR_XOR_MAPPED_ADDR, src,
+			       STUN_ATTR_SOFTWARE, icem->sw ? icem->sw : sw);
 
 
  badmsg:
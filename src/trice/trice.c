@@ -10,6 +10,7 @@
 #include <re_list.h>
 #include <re_tmr.h>
 #include <re_sa.h>
+#include <re_hmac.h>
 #include <re_stun.h>
 #include <re_ice.h>
 #include <re_sys.h>
@@ -49,6 +50,8 @@ static void trice_destructor(void *data)
 	mem_deref(icem->rpwd);
 	mem_deref(icem->lufrag);
 	mem_deref(icem->lpwd);
+	mem_deref(icem->lhmac);
+	mem_deref(icem->rhmac);
 	mem_deref(icem->sw);
 }
 
@@ -102,6 +105,11 @@ int trice_alloc(struct trice **icemp, const struct trice_conf *conf,
 	if (err)
 		goto out;
 
+	err = hmac_create(&icem->lhmac, HMAC_HASH_SHA1,
+			  (uint8_t *)lpwd, str_len(lpwd));
+	if (err)
+		goto out;
+
  out:
 	if (err)
 		mem_deref(icem);
@@ -124,12 +132,25 @@ int trice_set_remote_ufrag(struct trice *icem, const char *rufrag)
 
 int trice_set_remote_pwd(struct trice *icem, const char *rpwd)
 {
+	int err;
+
 	if (!icem || !rpwd)
 		return EINVAL;
 
-	icem->rpwd = mem_deref(icem->rpwd);
+	icem->rpwd  = mem_deref(icem->rpwd);
+	icem->rhmac = mem_deref(icem->rhmac);
+
+	err = str_dup(&icem->rpwd, rpwd);
+	if (err)
+		return err;
+
+	/* the connectivity checks refuse an empty password */
+	if (!str_isset(rpwd))
+		return 0;
 
-	return str_dup(&icem->rpwd, rpwd);
+	/* precompute the key for MESSAGE-INTEGRITY of outgoing checks */
+	return hmac_create(&icem->rhmac, HMAC_HASH_SHA1,
+			   (uint8_t *)rpwd, str_len(rpwd));
 }
 
 
@@ -464,7 +485,7 @@ bool trice_stun_process(struct trice *icem, struct ice_lcand *lcand,
 	size_t start = mb->pos;
 	(void)proto;
 
-	if (stun_msg_decode(&msg, mb, &ua)) {
+	if (!stun_msg_probe(mb) || stun_msg_decode(&msg, mb, &ua)) {
 		return false;  /* continue recv-processing */
 	}
 
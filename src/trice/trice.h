@@ -48,6 +48,8 @@ struct trice {
 	char *lpwd;                  /**< Local Password                     */
 	char *rufrag;                /**< Remote Username fragment           */
 	char *rpwd;                  /**< Remote Password                    */
+	struct hmac *lhmac;          /**< Precomputed local MI key           */
+	struct hmac *rhmac;          /**< Precomputed remote MI key          */
 
 	struct list lcandl;          /**< local candidates (add order)       */
 	struct list rcandl;          /**< remote candidates (add order)      */
@@ -148,16 +148,17 @@ static int chanbind_request(struct chan *chan, bool reset_ls)
 	if (reset_ls)
 		turnc_loopstate_reset(&chan->ls);
 
-	return stun_request(&chan->ct, t->stun, t->proto, t->sock, &t->srv, 0,
-			    STUN_METHOD_CHANBIND,
-			    t->realm ? t->md5_hash : NULL, sizeof(t->md5_hash),
-			    false, chanbind_resp_handler, chan, 6,
-			    STUN_ATTR_CHANNEL_NUMBER, &chan->nr,
-			    STUN_ATTR_XOR_PEER_ADDR, &chan->peer,
-			    STUN_ATTR_USERNAME, t->realm ? t->username : NULL,
-			    STUN_ATTR_REALM, t->realm,
-			    STUN_ATTR_NONCE, t->nonce,
-			    STUN_ATTR_SOFTWARE, stun_software);
+	return stun_request_hmac(&chan->ct, t->stun, t->proto, t->sock,
+				 &t->srv, 0, STUN_METHOD_CHANBIND,
+				 t->realm ? t->hmac : NULL, NULL, 0,
+				 false, chanbind_resp_handler, chan, 6,
+				 STUN_ATTR_CHANNEL_NUMBER, &chan->nr,
+				 STUN_ATTR_XOR_PEER_ADDR, &chan->peer,
+				 STUN_ATTR_USERNAME,
+				 t->realm ? t->username : NULL,
+				 STUN_ATTR_REALM, t->realm,
+				 STUN_ATTR_NONCE, t->nonce,
+				 STUN_ATTR_SOFTWARE, stun_software);
 }
 
 
@@ -123,15 +123,16 @@ static int createperm_request(struct perm *perm, bool reset_ls)
 	if (reset_ls)
 		turnc_loopstate_reset(&perm->ls);
 
-	return stun_request(&perm->ct, t->stun, t->proto, t->sock, &t->srv, 0,
-			    STUN_METHOD_CREATEPERM,
-			    t->realm ? t->md5_hash : NULL, sizeof(t->md5_hash),
-			    false, createperm_resp_handler, perm, 5,
-			    STUN_ATTR_XOR_PEER_ADDR, &perm->peer,
-			    STUN_ATTR_USERNAME, t->realm ? t->username : NULL,
-			    STUN_ATTR_REALM, t->realm,
-			    STUN_ATTR_NONCE, t->nonce,
-			    STUN_ATTR_SOFTWARE, stun_software);
+	return stun_request_hmac(&perm->ct, t->stun, t->proto, t->sock,
+				 &t->srv, 0, STUN_METHOD_CREATEPERM,
+				 t->realm ? t->hmac : NULL, NULL, 0,
+				 false, createperm_resp_handler, perm, 5,
+				 STUN_ATTR_XOR_PEER_ADDR, &perm->peer,
+				 STUN_ATTR_USERNAME,
+				 t->realm ? t->username : NULL,
+				 STUN_ATTR_REALM, t->realm,
+				 STUN_ATTR_NONCE, t->nonce,
+				 STUN_ATTR_SOFTWARE, stun_software);
 }
 
 
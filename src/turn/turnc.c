@@ -3,11 +3,13 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_fmt.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_md5.h>
+#include <re_hmac.h>
 #include <re_list.h>
 #include <re_hash.h>
 #include <re_tmr.h>
@@ -62,6 +64,7 @@ static void destructor(void *arg)
 	mem_deref(turnc->password);
 	mem_deref(turnc->nonce);
 	mem_deref(turnc->realm);
+	mem_deref(turnc->hmac);
 	mem_deref(turnc->stun);
 	mem_deref(turnc->uh);
 	mem_deref(turnc->sock);
@@ -165,16 +168,17 @@ static int allocate_request(struct turnc *t)
 {
 	const uint8_t proto = IPPROTO_UDP;
 
-	return stun_request(&t->ct, t->stun, t->proto, t->sock, &t->srv, 0,
-			    STUN_METHOD_ALLOCATE,
-			    t->realm ? t->md5_hash : NULL, sizeof(t->md5_hash),
-			    false, allocate_resp_handler, t, 6,
-			    STUN_ATTR_LIFETIME, &t->lifetime,
-			    STUN_ATTR_REQ_TRANSPORT, &proto,
-			    STUN_ATTR_USERNAME, t->realm ? t->username : NULL,
-			    STUN_ATTR_REALM, t->realm,
-			    STUN_ATTR_NONCE, t->nonce,
-			    STUN_ATTR_SOFTWARE, stun_software);
+	return stun_request_hmac(&t->ct, t->stun, t->proto, t->sock,
+				 &t->srv, 0, STUN_METHOD_ALLOCATE,
+				 t->realm ? t->hmac : NULL, NULL, 0,
+				 false, allocate_resp_handler, t, 6,
+				 STUN_ATTR_LIFETIME, &t->lifetime,
+				 STUN_ATTR_REQ_TRANSPORT, &proto,
+				 STUN_ATTR_USERNAME,
+				 t->realm ? t->username : NULL,
+				 STUN_ATTR_REALM, t->realm,
+				 STUN_ATTR_NONCE, t->nonce,
+				 STUN_ATTR_SOFTWARE, stun_software);
 }
 
 
@@ -230,15 +234,16 @@ static int refresh_request(struct turnc *t, uint32_t lifetime, bool reset_ls,
 	if (t->ct)
 		t->ct = mem_deref(t->ct);
 
-	return stun_request(&t->ct, t->stun, t->proto, t->sock, &t->srv, 0,
-			    STUN_METHOD_REFRESH,
-			    t->realm ? t->md5_hash : NULL, sizeof(t->md5_hash),
-			    false, resph, arg, 5,
-			    STUN_ATTR_LIFETIME, &lifetime,
-			    STUN_ATTR_USERNAME, t->realm ? t->username : NULL,
-			    STUN_ATTR_REALM, t->realm,
-			    STUN_ATTR_NONCE, t->nonce,
-			    STUN_ATTR_SOFTWARE, stun_software);
+	return stun_request_hmac(&t->ct, t->stun, t->proto, t->sock,
+				 &t->srv, 0, STUN_METHOD_REFRESH,
+				 t->realm ? t->hmac : NULL, NULL, 0,
+				 false, resph, arg, 5,
+				 STUN_ATTR_LIFETIME, &lifetime,
+				 STUN_ATTR_USERNAME,
+				 t->realm ? t->username : NULL,
+				 STUN_ATTR_REALM, t->realm,
+				 STUN_ATTR_NONCE, t->nonce,
+				 STUN_ATTR_SOFTWARE, stun_software);
 }
 
 
@@ -665,7 +670,9 @@ void turnc_loopstate_reset(struct loop_state *ls)
 
 int turnc_keygen(struct turnc *turnc, const struct stun_msg *msg)
 {
+	uint8_t md5_hash[MD5_SIZE];
 	struct stun_attr *realm, *nonce;
+	int err;
 
 	realm = stun_msg_attr(msg, STUN_ATTR_REALM);
 	nonce = stun_msg_attr(msg, STUN_ATTR_NONCE);
@@ -677,6 +684,18 @@ int turnc_keygen(struct turnc *turnc, const struct stun_msg *msg)
 	turnc->realm = mem_ref(realm->v.realm);
 	turnc->nonce = mem_ref(nonce->v.nonce);
 
-	return md5_printf(turnc->md5_hash, "%s:%s:%s",
-			  turnc->username, turnc->realm, turnc->password);
+	err = md5_printf(md5_hash, "%s:%s:%s",
+			 turnc->username, turnc->realm, turnc->password);
+	if (err)
+		return err;
+
+	/* the key only changes with the realm, not with the nonce */
+	if (turnc->hmac && !memcmp(md5_hash, turnc->md5_hash, MD5_SIZE))
+		return 0;
+
+	memcpy(turnc->md5_hash, md5_hash, MD5_SIZE);
+	turnc->hmac = mem_deref(turnc->hmac);
+
+	return hmac_create(&turnc->hmac, HMAC_HASH_SHA1,
+			   turnc->md5_hash, sizeof(turnc->md5_hash));
 }
@@ -30,6 +30,7 @@ struct turnc {
 	turnc_h *th;                   /**< Turn client handler             */
 	void *arg;                     /**< Handler argument                */
 	uint8_t md5_hash[MD5_SIZE];    /**< Cached MD5-sum of credentials   */
+	struct hmac *hmac;             /**< Precomputed MI key from md5_hash*/
 	char *nonce;                   /**< Saved NONCE value from server   */
 	char *realm;                   /**< Saved REALM value from server   */
 	struct hash *perms;            /**< Hash-table of permissions       */
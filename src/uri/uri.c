@@ -88,13 +88,13 @@ int uri_decode_hostport(const struct pl *hostport, struct pl *host,
 		return EINVAL;
 
 	/* Try IPv6 first */
-	if (!re_regex(hostport->p, hostport->l, "\\[[0-9a-f:]+\\][:]*[0-9]*",
-		      host, NULL, port))
+	if (!re_regex_cached(hostport->p, hostport->l,
+			     "\\[[0-9a-f:]+\\][:]*[0-9]*", host, NULL, port))
 		return 0;
 
 	/* Then non-IPv6 host */
-	return re_regex(hostport->p, hostport->l, "[^:]+[:]*[0-9]*",
-			host, NULL, port);
+	return re_regex_cached(hostport->p, hostport->l, "[^:]+[:]*[0-9]*",
+			       host, NULL, port);
 }
 
 
@@ -117,20 +117,22 @@ int uri_decode(struct uri *uri, const struct pl *pl)
 		return EINVAL;
 
 	memset(uri, 0, sizeof(*uri));
-	if (0 == re_regex(pl->p, pl->l,
-			  "[^:]+:[^@:]*[:]*[^@]*@[^/;? ]+[^;? ]*[^?]*[^]*",
-			  &uri->scheme, &uri->user, NULL, &uri->password,
-			  &hostport, &uri->path, &uri->params,
-			  &uri->headers)) {
+	if (0 == re_regex_cached(pl->p, pl->l,
+				 "[^:]+:[^@:]*[:]*[^@]*@[^/;? ]+[^;? ]*"
+				 "[^?]*[^]*",
+				 &uri->scheme, &uri->user, NULL,
+				 &uri->password, &hostport, &uri->path,
+				 &uri->params, &uri->headers)) {
 
 		if (0 == uri_decode_hostport(&hostport, &uri->host, &port))
 			goto out;
 	}
 
 	memset(uri, 0, sizeof(*uri));
-	err = re_regex(pl->p, pl->l, "[^:]+:[^/;? ]+[^;? ]*[^?]*[^]*",
-		       &uri->scheme, &hostport, &uri->path, &uri->params,
-		       &uri->headers);
+	err = re_regex_cached(pl->p, pl->l,
+			      "[^:]+:[^/;? ]+[^;? ]*[^?]*[^]*",
+			      &uri->scheme, &hostport, &uri->path,
+			      &uri->params, &uri->headers);
 	if (0 == err) {
 		err = uri_decode_hostport(&hostport, &uri->host, &port);
 		if (0 == err)
@@ -197,8 +199,8 @@ int uri_params_apply(const struct pl *pl, uri_apply_h *ah, void *arg)
 
 	while (plr.l > 0) {
 
-		err = re_regex(plr.p, plr.l, ";[^;=]+[=]*[^;]*",
-			       &pname, &eq, &pvalue);
+		err = re_regex_cached(plr.p, plr.l, ";[^;=]+[=]*[^;]*",
+				      &pname, &eq, &pvalue);
 		if (err)
 			break;
 
@@ -257,8 +259,8 @@ int uri_headers_apply(const struct pl *pl, uri_apply_h *ah, void *arg)
 
 	while (plr.l > 0) {
 
-		err = re_regex(plr.p, plr.l, "[?&]1[^=]+=[^&]+",
-			       &sep, &hname, &hvalue);
+		err = re_regex_cached(plr.p, plr.l, "[?&]1[^=]+=[^&]+",
+				      &sep, &hname, &hvalue);
 		if (err)
 			break;
 